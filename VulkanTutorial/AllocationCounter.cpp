@@ -0,0 +1,53 @@
+#include "AllocationCounter.h"
+#include<cstdlib>
+#include<new>
+
+namespace
+{
+	thread_local uint64_t allocationCount = 0;
+	thread_local uint32_t allowDepth = 0;
+}
+
+uint64_t getAllocationCount()
+{
+	return allocationCount;
+}
+
+AllowAllocations::AllowAllocations()
+{
+	allowDepth++;
+}
+
+AllowAllocations::~AllowAllocations()
+{
+	allowDepth--;
+}
+
+#ifndef NDEBUG
+
+//The array and nothrow versions of the standard library end up here, the aligned ones (only used for
+//types aligned over 16 bytes) are left alone and not counted
+void* operator new(std::size_t size)
+{
+	if (allowDepth == 0)
+		allocationCount++;
+
+	void* memory = std::malloc((size != 0) ? size : 1);
+
+	if (memory == nullptr)
+		throw std::bad_alloc();
+
+	return memory;
+}
+
+void operator delete(void* memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+	std::free(memory);
+}
+
+#endif
@@ -0,0 +1,21 @@
+#pragma once
+
+#include<cstdint>
+
+//Debug builds replace the global operator new to count the calls each thread makes, so the frame loop
+//can check it does not allocate once it is warm. Only the calling thread's calls are returned, the ones of
+//the worker threads are not charged to the thread that runs the frame. Release builds count nothing and
+//always return 0
+uint64_t getAllocationCount();
+
+//Allocations the calling thread makes while one of these is alive are not counted: creating resources
+//(streaming textures in, evicting them) is allowed to allocate in the middle of a frame
+class AllowAllocations
+{
+public:
+	AllowAllocations();
+	~AllowAllocations();
+
+	AllowAllocations(const AllowAllocations&) = delete;
+	AllowAllocations& operator=(const AllowAllocations&) = delete;
+};
@@ -0,0 +1,682 @@
+#include "AsyncFileReader.h"
+#include<cstring>
+#include<cerrno>
+#include<algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include<windows.h>
+#else
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/stat.h>
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define ASYNC_IO_URING
+#include<linux/io_uring.h>
+#include<sys/mman.h>
+#include<sys/syscall.h>
+#include<sys/uio.h>
+#endif
+#endif
+
+//************************** BATCHES *****************************
+void ReadBatch::complete(uint32_t count, bool succeeded)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	pending -= count;
+	failed = failed || !succeeded;
+
+	if (pending == 0)
+		finished.notify_all();
+}
+
+bool ReadBatch::isDone()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return pending == 0;
+}
+
+bool ReadBatch::hasFailed()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return failed;
+}
+
+void ReadBatch::wait()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	finished.wait(lock, [this]() { return pending == 0; });
+}
+
+void ReadBatch::reset()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (pending != 0)
+		throw std::runtime_error("Reset a read batch that is not done!");
+
+	failed = false;
+}
+
+//************************** IO_URING *****************************
+#ifdef ASYNC_IO_URING
+//Set up with the raw system calls, the rings are shared with the kernel: this side writes the submission
+//tail and the completion head, the kernel the other two
+struct AsyncFileReader::IoUring
+{
+	static constexpr uint64_t STOP = ~0ull;		//User data of the no-op that wakes the completion thread to stop
+
+	struct Slot
+	{
+		Read read;
+		iovec buffer;
+		bool used = false;
+	};
+
+	int fd = -1;
+
+	void* submissionRing = MAP_FAILED;
+	size_t submissionRingSize = 0;
+	void* completionRing = MAP_FAILED;
+	size_t completionRingSize = 0;
+	io_uring_sqe* entries = (io_uring_sqe*)MAP_FAILED;
+	size_t entriesSize = 0;
+
+	unsigned* submissionHead = nullptr;
+	unsigned* submissionTail = nullptr;
+	unsigned submissionMask = 0;
+	unsigned* submissionArray = nullptr;
+
+	unsigned* completionHead = nullptr;
+	unsigned* completionTail = nullptr;
+	unsigned completionMask = 0;
+	io_uring_cqe* completions = nullptr;
+
+	Slot slots[QUEUE_DEPTH];
+
+	~IoUring()
+	{
+		if (entries != MAP_FAILED)
+			munmap(entries, entriesSize);
+
+		if (completionRing != MAP_FAILED && completionRing != submissionRing)
+			munmap(completionRing, completionRingSize);
+
+		if (submissionRing != MAP_FAILED)
+			munmap(submissionRing, submissionRingSize);
+
+		if (fd >= 0)
+			close(fd);
+	}
+
+	//Null when the kernel has no io_uring, or does not let this process use it
+	static std::unique_ptr<IoUring> create()
+	{
+		std::unique_ptr<IoUring> ring(new IoUring);
+
+		//Room for every read in flight and the stop no-op, the completion ring is twice as big
+		io_uring_params params = {};
+		ring->fd = (int)syscall(__NR_io_uring_setup, QUEUE_DEPTH * 2, &params);
+
+		if (ring->fd < 0)
+			return nullptr;
+
+		ring->submissionRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		ring->completionRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+		//Both rings are in the same mapping on 5.4 and up
+		if (params.features & IORING_FEAT_SINGLE_MMAP)
+			ring->submissionRingSize = ring->completionRingSize = std::max(ring->submissionRingSize, ring->completionRingSize);
+
+		ring->submissionRing = mmap(nullptr, ring->submissionRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			ring->fd, IORING_OFF_SQ_RING);
+
+		if (ring->submissionRing == MAP_FAILED)
+			return nullptr;
+
+		ring->completionRing = (params.features & IORING_FEAT_SINGLE_MMAP) ? ring->submissionRing :
+			mmap(nullptr, ring->completionRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+
+		if (ring->completionRing == MAP_FAILED)
+			return nullptr;
+
+		ring->entriesSize = params.sq_entries * sizeof(io_uring_sqe);
+		ring->entries = (io_uring_sqe*)mmap(nullptr, ring->entriesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			ring->fd, IORING_OFF_SQES);
+
+		if (ring->entries == MAP_FAILED)
+			return nullptr;
+
+		char* submission = (char*)ring->submissionRing;
+		ring->submissionHead = (unsigned*)(submission + params.sq_off.head);
+		ring->submissionTail = (unsigned*)(submission + params.sq_off.tail);
+		ring->submissionMask = *(unsigned*)(submission + params.sq_off.ring_mask);
+		ring->submissionArray = (unsigned*)(submission + params.sq_off.array);
+
+		char* completion = (char*)ring->completionRing;
+		ring->completionHead = (unsigned*)(completion + params.cq_off.head);
+		ring->completionTail = (unsigned*)(completion + params.cq_off.tail);
+		ring->completionMask = *(unsigned*)(completion + params.cq_off.ring_mask);
+		ring->completions = (io_uring_cqe*)(completion + params.cq_off.cqes);
+
+		return ring;
+	}
+
+	//Only one thread at a time (the reader's mutex), the kernel sees it on the next enter
+	void push(uint8_t opcode, int file, uint64_t offset, const iovec* buffer, uint64_t userData)
+	{
+		unsigned tail = *submissionTail;
+		unsigned index = tail & submissionMask;
+
+		io_uring_sqe& entry = entries[index];
+		memset(&entry, 0, sizeof(entry));
+		entry.opcode = opcode;
+		entry.fd = file;
+		entry.off = offset;
+		entry.addr = (uint64_t)(uintptr_t)buffer;
+		entry.len = (buffer != nullptr) ? 1 : 0;
+		entry.user_data = userData;
+
+		submissionArray[index] = index;
+		__atomic_store_n(submissionTail, tail + 1, __ATOMIC_RELEASE);
+	}
+
+	void pushRead(uint32_t slot)
+	{
+		Slot& read = slots[slot];
+		read.buffer.iov_base = read.read.destination;
+		read.buffer.iov_len = read.read.size;
+
+		//Vectored, which every kernel with io_uring has (the plain read came in 5.6)
+		push(IORING_OP_READV, (int)read.read.handle, read.read.offset, &read.buffer, slot);
+	}
+
+	//Entries the kernel did not take yet
+	unsigned getUnsubmitted() const
+	{
+		return *submissionTail - __atomic_load_n(submissionHead, __ATOMIC_ACQUIRE);
+	}
+
+	//Submits what was pushed (with the reader's mutex locked), or sleeps until a completion is there.
+	//Interrupted or busy calls leave the entries in the ring for the next one
+	void enter(bool wait)
+	{
+		if (wait)
+			syscall(__NR_io_uring_enter, fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+		else
+			syscall(__NR_io_uring_enter, fd, getUnsubmitted(), 0, 0, nullptr, 0);
+	}
+};
+#else
+struct AsyncFileReader::IoUring
+{
+};
+#endif
+
+//************************** READER *****************************
+AsyncFileReader::AsyncFileReader()
+{
+}
+
+AsyncFileReader::~AsyncFileReader()
+{
+	stop();
+}
+
+void AsyncFileReader::start(bool allowIoUring)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (running)
+		return;
+
+#ifdef ASYNC_IO_URING
+	if (allowIoUring)
+		ring = IoUring::create();
+#endif
+
+	running = true;
+	stopping = false;
+
+	if (ring)
+	{
+		threads.emplace_back(&AsyncFileReader::completionLoop, this);
+	}
+	else
+	{
+		for (uint32_t i = 0; i < FALLBACK_THREAD_COUNT; i++)
+			threads.emplace_back(&AsyncFileReader::workerLoop, this);
+	}
+}
+
+void AsyncFileReader::stop()
+{
+	std::vector<std::pair<ReadBatch*, uint32_t>> cancelled;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (!running)
+			return;
+
+		stopping = true;
+
+		for (std::deque<Read>& reads : queued)
+		{
+			for (const Read& read : reads)
+				cancelled.push_back({ read.batch, 1 });
+
+			reads.clear();
+		}
+
+#ifdef ASYNC_IO_URING
+		//The completion thread may be asleep in the kernel, this completes right away and wakes it
+		if (ring)
+		{
+			ring->push(IORING_OP_NOP, -1, 0, nullptr, IoUring::STOP);
+			ring->enter(false);
+		}
+#endif
+	}
+
+	readQueued.notify_all();
+
+	for (std::thread& thread : threads)
+		thread.join();
+
+	for (auto& read : cancelled)
+		read.first->complete(read.second, false);
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	for (FileHandle file = 0; file < files.size(); file++)
+	{
+		if (!files[file].open)
+			continue;
+
+#ifdef _WIN32
+		CloseHandle((HANDLE)files[file].handle);
+#else
+		close((int)files[file].handle);
+#endif
+	}
+
+	files.clear();
+	threads.clear();
+	ring.reset();
+	running = false;
+}
+
+bool AsyncFileReader::isRunning()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return running;
+}
+
+bool AsyncFileReader::isUsingIoUring() const
+{
+	return ring != nullptr;
+}
+
+bool AsyncFileReader::popRead(Read& read)
+{
+	for (std::deque<Read>& reads : queued)
+	{
+		if (!reads.empty())
+		{
+			read = reads.front();
+			reads.pop_front();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void AsyncFileReader::submitReads()
+{
+#ifdef ASYNC_IO_URING
+	if (ring)
+	{
+		uint32_t submitted = 0;
+		Read read;
+
+		while (inFlight < QUEUE_DEPTH && popRead(read))
+		{
+			uint32_t slot = 0;
+
+			while (ring->slots[slot].used)
+				slot++;
+
+			ring->slots[slot].read = read;
+			ring->slots[slot].used = true;
+			ring->pushRead(slot);
+
+			inFlight++;
+			submitted++;
+		}
+
+		if (submitted > 0)
+			ring->enter(false);
+
+		return;
+	}
+#endif
+
+	readQueued.notify_one();
+}
+
+void AsyncFileReader::completionLoop()
+{
+#ifdef ASYNC_IO_URING
+	bool stopped = false;
+
+	//Reads whose batch is told once the mutex is unlocked, the batches have their own
+	std::vector<std::pair<ReadBatch*, bool>> finished;
+
+	while (true)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			unsigned head = *ring->completionHead;
+			unsigned tail = __atomic_load_n(ring->completionTail, __ATOMIC_ACQUIRE);
+
+			for (; head != tail; head++)
+			{
+				const io_uring_cqe& completion = ring->completions[head & ring->completionMask];
+
+				if (completion.user_data == IoUring::STOP)
+				{
+					stopped = true;
+					continue;
+				}
+
+				IoUring::Slot& slot = ring->slots[completion.user_data];
+				int result = completion.res;
+
+				//Short reads (signals, the page cache) go on from where they stopped
+				if (result == -EINTR || result == -EAGAIN || (result > 0 && (size_t)result < slot.read.size))
+				{
+					size_t done = (result > 0) ? (size_t)result : 0;
+					slot.read.offset += done;
+					slot.read.destination += done;
+					slot.read.size -= done;
+
+					ring->pushRead((uint32_t)completion.user_data);
+					continue;
+				}
+
+				finished.push_back({ slot.read.batch, result >= 0 && (size_t)result == slot.read.size });
+				slot.used = false;
+				inFlight--;
+			}
+
+			__atomic_store_n(ring->completionHead, head, __ATOMIC_RELEASE);
+
+			if (!stopping)
+				submitReads();
+
+			if (ring->getUnsubmitted() > 0)
+				ring->enter(false);
+		}
+
+		for (auto& read : finished)
+			read.first->complete(1, read.second);
+
+		finished.clear();
+
+		//stop cancels the queued reads, so nothing is submitted after the no-op
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			if (stopped && inFlight == 0)
+				return;
+		}
+
+		ring->enter(true);
+	}
+#endif
+}
+
+void AsyncFileReader::workerLoop()
+{
+	while (true)
+	{
+		Read read;
+
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			readQueued.wait(lock, [this]() { return stopping || !queued[0].empty() || !queued[1].empty() || !queued[2].empty(); });
+
+			if (!popRead(read))
+				return;
+
+			inFlight++;
+		}
+
+		bool succeeded = readAt(read.handle, read.offset, read.destination, read.size);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			inFlight--;
+		}
+
+		read.batch->complete(1, succeeded);
+	}
+}
+
+bool AsyncFileReader::readAt(intptr_t handle, uint64_t offset, char* destination, size_t size)
+{
+	while (size > 0)
+	{
+#ifdef _WIN32
+		//The offset of the overlapped structure makes it a positional read, even on a synchronous handle
+		OVERLAPPED overlapped = {};
+		overlapped.Offset = (DWORD)offset;
+		overlapped.OffsetHigh = (DWORD)(offset >> 32);
+
+		DWORD chunk = (DWORD)std::min<size_t>(size, 1u << 30);
+		DWORD bytesRead = 0;
+
+		if (!ReadFile((HANDLE)handle, destination, chunk, &bytesRead, &overlapped) || bytesRead == 0)
+			return false;
+
+		size_t done = bytesRead;
+#else
+		ssize_t result = pread((int)handle, destination, size, (off_t)offset);
+
+		if (result < 0 && errno == EINTR)
+			continue;
+
+		if (result <= 0)
+			return false;
+
+		size_t done = (size_t)result;
+#endif
+
+		offset += done;
+		destination += done;
+		size -= done;
+	}
+
+	return true;
+}
+
+FileHandle AsyncFileReader::openFile(const std::string& path)
+{
+	File file = {};
+
+#ifdef _WIN32
+	HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	LARGE_INTEGER size = {};
+
+	if (handle == INVALID_HANDLE_VALUE)
+		throw std::runtime_error("Failed to open \"" + path + "\"!");
+
+	if (!GetFileSizeEx(handle, &size))
+	{
+		CloseHandle(handle);
+		throw std::runtime_error("Failed to get the size of \"" + path + "\"!");
+	}
+
+	file.handle = (intptr_t)handle;
+	file.size = (uint64_t)size.QuadPart;
+#else
+	int handle = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	struct stat status = {};
+
+	if (handle < 0)
+		throw std::runtime_error("Failed to open \"" + path + "\"!");
+
+	if (fstat(handle, &status) != 0)
+	{
+		close(handle);
+		throw std::runtime_error("Failed to get the size of \"" + path + "\"!");
+	}
+
+	file.handle = handle;
+	file.size = (uint64_t)status.st_size;
+#endif
+
+	file.open = true;
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	for (FileHandle i = 0; i < files.size(); i++)
+	{
+		if (!files[i].open)
+		{
+			files[i] = file;
+			return i;
+		}
+	}
+
+	files.push_back(file);
+
+	return (FileHandle)(files.size() - 1);
+}
+
+uint64_t AsyncFileReader::getFileSize(FileHandle file)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (file >= files.size() || !files[file].open)
+		throw std::runtime_error("Invalid file handle!");
+
+	return files[file].size;
+}
+
+void AsyncFileReader::closeFile(FileHandle file)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (file >= files.size() || !files[file].open)
+		throw std::runtime_error("Invalid file handle!");
+
+#ifdef _WIN32
+	CloseHandle((HANDLE)files[file].handle);
+#else
+	close((int)files[file].handle);
+#endif
+
+	files[file].open = false;
+}
+
+void AsyncFileReader::read(FileHandle file, uint64_t offset, size_t size, void* destination, ReadPriority priority, ReadBatch& batch)
+{
+	if (size == 0)
+		return;
+
+	Read read = {};
+	read.offset = offset;
+	read.destination = (char*)destination;
+	read.size = size;
+	read.batch = &batch;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (!running || stopping)
+			throw std::runtime_error("The file reader is not running!");
+
+		if (file >= files.size() || !files[file].open)
+			throw std::runtime_error("Invalid file handle!");
+
+		if (offset > files[file].size || size > files[file].size - offset)
+			throw std::runtime_error("Read past the end of a file!");
+
+		read.handle = files[file].handle;
+	}
+
+	//Counted before it is queued, it could be finished before this returns
+	{
+		std::lock_guard<std::mutex> lock(batch.mutex);
+		batch.pending++;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	queued[(uint32_t)priority].push_back(read);
+	submitReads();
+}
+
+size_t AsyncFileReader::cancel(ReadBatch& batch)
+{
+	uint32_t cancelled = 0;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		for (std::deque<Read>& reads : queued)
+		{
+			for (auto read = reads.begin(); read != reads.end();)
+			{
+				if (read->batch == &batch)
+				{
+					read = reads.erase(read);
+					cancelled++;
+				}
+				else
+				{
+					read++;
+				}
+			}
+		}
+	}
+
+	if (cancelled > 0)
+		batch.complete(cancelled, false);
+
+	return cancelled;
+}
+
+std::vector<char> AsyncFileReader::readFile(const std::string& path, ReadPriority priority)
+{
+	FileHandle file = openFile(path);
+	std::vector<char> data((size_t)getFileSize(file));
+	ReadBatch batch;
+
+	try
+	{
+		read(file, 0, data.size(), data.data(), priority, batch);
+	}
+	catch (...)
+	{
+		closeFile(file);
+		throw;
+	}
+
+	batch.wait();
+	closeFile(file);
+
+	if (batch.hasFailed())
+		throw std::runtime_error("Failed to read \"" + path + "\"!");
+
+	return data;
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include<vector>
+#include<deque>
+#include<string>
+#include<thread>
+#include<mutex>
+#include<condition_variable>
+#include<memory>
+#include<cstdint>
+#include<stdexcept>
+
+//Queued reads start in priority order, the ones already started are not overtaken
+enum class ReadPriority
+{
+	High,			//Someone is waiting for it (a load that blocks, a texture with nothing resident)
+	Normal,
+	Low
+};
+
+const uint32_t READ_PRIORITY_COUNT = 3;
+
+using FileHandle = uint32_t;
+
+//Reads that are waited for together. A batch can be reused once it is done, and has to outlive its reads
+class ReadBatch
+{
+private:
+	friend class AsyncFileReader;
+
+	std::mutex mutex;
+	std::condition_variable finished;
+	uint32_t pending = 0;
+	bool failed = false;
+
+	void complete(uint32_t count, bool succeeded);
+
+public:
+	//No read of the batch is queued or in flight, the destinations can be used
+	bool isDone();
+
+	//A read failed, or was cancelled before it started
+	bool hasFailed();
+
+	void wait();
+
+	//Clears the failure of the last reads, the batch has to be done
+	void reset();
+};
+
+//Reads files into memory the caller owns (staging buffers, mapped or not) without blocking the thread that
+//asks for them. Reads are queued by priority and at most QUEUE_DEPTH are in flight, so a burst of low priority
+//streaming never delays a read the renderer is waiting on by more than the reads already started.
+//
+//On Linux the reads go through io_uring when the kernel allows it (5.1 and up, not disabled), completed by a
+//thread that sleeps in the kernel until they finish. Elsewhere, or when io_uring is not there, a few threads
+//do blocking positional reads. Opening a file is still a blocking call, streamed files stay open
+class AsyncFileReader
+{
+private:
+	static constexpr uint32_t QUEUE_DEPTH = 32;
+	static constexpr uint32_t FALLBACK_THREAD_COUNT = 2;
+
+	struct File
+	{
+		intptr_t handle;			//File descriptor, or HANDLE on Windows
+		uint64_t size;
+		bool open;
+	};
+
+	struct Read
+	{
+		intptr_t handle;
+		uint64_t offset;
+		char* destination;
+		size_t size;
+		ReadBatch* batch;
+	};
+
+	struct IoUring;				//The ring and the reads in flight, only on Linux
+
+	std::vector<File> files;
+	std::deque<Read> queued[READ_PRIORITY_COUNT];
+	uint32_t inFlight = 0;
+
+	std::mutex mutex;
+	std::condition_variable readQueued;
+	bool running = false;
+	bool stopping = false;
+
+	std::unique_ptr<IoUring> ring;
+	std::vector<std::thread> threads;
+
+	//Need mutex locked
+	bool popRead(Read& read);
+	void submitReads();
+
+	void workerLoop();
+	void completionLoop();
+
+	static bool readAt(intptr_t handle, uint64_t offset, char* destination, size_t size);
+
+public:
+	AsyncFileReader();
+	~AsyncFileReader();
+
+	AsyncFileReader(const AsyncFileReader&) = delete;
+	AsyncFileReader& operator=(const AsyncFileReader&) = delete;
+
+	//Without "allowIoUring" the threads do the reads everywhere, to compare the two
+	void start(bool allowIoUring = true);
+
+	//Reads not started yet are cancelled, the ones in flight are finished first
+	void stop();
+
+	bool isRunning();
+	bool isUsingIoUring() const;
+
+	FileHandle openFile(const std::string& path);
+	uint64_t getFileSize(FileHandle file);
+
+	//No read of the file may be queued or in flight
+	void closeFile(FileHandle file);
+
+	//Reads "size" bytes at "offset" into "destination", which has to stay valid until the batch is done.
+	//Throws when the range is not in the file, a read that then comes up short fails the batch
+	void read(FileHandle file, uint64_t offset, size_t size, void* destination, ReadPriority priority, ReadBatch& batch);
+
+	//Cancels the reads of the batch that did not start yet and fails it, the ones in flight still finish.
+	//Returns how many were cancelled
+	size_t cancel(ReadBatch& batch);
+
+	//Opens, reads whole and closes a file, blocking until it is read
+	std::vector<char> readFile(const std::string& path, ReadPriority priority = ReadPriority::High);
+};
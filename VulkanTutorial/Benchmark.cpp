@@ -0,0 +1,555 @@
+#include<iostream>
+#include<fstream>
+#include<sstream>
+#include<chrono>
+#include<cstring>
+#include<random>
+#include<functional>
+#include"VulkanRenderer.h"
+#include"SceneGenerator.h"
+#include"MeshCodec.h"
+
+//Renders synthetic scenes offscreen (VK_EXT_headless_surface, lavapipe works) and prints a JSON report.
+//Without scene arguments it runs the default suite, with any of them it runs that single scenario:
+//
+//	VulkanTutorialBenchmark [--meshes N] [--triangles M] [--instanced] [--blend] [--frames F]
+//		[--warmup W] [--width X] [--height Y] [--seed S] [--output file.json] [--readback frames.raw] [--encoded]
+//
+//--readback streams every frame (raw swapchain bytes) to a file, or to stdout with "-" when the report
+//goes to --output, to measure the renderer with the readback running. --encoded uploads the meshes from
+//their mesh files (MeshCodec.h), which every scenario also measures on its own against plain copies.
+//
+//	VulkanTutorialBenchmark --self-check
+//
+//checks that the mesh codec gives back what it encoded and rejects corrupt data, with the SSE2 and the plain
+//C++ decoders, without creating a renderer (so it runs without a GPU). It exits with EXIT_FAILURE on a mismatch
+
+struct BenchmarkScenario
+{
+	SceneDescription scene;
+	bool blending = false;
+};
+
+struct BenchmarkOptions
+{
+	std::vector<BenchmarkScenario> scenarios;
+	uint32_t frames = 200;
+	uint32_t warmupFrames = 20;
+	uint32_t width = 1280;
+	uint32_t height = 720;
+	std::string output;
+	std::string readback;
+	bool encodedMeshes = false;
+	bool selfCheck = false;
+};
+
+struct BenchmarkResult
+{
+	double initTime = 0.0;				//ms, renderer init
+	double uploadTime = 0.0;			//ms, every addMesh (buffers, LODs and meshlets, which mesh files already have)
+	uint64_t uploadBytes = 0;
+	double cpuRecordTime = 0.0;			//ms per frame, average
+	double gpuFrameTime = 0.0;			//ms per frame, average (0 without timestamps)
+	double frameTime = 0.0;				//ms per frame, average of the whole draw call
+	uint64_t drawnTriangles = 0;		//Of the last frame
+	uint32_t unsortedBinds = 0;			//Of the last frame, in instance order and in draw list order
+	uint32_t sortedBinds = 0;
+	size_t shaderVariants = 0;			//Scene pipelines compiled by the end of the run
+	uint64_t meshFileRawBytes = 0;		//The mesh files of the scene with their vertices and indices uncompressed
+	uint64_t meshFileBytes = 0;
+	double decodeThroughput = 0.0;		//MB/s of decoded vertices and indices
+	double copyThroughput = 0.0;		//MB/s of the same bytes copied, what the raw format costs
+	std::string deviceName;				//Runs of different machines can only be compared knowing it
+};
+
+namespace
+{
+	double millisecondsSince(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	//Every mesh is decoded (and copied) this many times, a single pass of the small scenes is too short to time
+	const uint32_t CODEC_REPEATS = 10;
+
+	void measureMeshCodec(const std::vector<std::vector<char>>& meshFiles, BenchmarkResult& result)
+	{
+		std::vector<MeshFile> files;
+		size_t largestMesh = 0;
+		uint64_t decodedBytes = 0;
+
+		for (const std::vector<char>& data : meshFiles)
+		{
+			files.push_back(parseMeshFile(data));
+
+			const MeshFileHeader& header = files.back().header;
+			size_t meshBytes = header.vertexCount * sizeof(VertexData) + header.indexCount * sizeof(uint32_t);
+
+			largestMesh = std::max(largestMesh, meshBytes);
+			decodedBytes += meshBytes;
+
+			result.meshFileBytes += data.size();
+			result.meshFileRawBytes += data.size() - header.vertexStreamSize - header.indexStreamSize + meshBytes;
+		}
+
+		//Decoded into (and copied between) buffers already touched, so page faults are not timed
+		std::vector<char> decoded(largestMesh, 0);
+		std::vector<char> copied(largestMesh, 0);
+
+		auto start = std::chrono::steady_clock::now();
+
+		for (uint32_t i = 0; i < CODEC_REPEATS; i++)
+		{
+			for (const MeshFile& file : files)
+			{
+				decodeMeshVertices(file, decoded.data());
+				decodeMeshIndices(file, decoded.data() + file.header.vertexCount * sizeof(VertexData));
+			}
+		}
+
+		double decodeTime = millisecondsSince(start);
+		start = std::chrono::steady_clock::now();
+
+		for (uint32_t i = 0; i < CODEC_REPEATS; i++)
+		{
+			for (const MeshFile& file : files)
+				memcpy(copied.data(), decoded.data(), file.header.vertexCount * sizeof(VertexData) + file.header.indexCount * sizeof(uint32_t));
+		}
+
+		double copyTime = millisecondsSince(start);
+		double megabytes = (double)decodedBytes * CODEC_REPEATS / (1024.0 * 1024.0);
+
+		result.decodeThroughput = (decodeTime > 0.0) ? megabytes / (decodeTime / 1000.0) : 0.0;
+		result.copyThroughput = (copyTime > 0.0) ? megabytes / (copyTime / 1000.0) : 0.0;
+	}
+
+	//************************** SELF CHECK *****************************
+	//Words written after every decoded buffer, a decoder that writes past the end changes them
+	const uint32_t GUARD_WORD = 0xA5A5A5A5;
+	const size_t GUARD_WORDS = 16;
+
+	bool throwsError(const std::function<void()>& function)
+	{
+		try
+		{
+			function();
+		}
+		catch (const std::runtime_error&)
+		{
+			return true;
+		}
+
+		return false;
+	}
+
+	//Lane values of a stream: small steps (the packed groups), random values (raw groups, negative deltas) or constants (empty groups)
+	std::vector<uint32_t> generateStreamValues(size_t valueCount, uint32_t kind, std::mt19937& random)
+	{
+		std::vector<uint32_t> values(valueCount);
+		uint32_t walk = random();
+
+		for (size_t i = 0; i < valueCount; i++)
+		{
+			if (kind == 0)
+				walk += (random() % 7) - 3;
+			else if (kind == 1)
+				walk = random();
+
+			values[i] = walk;
+		}
+
+		return values;
+	}
+
+	bool decodesTo(const std::vector<char>& stream, const std::vector<uint32_t>& values, size_t elementCount, size_t laneCount, bool allowSse2)
+	{
+		std::vector<uint32_t> decoded(values.size() + GUARD_WORDS, GUARD_WORD);
+		decodeStream(stream.data(), stream.size(), decoded.data(), elementCount, laneCount, allowSse2);
+
+		return std::equal(values.begin(), values.end(), decoded.begin()) &&
+			std::all_of(decoded.begin() + values.size(), decoded.end(), [](uint32_t word) { return word == GUARD_WORD; });
+	}
+
+	//Returns the number of checks that failed, each one is reported on stderr
+	uint32_t checkStreams(bool allowSse2)
+	{
+		const char* decoder = allowSse2 ? "SSE2" : "scalar";
+
+		//Lane counts that are and are not multiples of 4 (the SSE2 decoder transposes 4 lanes at a time), and
+		//element counts around the 16 element blocks
+		const size_t laneCounts[] = { 1, 3, 4, 5, 8, 12, MAX_STREAM_LANES };
+		const size_t elementCounts[] = { 0, 1, 15, 16, 17, 31, 33, 1000 };
+
+		std::mt19937 random(1234);
+		uint32_t failures = 0;
+
+		auto fail = [&](const std::string& what, size_t elementCount, size_t laneCount)
+		{
+			std::cerr << "FAILED (" << decoder << "): " << what << ", " << elementCount << " elements of " << laneCount << " lanes\n";
+			failures++;
+		};
+
+		for (size_t laneCount : laneCounts)
+		{
+			for (size_t elementCount : elementCounts)
+			{
+				for (uint32_t kind = 0; kind < 3; kind++)
+				{
+					std::vector<uint32_t> values = generateStreamValues(elementCount * laneCount, kind, random);
+					std::vector<char> stream = encodeStream(values.data(), elementCount, laneCount);
+
+					if (!decodesTo(stream, values, elementCount, laneCount, allowSse2))
+						fail("round trip", elementCount, laneCount);
+
+					if (elementCount == 0)
+						continue;
+
+					//Data missing or left over, and more elements than the stream has blocks for
+					std::vector<uint32_t> decoded((elementCount + 16) * laneCount);
+
+					if (!throwsError([&]() { decodeStream(stream.data(), stream.size() - 1, decoded.data(), elementCount, laneCount, allowSse2); }))
+						fail("truncated stream accepted", elementCount, laneCount);
+
+					std::vector<char> padded = stream;
+					padded.push_back(0);
+
+					if (!throwsError([&]() { decodeStream(padded.data(), padded.size(), decoded.data(), elementCount, laneCount, allowSse2); }))
+						fail("stream with trailing data accepted", elementCount, laneCount);
+
+					if (!throwsError([&]() { decodeStream(stream.data(), stream.size(), decoded.data(), elementCount + 16, laneCount, allowSse2); }))
+						fail("stream shorter than its element count accepted", elementCount, laneCount);
+				}
+			}
+		}
+
+		uint32_t value = 0;
+		std::vector<char> stream = encodeStream(&value, 1, 1);
+
+		if (!throwsError([&]() { decodeStream(stream.data(), stream.size(), &value, 1, 0, allowSse2); }) ||
+			!throwsError([&]() { decodeStream(stream.data(), stream.size(), &value, 1, MAX_STREAM_LANES + 1, allowSse2); }))
+			fail("invalid lane count accepted", 1, 0);
+
+		return failures;
+	}
+
+	//A mesh file with random vertices (the codec only sees their bits) and triangles
+	uint32_t checkMeshFiles()
+	{
+		std::mt19937 random(5678);
+		uint32_t failures = 0;
+
+		auto fail = [&](const std::string& what)
+		{
+			std::cerr << "FAILED (mesh file): " << what << "\n";
+			failures++;
+		};
+
+		const uint32_t vertexCount = 37;
+		const uint32_t triangleCount = 23;
+
+		std::vector<VertexData> vertices(vertexCount);
+		std::vector<uint32_t> vertexBits = generateStreamValues(vertexCount * sizeof(VertexData) / sizeof(uint32_t), 0, random);
+		memcpy((void*)vertices.data(), vertexBits.data(), vertexCount * sizeof(VertexData));
+
+		std::vector<uint32_t> indices(triangleCount * 3);
+
+		for (uint32_t& index : indices)
+			index = random() % vertexCount;
+
+		std::vector<MeshLod> lods = { MeshLod{ 0, (uint32_t)indices.size(), 0.0f, 0, 0 } };
+		std::vector<char> data = encodeMeshFile(vertices, indices, lods, {});
+
+		MeshFile file = parseMeshFile(data);
+
+		std::vector<char> decodedVertices(vertexCount * sizeof(VertexData));
+		std::vector<uint32_t> decodedIndices(indices.size());
+
+		decodeMeshVertices(file, decodedVertices.data());
+		decodeMeshIndices(file, decodedIndices.data());
+
+		if (memcmp(decodedVertices.data(), vertices.data(), decodedVertices.size()) != 0 || decodedIndices != indices)
+			fail("round trip");
+
+		//An index past the vertices would let the GPU read out of the vertex buffer
+		std::vector<uint32_t> badIndices = indices;
+		badIndices.back() = vertexCount;
+
+		std::vector<char> badData = encodeMeshFile(vertices, badIndices, lods, {});
+		MeshFile badFile = parseMeshFile(badData);
+
+		if (!throwsError([&]() { decodeMeshIndices(badFile, decodedIndices.data()); }))
+			fail("index out of the vertices accepted");
+
+		badData = data;
+		badData[0] ^= 1;
+
+		if (!throwsError([&]() { parseMeshFile(badData); }))
+			fail("wrong magic accepted");
+
+		badData = data;
+		badData.pop_back();
+
+		if (!throwsError([&]() { parseMeshFile(badData); }))
+			fail("truncated file accepted");
+
+		return failures;
+	}
+
+	bool runSelfCheck()
+	{
+		uint32_t failures = checkStreams(false);
+
+		if (hasSse2StreamDecoder())
+			failures += checkStreams(true);
+		else
+			std::cerr << "No SSE2 decoder in this build, only the scalar one was checked\n";
+
+		failures += checkMeshFiles();
+
+		std::cerr << "Mesh codec self-check: " << ((failures == 0) ? "passed" : std::to_string(failures) + " failures") << "\n";
+
+		return failures == 0;
+	}
+
+	uint32_t parseNumber(int argc, char** argv, int& i)
+	{
+		if (i + 1 >= argc)
+			throw std::runtime_error(std::string("Missing value for ") + argv[i] + "!");
+
+		return (uint32_t)std::stoul(argv[++i]);
+	}
+
+	//Small, medium and large scenes, each drawn as separate meshes and as instances, with and without blending
+	std::vector<BenchmarkScenario> getDefaultSuite(uint32_t seed)
+	{
+		const uint32_t sizes[][2] = {
+			{ 1, 100000 },			//One big mesh
+			{ 100, 1000 },
+			{ 1000, 100 }			//Many small ones, the per draw cost dominates
+		};
+
+		std::vector<BenchmarkScenario> scenarios;
+
+		for (const auto& size : sizes)
+		{
+			for (int instanced = 0; instanced < 2; instanced++)
+			{
+				for (int blending = 0; blending < 2; blending++)
+				{
+					BenchmarkScenario scenario;
+					scenario.scene.meshCount = size[0];
+					scenario.scene.trianglesPerMesh = size[1];
+					scenario.scene.instanced = instanced != 0;
+					scenario.scene.seed = seed;
+					scenario.blending = blending != 0;
+
+					scenarios.push_back(scenario);
+				}
+			}
+		}
+
+		return scenarios;
+	}
+
+	BenchmarkOptions parseOptions(int argc, char** argv)
+	{
+		BenchmarkOptions options;
+		BenchmarkScenario scenario;
+		bool customScenario = false;
+
+		for (int i = 1; i < argc; i++)
+		{
+			if (strcmp(argv[i], "--meshes") == 0)			{ scenario.scene.meshCount = parseNumber(argc, argv, i); customScenario = true; }
+			else if (strcmp(argv[i], "--triangles") == 0)	{ scenario.scene.trianglesPerMesh = parseNumber(argc, argv, i); customScenario = true; }
+			else if (strcmp(argv[i], "--instanced") == 0)	{ scenario.scene.instanced = true; customScenario = true; }
+			else if (strcmp(argv[i], "--blend") == 0)		{ scenario.blending = true; customScenario = true; }
+			else if (strcmp(argv[i], "--seed") == 0)		scenario.scene.seed = parseNumber(argc, argv, i);
+			else if (strcmp(argv[i], "--frames") == 0)		options.frames = parseNumber(argc, argv, i);
+			else if (strcmp(argv[i], "--warmup") == 0)		options.warmupFrames = parseNumber(argc, argv, i);
+			else if (strcmp(argv[i], "--width") == 0)		options.width = parseNumber(argc, argv, i);
+			else if (strcmp(argv[i], "--height") == 0)		options.height = parseNumber(argc, argv, i);
+			else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)	options.output = argv[++i];
+			else if (strcmp(argv[i], "--readback") == 0 && i + 1 < argc)	options.readback = argv[++i];
+			else if (strcmp(argv[i], "--encoded") == 0)		options.encodedMeshes = true;
+			else if (strcmp(argv[i], "--self-check") == 0)	options.selfCheck = true;
+			else
+				throw std::runtime_error(std::string("Unknown argument ") + argv[i] + "!");
+		}
+
+		if (options.readback == "-" && options.output.empty())
+			throw std::runtime_error("Streaming the frames to stdout needs the report in a file (--output)!");
+
+		if (options.frames == 0)
+			throw std::runtime_error("The benchmark needs at least one frame!");
+
+		if (customScenario)
+			options.scenarios.push_back(scenario);
+		else
+			options.scenarios = getDefaultSuite(scenario.scene.seed);
+
+		return options;
+	}
+
+	BenchmarkResult runScenario(const BenchmarkScenario& scenario, const BenchmarkOptions& options)
+	{
+		//Generated before anything is timed, the scene is the same on every run
+		GeneratedScene scene = generateScene(scenario.scene);
+		std::vector<std::vector<char>> meshFiles;
+
+		for (const GeneratedMesh& mesh : scene.meshes)
+			meshFiles.push_back(Mesh::encode(mesh.vertices, mesh.indices));
+
+		BenchmarkResult result;
+		measureMeshCodec(meshFiles, result);
+
+		RendererSettings settings;
+		settings.headless = true;
+		settings.width = options.width;
+		settings.height = options.height;
+		settings.blending = scenario.blending;
+		settings.defaultScene = false;
+		settings.printStartupTimeline = false;
+		settings.readbackOutput = options.readback;
+
+		VulkanRenderer renderer;
+
+		auto start = std::chrono::steady_clock::now();
+
+		if (renderer.init(nullptr, settings) == EXIT_FAILURE)
+			throw std::runtime_error("Failed to initialize the renderer!");
+
+		result.initTime = millisecondsSince(start);
+
+		//************************** UPLOAD *****************************
+		std::vector<uint32_t> meshes;
+		start = std::chrono::steady_clock::now();
+
+		for (size_t i = 0; i < scene.meshes.size(); i++)
+		{
+			if (options.encodedMeshes)
+				meshes.push_back(renderer.addMesh(meshFiles[i]));
+			else
+				meshes.push_back(renderer.addMesh(scene.meshes[i].vertices, scene.meshes[i].indices));
+		}
+
+		result.uploadTime = millisecondsSince(start);
+		result.uploadBytes = scene.getMeshBytes();
+
+		//Instances of the same mesh are added together so its buffers are bound once
+		for (size_t i = 0; i < scene.objectMeshes.size(); i++)
+		{
+			uint32_t instance = renderer.addMeshInstance(meshes[scene.objectMeshes[i]]);
+			renderer.getSceneGraph().setLocalTransform(renderer.getInstanceNode(instance), scene.objectTransforms[i]);
+		}
+
+		//************************** FRAMES *****************************
+		for (uint32_t i = 0; i < options.warmupFrames; i++)
+			renderer.draw();
+
+		start = std::chrono::steady_clock::now();
+
+		for (uint32_t i = 0; i < options.frames; i++)
+		{
+			renderer.draw();
+
+			result.cpuRecordTime += renderer.getCpuRecordTime();
+			result.gpuFrameTime += renderer.getGpuFrameTime();
+		}
+
+		result.frameTime = millisecondsSince(start) / options.frames;
+		result.cpuRecordTime /= options.frames;
+		result.gpuFrameTime /= options.frames;
+		result.drawnTriangles = renderer.getDrawnTriangleCount();
+		result.unsortedBinds = renderer.getUnsortedBindCount();
+		result.sortedBinds = renderer.getSortedBindCount();
+		result.shaderVariants = renderer.getShaderVariantCount();
+		result.deviceName = renderer.getDeviceCapabilities().properties.deviceName;
+
+		return result;
+	}
+
+	void writeResult(std::ostream& stream, const BenchmarkScenario& scenario, const BenchmarkResult& result)
+	{
+		double uploadThroughput = (result.uploadTime > 0.0) ? result.uploadBytes / (result.uploadTime / 1000.0) / (1024.0 * 1024.0) : 0.0;
+
+		stream << "    {\n"
+			<< "      \"device\": \"" << result.deviceName << "\",\n"
+			<< "      \"meshes\": " << scenario.scene.meshCount << ",\n"
+			<< "      \"trianglesPerMesh\": " << scenario.scene.trianglesPerMesh << ",\n"
+			<< "      \"instanced\": " << (scenario.scene.instanced ? "true" : "false") << ",\n"
+			<< "      \"blending\": " << (scenario.blending ? "true" : "false") << ",\n"
+			<< "      \"seed\": " << scenario.scene.seed << ",\n"
+			<< "      \"initMs\": " << result.initTime << ",\n"
+			<< "      \"uploadMs\": " << result.uploadTime << ",\n"
+			<< "      \"uploadBytes\": " << result.uploadBytes << ",\n"
+			<< "      \"uploadMBps\": " << uploadThroughput << ",\n"
+			<< "      \"cpuRecordMs\": " << result.cpuRecordTime << ",\n"
+			<< "      \"gpuMs\": " << result.gpuFrameTime << ",\n"
+			<< "      \"frameMs\": " << result.frameTime << ",\n"
+			<< "      \"fps\": " << ((result.frameTime > 0.0) ? 1000.0 / result.frameTime : 0.0) << ",\n"
+			<< "      \"drawnTriangles\": " << result.drawnTriangles << ",\n"
+			<< "      \"unsortedBinds\": " << result.unsortedBinds << ",\n"
+			<< "      \"sortedBinds\": " << result.sortedBinds << ",\n"
+			<< "      \"shaderVariants\": " << result.shaderVariants << ",\n"
+			<< "      \"meshFileRawBytes\": " << result.meshFileRawBytes << ",\n"
+			<< "      \"meshFileBytes\": " << result.meshFileBytes << ",\n"
+			<< "      \"meshDecodeMBps\": " << result.decodeThroughput << ",\n"
+			<< "      \"meshCopyMBps\": " << result.copyThroughput << "\n"
+			<< "    }";
+	}
+}
+
+int main(int argc, char** argv)
+{
+	try
+	{
+		BenchmarkOptions options = parseOptions(argc, argv);
+
+		if (options.selfCheck)
+			return runSelfCheck() ? EXIT_SUCCESS : EXIT_FAILURE;
+
+		std::ostringstream report;
+		report << "{\n"
+			<< "  \"frames\": " << options.frames << ",\n"
+			<< "  \"warmupFrames\": " << options.warmupFrames << ",\n"
+			<< "  \"width\": " << options.width << ",\n"
+			<< "  \"height\": " << options.height << ",\n"
+			<< "  \"encodedMeshes\": " << (options.encodedMeshes ? "true" : "false") << ",\n"
+			<< "  \"scenarios\": [\n";
+
+		for (size_t i = 0; i < options.scenarios.size(); i++)
+		{
+			const BenchmarkScenario& scenario = options.scenarios[i];
+
+			std::cerr << "Scenario " << i + 1 << "/" << options.scenarios.size() << ": " << scenario.scene.meshCount << " x "
+				<< scenario.scene.trianglesPerMesh << " triangles" << (scenario.scene.instanced ? ", instanced" : "")
+				<< (scenario.blending ? ", blending" : "") << "\n";
+
+			writeResult(report, scenario, runScenario(scenario, options));
+			report << ((i + 1 < options.scenarios.size()) ? ",\n" : "\n");
+		}
+
+		report << "  ]\n}\n";
+
+		if (options.output.empty())
+		{
+			std::cout << report.str();
+		}
+		else
+		{
+			std::ofstream file(options.output);
+
+			if (!file)
+				throw std::runtime_error("Failed to open " + options.output + "!");
+
+			file << report.str();
+		}
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "ERROR: " << e.what() << "\n";
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,219 @@
+#include "BindlessDescriptors.h"
+#include<algorithm>
+
+uint32_t BindlessDescriptors::SlotAllocator::allocate()
+{
+	if (!freeSlots.empty())
+	{
+		uint32_t slot = freeSlots.back();
+		freeSlots.pop_back();
+		return slot;
+	}
+
+	if (next == capacity)
+		throw std::runtime_error("Bindless descriptor array is full!");
+
+	return next++;
+}
+
+void BindlessDescriptors::SlotAllocator::release(uint32_t slot, uint32_t frame)
+{
+	if (slot >= next)
+		throw std::runtime_error("Invalid bindless descriptor index!");
+
+	retiredSlots[frame].push_back(slot);
+}
+
+void BindlessDescriptors::SlotAllocator::recycle(uint32_t frame)
+{
+	freeSlots.insert(freeSlots.end(), retiredSlots[frame].begin(), retiredSlots[frame].end());
+	retiredSlots[frame].clear();
+}
+
+BindlessDescriptors::BindlessDescriptors(const DeviceCapabilities& capabilities, VkDevice device) : device{ device }
+{
+	//************************** ARRAY SIZES *****************************
+	const VkPhysicalDeviceDescriptorIndexingProperties& indexingProperties = capabilities.descriptorIndexingProperties;
+
+	storageBuffers.capacity = std::min({ MAX_BINDLESS_BUFFERS,
+		indexingProperties.maxPerStageDescriptorUpdateAfterBindStorageBuffers,
+		indexingProperties.maxDescriptorSetUpdateAfterBindStorageBuffers });
+
+	sampledImages.capacity = std::min({ MAX_BINDLESS_IMAGES,
+		indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers,
+		indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+		indexingProperties.maxDescriptorSetUpdateAfterBindSamplers,
+		indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages });
+
+	//Recycling released indices never allocates in the frame loop
+	storageBuffers.freeSlots.reserve(storageBuffers.capacity);
+	sampledImages.freeSlots.reserve(sampledImages.capacity);
+
+	//************************** LAYOUT *****************************
+	bindings.resize(2);
+
+	bindings[0].binding = STORAGE_BUFFER_BINDING;
+	bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[0].descriptorCount = storageBuffers.capacity;
+	bindings[0].stageFlags = VK_SHADER_STAGE_ALL_GRAPHICS;
+	bindings[0].pImmutableSamplers = nullptr;
+
+	bindings[1].binding = SAMPLED_IMAGE_BINDING;
+	bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	bindings[1].descriptorCount = sampledImages.capacity;
+	bindings[1].stageFlags = VK_SHADER_STAGE_ALL_GRAPHICS;
+	bindings[1].pImmutableSamplers = nullptr;
+
+	VkDescriptorBindingFlags bindingFlags[2] = {};
+
+	for (auto& flags : bindingFlags)
+		flags = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+			VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT |
+			VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+
+	VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsCreateInfo = {};
+	bindingFlagsCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+	bindingFlagsCreateInfo.pNext = nullptr;
+	bindingFlagsCreateInfo.bindingCount = 2;
+	bindingFlagsCreateInfo.pBindingFlags = bindingFlags;
+
+	VkDescriptorSetLayoutCreateInfo layoutCreateInfo = {};
+	layoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutCreateInfo.pNext = &bindingFlagsCreateInfo;
+	layoutCreateInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+	layoutCreateInfo.bindingCount = 2;
+	layoutCreateInfo.pBindings = bindings.data();
+
+	VkResult result = vkCreateDescriptorSetLayout(device, &layoutCreateInfo, getHostAllocator(), &layout);
+
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Failed to create the bindless descriptor set layout!");
+
+	//************************** POOL AND SET *****************************
+	VkDescriptorPoolSize poolSizes[2] = {};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[0].descriptorCount = storageBuffers.capacity;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[1].descriptorCount = sampledImages.capacity;
+
+	VkDescriptorPoolCreateInfo poolCreateInfo = {};
+	poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolCreateInfo.pNext = nullptr;
+	poolCreateInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+	poolCreateInfo.maxSets = 1;
+	poolCreateInfo.poolSizeCount = 2;
+	poolCreateInfo.pPoolSizes = poolSizes;
+
+	result = vkCreateDescriptorPool(device, &poolCreateInfo, getHostAllocator(), &pool);
+
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Failed to create the bindless descriptor pool!");
+
+	VkDescriptorSetAllocateInfo setAllocateInfo = {};
+	setAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	setAllocateInfo.pNext = nullptr;
+	setAllocateInfo.descriptorPool = pool;
+	setAllocateInfo.descriptorSetCount = 1;
+	setAllocateInfo.pSetLayouts = &layout;
+
+	result = vkAllocateDescriptorSets(device, &setAllocateInfo, &set);
+
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Failed to allocate the bindless descriptor set!");
+}
+
+uint32_t BindlessDescriptors::addStorageBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
+{
+	uint32_t index = storageBuffers.allocate();
+
+	VkDescriptorBufferInfo bufferInfo = {};
+	bufferInfo.buffer = buffer;
+	bufferInfo.offset = offset;
+	bufferInfo.range = range;
+
+	VkWriteDescriptorSet write = {};
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.pNext = nullptr;
+	write.dstSet = set;
+	write.dstBinding = STORAGE_BUFFER_BINDING;
+	write.dstArrayElement = index;
+	write.descriptorCount = 1;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	write.pBufferInfo = &bufferInfo;
+
+	vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+
+	return index;
+}
+
+uint32_t BindlessDescriptors::addSampledImage(VkImageView imageView, VkSampler sampler, VkImageLayout layout)
+{
+	uint32_t index = sampledImages.allocate();
+
+	VkDescriptorImageInfo imageInfo = {};
+	imageInfo.sampler = sampler;
+	imageInfo.imageView = imageView;
+	imageInfo.imageLayout = layout;
+
+	VkWriteDescriptorSet write = {};
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.pNext = nullptr;
+	write.dstSet = set;
+	write.dstBinding = SAMPLED_IMAGE_BINDING;
+	write.dstArrayElement = index;
+	write.descriptorCount = 1;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	write.pImageInfo = &imageInfo;
+
+	vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+
+	return index;
+}
+
+void BindlessDescriptors::removeStorageBuffer(uint32_t index)
+{
+	storageBuffers.release(index, frame);
+}
+
+void BindlessDescriptors::removeSampledImage(uint32_t index)
+{
+	sampledImages.release(index, frame);
+}
+
+void BindlessDescriptors::nextFrame(uint32_t currentFrame)
+{
+	//The fence of this frame was waited on, nothing submitted the last time it was current is still running
+	frame = currentFrame;
+
+	storageBuffers.recycle(frame);
+	sampledImages.recycle(frame);
+}
+
+VkDescriptorSetLayout BindlessDescriptors::getLayout() const
+{
+	return layout;
+}
+
+const std::vector<VkDescriptorSetLayoutBinding>& BindlessDescriptors::getBindings() const
+{
+	return bindings;
+}
+
+VkDescriptorSet BindlessDescriptors::getSet() const
+{
+	return set;
+}
+
+void BindlessDescriptors::destroy()
+{
+	//The set is freed with its pool
+	if (pool != VK_NULL_HANDLE)
+		vkDestroyDescriptorPool(device, pool, getHostAllocator());
+
+	if (layout != VK_NULL_HANDLE)
+		vkDestroyDescriptorSetLayout(device, layout, getHostAllocator());
+
+	pool = VK_NULL_HANDLE;
+	layout = VK_NULL_HANDLE;
+	set = VK_NULL_HANDLE;
+}
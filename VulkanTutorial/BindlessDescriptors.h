@@ -0,0 +1,69 @@
+#pragma once
+
+#include<vulkan/vulkan.h>
+#include<vector>
+#include<string>
+#include<stdexcept>
+#include "Utilities.h"
+#include "DeviceCapabilities.h"
+
+//A single descriptor set, bound once per command buffer, with one big array per resource type
+//(binding 0: storage buffers, binding 1: combined image samplers). Resources are referenced from the
+//shaders by their index in the array, so changing them never needs a rebind. The arrays are
+//update-after-bind and partially bound: slots can be written while the set is in use and unused
+//slots can stay empty.
+class BindlessDescriptors
+{
+private:
+	//Indices of one of the arrays. A released index is only reused once the frames in flight that could
+	//still read it are finished
+	struct SlotAllocator
+	{
+		uint32_t capacity = 0;
+		uint32_t next = 0;
+		std::vector<uint32_t> freeSlots;
+		std::vector<uint32_t> retiredSlots[MAX_FRAME_COUNT];
+
+		uint32_t allocate();
+		void release(uint32_t slot, uint32_t frame);
+		void recycle(uint32_t frame);
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+
+	VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+	std::vector<VkDescriptorSetLayoutBinding> bindings;
+	VkDescriptorPool pool = VK_NULL_HANDLE;
+	VkDescriptorSet set = VK_NULL_HANDLE;
+
+	SlotAllocator storageBuffers;
+	SlotAllocator sampledImages;
+
+	uint32_t frame = 0;
+
+public:
+	static const uint32_t STORAGE_BUFFER_BINDING = 0;
+	static const uint32_t SAMPLED_IMAGE_BINDING = 1;
+
+	BindlessDescriptors() = default;
+
+	//The sizes of the arrays are MAX_BINDLESS_BUFFERS and MAX_BINDLESS_IMAGES clamped to the device limits
+	BindlessDescriptors(const DeviceCapabilities& capabilities, VkDevice device);
+
+	uint32_t addStorageBuffer(VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE);
+	uint32_t addSampledImage(VkImageView imageView, VkSampler sampler, VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+	void removeStorageBuffer(uint32_t index);
+	void removeSampledImage(uint32_t index);
+
+	//Called once per frame after waiting for its fence, makes the slots released MAX_FRAME_COUNT frames ago reusable
+	void nextFrame(uint32_t currentFrame);
+
+	VkDescriptorSetLayout getLayout() const;
+
+	//What the layout was made with, for checking the shaders against it
+	const std::vector<VkDescriptorSetLayoutBinding>& getBindings() const;
+	VkDescriptorSet getSet() const;
+
+	void destroy();
+};
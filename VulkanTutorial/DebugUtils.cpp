@@ -0,0 +1,223 @@
+#include "DebugUtils.h"
+#include "AllocationCounter.h"
+#include<cstdio>
+#include<cstring>
+#include<chrono>
+
+namespace
+{
+	PFN_vkSetDebugUtilsObjectNameEXT setObjectName = nullptr;
+	PFN_vkCmdBeginDebugUtilsLabelEXT cmdBeginLabel = nullptr;
+	PFN_vkCmdEndDebugUtilsLabelEXT cmdEndLabel = nullptr;
+
+	const char* getSeverityName(VkDebugUtilsMessageSeverityFlagBitsEXT severity)
+	{
+		if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT)
+			return "ERROR";
+
+		if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT)
+			return "WARNING";
+
+		if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT)
+			return "INFO";
+
+		return "VERBOSE";
+	}
+
+	//Messages without an id are told apart by their text
+	int32_t hashText(const char* text)
+	{
+		uint32_t hash = 2166136261u;
+
+		for (; *text != '\0'; text++)
+			hash = (hash ^ (uint8_t)*text) * 16777619u;
+
+		return (int32_t)hash;
+	}
+}
+
+DebugLog::~DebugLog()
+{
+	stop();
+}
+
+void DebugLog::start()
+{
+	if (running)
+		return;
+
+	slots.reset(new Slot[RING_SIZE]);
+
+	for (size_t i = 0; i < RING_SIZE; i++)
+		slots[i].sequence = i;
+
+	writePosition = 0;
+	readPosition = 0;
+
+	running = true;
+	loggingThread = std::thread(&DebugLog::loggingLoop, this);
+}
+
+void DebugLog::stop()
+{
+	if (!running)
+		return;
+
+	running = false;
+	loggingThread.join();
+
+	if (droppedMessages > 0)
+		fprintf(stderr, "VALIDATION: %llu messages dropped, the log could not keep up\n", (unsigned long long)droppedMessages.load());
+}
+
+bool DebugLog::push(VkDebugUtilsMessageSeverityFlagBitsEXT severity, VkDebugUtilsMessageTypeFlagsEXT type,
+	const VkDebugUtilsMessengerCallbackDataEXT* callbackData)
+{
+	if (!slots)
+		return false;
+
+	size_t position = writePosition.load(std::memory_order_relaxed);
+	Slot* slot = nullptr;
+
+	while (true)
+	{
+		slot = &slots[position & (RING_SIZE - 1)];
+		size_t sequence = slot->sequence.load(std::memory_order_acquire);
+
+		if (sequence == position)
+		{
+			if (writePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				break;
+		}
+		else if (sequence < position)
+		{
+			//The logging thread has not read this slot since the last lap
+			droppedMessages++;
+			return false;
+		}
+		else
+		{
+			position = writePosition.load(std::memory_order_relaxed);
+		}
+	}
+
+	const char* text = (callbackData->pMessage != nullptr) ? callbackData->pMessage : "";
+
+	slot->message.severity = severity;
+	slot->message.type = type;
+	slot->message.id = (callbackData->messageIdNumber != 0) ? callbackData->messageIdNumber : hashText(text);
+
+	strncpy(slot->message.text, text, DebugMessage::MAX_TEXT_LENGTH - 1);
+	slot->message.text[DebugMessage::MAX_TEXT_LENGTH - 1] = '\0';
+
+	slot->sequence.store(position + 1, std::memory_order_release);
+
+	return true;
+}
+
+bool DebugLog::pop(DebugMessage& message)
+{
+	Slot& slot = slots[readPosition & (RING_SIZE - 1)];
+
+	if (slot.sequence.load(std::memory_order_acquire) != readPosition + 1)
+		return false;
+
+	message = slot.message;
+
+	//Free for the writer of the next lap
+	slot.sequence.store(readPosition + RING_SIZE, std::memory_order_release);
+	readPosition++;
+
+	return true;
+}
+
+void DebugLog::print(const DebugMessage& message)
+{
+	uint64_t count = ++messageCounts[message.id];
+
+	if (count <= PRINTED_REPEATS)
+	{
+		fprintf(stderr, "VALIDATION %s: %s\n", getSeverityName(message.severity), message.text);
+		return;
+	}
+
+	//Repeats are only counted, and reported when they reach the next power of 10
+	uint64_t powerOf10 = 10;
+
+	while (powerOf10 < count)
+		powerOf10 *= 10;
+
+	if (count == powerOf10)
+		fprintf(stderr, "VALIDATION %s (repeated %llu times): %s\n", getSeverityName(message.severity), (unsigned long long)count, message.text);
+}
+
+void DebugLog::loggingLoop()
+{
+	//The thread is not part of the frame loop, what it allocates is never a frame's
+	AllowAllocations allowAllocations;
+
+	DebugMessage message;
+
+	while (true)
+	{
+		bool stopping = !running;
+		bool printed = false;
+
+		while (pop(message))
+		{
+			print(message);
+			printed = true;
+		}
+
+		if (printed)
+			fflush(stderr);
+
+		//Everything pushed before stop() was called has been printed
+		if (stopping)
+			return;
+
+		if (!printed)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
+
+void loadDebugUtils(VkInstance instance)
+{
+	setObjectName = (PFN_vkSetDebugUtilsObjectNameEXT)vkGetInstanceProcAddr(instance, "vkSetDebugUtilsObjectNameEXT");
+	cmdBeginLabel = (PFN_vkCmdBeginDebugUtilsLabelEXT)vkGetInstanceProcAddr(instance, "vkCmdBeginDebugUtilsLabelEXT");
+	cmdEndLabel = (PFN_vkCmdEndDebugUtilsLabelEXT)vkGetInstanceProcAddr(instance, "vkCmdEndDebugUtilsLabelEXT");
+}
+
+void setDebugName(VkDevice device, VkObjectType type, uint64_t handle, const char* name)
+{
+	if (setObjectName == nullptr || handle == 0)
+		return;
+
+	VkDebugUtilsObjectNameInfoEXT nameInfo = {};
+	nameInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_OBJECT_NAME_INFO_EXT;
+	nameInfo.pNext = nullptr;
+	nameInfo.objectType = type;
+	nameInfo.objectHandle = handle;
+	nameInfo.pObjectName = name;
+
+	setObjectName(device, &nameInfo);
+}
+
+void beginDebugLabel(VkCommandBuffer commandBuffer, const char* name)
+{
+	if (cmdBeginLabel == nullptr)
+		return;
+
+	VkDebugUtilsLabelEXT label = {};
+	label.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_LABEL_EXT;
+	label.pNext = nullptr;
+	label.pLabelName = name;
+
+	cmdBeginLabel(commandBuffer, &label);
+}
+
+void endDebugLabel(VkCommandBuffer commandBuffer)
+{
+	if (cmdEndLabel != nullptr)
+		cmdEndLabel(commandBuffer);
+}
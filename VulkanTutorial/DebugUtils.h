@@ -0,0 +1,78 @@
+#pragma once
+
+#include<vulkan/vulkan.h>
+#include<atomic>
+#include<thread>
+#include<memory>
+#include<unordered_map>
+
+//One message of the validation layers, truncated to what fits
+struct DebugMessage
+{
+	static const size_t MAX_TEXT_LENGTH = 1024;
+
+	VkDebugUtilsMessageSeverityFlagBitsEXT severity;
+	VkDebugUtilsMessageTypeFlagsEXT type;
+	int32_t id;
+	char text[MAX_TEXT_LENGTH];
+};
+
+//Messages of the VK_EXT_debug_utils messenger. The callback runs inside the driver, on any thread that
+//makes Vulkan calls, so it only copies the message into a lock-free ring and returns. A logging thread
+//prints them, every message id only a few times and then once per power of 10 of its repeats.
+//A full ring drops messages instead of waiting, the count is printed when the log stops. Everything goes to
+//stderr, stdout may be the frames streamed by the readback
+class DebugLog
+{
+private:
+	static const size_t RING_SIZE = 256;			//Power of 2
+	static const uint32_t PRINTED_REPEATS = 3;
+
+	//Bounded multi producer ring: a slot can be written when its sequence is its position and read
+	//when it is its position + 1
+	struct Slot
+	{
+		std::atomic<size_t> sequence{ 0 };
+		DebugMessage message;
+	};
+
+	std::unique_ptr<Slot[]> slots;
+	std::atomic<size_t> writePosition{ 0 };
+	size_t readPosition = 0;						//Only the logging thread reads
+
+	std::atomic<uint64_t> droppedMessages{ 0 };
+	std::unordered_map<int32_t, uint64_t> messageCounts;
+
+	std::thread loggingThread;
+	std::atomic<bool> running{ false };
+
+	bool pop(DebugMessage& message);
+	void print(const DebugMessage& message);
+	void loggingLoop();
+
+public:
+	DebugLog() = default;
+	~DebugLog();
+
+	DebugLog(const DebugLog&) = delete;
+	DebugLog& operator=(const DebugLog&) = delete;
+
+	void start();
+
+	//Prints what is left in the ring before returning
+	void stop();
+
+	//Lock and allocation free, false when the ring is full
+	bool push(VkDebugUtilsMessageSeverityFlagBitsEXT severity, VkDebugUtilsMessageTypeFlagsEXT type,
+		const VkDebugUtilsMessengerCallbackDataEXT* callbackData);
+};
+
+//************************** LABELS AND NAMES *****************************
+//They show up in the validation messages and in GPU captures and traces. They do nothing until
+//loadDebugUtils found the functions (VK_EXT_debug_utils is enabled on the instance)
+void loadDebugUtils(VkInstance instance);
+
+void setDebugName(VkDevice device, VkObjectType type, uint64_t handle, const char* name);
+
+void beginDebugLabel(VkCommandBuffer commandBuffer, const char* name);
+void endDebugLabel(VkCommandBuffer commandBuffer);
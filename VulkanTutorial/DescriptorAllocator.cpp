@@ -0,0 +1,366 @@
+#include "DescriptorAllocator.h"
+
+namespace
+{
+	//Descriptors of each type a pool has per set it can allocate. The sets do not all have the same
+	//layout, so this is a guess that leans towards what the renderer uses most
+	struct PoolRatio
+	{
+		VkDescriptorType type;
+		float descriptorsPerSet;
+	};
+
+	const PoolRatio POOL_RATIOS[] = {
+		{ VK_DESCRIPTOR_TYPE_SAMPLER, 0.5f },
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4.0f },
+		{ VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 4.0f },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1.0f },
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, 1.0f },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER, 1.0f },
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2.0f },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2.0f },
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.0f },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1.0f },
+		{ VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 0.5f }
+	};
+
+	//Which part of a DescriptorWrite describes the descriptor
+	enum class DescriptorInfo
+	{
+		Buffer,
+		Image,
+		TexelBuffer
+	};
+
+	DescriptorInfo getDescriptorInfo(VkDescriptorType type)
+	{
+		switch (type)
+		{
+		case VK_DESCRIPTOR_TYPE_SAMPLER:
+		case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+		case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+		case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+		case VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT:
+			return DescriptorInfo::Image;
+
+		case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER:
+		case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER:
+			return DescriptorInfo::TexelBuffer;
+
+		case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+		case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+		case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC:
+		case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC:
+			return DescriptorInfo::Buffer;
+
+		default:
+			throw std::runtime_error("Descriptor type not supported by the descriptor allocator!");
+		}
+	}
+
+	//FNV-1a, fed the fields one by one so the padding of the structures is left out
+	void hashValue(uint64_t& hash, uint64_t value)
+	{
+		for (int i = 0; i < 8; i++)
+		{
+			hash ^= (value >> (i * 8)) & 0xFF;
+			hash *= 1099511628211ull;
+		}
+	}
+
+	uint64_t hashContent(VkDescriptorSetLayout layout, const std::vector<DescriptorWrite>& content)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		hashValue(hash, (uint64_t)layout);
+
+		for (const DescriptorWrite& descriptor : content)
+		{
+			hashValue(hash, descriptor.binding);
+			hashValue(hash, descriptor.type);
+
+			switch (getDescriptorInfo(descriptor.type))
+			{
+			case DescriptorInfo::Image:
+				hashValue(hash, (uint64_t)descriptor.image.sampler);
+				hashValue(hash, (uint64_t)descriptor.image.imageView);
+				hashValue(hash, descriptor.image.imageLayout);
+				break;
+
+			case DescriptorInfo::TexelBuffer:
+				hashValue(hash, (uint64_t)descriptor.texelBufferView);
+				break;
+
+			case DescriptorInfo::Buffer:
+				hashValue(hash, (uint64_t)descriptor.buffer.buffer);
+				hashValue(hash, descriptor.buffer.offset);
+				hashValue(hash, descriptor.buffer.range);
+				break;
+			}
+		}
+
+		return hash;
+	}
+
+	bool isSameContent(const std::vector<DescriptorWrite>& a, const std::vector<DescriptorWrite>& b)
+	{
+		if (a.size() != b.size())
+			return false;
+
+		for (size_t i = 0; i < a.size(); i++)
+		{
+			if (a[i].binding != b[i].binding || a[i].type != b[i].type)
+				return false;
+
+			bool same = false;
+
+			switch (getDescriptorInfo(a[i].type))
+			{
+			case DescriptorInfo::Image:
+				same = a[i].image.sampler == b[i].image.sampler && a[i].image.imageView == b[i].image.imageView &&
+					a[i].image.imageLayout == b[i].image.imageLayout;
+				break;
+
+			case DescriptorInfo::TexelBuffer:
+				same = a[i].texelBufferView == b[i].texelBufferView;
+				break;
+
+			case DescriptorInfo::Buffer:
+				same = a[i].buffer.buffer == b[i].buffer.buffer && a[i].buffer.offset == b[i].buffer.offset &&
+					a[i].buffer.range == b[i].buffer.range;
+				break;
+			}
+
+			if (!same)
+				return false;
+		}
+
+		return true;
+	}
+}
+
+DescriptorAllocator::DescriptorAllocator(VkDevice device) : device{ device }
+{
+}
+
+VkDescriptorPool DescriptorAllocator::createPool()
+{
+	if (!freePools.empty())
+	{
+		VkDescriptorPool pool = freePools.back();
+		freePools.pop_back();
+		return pool;
+	}
+
+	uint32_t maxSets = nextPoolSize;
+	nextPoolSize = std::min(nextPoolSize * 2, MAX_SETS_PER_POOL);
+
+	VkDescriptorPoolSize poolSizes[sizeof(POOL_RATIOS) / sizeof(POOL_RATIOS[0])] = {};
+
+	for (size_t i = 0; i < sizeof(POOL_RATIOS) / sizeof(POOL_RATIOS[0]); i++)
+	{
+		poolSizes[i].type = POOL_RATIOS[i].type;
+		poolSizes[i].descriptorCount = std::max(1u, (uint32_t)(POOL_RATIOS[i].descriptorsPerSet * maxSets));
+	}
+
+	VkDescriptorPoolCreateInfo poolCreateInfo = {};
+	poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolCreateInfo.pNext = nullptr;
+	poolCreateInfo.flags = 0;
+	poolCreateInfo.maxSets = maxSets;
+	poolCreateInfo.poolSizeCount = (uint32_t)(sizeof(poolSizes) / sizeof(poolSizes[0]));
+	poolCreateInfo.pPoolSizes = poolSizes;
+
+	VkDescriptorPool pool = VK_NULL_HANDLE;
+	VkResult result = vkCreateDescriptorPool(device, &poolCreateInfo, getHostAllocator(), &pool);
+
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Failed to create a descriptor pool!");
+
+	poolCount++;
+
+	return pool;
+}
+
+VkDescriptorSet DescriptorAllocator::allocateFrom(Pools& pools, VkDescriptorSetLayout layout)
+{
+	if (pools.used.empty())
+		pools.used.push_back(createPool());
+
+	VkDescriptorSetAllocateInfo setAllocateInfo = {};
+	setAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	setAllocateInfo.pNext = nullptr;
+	setAllocateInfo.descriptorPool = pools.used.back();
+	setAllocateInfo.descriptorSetCount = 1;
+	setAllocateInfo.pSetLayouts = &layout;
+
+	VkDescriptorSet set = VK_NULL_HANDLE;
+	VkResult result = vkAllocateDescriptorSets(device, &setAllocateInfo, &set);
+
+	//The pool is full, the rest of its space stays there until it is reset. Free pools can be smaller than
+	//the new ones, so they are tried until a new pool fails too (the layout needs more than a whole pool has)
+	while (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL)
+	{
+		bool newPool = freePools.empty();
+
+		pools.used.push_back(createPool());
+		setAllocateInfo.descriptorPool = pools.used.back();
+
+		result = vkAllocateDescriptorSets(device, &setAllocateInfo, &set);
+
+		if (newPool)
+			break;
+	}
+
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Failed to allocate a descriptor set!");
+
+	return set;
+}
+
+void DescriptorAllocator::write(VkDescriptorSet set, const std::vector<DescriptorWrite>& content)
+{
+	writes.resize(content.size());
+
+	for (size_t i = 0; i < content.size(); i++)
+	{
+		writes[i] = {};
+		writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[i].pNext = nullptr;
+		writes[i].dstSet = set;
+		writes[i].dstBinding = content[i].binding;
+		writes[i].dstArrayElement = 0;
+		writes[i].descriptorCount = 1;
+		writes[i].descriptorType = content[i].type;
+
+		switch (getDescriptorInfo(content[i].type))
+		{
+		case DescriptorInfo::Image:
+			writes[i].pImageInfo = &content[i].image;
+			break;
+
+		case DescriptorInfo::TexelBuffer:
+			writes[i].pTexelBufferView = &content[i].texelBufferView;
+			break;
+
+		case DescriptorInfo::Buffer:
+			writes[i].pBufferInfo = &content[i].buffer;
+			break;
+		}
+	}
+
+	vkUpdateDescriptorSets(device, (uint32_t)writes.size(), writes.data(), 0, nullptr);
+}
+
+void DescriptorAllocator::nextFrame(uint32_t currentFrame)
+{
+	frame = currentFrame;
+	frameAllocations = 0;
+
+	//Reset keeps the pools' memory, they are as good as new ones for whichever frame takes them next
+	for (VkDescriptorPool pool : framePools[frame].used)
+	{
+		vkResetDescriptorPool(device, pool, 0);
+		freePools.push_back(pool);
+	}
+
+	framePools[frame].used.clear();
+}
+
+VkDescriptorSet DescriptorAllocator::allocate(VkDescriptorSetLayout layout)
+{
+	frameAllocations++;
+
+	return allocateFrom(framePools[frame], layout);
+}
+
+VkDescriptorSet DescriptorAllocator::allocate(VkDescriptorSetLayout layout, const std::vector<DescriptorWrite>& content)
+{
+	VkDescriptorSet set = allocate(layout);
+	write(set, content);
+
+	return set;
+}
+
+VkDescriptorSet DescriptorAllocator::getCachedSet(VkDescriptorSetLayout layout, const std::vector<DescriptorWrite>& content)
+{
+	cacheLookups++;
+
+	uint64_t hash = hashContent(layout, content);
+	auto range = cachedSets.equal_range(hash);
+
+	for (auto cached = range.first; cached != range.second; cached++)
+	{
+		if (cached->second.layout == layout && isSameContent(cached->second.content, content))
+		{
+			cacheHits++;
+			return cached->second.set;
+		}
+	}
+
+	VkDescriptorSet set = allocateFrom(cachedPools, layout);
+	write(set, content);
+
+	cachedSets.emplace(hash, CachedSet{ layout, content, set });
+
+	return set;
+}
+
+void DescriptorAllocator::clearCache()
+{
+	for (VkDescriptorPool pool : cachedPools.used)
+	{
+		vkResetDescriptorPool(device, pool, 0);
+		freePools.push_back(pool);
+	}
+
+	cachedPools.used.clear();
+	cachedSets.clear();
+}
+
+uint32_t DescriptorAllocator::getPoolCount() const
+{
+	return poolCount;
+}
+
+uint32_t DescriptorAllocator::getFrameAllocationCount() const
+{
+	return frameAllocations;
+}
+
+size_t DescriptorAllocator::getCachedSetCount() const
+{
+	return cachedSets.size();
+}
+
+uint64_t DescriptorAllocator::getCacheHitCount() const
+{
+	return cacheHits;
+}
+
+uint64_t DescriptorAllocator::getCacheLookupCount() const
+{
+	return cacheLookups;
+}
+
+void DescriptorAllocator::destroy()
+{
+	//The sets are freed with their pools
+	for (Pools& pools : framePools)
+	{
+		for (VkDescriptorPool pool : pools.used)
+			vkDestroyDescriptorPool(device, pool, getHostAllocator());
+
+		pools.used.clear();
+	}
+
+	for (VkDescriptorPool pool : cachedPools.used)
+		vkDestroyDescriptorPool(device, pool, getHostAllocator());
+
+	for (VkDescriptorPool pool : freePools)
+		vkDestroyDescriptorPool(device, pool, getHostAllocator());
+
+	cachedPools.used.clear();
+	freePools.clear();
+	cachedSets.clear();
+	poolCount = 0;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include<vulkan/vulkan.h>
+#include<vector>
+#include<unordered_map>
+#include<stdexcept>
+#include "Utilities.h"
+
+//One descriptor of a set, the buffer info, the image info or the buffer view is used depending on the type
+//(the view for the texel buffers). Types none of them describe (inline uniform blocks) are rejected
+struct DescriptorWrite
+{
+	uint32_t binding = 0;
+	VkDescriptorType type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	VkDescriptorBufferInfo buffer = {};
+	VkDescriptorImageInfo image = {};
+	VkBufferView texelBufferView = VK_NULL_HANDLE;
+};
+
+//Descriptor sets that are not part of the bindless set, from pools that grow on demand:
+//	- Frame sets live until the frame in flight they were allocated in comes around again. The pools of
+//	  a frame are reset whole once its fence has signaled and go back to the free pools, nothing is
+//	  freed set by set, so they never fragment
+//	- Cached sets are immutable and looked up by their layout and content, a draw asking for the same
+//	  descriptors as an earlier one gets the same set back without allocating or writing anything
+//
+//A pool that runs out (VK_ERROR_OUT_OF_POOL_MEMORY or VK_ERROR_FRAGMENTED_POOL) is replaced by a free
+//one or a new one with twice the sets, up to MAX_SETS_PER_POOL. Not thread safe, it belongs to the frame loop
+class DescriptorAllocator
+{
+private:
+	static constexpr uint32_t MIN_SETS_PER_POOL = 64;
+	static constexpr uint32_t MAX_SETS_PER_POOL = 4096;
+
+	struct Pools
+	{
+		std::vector<VkDescriptorPool> used;		//The last one is the one allocated from
+	};
+
+	struct CachedSet
+	{
+		VkDescriptorSetLayout layout;
+		std::vector<DescriptorWrite> content;
+		VkDescriptorSet set;
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+
+	Pools framePools[MAX_FRAME_COUNT];
+	Pools cachedPools;
+	std::vector<VkDescriptorPool> freePools;
+	uint32_t nextPoolSize = MIN_SETS_PER_POOL;
+	uint32_t poolCount = 0;
+
+	uint32_t frame = 0;
+	uint32_t frameAllocations = 0;
+
+	//By the hash of their layout and content, collisions are told apart by comparing the content
+	std::unordered_multimap<uint64_t, CachedSet> cachedSets;
+	uint64_t cacheLookups = 0;
+	uint64_t cacheHits = 0;
+
+	//Reused by every write, so writing a set does not allocate once it has grown
+	std::vector<VkWriteDescriptorSet> writes;
+
+	VkDescriptorPool createPool();
+	VkDescriptorSet allocateFrom(Pools& pools, VkDescriptorSetLayout layout);
+	void write(VkDescriptorSet set, const std::vector<DescriptorWrite>& content);
+
+public:
+	DescriptorAllocator() = default;
+	DescriptorAllocator(VkDevice device);
+
+	//Called once per frame after waiting for its fence, the sets allocated the last time the frame ran are gone
+	void nextFrame(uint32_t currentFrame);
+
+	//A set that lives until this frame in flight comes around again
+	VkDescriptorSet allocate(VkDescriptorSetLayout layout);
+	VkDescriptorSet allocate(VkDescriptorSetLayout layout, const std::vector<DescriptorWrite>& content);
+
+	//The set with this layout and content, written the first time it is asked for. The resources of the content
+	//have to outlive the cache (or clearCache has to be called once the device is idle)
+	VkDescriptorSet getCachedSet(VkDescriptorSetLayout layout, const std::vector<DescriptorWrite>& content);
+	void clearCache();
+
+	uint32_t getPoolCount() const;
+	uint32_t getFrameAllocationCount() const;		//Frame sets allocated since the last nextFrame
+	size_t getCachedSetCount() const;
+	uint64_t getCacheHitCount() const;
+	uint64_t getCacheLookupCount() const;
+
+	void destroy();
+};
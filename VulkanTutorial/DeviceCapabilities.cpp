@@ -0,0 +1,123 @@
+#include "DeviceCapabilities.h"
+#include<algorithm>
+#include<cstring>
+
+bool DeviceCapabilities::hasExtension(const char* extension) const
+{
+	return std::any_of(extensions.begin(), extensions.end(),
+		[extension](const VkExtensionProperties& prop) { return strcmp(prop.extensionName, extension) == 0; });
+}
+
+VkDeviceSize DeviceCapabilities::getDeviceLocalMemory() const
+{
+	VkDeviceSize size = 0;
+
+	for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++)
+		if (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+			size = std::max(size, memoryProperties.memoryHeaps[i].size);
+
+	return size;
+}
+
+DeviceCapabilities queryDeviceCapabilities(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface)
+{
+	DeviceCapabilities capabilities;
+	capabilities.physicalDevice = physicalDevice;
+
+	//************************** PROPERTIES *****************************
+	vkGetPhysicalDeviceProperties(physicalDevice, &capabilities.properties);
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &capabilities.memoryProperties);
+	vkGetPhysicalDeviceFeatures(physicalDevice, &capabilities.features);
+
+	//The 1.2 structures can only be chained on devices that have it
+	if (capabilities.properties.apiVersion >= VK_API_VERSION_1_2)
+	{
+		capabilities.descriptorIndexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES;
+
+		VkPhysicalDeviceProperties2 properties2 = {};
+		properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		properties2.pNext = &capabilities.descriptorIndexingProperties;
+
+		vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+
+		capabilities.vulkan11Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
+		capabilities.vulkan11Features.pNext = &capabilities.vulkan12Features;
+		capabilities.vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+		VkPhysicalDeviceFeatures2 features2 = {};
+		features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features2.pNext = &capabilities.vulkan11Features;
+
+		vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+
+		//The snapshot is copied around, it must not point to anything
+		capabilities.descriptorIndexingProperties.pNext = nullptr;
+		capabilities.vulkan11Features.pNext = nullptr;
+		capabilities.vulkan12Features.pNext = nullptr;
+	}
+
+	//************************** EXTENSIONS *****************************
+	uint32_t extensionCount = 0;
+	vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+
+	capabilities.extensions.resize(extensionCount);
+	vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, capabilities.extensions.data());
+
+	//************************** QUEUE FAMILIES *****************************
+	uint32_t queueCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueCount, nullptr);
+
+	capabilities.queueFamilies.resize(queueCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueCount, capabilities.queueFamilies.data());
+
+	//The first family of each kind, one that can do both if there is one
+	for (uint32_t i = 0; i < queueCount; i++)
+	{
+		VkBool32 presentationSupport = VK_FALSE;
+		vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface, &presentationSupport);
+
+		bool graphicsSupport = capabilities.queueFamilies[i].queueCount > 0 &&
+			(capabilities.queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT);
+
+		QueueFamilyIndices& indices = capabilities.queueFamilyIndices;
+
+		if (graphicsSupport && presentationSupport)
+		{
+			indices.graphicsFamily = (int)i;
+			indices.presentationFamily = (int)i;
+			break;
+		}
+
+		if (graphicsSupport && indices.graphicsFamily < 0)
+			indices.graphicsFamily = (int)i;
+
+		if (presentationSupport && indices.presentationFamily < 0)
+			indices.presentationFamily = (int)i;
+	}
+
+	return capabilities;
+}
+
+uint64_t scoreDevice(const DeviceCapabilities& capabilities)
+{
+	uint64_t typeScore = 0;
+
+	switch (capabilities.properties.deviceType)
+	{
+	case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:	typeScore = 4; break;
+	case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:	typeScore = 3; break;
+	case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:	typeScore = 2; break;
+	case VK_PHYSICAL_DEVICE_TYPE_CPU:			typeScore = 1; break;
+	default:									typeScore = 0; break;
+	}
+
+	uint64_t memoryScore = std::min<uint64_t>(capabilities.getDeviceLocalMemory() / (1024 * 1024), 0xFFFFFFFFull);
+
+	uint64_t featureScore = 0;
+	featureScore += capabilities.features.pipelineStatisticsQuery ? 1 : 0;
+	featureScore += capabilities.features.textureCompressionBC ? 1 : 0;
+	featureScore += capabilities.hasExtension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) ? 1 : 0;
+
+	//[type: 8 bits][device local MB: 32 bits][features: 8 bits]
+	return (typeScore << 40) | (memoryScore << 8) | featureScore;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include<vulkan/vulkan.h>
+#include<vector>
+#include<string>
+#include<stdexcept>
+#include "Utilities.h"
+
+//Everything the renderer needs to know about a physical device, queried once when the devices are
+//enumerated. It never changes afterwards, so it is read instead of asking the driver again
+struct DeviceCapabilities
+{
+	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+
+	VkPhysicalDeviceProperties properties = {};
+	VkPhysicalDeviceDescriptorIndexingProperties descriptorIndexingProperties = {};
+	VkPhysicalDeviceMemoryProperties memoryProperties = {};
+
+	VkPhysicalDeviceFeatures features = {};
+	VkPhysicalDeviceVulkan11Features vulkan11Features = {};		//All false below Vulkan 1.2
+	VkPhysicalDeviceVulkan12Features vulkan12Features = {};		//All false below Vulkan 1.2
+
+	std::vector<VkQueueFamilyProperties> queueFamilies;
+	QueueFamilyIndices queueFamilyIndices;						//Graphics and presentation to "surface"
+
+	std::vector<VkExtensionProperties> extensions;
+
+	bool hasExtension(const char* extension) const;
+
+	//Size of the biggest device local heap
+	VkDeviceSize getDeviceLocalMemory() const;
+};
+
+DeviceCapabilities queryDeviceCapabilities(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface);
+
+//Higher is better: the device type first (discrete > integrated > virtual > cpu), then the device local
+//memory and then the optional features the renderer uses
+uint64_t scoreDevice(const DeviceCapabilities& capabilities);
+
+//Name of the environment variable that overrides the scoring: a device index or a part of its name
+const char* const DEVICE_OVERRIDE_VARIABLE = "VULKAN_TUTORIAL_DEVICE";
@@ -0,0 +1,164 @@
+#include "DrawList.h"
+#include<algorithm>
+
+namespace
+{
+	//The bits of the key a change of which needs a bind
+	uint64_t getBindBits(uint64_t key)
+	{
+		return key & ((getDrawKeyPass(key) == DRAW_PASS_TRANSLUCENT) ? TRANSLUCENT_KEY_BIND_MASK : DRAW_KEY_BIND_MASK);
+	}
+}
+
+uint64_t makeDrawKey(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t mesh, float depth)
+{
+	const uint32_t maxDepth = (1u << DRAW_KEY_DEPTH_BITS) - 1;
+
+	uint32_t quantizedDepth = (uint32_t)(std::min(std::max(depth, 0.0f), 1.0f) * maxDepth);
+
+	if (pass == DRAW_PASS_TRANSLUCENT)
+		return ((uint64_t)pass << DRAW_KEY_PASS_SHIFT) |
+			((uint64_t)(maxDepth - quantizedDepth) << TRANSLUCENT_KEY_DEPTH_SHIFT) |
+			((uint64_t)(pipeline & 0xFF) << TRANSLUCENT_KEY_PIPELINE_SHIFT) |
+			((uint64_t)(material & 0xFFFF) << TRANSLUCENT_KEY_MATERIAL_SHIFT) |
+			((uint64_t)(mesh & 0xFFFF) << TRANSLUCENT_KEY_MESH_SHIFT);
+
+	return ((uint64_t)(pass & 0xF) << DRAW_KEY_PASS_SHIFT) |
+		((uint64_t)(pipeline & 0xFF) << DRAW_KEY_PIPELINE_SHIFT) |
+		((uint64_t)(material & 0xFFFF) << DRAW_KEY_MATERIAL_SHIFT) |
+		((uint64_t)(mesh & 0xFFFF) << DRAW_KEY_MESH_SHIFT) |
+		quantizedDepth;
+}
+
+uint32_t getDrawKeyPass(uint64_t key)
+{
+	return (uint32_t)(key >> DRAW_KEY_PASS_SHIFT) & 0xF;
+}
+
+uint32_t getDrawKeyPipeline(uint64_t key)
+{
+	uint32_t shift = (getDrawKeyPass(key) == DRAW_PASS_TRANSLUCENT) ? TRANSLUCENT_KEY_PIPELINE_SHIFT : DRAW_KEY_PIPELINE_SHIFT;
+
+	return (uint32_t)(key >> shift) & 0xFF;
+}
+
+void DrawList::clear()
+{
+	items.clear();
+}
+
+void DrawList::add(uint64_t key, uint32_t instance)
+{
+	items.push_back({ key, instance, 0 });
+}
+
+const std::vector<DrawItem>& DrawList::getItems() const
+{
+	return items;
+}
+
+uint32_t DrawList::countBinds() const
+{
+	uint32_t binds = 0;
+
+	for (size_t i = 0; i < items.size(); i++)
+		if (i == 0 || getBindBits(items[i].key) != getBindBits(items[i - 1].key))
+			binds++;
+
+	return binds;
+}
+
+void DrawList::countChunk(size_t chunk)
+{
+	uint32_t* histogram = &histograms[chunk * RADIX_BUCKETS];
+	std::fill(histogram, histogram + RADIX_BUCKETS, 0);
+
+	size_t end = std::min((chunk + 1) * chunkSize, items.size());
+
+	for (size_t i = chunk * chunkSize; i < end; i++)
+		histogram[(source[i].key >> shift) & (RADIX_BUCKETS - 1)]++;
+}
+
+void DrawList::scatterChunk(size_t chunk)
+{
+	uint32_t* offsets = &histograms[chunk * RADIX_BUCKETS];
+
+	size_t end = std::min((chunk + 1) * chunkSize, items.size());
+
+	//Every chunk writes its items in order, so each pass is stable
+	for (size_t i = chunk * chunkSize; i < end; i++)
+		destination[offsets[(source[i].key >> shift) & (RADIX_BUCKETS - 1)]++] = source[i];
+}
+
+void DrawList::sort(ThreadPool* threadPool)
+{
+	size_t count = items.size();
+
+	if (count < 2)
+		return;
+
+	size_t maxChunks = (threadPool != nullptr) ? threadPool->getThreadCount() + 1 : 1;
+
+	chunkCount = std::max<size_t>(std::min(maxChunks, count / MIN_CHUNK_SIZE), 1);
+	chunkSize = (count + chunkCount - 1) / chunkCount;
+
+	scratch.resize(count);
+	histograms.resize(chunkCount * RADIX_BUCKETS);
+
+	source = items.data();
+	destination = scratch.data();
+
+	//Only "this" is captured, std::function keeps it without allocating
+	const std::function<void(size_t, size_t)> countChunks = [this](size_t begin, size_t end)
+	{
+		for (size_t chunk = begin; chunk < end; chunk++)
+			countChunk(chunk);
+	};
+
+	const std::function<void(size_t, size_t)> scatterChunks = [this](size_t begin, size_t end)
+	{
+		for (size_t chunk = begin; chunk < end; chunk++)
+			scatterChunk(chunk);
+	};
+
+	for (shift = 0; shift < 64; shift += 8)
+	{
+		if (chunkCount == 1)
+			countChunk(0);
+		else
+			threadPool->parallelFor(chunkCount, 1, countChunks);
+
+		//Bucket by bucket, chunk by chunk: where each chunk starts writing each bucket
+		uint32_t offset = 0;
+		bool allInOneBucket = false;
+
+		for (size_t bucket = 0; bucket < RADIX_BUCKETS; bucket++)
+		{
+			uint32_t bucketStart = offset;
+
+			for (size_t chunk = 0; chunk < chunkCount; chunk++)
+			{
+				uint32_t bucketCount = histograms[chunk * RADIX_BUCKETS + bucket];
+				histograms[chunk * RADIX_BUCKETS + bucket] = offset;
+				offset += bucketCount;
+			}
+
+			if (offset - bucketStart == count)
+				allInOneBucket = true;
+		}
+
+		//The byte is the same in every key, the pass would not move anything
+		if (allInOneBucket)
+			continue;
+
+		if (chunkCount == 1)
+			scatterChunk(0);
+		else
+			threadPool->parallelFor(chunkCount, 1, scatterChunks);
+
+		std::swap(source, destination);
+	}
+
+	if (source != items.data())
+		items.swap(scratch);
+}
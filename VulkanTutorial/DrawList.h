@@ -0,0 +1,82 @@
+#pragma once
+
+#include<vector>
+#include<cstdint>
+#include "ThreadPool.h"
+
+//Sort key of a draw, most significant first:
+//	[pass: 4][pipeline: 8][material: 16][mesh: 16][depth: 20]
+//Draws that share a pipeline and a mesh end up next to each other, so recording them in key order binds
+//each one once. Only the order depends on the key, so wider values (they are masked) just group worse
+const uint32_t DRAW_KEY_DEPTH_BITS = 20;
+const uint32_t DRAW_KEY_MESH_SHIFT = DRAW_KEY_DEPTH_BITS;
+const uint32_t DRAW_KEY_MATERIAL_SHIFT = DRAW_KEY_MESH_SHIFT + 16;
+const uint32_t DRAW_KEY_PIPELINE_SHIFT = DRAW_KEY_MATERIAL_SHIFT + 16;
+const uint32_t DRAW_KEY_PASS_SHIFT = DRAW_KEY_PIPELINE_SHIFT + 8;
+
+//Blended draws have to be drawn back to front whatever their state, so the keys of the translucent pass
+//put the depth first and only group the draws at the same depth:
+//	[pass: 4][depth: 20][pipeline: 8][material: 16][mesh: 16]
+const uint32_t DRAW_PASS_OPAQUE = 0;
+const uint32_t DRAW_PASS_TRANSLUCENT = 1;
+
+const uint32_t TRANSLUCENT_KEY_MESH_SHIFT = 0;
+const uint32_t TRANSLUCENT_KEY_MATERIAL_SHIFT = TRANSLUCENT_KEY_MESH_SHIFT + 16;
+const uint32_t TRANSLUCENT_KEY_PIPELINE_SHIFT = TRANSLUCENT_KEY_MATERIAL_SHIFT + 16;
+const uint32_t TRANSLUCENT_KEY_DEPTH_SHIFT = TRANSLUCENT_KEY_PIPELINE_SHIFT + 8;
+
+//The bits a change of which needs a bind (pipeline or vertex and index buffers), in both layouts
+const uint64_t DRAW_KEY_BIND_MASK =
+	(0xFFull << DRAW_KEY_PIPELINE_SHIFT) | (0xFFFFull << DRAW_KEY_MESH_SHIFT) | (0xFull << DRAW_KEY_PASS_SHIFT);
+const uint64_t TRANSLUCENT_KEY_BIND_MASK =
+	(0xFFull << TRANSLUCENT_KEY_PIPELINE_SHIFT) | (0xFFFFull << TRANSLUCENT_KEY_MESH_SHIFT) | (0xFull << DRAW_KEY_PASS_SHIFT);
+
+//"depth" in [0, 1]. Opaque draws come nearest first (front to back, the depth test rejects more), the
+//translucent pass farthest first
+uint64_t makeDrawKey(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t mesh, float depth);
+
+uint32_t getDrawKeyPass(uint64_t key);
+uint32_t getDrawKeyPipeline(uint64_t key);
+
+struct DrawItem
+{
+	uint64_t key;
+	uint32_t instance;
+	uint32_t padding;
+};
+
+//Draws of a frame sorted by key with a parallel LSD radix sort (8 bits per pass, the passes where every
+//key has the same byte are skipped). Its buffers only grow, so once warm sorting does not allocate
+class DrawList
+{
+private:
+	static const size_t RADIX_BUCKETS = 256;
+	static const size_t MIN_CHUNK_SIZE = 4096;		//Smaller lists are sorted by the calling thread
+
+	std::vector<DrawItem> items;
+	std::vector<DrawItem> scratch;
+
+	//Bucket counts of every chunk (chunk * RADIX_BUCKETS + bucket), turned into write offsets
+	std::vector<uint32_t> histograms;
+
+	//Radix pass being run on the pool, the tasks only capture "this" so they do not allocate
+	size_t chunkSize = 0;
+	size_t chunkCount = 0;
+	uint32_t shift = 0;
+	DrawItem* source = nullptr;
+	DrawItem* destination = nullptr;
+
+	void countChunk(size_t chunk);
+	void scatterChunk(size_t chunk);
+
+public:
+	void clear();
+	void add(uint64_t key, uint32_t instance);
+
+	void sort(ThreadPool* threadPool);
+
+	const std::vector<DrawItem>& getItems() const;
+
+	//Binds recording the items in their current order would make
+	uint32_t countBinds() const;
+};
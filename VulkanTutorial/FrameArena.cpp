@@ -0,0 +1,89 @@
+#include "FrameArena.h"
+#include "AllocationCounter.h"
+#include<cstdlib>
+#include<new>
+#include<algorithm>
+
+FrameArena::FrameArena(size_t initialSize)
+{
+	blockSize = (initialSize > MIN_BLOCK_SIZE) ? initialSize : MIN_BLOCK_SIZE;
+	block = static_cast<char*>(std::malloc(blockSize));
+
+	if (block == nullptr)
+		throw std::bad_alloc();
+}
+
+FrameArena::~FrameArena()
+{
+	reset();
+	std::free(block);
+}
+
+void* FrameArena::allocate(size_t size, size_t alignment)
+{
+	size_t alignedOffset = (offset + alignment - 1) & ~(alignment - 1);
+
+	if (alignedOffset + size <= blockSize)
+	{
+		offset = alignedOffset + size;
+		return block + alignedOffset;
+	}
+
+	//malloc aligns to max_align_t, more than that is not needed by anything the frames allocate
+	void* memory = std::malloc(std::max<size_t>(size, 1));
+
+	if (memory == nullptr)
+		throw std::bad_alloc();
+
+	//Once per size the frames grow to, the next reset makes the block big enough
+	{
+		AllowAllocations allowAllocations;
+		overflowAllocations.push_back(memory);
+	}
+
+	overflowBytes += size;
+
+	return memory;
+}
+
+void FrameArena::reset()
+{
+	peakBytes = std::max(peakBytes, getUsedBytes());
+
+	if (!overflowAllocations.empty())
+	{
+		for (void* memory : overflowAllocations)
+			std::free(memory);
+
+		overflowAllocations.clear();
+		overflowBytes = 0;
+
+		//The next frame that needs as much fits in the block, with room for the alignment padding
+		size_t newSize = std::max(blockSize * 2, peakBytes + peakBytes / 4);
+		char* newBlock = static_cast<char*>(std::malloc(newSize));
+
+		if (newBlock != nullptr)
+		{
+			std::free(block);
+			block = newBlock;
+			blockSize = newSize;
+		}
+	}
+
+	offset = 0;
+}
+
+size_t FrameArena::getUsedBytes() const
+{
+	return offset + overflowBytes;
+}
+
+size_t FrameArena::getPeakBytes() const
+{
+	return peakBytes;
+}
+
+size_t FrameArena::getCapacity() const
+{
+	return blockSize;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include<vector>
+#include<cstddef>
+#include<cstdint>
+
+//Bump allocator for the scratch memory of one frame in flight. Allocations are never freed one by one,
+//the whole arena is reset once the frame's fence has signaled. Whatever did not fit in the block
+//(the first frames, a frame bigger than any before it) is allocated on the side, and the next reset
+//grows the block so that the steady state does not touch the heap
+class FrameArena
+{
+private:
+	static const size_t MIN_BLOCK_SIZE = 64 * 1024;
+
+	char* block = nullptr;
+	size_t blockSize = 0;
+	size_t offset = 0;
+
+	std::vector<void*> overflowAllocations;
+	size_t overflowBytes = 0;
+
+	size_t peakBytes = 0;
+
+public:
+	explicit FrameArena(size_t initialSize = MIN_BLOCK_SIZE);
+	~FrameArena();
+
+	FrameArena(const FrameArena&) = delete;
+	FrameArena& operator=(const FrameArena&) = delete;
+
+	//"alignment" has to be a power of 2
+	void* allocate(size_t size, size_t alignment);
+
+	//Everything allocated since the last reset is gone
+	void reset();
+
+	size_t getUsedBytes() const;
+	size_t getPeakBytes() const;
+	size_t getCapacity() const;
+};
+
+//STL allocator on top of a FrameArena, containers using it must not outlive the frame
+template<typename T>
+class ArenaAllocator
+{
+private:
+	FrameArena* arena;
+
+	template<typename U> friend class ArenaAllocator;
+
+public:
+	using value_type = T;
+
+	explicit ArenaAllocator(FrameArena& arena) : arena{ &arena } {}
+
+	template<typename U>
+	ArenaAllocator(const ArenaAllocator<U>& other) : arena{ other.arena } {}
+
+	T* allocate(size_t count)
+	{
+		return static_cast<T*>(arena->allocate(count * sizeof(T), alignof(T)));
+	}
+
+	//Freed with the rest of the arena
+	void deallocate(T*, size_t) {}
+
+	template<typename U>
+	bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+
+	template<typename U>
+	bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+};
+
+template<typename T>
+using FrameVector = std::vector<T, ArenaAllocator<T>>;
@@ -0,0 +1,290 @@
+#include "FrameReadback.h"
+#include "AllocationCounter.h"
+#include "DebugUtils.h"
+
+#ifdef _WIN32
+#include<io.h>
+#include<fcntl.h>
+#endif
+
+FrameReadback::~FrameReadback()
+{
+	stop();
+}
+
+void FrameReadback::start(VkDevice device, MemoryBudget* memoryBudget, VkExtent2D extent, VkFormat imageFormat,
+	const std::string& path, ReadbackFormat format)
+{
+	if (slots)
+		return;
+
+	switch (imageFormat)
+	{
+	case VK_FORMAT_B8G8R8A8_UNORM:
+	case VK_FORMAT_B8G8R8A8_SRGB:	bgra = true; break;
+	case VK_FORMAT_R8G8B8A8_UNORM:
+	case VK_FORMAT_R8G8B8A8_SRGB:	bgra = false; break;
+	default:
+		throw std::runtime_error("Frame readback needs an 8 bit RGBA or BGRA image!");
+	}
+
+	this->device = device;
+	this->memoryBudget = memoryBudget;
+	this->extent = extent;
+	this->format = format;
+
+	frameSize = (VkDeviceSize)extent.width * extent.height * 4;
+
+	//************************** OUTPUT *****************************
+	if (path == "-")
+	{
+		output = stdout;
+
+#ifdef _WIN32
+		//Text mode would turn every 0x0A byte into 0x0D 0x0A
+		_setmode(_fileno(stdout), _O_BINARY);
+#endif
+	}
+	else
+	{
+		output = fopen(path.c_str(), "wb");
+
+		if (output == nullptr)
+			throw std::runtime_error("Failed to open the frame readback output " + path + "!");
+	}
+
+	rowBuffer.resize((size_t)extent.width * 3);
+
+	//************************** SLOTS *****************************
+	slots.reset(new Slot[SLOT_COUNT]);
+
+	for (size_t i = 0; i < SLOT_COUNT; i++)
+	{
+		Slot& slot = slots[i];
+
+		VkBufferCreateInfo bufferCreateInfo = {};
+		bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		bufferCreateInfo.pNext = nullptr;
+		bufferCreateInfo.size = frameSize;
+		bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		if (vkCreateBuffer(device, &bufferCreateInfo, getHostAllocator(), &slot.buffer) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create a frame readback buffer!");
+
+		VkMemoryRequirements memReqs;
+		vkGetBufferMemoryRequirements(device, slot.buffer, &memReqs);
+
+		//Cached memory is read much faster by the CPU, it just has to be invalidated first
+		slot.memory = memoryBudget->allocate(memReqs, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+
+		vkBindBufferMemory(device, slot.buffer, slot.memory, 0);
+		vkMapMemory(device, slot.memory, 0, frameSize, 0, &slot.mapping);
+
+		setDebugName(device, VK_OBJECT_TYPE_BUFFER, (uint64_t)slot.buffer, ("Readback " + std::to_string(i)).c_str());
+	}
+
+	for (uint32_t& frameSlot : frameSlots)
+		frameSlot = NO_SLOT;
+
+	nextSlot = 0;
+	writeSlot = 0;
+	writtenFrames = 0;
+	droppedFrames = 0;
+	writeFailed = false;
+
+	running = true;
+	writerThread = std::thread(&FrameReadback::writerLoop, this);
+}
+
+void FrameReadback::stop()
+{
+	if (!slots)
+		return;
+
+	//With the device idle every copy recorded is done
+	for (uint32_t frame = 0; frame < MAX_FRAME_COUNT; frame++)
+		completeFrame(frame);
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		running = false;
+	}
+
+	slotReady.notify_one();
+	writerThread.join();
+
+	for (size_t i = 0; i < SLOT_COUNT; i++)
+	{
+		vkUnmapMemory(device, slots[i].memory);
+		vkDestroyBuffer(device, slots[i].buffer, getHostAllocator());
+		memoryBudget->free(slots[i].memory);
+	}
+
+	slots.reset();
+
+	if (output != stdout)
+		fclose(output);
+	else
+		fflush(output);
+
+	output = nullptr;
+
+	//stdout may be the stream itself
+	fprintf(stderr, "READBACK: %llu frames written, %llu dropped%s\n", (unsigned long long)writtenFrames.load(),
+		(unsigned long long)droppedFrames.load(), (writeFailed) ? ", the output failed" : "");
+}
+
+bool FrameReadback::isRunning() const
+{
+	return slots != nullptr;
+}
+
+void FrameReadback::completeFrame(uint32_t frame)
+{
+	uint32_t slot = frameSlots[frame];
+
+	if (slot == NO_SLOT)
+		return;
+
+	frameSlots[frame] = NO_SLOT;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		slots[slot].state = SlotState::Ready;
+	}
+
+	slotReady.notify_one();
+}
+
+void FrameReadback::recordCopy(VkCommandBuffer commandBuffer, VkImage image, uint32_t frame)
+{
+	frameSlots[frame] = NO_SLOT;
+
+	//Slots are handed out and written in order, the next one is free unless the writer is behind
+	Slot& slot = slots[nextSlot];
+
+	if (slot.state.load() != SlotState::Free)
+	{
+		droppedFrames++;
+		return;
+	}
+
+	VkBufferImageCopy region = {};
+	region.bufferOffset = 0;
+	region.bufferRowLength = 0;				//Tightly packed
+	region.bufferImageHeight = 0;
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.mipLevel = 0;
+	region.imageSubresource.baseArrayLayer = 0;
+	region.imageSubresource.layerCount = 1;
+	region.imageOffset = { 0, 0, 0 };
+	region.imageExtent = { extent.width, extent.height, 1 };
+
+	vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.buffer, 1, &region);
+
+	//Makes the copy visible to the host once the fence signals
+	VkBufferMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.pNext = nullptr;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer = slot.buffer;
+	barrier.offset = 0;
+	barrier.size = VK_WHOLE_SIZE;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+		0, nullptr, 1, &barrier, 0, nullptr);
+
+	slot.state = SlotState::Recorded;
+	frameSlots[frame] = (uint32_t)nextSlot;
+	nextSlot = (nextSlot + 1) % SLOT_COUNT;
+}
+
+uint64_t FrameReadback::getWrittenFrameCount() const
+{
+	return writtenFrames;
+}
+
+uint64_t FrameReadback::getDroppedFrameCount() const
+{
+	return droppedFrames;
+}
+
+void FrameReadback::writeFrame(const Slot& slot)
+{
+	VkMappedMemoryRange range = {};
+	range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+	range.pNext = nullptr;
+	range.memory = slot.memory;
+	range.offset = 0;
+	range.size = VK_WHOLE_SIZE;
+
+	vkInvalidateMappedMemoryRanges(device, 1, &range);
+
+	const uint8_t* pixels = static_cast<const uint8_t*>(slot.mapping);
+	bool written = true;
+
+	if (format == ReadbackFormat::Raw)
+	{
+		written = fwrite(pixels, 1, (size_t)frameSize, output) == frameSize;
+	}
+	else
+	{
+		written = fprintf(output, "P6\n%u %u\n255\n", extent.width, extent.height) > 0;
+
+		size_t red = (bgra) ? 2 : 0;
+		size_t blue = (bgra) ? 0 : 2;
+
+		for (uint32_t y = 0; y < extent.height && written; y++)
+		{
+			const uint8_t* row = pixels + (size_t)y * extent.width * 4;
+
+			for (uint32_t x = 0; x < extent.width; x++)
+			{
+				rowBuffer[x * 3 + 0] = row[x * 4 + red];
+				rowBuffer[x * 3 + 1] = row[x * 4 + 1];
+				rowBuffer[x * 3 + 2] = row[x * 4 + blue];
+			}
+
+			written = fwrite(rowBuffer.data(), 1, rowBuffer.size(), output) == rowBuffer.size();
+		}
+	}
+
+	//A pipe reader sees every frame as soon as it is complete
+	written = written && fflush(output) == 0;
+
+	if (written)
+		writtenFrames++;
+	else
+		writeFailed = true;
+}
+
+void FrameReadback::writerLoop()
+{
+	//The thread is not part of the frame loop, what it allocates is never a frame's
+	AllowAllocations allowAllocations;
+
+	while (true)
+	{
+		Slot& slot = slots[writeSlot];
+
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			slotReady.wait(lock, [&]() { return slot.state == SlotState::Ready || !running; });
+
+			//stop() completes every frame before it stops the writer, nothing is left behind
+			if (slot.state != SlotState::Ready)
+				return;
+		}
+
+		//Once the output failed the frames are still consumed, so the renderer does not start dropping
+		if (!writeFailed)
+			writeFrame(slot);
+
+		slot.state = SlotState::Free;
+		writeSlot = (writeSlot + 1) % SLOT_COUNT;
+	}
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include<vulkan/vulkan.h>
+#include<atomic>
+#include<thread>
+#include<mutex>
+#include<condition_variable>
+#include<memory>
+#include<vector>
+#include<string>
+#include<cstdio>
+#include<stdexcept>
+#include "MemoryBudget.h"
+#include "Utilities.h"
+
+enum class ReadbackFormat
+{
+	Raw,		//The bytes of the swapchain image, row after row (BGRA or RGBA, as the swapchain is)
+	Ppm			//Binary PPM (P6) images one after the other, what "ffmpeg -f image2pipe -c:v ppm" reads
+};
+
+//Copies every finished frame into a ring of persistently mapped host buffers, and a writer thread streams
+//them to a file or to stdout ("-"). The copy is recorded at the end of the frame and the slot is handed to
+//the writer once the frame's fence has signaled, so the render loop never waits for the disk or the pipe.
+//When the writer falls behind and every slot is taken the frame is dropped, the count is printed at stop
+class FrameReadback
+{
+private:
+	//Frames in flight plus the ones the writer can be behind
+	static const size_t SLOT_COUNT = MAX_FRAME_COUNT + 2;
+	static const uint32_t NO_SLOT = ~0u;
+
+	enum class SlotState
+	{
+		Free,
+		Recorded,		//The copy is in a command buffer that may not have finished yet
+		Ready			//The copy is done, waiting for the writer
+	};
+
+	struct Slot
+	{
+		VkBuffer buffer = VK_NULL_HANDLE;
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		void* mapping = nullptr;
+		std::atomic<SlotState> state{ SlotState::Free };
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	MemoryBudget* memoryBudget = nullptr;
+	VkExtent2D extent = {};
+	VkDeviceSize frameSize = 0;
+	bool bgra = false;
+	ReadbackFormat format = ReadbackFormat::Raw;
+
+	std::unique_ptr<Slot[]> slots;
+	size_t nextSlot = 0;							//Only the render thread uses it
+	size_t writeSlot = 0;							//Only the writer uses it
+	uint32_t frameSlots[MAX_FRAME_COUNT];			//Slot each frame in flight copied to, or NO_SLOT
+
+	FILE* output = nullptr;
+	std::vector<uint8_t> rowBuffer;					//One row converted to RGB for the PPM images
+
+	std::thread writerThread;
+	std::mutex mutex;
+	std::condition_variable slotReady;
+	bool running = false;							//Guarded by mutex
+
+	std::atomic<uint64_t> writtenFrames{ 0 };
+	std::atomic<uint64_t> droppedFrames{ 0 };
+	bool writeFailed = false;						//Only the writer uses it until stop
+
+	void writeFrame(const Slot& slot);
+	void writerLoop();
+
+public:
+	FrameReadback() = default;
+	~FrameReadback();
+
+	FrameReadback(const FrameReadback&) = delete;
+	FrameReadback& operator=(const FrameReadback&) = delete;
+
+	//The images copied have to be "extent" big, with an 8 bit RGBA or BGRA "imageFormat"
+	void start(VkDevice device, MemoryBudget* memoryBudget, VkExtent2D extent, VkFormat imageFormat,
+		const std::string& path, ReadbackFormat format);
+
+	//Writes what the finished frames copied, the device has to be idle
+	void stop();
+
+	bool isRunning() const;
+
+	//Once the fence of "frame" has signaled, hands what it copied to the writer
+	void completeFrame(uint32_t frame);
+
+	//Copies "image" (in VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL) into the next free slot, or drops the frame
+	void recordCopy(VkCommandBuffer commandBuffer, VkImage image, uint32_t frame);
+
+	uint64_t getWrittenFrameCount() const;
+	uint64_t getDroppedFrameCount() const;
+};
@@ -0,0 +1,264 @@
+#include "HostAllocator.h"
+#include<cstdlib>
+#include<cstring>
+#include<algorithm>
+#include<stdexcept>
+#include "Utilities.h"
+
+namespace
+{
+	const char* SCOPE_NAMES[] = { "command", "object", "cache", "device", "instance" };
+
+	size_t getSizeClassSize(size_t sizeClass)
+	{
+		return (size_t)32 << sizeClass;
+	}
+}
+
+HostAllocator::HostAllocator()
+{
+	callbacks.pUserData = this;
+	callbacks.pfnAllocation = allocationFunction;
+	callbacks.pfnReallocation = reallocationFunction;
+	callbacks.pfnFree = freeFunction;
+	callbacks.pfnInternalAllocation = internalAllocationNotification;
+	callbacks.pfnInternalFree = internalFreeNotification;
+
+	scopes[VK_SYSTEM_ALLOCATION_SCOPE_COMMAND].backend = HostAllocatorBackend::Pool;
+	scopes[VK_SYSTEM_ALLOCATION_SCOPE_OBJECT].backend = HostAllocatorBackend::Pool;
+}
+
+HostAllocator::~HostAllocator()
+{
+	for (auto& sizeClass : sizeClasses)
+		for (void* chunk : sizeClass.chunks)
+			std::free(chunk);
+}
+
+void* HostAllocator::allocateBlock(size_t sizeClass)
+{
+	SizeClass& pool = sizeClasses[sizeClass];
+	std::lock_guard<std::mutex> lock(pool.mutex);
+
+	if (pool.freeBlocks.empty())
+	{
+		//A new chunk is cut in blocks of header + size class, all of them 16 byte aligned
+		size_t blockSize = sizeof(Header) + getSizeClassSize(sizeClass);
+		char* chunk = static_cast<char*>(std::malloc(CHUNK_SIZE));
+
+		if (chunk == nullptr)
+			return nullptr;
+
+		pool.chunks.push_back(chunk);
+
+		for (size_t offset = 0; offset + blockSize <= CHUNK_SIZE; offset += blockSize)
+			pool.freeBlocks.push_back(chunk + offset);
+	}
+
+	void* block = pool.freeBlocks.back();
+	pool.freeBlocks.pop_back();
+
+	return block;
+}
+
+void* HostAllocator::allocate(size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+	if (size == 0)
+		return nullptr;
+
+	alignment = std::max(alignment, sizeof(Header));
+
+	Scope& scopeStats = scopes[scope];
+	Header* header = nullptr;
+
+	size_t sizeClass = 0;
+
+	while (sizeClass < SIZE_CLASS_COUNT && getSizeClassSize(sizeClass) < size)
+		sizeClass++;
+
+	if (scopeStats.backend == HostAllocatorBackend::Pool && sizeClass < SIZE_CLASS_COUNT && alignment == sizeof(Header))
+	{
+		header = static_cast<Header*>(allocateBlock(sizeClass));
+
+		if (header == nullptr)
+			return nullptr;
+
+		header->offset = 0;
+		header->sizeClass = (uint16_t)sizeClass;
+	}
+	else
+	{
+		//Room for the header and for moving the allocation up to the alignment
+		char* block = static_cast<char*>(std::malloc(size + alignment + sizeof(Header)));
+
+		if (block == nullptr)
+			return nullptr;
+
+		uintptr_t memory = ((uintptr_t)block + sizeof(Header) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+
+		header = reinterpret_cast<Header*>(memory) - 1;
+		header->offset = (uint32_t)((char*)header - block);
+		header->sizeClass = (uint16_t)SIZE_CLASS_COUNT;
+	}
+
+	header->size = size;
+	header->scope = (uint8_t)scope;
+
+	uint64_t bytes = scopeStats.bytes.fetch_add(size) + size;
+	uint64_t peak = scopeStats.peakBytes.load();
+
+	while (bytes > peak && !scopeStats.peakBytes.compare_exchange_weak(peak, bytes));
+
+	scopeStats.count++;
+	scopeStats.totalAllocations++;
+
+	return header + 1;
+}
+
+void* HostAllocator::reallocate(void* original, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+	if (original == nullptr)
+		return allocate(size, alignment, scope);
+
+	if (size == 0)
+	{
+		free(original);
+		return nullptr;
+	}
+
+	Header* header = static_cast<Header*>(original) - 1;
+
+	//The block is big enough already
+	if (header->sizeClass < SIZE_CLASS_COUNT && size <= getSizeClassSize(header->sizeClass) && header->scope == scope)
+	{
+		Scope& scopeStats = scopes[scope];
+		scopeStats.bytes += size;
+		scopeStats.bytes -= header->size;
+		scopeStats.totalAllocations++;
+
+		header->size = size;
+
+		return original;
+	}
+
+	void* memory = allocate(size, alignment, scope);
+
+	if (memory == nullptr)
+		return nullptr;
+
+	memcpy(memory, original, (size_t)std::min<uint64_t>(size, header->size));
+	free(original);
+
+	return memory;
+}
+
+void HostAllocator::free(void* memory)
+{
+	if (memory == nullptr)
+		return;
+
+	Header* header = static_cast<Header*>(memory) - 1;
+	Scope& scopeStats = scopes[header->scope];
+
+	scopeStats.bytes -= header->size;
+	scopeStats.count--;
+
+	if (header->sizeClass < SIZE_CLASS_COUNT)
+	{
+		SizeClass& pool = sizeClasses[header->sizeClass];
+		std::lock_guard<std::mutex> lock(pool.mutex);
+
+		pool.freeBlocks.push_back(header);
+	}
+	else
+	{
+		std::free(reinterpret_cast<char*>(header) - header->offset);
+	}
+}
+
+VKAPI_ATTR void* VKAPI_CALL HostAllocator::allocationFunction(void* userData, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+	return static_cast<HostAllocator*>(userData)->allocate(size, alignment, scope);
+}
+
+VKAPI_ATTR void* VKAPI_CALL HostAllocator::reallocationFunction(void* userData, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+	return static_cast<HostAllocator*>(userData)->reallocate(original, size, alignment, scope);
+}
+
+VKAPI_ATTR void VKAPI_CALL HostAllocator::freeFunction(void* userData, void* memory)
+{
+	static_cast<HostAllocator*>(userData)->free(memory);
+}
+
+VKAPI_ATTR void VKAPI_CALL HostAllocator::internalAllocationNotification(void* userData, size_t size, VkInternalAllocationType /*type*/, VkSystemAllocationScope scope)
+{
+	static_cast<HostAllocator*>(userData)->scopes[scope].internalBytes += size;
+}
+
+VKAPI_ATTR void VKAPI_CALL HostAllocator::internalFreeNotification(void* userData, size_t size, VkInternalAllocationType /*type*/, VkSystemAllocationScope scope)
+{
+	static_cast<HostAllocator*>(userData)->scopes[scope].internalBytes -= size;
+}
+
+const VkAllocationCallbacks* HostAllocator::getCallbacks() const
+{
+	return &callbacks;
+}
+
+void HostAllocator::setBackend(VkSystemAllocationScope scope, HostAllocatorBackend backend)
+{
+	if (scopes[scope].count != 0)
+		throw std::runtime_error("Changing the backend of a host allocation scope in use!");
+
+	scopes[scope].backend = backend;
+}
+
+HostAllocationStats HostAllocator::getStatistics(VkSystemAllocationScope scope) const
+{
+	const Scope& scopeStats = scopes[scope];
+
+	HostAllocationStats stats;
+	stats.bytes = scopeStats.bytes;
+	stats.count = scopeStats.count;
+	stats.peakBytes = scopeStats.peakBytes;
+	stats.totalAllocations = scopeStats.totalAllocations;
+	stats.internalBytes = scopeStats.internalBytes;
+
+	return stats;
+}
+
+uint64_t HostAllocator::getFrameAllocations(VkSystemAllocationScope scope) const
+{
+	return scopes[scope].totalAllocations - scopes[scope].frameStartAllocations;
+}
+
+void HostAllocator::beginFrame()
+{
+	for (auto& scope : scopes)
+		scope.frameStartAllocations = scope.totalAllocations.load();
+}
+
+void HostAllocator::printStatistics(std::ostream& stream) const
+{
+	for (size_t i = 0; i < SCOPE_COUNT; i++)
+	{
+		HostAllocationStats stats = getStatistics((VkSystemAllocationScope)i);
+
+		stream << SCOPE_NAMES[i] << ": " << stats.bytes << " bytes in " << stats.count << " allocations (peak "
+			<< stats.peakBytes << ", " << stats.totalAllocations << " total, "
+			<< getFrameAllocations((VkSystemAllocationScope)i) << " this frame, "
+			<< stats.internalBytes << " internal)\n";
+	}
+}
+
+HostAllocator& getHostAllocatorInstance()
+{
+	static HostAllocator hostAllocator;
+	return hostAllocator;
+}
+
+const VkAllocationCallbacks* getHostAllocator()
+{
+	return (enableHostAllocator) ? getHostAllocatorInstance().getCallbacks() : nullptr;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include<vulkan/vulkan.h>
+#include<atomic>
+#include<mutex>
+#include<vector>
+#include<ostream>
+
+enum class HostAllocatorBackend
+{
+	Heap,		//malloc, any size and alignment
+	Pool		//Size classes carved out of 64KB chunks, blocks are reused and never go back to the heap
+};
+
+struct HostAllocationStats
+{
+	uint64_t bytes = 0;					//Live bytes
+	uint64_t count = 0;					//Live allocations
+	uint64_t peakBytes = 0;
+	uint64_t totalAllocations = 0;		//Allocations (and reallocations) since the start
+	uint64_t internalBytes = 0;			//Reported by the driver, allocated without the callbacks
+};
+
+//Host memory the driver allocates through VkAllocationCallbacks. Every allocation is counted by its
+//VkSystemAllocationScope, and each scope can use its own backend: commands and objects allocate and free
+//small blocks all the time, so they use the pools by default.
+//
+//The callbacks given to a vkCreate* call have to be given to its vkDestroy* too, so every call uses the
+//ones of getHostAllocator()
+class HostAllocator
+{
+private:
+	static const size_t SCOPE_COUNT = VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1;
+	static const size_t SIZE_CLASS_COUNT = 7;		//32 bytes to 2KB
+	static const size_t CHUNK_SIZE = 64 * 1024;
+
+	struct Scope
+	{
+		std::atomic<uint64_t> bytes{ 0 };
+		std::atomic<uint64_t> count{ 0 };
+		std::atomic<uint64_t> peakBytes{ 0 };
+		std::atomic<uint64_t> totalAllocations{ 0 };
+		std::atomic<uint64_t> frameStartAllocations{ 0 };
+		std::atomic<uint64_t> internalBytes{ 0 };
+		std::atomic<HostAllocatorBackend> backend{ HostAllocatorBackend::Heap };
+	};
+
+	struct SizeClass
+	{
+		std::mutex mutex;
+		std::vector<void*> freeBlocks;
+		std::vector<void*> chunks;
+	};
+
+	//Stored right before every allocation
+	struct Header
+	{
+		uint64_t size;
+		uint32_t offset;		//From the start of the malloc block (heap backend)
+		uint16_t sizeClass;		//SIZE_CLASS_COUNT for the heap backend
+		uint8_t scope;
+		uint8_t padding;
+	};
+
+	Scope scopes[SCOPE_COUNT];
+	SizeClass sizeClasses[SIZE_CLASS_COUNT];
+	VkAllocationCallbacks callbacks = {};
+
+	void* allocate(size_t size, size_t alignment, VkSystemAllocationScope scope);
+	void* reallocate(void* original, size_t size, size_t alignment, VkSystemAllocationScope scope);
+	void free(void* memory);
+
+	void* allocateBlock(size_t sizeClass);
+
+	static VKAPI_ATTR void* VKAPI_CALL allocationFunction(void* userData, size_t size, size_t alignment, VkSystemAllocationScope scope);
+	static VKAPI_ATTR void* VKAPI_CALL reallocationFunction(void* userData, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope);
+	static VKAPI_ATTR void VKAPI_CALL freeFunction(void* userData, void* memory);
+	static VKAPI_ATTR void VKAPI_CALL internalAllocationNotification(void* userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope);
+	static VKAPI_ATTR void VKAPI_CALL internalFreeNotification(void* userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope);
+
+public:
+	HostAllocator();
+	~HostAllocator();
+
+	HostAllocator(const HostAllocator&) = delete;
+	HostAllocator& operator=(const HostAllocator&) = delete;
+
+	const VkAllocationCallbacks* getCallbacks() const;
+
+	//Only for scopes that have nothing allocated yet
+	void setBackend(VkSystemAllocationScope scope, HostAllocatorBackend backend);
+
+	HostAllocationStats getStatistics(VkSystemAllocationScope scope) const;
+
+	//Allocations made in the scope since the last beginFrame, anything but 0 in the frame loop is churn
+	uint64_t getFrameAllocations(VkSystemAllocationScope scope) const;
+	void beginFrame();
+
+	void printStatistics(std::ostream& stream) const;
+};
+
+//The allocator every Vulkan call uses (its callbacks, nullptr when enableHostAllocator is false)
+HostAllocator& getHostAllocatorInstance();
+const VkAllocationCallbacks* getHostAllocator();
@@ -0,0 +1,304 @@
+#include "MemoryBudget.h"
+#include<algorithm>
+
+namespace
+{
+	uint32_t countBits(uint32_t value)
+	{
+		uint32_t count = 0;
+
+		for (; value != 0; value &= value - 1)
+			count++;
+
+		return count;
+	}
+}
+
+MemoryBudget::MemoryBudget(const DeviceCapabilities& capabilities, VkDevice device, bool budgetExtensionEnabled) :
+	physicalDevice{ capabilities.physicalDevice }, device{ device }, budgetExtensionEnabled{ budgetExtensionEnabled },
+	memoryProperties{ capabilities.memoryProperties }
+{
+	heapBudgets.assign(memoryProperties.memoryHeapCount, 0);
+	heapUsages.assign(memoryProperties.memoryHeapCount, 0);
+	externalUsages.assign(memoryProperties.memoryHeapCount, 0);
+
+	pollBudget();
+}
+
+std::vector<uint32_t> MemoryBudget::rankMemoryTypes(uint32_t allowedTypes, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred) const
+{
+	std::vector<uint32_t> types;
+
+	for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+		if ((allowedTypes & (1u << i)) && (memoryProperties.memoryTypes[i].propertyFlags & required) == required)
+			types.push_back(i);
+
+	//Ties keep the order of the device, which lists the faster types first
+	std::stable_sort(types.begin(), types.end(), [&](uint32_t a, uint32_t b)
+	{
+		VkMemoryPropertyFlags flagsA = memoryProperties.memoryTypes[a].propertyFlags;
+		VkMemoryPropertyFlags flagsB = memoryProperties.memoryTypes[b].propertyFlags;
+
+		uint32_t preferredA = countBits(flagsA & preferred);
+		uint32_t preferredB = countBits(flagsB & preferred);
+
+		if (preferredA != preferredB)
+			return preferredA > preferredB;
+
+		return countBits(flagsA & ~(required | preferred)) < countBits(flagsB & ~(required | preferred));
+	});
+
+	return types;
+}
+
+uint32_t MemoryBudget::findMemoryType(uint32_t allowedTypes, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred) const
+{
+	std::vector<uint32_t> types = rankMemoryTypes(allowedTypes, required, preferred);
+
+	if (types.empty())
+		throw std::runtime_error("Failed to find a suitable memory type!");
+
+	for (uint32_t type : types)
+		if (getAvailable(memoryProperties.memoryTypes[type].heapIndex) > 0)
+			return type;
+
+	return types.front();
+}
+
+bool MemoryBudget::makeRoom(uint32_t heap, VkDeviceSize size)
+{
+	if (getAvailable(heap) >= size)
+		return true;
+
+	//Resources of this heap the frames in flight do not use, the least recently used first
+	std::vector<MemoryResource> candidates;
+
+	for (MemoryResource i = 0; i < resources.size(); i++)
+	{
+		const Resource& resource = resources[i];
+
+		if (!resource.evict || resource.lastUsedFrame + MAX_FRAME_COUNT > frameNumber)
+			continue;
+
+		auto allocation = allocations.find(resource.memory);
+
+		if (allocation != allocations.end() && allocation->second.heap == heap)
+			candidates.push_back(i);
+	}
+
+	std::sort(candidates.begin(), candidates.end(), [&](MemoryResource a, MemoryResource b)
+	{
+		return resources[a].lastUsedFrame < resources[b].lastUsedFrame;
+	});
+
+	for (MemoryResource candidate : candidates)
+	{
+		if (getAvailable(heap) >= size)
+			break;
+
+		//The callback frees the memory and unregisters the resource, so it is copied first
+		std::function<void()> evict = resources[candidate].evict;
+
+		if (evict)
+			evict();
+	}
+
+	return getAvailable(heap) >= size;
+}
+
+VkDeviceMemory MemoryBudget::allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred)
+{
+	std::vector<uint32_t> types = rankMemoryTypes(requirements.memoryTypeBits, required, preferred);
+
+	if (types.empty())
+		throw std::runtime_error("Failed to find a suitable memory type!");
+
+	VkMemoryAllocateInfo memAllocInfo = {};
+	memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	memAllocInfo.pNext = nullptr;
+	memAllocInfo.allocationSize = requirements.size;
+
+	for (size_t i = 0; i < types.size(); i++)
+	{
+		uint32_t heap = memoryProperties.memoryTypes[types[i]].heapIndex;
+
+		//A type over its budget is skipped while there are others left to try, the last one is
+		//tried anyway since the budget is only an estimate of what the heap can hold
+		if (!makeRoom(heap, requirements.size) && i + 1 < types.size())
+			continue;
+
+		memAllocInfo.memoryTypeIndex = types[i];
+
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkResult result = vkAllocateMemory(device, &memAllocInfo, getHostAllocator(), &memory);
+
+		if (result == VK_ERROR_OUT_OF_DEVICE_MEMORY || result == VK_ERROR_OUT_OF_HOST_MEMORY)
+		{
+			//The budget was wrong, everything that can go goes and the allocation is tried again
+			makeRoom(heap, heapBudgets[heap]);
+			result = vkAllocateMemory(device, &memAllocInfo, getHostAllocator(), &memory);
+		}
+
+		if (result == VK_SUCCESS)
+		{
+			allocations[memory] = { heap, requirements.size };
+			heapUsages[heap] += requirements.size;
+
+			return memory;
+		}
+	}
+
+	throw std::runtime_error("Failed to allocate device memory!");
+}
+
+void MemoryBudget::free(VkDeviceMemory memory)
+{
+	if (memory == VK_NULL_HANDLE)
+		return;
+
+	auto allocation = allocations.find(memory);
+
+	if (allocation == allocations.end())
+		throw std::runtime_error("Freeing memory that was not allocated by the memory budget!");
+
+	heapUsages[allocation->second.heap] -= allocation->second.size;
+	allocations.erase(allocation);
+
+	vkFreeMemory(device, memory, getHostAllocator());
+}
+
+void MemoryBudget::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred,
+	VkBuffer& buffer, VkDeviceMemory& memory)
+{
+	VkBufferCreateInfo bufferCreateInfo = {};
+	bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferCreateInfo.pNext = nullptr;
+	bufferCreateInfo.flags = 0;
+	bufferCreateInfo.size = size;
+	bufferCreateInfo.usage = usage;
+	bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	bufferCreateInfo.queueFamilyIndexCount = 0;
+	bufferCreateInfo.pQueueFamilyIndices = nullptr;
+
+	if (vkCreateBuffer(device, &bufferCreateInfo, getHostAllocator(), &buffer) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create a buffer!");
+
+	VkMemoryRequirements memReqs = {};
+	vkGetBufferMemoryRequirements(device, buffer, &memReqs);
+
+	try
+	{
+		memory = allocate(memReqs, required, preferred);
+	}
+	catch (...)
+	{
+		vkDestroyBuffer(device, buffer, getHostAllocator());
+		buffer = VK_NULL_HANDLE;
+		throw;
+	}
+
+	vkBindBufferMemory(device, buffer, memory, 0);
+}
+
+void MemoryBudget::pollBudget()
+{
+	if (budgetExtensionEnabled)
+	{
+		VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties = {};
+		budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+		VkPhysicalDeviceMemoryProperties2 properties = {};
+		properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+		properties.pNext = &budgetProperties;
+
+		vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &properties);
+
+		//The usage reported includes the allocations made here, the rest is somebody else's
+		for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++)
+		{
+			heapBudgets[i] = budgetProperties.heapBudget[i];
+			externalUsages[i] = (budgetProperties.heapUsage[i] > heapUsages[i]) ? budgetProperties.heapUsage[i] - heapUsages[i] : 0;
+		}
+	}
+	else
+	{
+		for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++)
+			heapBudgets[i] = memoryProperties.memoryHeaps[i].size / 5 * 4;
+	}
+}
+
+void MemoryBudget::beginFrame()
+{
+	frameNumber++;
+	pollBudget();
+}
+
+uint64_t MemoryBudget::getFrameNumber() const
+{
+	return frameNumber;
+}
+
+MemoryResource MemoryBudget::registerResource(VkDeviceMemory memory, std::function<void()> evict)
+{
+	MemoryResource resource;
+
+	if (!freeResources.empty())
+	{
+		resource = freeResources.back();
+		freeResources.pop_back();
+	}
+	else
+	{
+		resource = (MemoryResource)resources.size();
+		resources.emplace_back();
+	}
+
+	resources[resource].memory = memory;
+	resources[resource].lastUsedFrame = frameNumber;
+	resources[resource].evict = std::move(evict);
+
+	return resource;
+}
+
+void MemoryBudget::unregisterResource(MemoryResource resource)
+{
+	resources.at(resource) = Resource{};
+	freeResources.push_back(resource);
+}
+
+void MemoryBudget::setResourceMemory(MemoryResource resource, VkDeviceMemory memory)
+{
+	resources.at(resource).memory = memory;
+}
+
+void MemoryBudget::touch(MemoryResource resource)
+{
+	resources.at(resource).lastUsedFrame = frameNumber;
+}
+
+uint32_t MemoryBudget::getHeapCount() const
+{
+	return memoryProperties.memoryHeapCount;
+}
+
+uint32_t MemoryBudget::getHeapIndex(VkMemoryPropertyFlags flags) const
+{
+	return memoryProperties.memoryTypes[findMemoryType(~0u, flags)].heapIndex;
+}
+
+VkDeviceSize MemoryBudget::getHeapBudget(uint32_t heap) const
+{
+	return heapBudgets.at(heap);
+}
+
+VkDeviceSize MemoryBudget::getHeapUsage(uint32_t heap) const
+{
+	return externalUsages.at(heap) + heapUsages.at(heap);
+}
+
+VkDeviceSize MemoryBudget::getAvailable(uint32_t heap) const
+{
+	VkDeviceSize usage = getHeapUsage(heap);
+
+	return (usage < heapBudgets.at(heap)) ? heapBudgets.at(heap) - usage : 0;
+}
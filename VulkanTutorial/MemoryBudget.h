@@ -0,0 +1,99 @@
+#pragma once
+
+#include<vulkan/vulkan.h>
+#include<vector>
+#include<unordered_map>
+#include<functional>
+#include<stdexcept>
+#include "Utilities.h"
+#include "DeviceCapabilities.h"
+
+using MemoryResource = uint32_t;
+
+//Allocations made through here are tracked, so the usage of each heap is known. The budget of the
+//heaps comes from VK_EXT_memory_budget when the device has it (otherwise 80% of the heap size) and is
+//polled once per frame.
+//
+//Resources that can be rebuilt later (streamed textures) register an eviction callback. When an allocation
+//would go over the budget of its heap, the least recently used of them are evicted first, and when the
+//allocation fails anyway it is tried again with the memory they freed and then with the other memory types.
+class MemoryBudget
+{
+private:
+	struct Allocation
+	{
+		uint32_t heap;
+		VkDeviceSize size;
+	};
+
+	struct Resource
+	{
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		uint64_t lastUsedFrame = 0;
+		std::function<void()> evict;		//Has to free the memory (and unregister the resource)
+	};
+
+	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+	VkDevice device = VK_NULL_HANDLE;
+	bool budgetExtensionEnabled = false;
+
+	VkPhysicalDeviceMemoryProperties memoryProperties = {};
+
+	//Per heap: the budget, the memory allocated here and the memory used by everything else (other
+	//processes, the swapchain...) the last time the budget was polled
+	std::vector<VkDeviceSize> heapBudgets;
+	std::vector<VkDeviceSize> heapUsages;
+	std::vector<VkDeviceSize> externalUsages;
+
+	std::unordered_map<VkDeviceMemory, Allocation> allocations;
+
+	std::vector<Resource> resources;
+	std::vector<MemoryResource> freeResources;
+
+	uint64_t frameNumber = 0;
+
+	//Memory types allowed by "allowedTypes" with all the "required" flags, the best ones first
+	std::vector<uint32_t> rankMemoryTypes(uint32_t allowedTypes, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred) const;
+
+	//Evicts the least recently used resources of the heap (not used by a frame in flight) until
+	//"size" bytes fit in its budget, returns false if they do not
+	bool makeRoom(uint32_t heap, VkDeviceSize size);
+
+	void pollBudget();
+
+public:
+	MemoryBudget() = default;
+
+	MemoryBudget(const DeviceCapabilities& capabilities, VkDevice device, bool budgetExtensionEnabled);
+
+	//Best memory type with all the "required" flags: the most "preferred" flags and the fewest other
+	//flags win, and types whose heap has room in its budget come before the rest
+	uint32_t findMemoryType(uint32_t allowedTypes, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred = 0) const;
+
+	VkDeviceMemory allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred = 0);
+	void free(VkDeviceMemory memory);
+
+	//Creates a buffer bound to the start of its own allocation. The memory is freed with free() once
+	//the buffer is destroyed
+	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred,
+		VkBuffer& buffer, VkDeviceMemory& memory);
+
+	//Called after waiting for the frame's fence
+	void beginFrame();
+	uint64_t getFrameNumber() const;
+
+	MemoryResource registerResource(VkDeviceMemory memory, std::function<void()> evict);
+	void unregisterResource(MemoryResource resource);
+
+	//The memory of a resource changed, it keeps its place in the LRU order
+	void setResourceMemory(MemoryResource resource, VkDeviceMemory memory);
+
+	//Marks the resource as used by the frame being recorded, it can not be evicted until that frame is done
+	void touch(MemoryResource resource);
+
+	uint32_t getHeapCount() const;
+	uint32_t getHeapIndex(VkMemoryPropertyFlags flags) const;
+	VkDeviceSize getHeapBudget(uint32_t heap) const;
+	VkDeviceSize getHeapUsage(uint32_t heap) const;
+	VkDeviceSize getAvailable(uint32_t heap) const;
+};
@@ -1,51 +1,171 @@
 #include "Mesh.h"
+#include<cstring>
+#include "MeshSimplifier.h"
+#include "MeshCodec.h"
 
-void Mesh::creaeVertexBuffer(std::vector<VertexData>& vertices)
+void* Mesh::createMappedBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer& buffer, VkDeviceMemory& memory)
 {
 	VkBufferCreateInfo bufferCreateInfo = {};
 	bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
 	bufferCreateInfo.pNext = nullptr;
 	bufferCreateInfo.flags = 0;
-	bufferCreateInfo.size = sizeof(VertexData) * vertexCount;
-	bufferCreateInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+	bufferCreateInfo.size = size;
+	bufferCreateInfo.usage = usage;
 	bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 	bufferCreateInfo.queueFamilyIndexCount = 0;
 	bufferCreateInfo.pQueueFamilyIndices = nullptr;
 
-	VkResult result = vkCreateBuffer(device, &bufferCreateInfo, nullptr, &vertexBuffer);
+	VkResult result = vkCreateBuffer(device, &bufferCreateInfo, getHostAllocator(), &buffer);
 
 	if (result != VK_SUCCESS)
-		throw std::runtime_error("Failed to create vertex buffer!");
+		throw std::runtime_error("Failed to create mesh buffer!");
 
 	VkMemoryRequirements memReqs = {};
-	vkGetBufferMemoryRequirements(device, vertexBuffer, &memReqs);
+	vkGetBufferMemoryRequirements(device, buffer, &memReqs);
 
-	VkMemoryAllocateInfo memAllocInfo = {};
-	memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	memAllocInfo.pNext = nullptr;
-	memAllocInfo.allocationSize = memReqs.size;
-	memAllocInfo.memoryTypeIndex = findMemoryIndex(memReqs.memoryTypeBits,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	//Written by the CPU, device local too if the device has such memory (resizable BAR)
+	memory = memoryBudget->allocate(memReqs, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-	result = vkAllocateMemory(device, &memAllocInfo, nullptr, &vertexMemory);
+	vkBindBufferMemory(device, buffer, memory, 0);
 
-	if (result != VK_SUCCESS)
-		throw std::runtime_error("Failed to allocate vertex buffer memory!");
+	void* data = nullptr;
 
-	vkBindBufferMemory(device, vertexBuffer, vertexMemory, 0);
+	vkMapMemory(device, memory, 0, size, 0, &data);
 
-	void* data = 0x00000000;
+	return data;
+}
 
-	vkMapMemory(device, vertexMemory, 0, memAllocInfo.allocationSize, 0, &data);
+void Mesh::creaeVertexBuffer(const std::vector<VertexData>& vertices)
+{
+	VkDeviceSize size = sizeof(VertexData) * vertexCount;
+	void* data = createMappedBuffer(size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vertexBuffer, vertexMemory);
 
-	memcpy(data, vertices.data(), (size_t)memAllocInfo.allocationSize);
+	memcpy(data, vertices.data(), (size_t)size);
 
 	vkUnmapMemory(device, vertexMemory);
 }
 
-Mesh::Mesh(VkPhysicalDevice physicalDevice, VkDevice device, std::vector<VertexData>& vertices) :
-	vertexCount{ vertices.size() }, physicalDevice{ physicalDevice }, device{ device } {
+void Mesh::createIndexBuffer(const std::vector<uint32_t>& indices)
+{
+	VkDeviceSize size = sizeof(uint32_t) * indices.size();
+	void* data = createMappedBuffer(size, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, indexBuffer, indexMemory);
+
+	memcpy(data, indices.data(), (size_t)size);
+
+	vkUnmapMemory(device, indexMemory);
+}
+
+std::vector<uint32_t> Mesh::generateLods(const std::vector<VertexData>& vertices, const std::vector<uint32_t>& indices)
+{
+	std::vector<uint32_t> allIndices = indices;
+	std::vector<uint32_t> lodIndices = indices;
+	float lodError = 0.0f;
+
+	lods.clear();
+	lods.push_back({ 0, (uint32_t)indices.size(), 0.0f, 0, 0 });
+
+	//Every level is simplified from the previous one, so their errors add up
+	while (lods.size() < MAX_LOD_COUNT)
+	{
+		size_t targetIndexCount = (lodIndices.size() / 6) * 3;
+
+		if (targetIndexCount == 0)
+			break;
+
+		float simplificationError = 0.0f;
+		std::vector<uint32_t> simplified = simplifyMesh(vertices, lodIndices, targetIndexCount, simplificationError);
+
+		//Not worth another level (and its memory) if it barely removes anything
+		if (simplified.empty() || simplified.size() * 4 > lodIndices.size() * 3)
+			break;
+
+		lodError += simplificationError;
+		lods.push_back({ (uint32_t)allIndices.size(), (uint32_t)simplified.size(), lodError, 0, 0 });
+
+		allIndices.insert(allIndices.end(), simplified.begin(), simplified.end());
+		lodIndices = std::move(simplified);
+	}
+
+	meshlets.clear();
+
+	if (enableMeshletCulling)
+	{
+		for (auto& lod : lods)
+		{
+			std::vector<Meshlet> lodMeshlets = buildMeshlets(vertices, allIndices, lod.firstIndex, lod.indexCount);
+
+			lod.firstMeshlet = (uint32_t)meshlets.size();
+			lod.meshletCount = (uint32_t)lodMeshlets.size();
+
+			meshlets.insert(meshlets.end(), lodMeshlets.begin(), lodMeshlets.end());
+		}
+	}
+
+	return allIndices;
+}
+
+Mesh::Mesh(MemoryBudget* memoryBudget, VkDevice device, const std::vector<VertexData>& vertices) :
+	vertexCount{ vertices.size() }, memoryBudget{ memoryBudget }, device{ device } {
+	std::vector<uint32_t> indices(vertices.size());
+
+	for (uint32_t i = 0; i < indices.size(); i++)
+		indices[i] = i;
+
+	creaeVertexBuffer(vertices);
+	createIndexBuffer(generateLods(vertices, indices));
+}
+
+Mesh::Mesh(MemoryBudget* memoryBudget, VkDevice device, const std::vector<VertexData>& vertices, const std::vector<uint32_t>& indices) :
+	vertexCount{ vertices.size() }, memoryBudget{ memoryBudget }, device{ device } {
 	creaeVertexBuffer(vertices);
+	createIndexBuffer(generateLods(vertices, indices));
+}
+
+Mesh::Mesh(MemoryBudget* memoryBudget, VkDevice device, const std::vector<char>& encodedMesh) :
+	memoryBudget{ memoryBudget }, device{ device } {
+	//Checked whole before anything is allocated, the streams are checked as they are decoded
+	MeshFile file = parseMeshFile(encodedMesh);
+
+	vertexCount = file.header.vertexCount;
+	lods = std::move(file.lods);
+	meshlets = std::move(file.meshlets);
+
+	void* vertexData = createMappedBuffer(sizeof(VertexData) * vertexCount, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vertexBuffer, vertexMemory);
+	void* indexData = createMappedBuffer(sizeof(uint32_t) * file.header.indexCount, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, indexBuffer, indexMemory);
+
+	try
+	{
+		decodeMeshVertices(file, vertexData);
+		decodeMeshIndices(file, indexData);
+	}
+	catch (...)
+	{
+		destroyVertexBuffer();
+		throw;
+	}
+
+	vkUnmapMemory(device, vertexMemory);
+	vkUnmapMemory(device, indexMemory);
+}
+
+std::vector<char> Mesh::encode(const std::vector<VertexData>& vertices, const std::vector<uint32_t>& indices)
+{
+	std::vector<uint32_t> triangles = indices;
+
+	if (triangles.empty())
+	{
+		triangles.resize(vertices.size());
+
+		for (uint32_t i = 0; i < triangles.size(); i++)
+			triangles[i] = i;
+	}
+
+	//Only the LODs and the meshlets of the mesh are used, it has no buffers
+	Mesh mesh;
+	std::vector<uint32_t> allIndices = mesh.generateLods(vertices, triangles);
+
+	return encodeMeshFile(vertices, allIndices, mesh.lods, mesh.meshlets);
 }
 
 int Mesh::getVerticesCount()
@@ -58,18 +178,41 @@ VkBuffer Mesh::getVertexBuffer()
 	return vertexBuffer;
 }
 
-void Mesh::destroyVertexBuffer()
+VkBuffer Mesh::getIndexBuffer()
 {
-	vkDestroyBuffer(device, vertexBuffer, nullptr);
-	vkFreeMemory(device, vertexMemory, nullptr);
+	return indexBuffer;
 }
 
-uint32_t Mesh::findMemoryIndex(uint32_t allowedTypes, VkMemoryPropertyFlags flags)
+size_t Mesh::getLodCount() const
+{
+	return lods.size();
+}
+
+const MeshLod& Mesh::getLod(size_t lod) const
+{
+	return lods.at(lod);
+}
+
+const std::vector<Meshlet>& Mesh::getMeshlets() const
+{
+	return meshlets;
+}
+
+uint32_t Mesh::selectLod(float pixelsPerUnit) const
+{
+	//Errors only grow with the level, so the first one that is small enough from the end is the coarsest
+	for (size_t lod = lods.size() - 1; lod > 0; lod--)
+		if (lods[lod].error * pixelsPerUnit <= LOD_MAX_PIXEL_ERROR)
+			return (uint32_t)lod;
+
+	return 0;
+}
+
+void Mesh::destroyVertexBuffer()
 {
-	VkPhysicalDeviceMemoryProperties physicalMemProps = {};
-	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &physicalMemProps);
+	vkDestroyBuffer(device, indexBuffer, getHostAllocator());
+	memoryBudget->free(indexMemory);
 
-	for (uint32_t i = 0; i < physicalMemProps.memoryTypeCount; i++)
-		if ((allowedTypes & (1 << i)) && physicalMemProps.memoryTypes[i].propertyFlags == flags)
-			return i;
+	vkDestroyBuffer(device, vertexBuffer, getHostAllocator());
+	memoryBudget->free(vertexMemory);
 }
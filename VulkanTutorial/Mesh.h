@@ -4,6 +4,20 @@
 #include<GLFW/glfw3.h>
 #include<vector>
 #include "Utilities.h"
+#include "Meshlet.h"
+#include "MemoryBudget.h"
+
+//Range of the index buffer with one level of detail. "error" is how far (in object space units) it
+//may be from the full detail mesh. Its triangles are ordered by meshlet
+struct MeshLod
+{
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	float error;
+
+	uint32_t firstMeshlet;
+	uint32_t meshletCount;
+};
 
 class Mesh
 {
@@ -13,23 +27,53 @@ private:
 	VkBuffer vertexBuffer;
 	VkDeviceMemory vertexMemory;
 
-	VkPhysicalDevice physicalDevice;
+	//Every LOD indexes the same vertices, their index ranges are stored one after the other (LOD 0 first)
+	VkBuffer indexBuffer;
+	VkDeviceMemory indexMemory;
+	std::vector<MeshLod> lods;
+	std::vector<Meshlet> meshlets;
+
+	MemoryBudget* memoryBudget;
 	VkDevice device;
 
-	void creaeVertexBuffer(std::vector<VertexData>& vertices);
+	//Host visible, returns the memory mapped so the caller can fill it and unmap it
+	void* createMappedBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer& buffer, VkDeviceMemory& memory);
+	void creaeVertexBuffer(const std::vector<VertexData>& vertices);
+	void createIndexBuffer(const std::vector<uint32_t>& indices);
+	std::vector<uint32_t> generateLods(const std::vector<VertexData>& vertices, const std::vector<uint32_t>& indices);
 
 public:
 
 	Mesh() = default;
 
-	Mesh(VkPhysicalDevice physicalDevice, VkDevice device, std::vector<VertexData>& vertices);
+	//Without indices every 3 vertices are a triangle
+	Mesh(MemoryBudget* memoryBudget, VkDevice device, const std::vector<VertexData>& vertices);
+
+	Mesh(MemoryBudget* memoryBudget, VkDevice device, const std::vector<VertexData>& vertices, const std::vector<uint32_t>& indices);
+
+	//From a mesh file made by encode (see MeshCodec.h), decoded straight into the mapped buffers. The LODs and
+	//the meshlets come with the file
+	Mesh(MemoryBudget* memoryBudget, VkDevice device, const std::vector<char>& encodedMesh);
+
+	//The mesh file of a mesh, with its LODs and meshlets generated the same way the constructors do
+	static std::vector<char> encode(const std::vector<VertexData>& vertices, const std::vector<uint32_t>& indices);
 
 	int getVerticesCount();
 
 	VkBuffer getVertexBuffer();
 
+	VkBuffer getIndexBuffer();
+
+	size_t getLodCount() const;
+
+	const MeshLod& getLod(size_t lod) const;
+
+	const std::vector<Meshlet>& getMeshlets() const;
+
+	//Coarsest LOD whose error covers less than LOD_MAX_PIXEL_ERROR pixels when one object space unit covers "pixelsPerUnit"
+	uint32_t selectLod(float pixelsPerUnit) const;
+
+	//Destroys the vertex and the index buffers
 	void destroyVertexBuffer();
-	
-	uint32_t findMemoryIndex(uint32_t allowedTypes, VkMemoryPropertyFlags flags);
 };
 
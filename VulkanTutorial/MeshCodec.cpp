@@ -0,0 +1,462 @@
+#include "MeshCodec.h"
+#include<cstring>
+#include<algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MESH_CODEC_SSE2
+#include<emmintrin.h>
+#endif
+
+namespace
+{
+	const size_t BLOCK_ELEMENTS = 16;
+
+	//Bytes of a group of 16 bytes in each mode: all zero, 2 bits, 4 bits and raw
+	const size_t GROUP_SIZES[4] = { 0, 4, 8, 16 };
+
+	uint32_t zigzag(uint32_t delta)
+	{
+		return (delta << 1) ^ (0u - (delta >> 31));
+	}
+
+	uint32_t groupMode(const uint8_t* group)
+	{
+		uint8_t biggest = 0;
+
+		for (size_t i = 0; i < BLOCK_ELEMENTS; i++)
+			biggest = std::max(biggest, group[i]);
+
+		return (biggest == 0) ? 0 : (biggest < 4) ? 1 : (biggest < 16) ? 2 : 3;
+	}
+
+	void packGroup(const uint8_t* group, uint32_t mode, std::vector<char>& output)
+	{
+		uint8_t packed[16] = {};
+
+		//2 bits: byte j has values 4j to 4j + 3 from its lowest bits up, 4 bits: values 2j and 2j + 1
+		for (size_t i = 0; i < BLOCK_ELEMENTS; i++)
+		{
+			if (mode == 1)
+				packed[i / 4] |= group[i] << ((i % 4) * 2);
+			else if (mode == 2)
+				packed[i / 2] |= group[i] << ((i % 2) * 4);
+			else
+				packed[i] = group[i];
+		}
+
+		output.insert(output.end(), (const char*)packed, (const char*)packed + GROUP_SIZES[mode]);
+	}
+
+	void checkStream(size_t laneCount)
+	{
+		if (laneCount == 0 || laneCount > MAX_STREAM_LANES)
+			throw std::runtime_error("Invalid mesh stream lane count!");
+	}
+
+	//Hands the 4 groups of a lane (lowest byte plane first) and their modes from its header byte to "readGroup"
+	template<typename ReadGroup>
+	const char* readLane(const char* data, const char* end, uint8_t header, ReadGroup readGroup)
+	{
+		for (uint32_t plane = 0; plane < 4; plane++)
+		{
+			uint32_t mode = (header >> (plane * 2)) & 3;
+
+			if ((size_t)(end - data) < GROUP_SIZES[mode])
+				throw std::runtime_error("Corrupt mesh stream!");
+
+			readGroup(plane, mode, data);
+			data += GROUP_SIZES[mode];
+		}
+
+		return data;
+	}
+
+#ifdef MESH_CODEC_SSE2
+	//16 bytes from a group, the groups are not aligned and may be at the very end of the data
+	__m128i expandGroup(const char* group, uint32_t mode)
+	{
+		const __m128i lowBits = _mm_set1_epi8(0x03);
+		const __m128i lowNibbles = _mm_set1_epi8(0x0F);
+
+		if (mode == 0)
+			return _mm_setzero_si128();
+
+		if (mode == 1)
+		{
+			int32_t packed;
+			memcpy(&packed, group, sizeof(packed));
+
+			//The 16 bit shifts pull bits of the next byte into the top of each byte, the masks drop them
+			__m128i bytes = _mm_cvtsi32_si128(packed);
+			__m128i value0 = _mm_and_si128(bytes, lowBits);
+			__m128i value1 = _mm_and_si128(_mm_srli_epi16(bytes, 2), lowBits);
+			__m128i value2 = _mm_and_si128(_mm_srli_epi16(bytes, 4), lowBits);
+			__m128i value3 = _mm_and_si128(_mm_srli_epi16(bytes, 6), lowBits);
+
+			return _mm_unpacklo_epi16(_mm_unpacklo_epi8(value0, value1), _mm_unpacklo_epi8(value2, value3));
+		}
+
+		if (mode == 2)
+		{
+			__m128i bytes = _mm_loadl_epi64((const __m128i*)group);
+
+			return _mm_unpacklo_epi8(_mm_and_si128(bytes, lowNibbles), _mm_and_si128(_mm_srli_epi16(bytes, 4), lowNibbles));
+		}
+
+		return _mm_loadu_si128((const __m128i*)group);
+	}
+
+	//Zigzagged deltas to values, "carry" has the last value of the lane in every element and is updated
+	__m128i accumulate(__m128i values, __m128i& carry)
+	{
+		__m128i deltas = _mm_xor_si128(_mm_srli_epi32(values, 1), _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(values, _mm_set1_epi32(1))));
+
+		deltas = _mm_add_epi32(deltas, _mm_slli_si128(deltas, 4));
+		deltas = _mm_add_epi32(deltas, _mm_slli_si128(deltas, 8));
+		deltas = _mm_add_epi32(deltas, carry);
+
+		carry = _mm_shuffle_epi32(deltas, 0xFF);
+
+		return deltas;
+	}
+
+	const char* decodeBlockSse2(const char* data, const char* end, uint32_t* block, size_t laneCount, __m128i* carries)
+	{
+		const uint8_t* headers = (const uint8_t*)data;
+		data += laneCount;
+
+		//Values of each lane, 4 elements per vector
+		__m128i lanes[MAX_STREAM_LANES][4];
+
+		for (size_t lane = 0; lane < laneCount; lane++)
+		{
+			__m128i planes[4];
+
+			data = readLane(data, end, headers[lane], [&](uint32_t plane, uint32_t mode, const char* group) {
+				planes[plane] = expandGroup(group, mode);
+			});
+
+			//Bytes to 32 bit values, lowest plane first
+			__m128i low = _mm_unpacklo_epi8(planes[0], planes[1]);
+			__m128i high = _mm_unpackhi_epi8(planes[0], planes[1]);
+			__m128i low23 = _mm_unpacklo_epi8(planes[2], planes[3]);
+			__m128i high23 = _mm_unpackhi_epi8(planes[2], planes[3]);
+
+			lanes[lane][0] = accumulate(_mm_unpacklo_epi16(low, low23), carries[lane]);
+			lanes[lane][1] = accumulate(_mm_unpackhi_epi16(low, low23), carries[lane]);
+			lanes[lane][2] = accumulate(_mm_unpacklo_epi16(high, high23), carries[lane]);
+			lanes[lane][3] = accumulate(_mm_unpackhi_epi16(high, high23), carries[lane]);
+		}
+
+		//Lanes to elements, 4 lanes of 4 elements at a time when the lanes allow it
+		if (laneCount % 4 == 0)
+		{
+			for (size_t lane = 0; lane < laneCount; lane += 4)
+			{
+				for (size_t quad = 0; quad < 4; quad++)
+				{
+					__m128i lane01Low = _mm_unpacklo_epi32(lanes[lane][quad], lanes[lane + 1][quad]);
+					__m128i lane01High = _mm_unpackhi_epi32(lanes[lane][quad], lanes[lane + 1][quad]);
+					__m128i lane23Low = _mm_unpacklo_epi32(lanes[lane + 2][quad], lanes[lane + 3][quad]);
+					__m128i lane23High = _mm_unpackhi_epi32(lanes[lane + 2][quad], lanes[lane + 3][quad]);
+
+					uint32_t* element = block + quad * 4 * laneCount + lane;
+
+					_mm_storeu_si128((__m128i*)(element), _mm_unpacklo_epi64(lane01Low, lane23Low));
+					_mm_storeu_si128((__m128i*)(element + laneCount), _mm_unpackhi_epi64(lane01Low, lane23Low));
+					_mm_storeu_si128((__m128i*)(element + laneCount * 2), _mm_unpacklo_epi64(lane01High, lane23High));
+					_mm_storeu_si128((__m128i*)(element + laneCount * 3), _mm_unpackhi_epi64(lane01High, lane23High));
+				}
+			}
+		}
+		else
+		{
+			for (size_t lane = 0; lane < laneCount; lane++)
+			{
+				uint32_t values[BLOCK_ELEMENTS];
+
+				for (size_t quad = 0; quad < 4; quad++)
+					_mm_storeu_si128((__m128i*)(values + quad * 4), lanes[lane][quad]);
+
+				for (size_t element = 0; element < BLOCK_ELEMENTS; element++)
+					block[element * laneCount + lane] = values[element];
+			}
+		}
+
+		return data;
+	}
+#endif
+
+	uint32_t unzigzag(uint32_t value)
+	{
+		return (value >> 1) ^ (0u - (value & 1));
+	}
+
+	const char* decodeBlockScalar(const char* data, const char* end, uint32_t* block, size_t laneCount, uint32_t* carries)
+	{
+		const uint8_t* headers = (const uint8_t*)data;
+		data += laneCount;
+
+		for (size_t lane = 0; lane < laneCount; lane++)
+		{
+			uint32_t values[BLOCK_ELEMENTS] = {};
+
+			data = readLane(data, end, headers[lane], [&](uint32_t plane, uint32_t mode, const char* group) {
+				const uint8_t* bytes = (const uint8_t*)group;
+
+				for (size_t i = 0; i < BLOCK_ELEMENTS && mode != 0; i++)
+				{
+					uint32_t value = (mode == 1) ? (bytes[i / 4] >> ((i % 4) * 2)) & 0x03 :
+						(mode == 2) ? (bytes[i / 2] >> ((i % 2) * 4)) & 0x0F : bytes[i];
+
+					values[i] |= value << (plane * 8);
+				}
+			});
+
+			for (size_t element = 0; element < BLOCK_ELEMENTS; element++)
+			{
+				carries[lane] += unzigzag(values[element]);
+				block[element * laneCount + lane] = carries[lane];
+			}
+		}
+
+		return data;
+	}
+
+	//"limit" is checked against every value when it is not 0, so decoded indices can be trusted by the GPU.
+	//"Carry" is what "decodeBlock" keeps of each lane from one block to the next
+	template<typename Carry, typename DecodeBlock>
+	void decodeStreamWith(const char* data, size_t size, void* destination, size_t elementCount, size_t laneCount, uint32_t limit,
+		Carry zero, DecodeBlock decodeBlock)
+	{
+		checkStream(laneCount);
+
+		const char* end = data + size;
+		size_t elementSize = laneCount * sizeof(uint32_t);
+
+		Carry carries[MAX_STREAM_LANES];
+
+		for (size_t lane = 0; lane < laneCount; lane++)
+			carries[lane] = zero;
+
+		//Decoded in the cache and copied whole, so the destination is only written once, in order
+		uint32_t block[BLOCK_ELEMENTS * MAX_STREAM_LANES];
+
+		for (size_t first = 0; first < elementCount; first += BLOCK_ELEMENTS)
+		{
+			if ((size_t)(end - data) < laneCount)
+				throw std::runtime_error("Corrupt mesh stream!");
+
+			data = decodeBlock(data, end, block, laneCount, carries);
+
+			size_t count = std::min(BLOCK_ELEMENTS, elementCount - first);
+
+			if (limit != 0)
+			{
+				for (size_t i = 0; i < count * laneCount; i++)
+				{
+					if (block[i] >= limit)
+						throw std::runtime_error("Corrupt mesh stream!");
+				}
+			}
+
+			memcpy((char*)destination + first * elementSize, block, count * elementSize);
+		}
+
+		if (data != end)
+			throw std::runtime_error("Corrupt mesh stream!");
+	}
+
+	void decodeStreamTo(const char* data, size_t size, void* destination, size_t elementCount, size_t laneCount, uint32_t limit,
+		bool allowSse2)
+	{
+#ifdef MESH_CODEC_SSE2
+		if (allowSse2)
+		{
+			decodeStreamWith(data, size, destination, elementCount, laneCount, limit, _mm_setzero_si128(),
+				[](const char* data, const char* end, uint32_t* block, size_t laneCount, __m128i* carries)
+				{ return decodeBlockSse2(data, end, block, laneCount, carries); });
+
+			return;
+		}
+#endif
+		decodeStreamWith(data, size, destination, elementCount, laneCount, limit, 0u,
+			[](const char* data, const char* end, uint32_t* block, size_t laneCount, uint32_t* carries)
+			{ return decodeBlockScalar(data, end, block, laneCount, carries); });
+	}
+
+	template<typename Value>
+	void append(std::vector<char>& output, const Value* values, size_t count)
+	{
+		output.insert(output.end(), (const char*)values, (const char*)(values + count));
+	}
+}
+
+std::vector<char> encodeStream(const void* elements, size_t elementCount, size_t laneCount)
+{
+	checkStream(laneCount);
+
+	const uint32_t* values = (const uint32_t*)elements;
+	std::vector<char> output;
+
+	uint32_t previous[MAX_STREAM_LANES] = {};
+
+	for (size_t first = 0; first < elementCount; first += BLOCK_ELEMENTS)
+	{
+		//Bytes of each plane of each lane. The last block repeats its last element, which costs nothing (deltas of 0)
+		uint8_t planes[MAX_STREAM_LANES][4][BLOCK_ELEMENTS];
+
+		for (size_t i = 0; i < BLOCK_ELEMENTS; i++)
+		{
+			const uint32_t* element = values + std::min(first + i, elementCount - 1) * laneCount;
+
+			for (size_t lane = 0; lane < laneCount; lane++)
+			{
+				uint32_t value = zigzag(element[lane] - previous[lane]);
+				previous[lane] = element[lane];
+
+				for (size_t plane = 0; plane < 4; plane++)
+					planes[lane][plane][i] = (uint8_t)(value >> (plane * 8));
+			}
+		}
+
+		size_t headers = output.size();
+		output.resize(output.size() + laneCount);
+
+		for (size_t lane = 0; lane < laneCount; lane++)
+		{
+			uint8_t header = 0;
+
+			for (uint32_t plane = 0; plane < 4; plane++)
+			{
+				uint32_t mode = groupMode(planes[lane][plane]);
+				header |= mode << (plane * 2);
+
+				packGroup(planes[lane][plane], mode, output);
+			}
+
+			output[headers + lane] = (char)header;
+		}
+	}
+
+	return output;
+}
+
+void decodeStream(const char* data, size_t size, void* destination, size_t elementCount, size_t laneCount, bool allowSse2)
+{
+	decodeStreamTo(data, size, destination, elementCount, laneCount, 0, allowSse2);
+}
+
+bool hasSse2StreamDecoder()
+{
+#ifdef MESH_CODEC_SSE2
+	return true;
+#else
+	return false;
+#endif
+}
+
+//************************** MESH FILES *****************************
+std::vector<char> encodeMeshFile(const std::vector<VertexData>& vertices, const std::vector<uint32_t>& indices,
+	const std::vector<MeshLod>& lods, const std::vector<Meshlet>& meshlets)
+{
+	static_assert(sizeof(VertexData) % sizeof(uint32_t) == 0, "Vertices have to be made of 32 bit lanes");
+
+	if (indices.size() % 3 != 0)
+		throw std::runtime_error("Mesh file indices are not triangles!");
+
+	std::vector<char> vertexStream = encodeStream(vertices.data(), vertices.size(), sizeof(VertexData) / sizeof(uint32_t));
+	std::vector<char> indexStream = encodeStream(indices.data(), indices.size() / 3, 3);
+
+	MeshFileHeader header = {};
+	header.magic = MESH_FILE_MAGIC;
+	header.version = MESH_FILE_VERSION;
+	header.vertexCount = (uint32_t)vertices.size();
+	header.indexCount = (uint32_t)indices.size();
+	header.lodCount = (uint32_t)lods.size();
+	header.meshletCount = (uint32_t)meshlets.size();
+	header.vertexStreamSize = (uint32_t)vertexStream.size();
+	header.indexStreamSize = (uint32_t)indexStream.size();
+
+	std::vector<char> data;
+	append(data, &header, 1);
+	append(data, lods.data(), lods.size());
+	append(data, meshlets.data(), meshlets.size());
+	append(data, vertexStream.data(), vertexStream.size());
+	append(data, indexStream.data(), indexStream.size());
+
+	return data;
+}
+
+MeshFile parseMeshFile(const std::vector<char>& data)
+{
+	MeshFile file;
+
+	if (data.size() < sizeof(MeshFileHeader))
+		throw std::runtime_error("Mesh file is too small!");
+
+	memcpy(&file.header, data.data(), sizeof(MeshFileHeader));
+	const MeshFileHeader& header = file.header;
+
+	if (header.magic != MESH_FILE_MAGIC)
+		throw std::runtime_error("Not a mesh file!");
+
+	if (header.version != MESH_FILE_VERSION)
+		throw std::runtime_error("Unsupported mesh file version!");
+
+	//64 bit sums, so huge counts can not wrap around
+	uint64_t expectedSize = sizeof(MeshFileHeader) + (uint64_t)header.lodCount * sizeof(MeshLod) +
+		(uint64_t)header.meshletCount * sizeof(Meshlet) + header.vertexStreamSize + header.indexStreamSize;
+
+	if (expectedSize != data.size() || header.indexCount % 3 != 0 || header.lodCount == 0 ||
+		header.lodCount > MAX_LOD_COUNT)
+		throw std::runtime_error("Corrupt mesh file!");
+
+	const char* tables = data.data() + sizeof(MeshFileHeader);
+
+	file.lods.resize(header.lodCount);
+	memcpy(file.lods.data(), tables, header.lodCount * sizeof(MeshLod));
+	tables += header.lodCount * sizeof(MeshLod);
+
+	//Meshes drawn without meshlet culling have none
+	file.meshlets.resize(header.meshletCount);
+
+	if (header.meshletCount > 0)
+		memcpy(file.meshlets.data(), tables, header.meshletCount * sizeof(Meshlet));
+
+	tables += header.meshletCount * sizeof(Meshlet);
+
+	for (const MeshLod& lod : file.lods)
+	{
+		if ((uint64_t)lod.firstIndex + lod.indexCount > header.indexCount ||
+			(uint64_t)lod.firstMeshlet + lod.meshletCount > header.meshletCount)
+			throw std::runtime_error("Corrupt mesh file!");
+	}
+
+	for (const Meshlet& meshlet : file.meshlets)
+	{
+		if ((uint64_t)meshlet.firstIndex + (uint64_t)meshlet.triangleCount * 3 > header.indexCount)
+			throw std::runtime_error("Corrupt mesh file!");
+	}
+
+	file.vertexStream = tables;
+	file.indexStream = tables + header.vertexStreamSize;
+
+	return file;
+}
+
+void decodeMeshVertices(const MeshFile& file, void* destination)
+{
+	decodeStreamTo(file.vertexStream, file.header.vertexStreamSize, destination, file.header.vertexCount,
+		sizeof(VertexData) / sizeof(uint32_t), 0, true);
+}
+
+void decodeMeshIndices(const MeshFile& file, void* destination)
+{
+	//A mesh without vertices can not have indices either, which the limit of 0 would not check
+	if (file.header.vertexCount == 0 && file.header.indexCount != 0)
+		throw std::runtime_error("Corrupt mesh file!");
+
+	decodeStreamTo(file.indexStream, file.header.indexStreamSize, destination, file.header.indexCount / 3, 3,
+		file.header.vertexCount, true);
+}
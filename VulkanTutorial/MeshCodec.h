@@ -0,0 +1,67 @@
+#pragma once
+
+#include<vector>
+#include<cstdint>
+#include<cstddef>
+#include<stdexcept>
+#include "Mesh.h"
+
+//Lossless codec of the vertex and index buffers of a mesh, made to decode fast.
+//
+//A stream is a sequence of elements made of 32 bit lanes (the components of a vertex, the corners of a
+//triangle). Every lane is stored as the difference with the same lane of the previous element, zigzag
+//encoded so small negative differences are small numbers too, and split in its four byte planes. Each
+//plane of 16 elements is a group stored with the fewest bits (0, 2, 4 or 8) its biggest byte needs.
+//Neighbouring vertices and triangles are close to each other, so most of the high planes are empty.
+//
+//The decoder expands 16 elements of a lane at a time with SSE2 (plain C++ elsewhere), and writes whole
+//elements in order, so it can decode straight into mapped (write combined) memory
+const size_t MAX_STREAM_LANES = 16;
+
+//Elements are read as 32 bit lanes, so their size has to be a multiple of 4 bytes
+std::vector<char> encodeStream(const void* elements, size_t elementCount, size_t laneCount);
+
+//Throws if the data is not exactly one stream of "elementCount" elements. Without "allowSse2" the plain C++
+//decoder is used everywhere, to compare the two
+void decodeStream(const char* data, size_t size, void* destination, size_t elementCount, size_t laneCount, bool allowSse2 = true);
+
+//Whether this build has the SSE2 decoder, the plain C++ one is always there
+bool hasSse2StreamDecoder();
+
+//************************** MESH FILES *****************************
+//A mesh as it is uploaded: the vertices and the indices of every LOD (the triangles in meshlet order), with
+//the LOD table and the meshlets, so nothing has to be generated when it is loaded. Little endian:
+//	MeshFileHeader, MeshLod[lodCount], Meshlet[meshletCount], vertex stream, index stream (a triangle per element)
+const uint32_t MESH_FILE_MAGIC = 0x4D535456;		//"VTSM"
+const uint32_t MESH_FILE_VERSION = 1;
+
+struct MeshFileHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t lodCount;
+	uint32_t meshletCount;
+	uint32_t vertexStreamSize;		//Bytes
+	uint32_t indexStreamSize;
+};
+
+//A parsed mesh file, the streams point into the data it was parsed from
+struct MeshFile
+{
+	MeshFileHeader header = {};
+	std::vector<MeshLod> lods;
+	std::vector<Meshlet> meshlets;
+	const char* vertexStream = nullptr;
+	const char* indexStream = nullptr;
+};
+
+std::vector<char> encodeMeshFile(const std::vector<VertexData>& vertices, const std::vector<uint32_t>& indices,
+	const std::vector<MeshLod>& lods, const std::vector<Meshlet>& meshlets);
+
+MeshFile parseMeshFile(const std::vector<char>& data);
+
+//"destination" has room for header.vertexCount vertices / header.indexCount indices
+void decodeMeshVertices(const MeshFile& file, void* destination);
+void decodeMeshIndices(const MeshFile& file, void* destination);
@@ -0,0 +1,355 @@
+#include "MeshSimplifier.h"
+#include<array>
+#include<algorithm>
+#include<queue>
+#include<cmath>
+#include<unordered_map>
+
+//Border edges get a plane perpendicular to their triangle so that the outline of open meshes is kept
+const double BORDER_EDGE_WEIGHT = 10.0;
+
+namespace
+{
+	//Sum of squared distances to a set of planes, weighted by the area of the triangles they come from
+	struct Quadric
+	{
+		double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+		double b0 = 0, b1 = 0, b2 = 0;
+		double c = 0;
+		double weight = 0;
+
+		void addPlane(const glm::vec3& normal, double distance, double planeWeight)
+		{
+			double x = normal.x, y = normal.y, z = normal.z;
+
+			a00 += planeWeight * x * x; a01 += planeWeight * x * y; a02 += planeWeight * x * z;
+			a11 += planeWeight * y * y; a12 += planeWeight * y * z;
+			a22 += planeWeight * z * z;
+
+			b0 += planeWeight * distance * x; b1 += planeWeight * distance * y; b2 += planeWeight * distance * z;
+			c += planeWeight * distance * distance;
+
+			weight += planeWeight;
+		}
+
+		Quadric& operator+=(const Quadric& other)
+		{
+			a00 += other.a00; a01 += other.a01; a02 += other.a02;
+			a11 += other.a11; a12 += other.a12;
+			a22 += other.a22;
+			b0 += other.b0; b1 += other.b1; b2 += other.b2;
+			c += other.c;
+			weight += other.weight;
+
+			return *this;
+		}
+
+		//p^T A p + 2 b.p + c
+		double evaluate(const glm::vec3& p) const
+		{
+			double x = p.x, y = p.y, z = p.z;
+
+			double result =
+				a00 * x * x + 2.0 * a01 * x * y + 2.0 * a02 * x * z +
+				a11 * y * y + 2.0 * a12 * y * z +
+				a22 * z * z +
+				2.0 * (b0 * x + b1 * y + b2 * z) + c;
+
+			return (result > 0.0) ? result : 0.0;
+		}
+	};
+
+	struct Collapse
+	{
+		double cost;
+		uint32_t from;
+		uint32_t to;
+		uint32_t fromVersion;
+		uint32_t toVersion;
+
+		bool operator>(const Collapse& other) const { return cost > other.cost; }
+	};
+
+	struct PositionKey
+	{
+		float x, y, z;
+
+		bool operator==(const PositionKey& other) const { return x == other.x && y == other.y && z == other.z; }
+	};
+
+	struct PositionHash
+	{
+		size_t operator()(const PositionKey& key) const
+		{
+			std::hash<float> hash;
+			return hash(key.x) ^ (hash(key.y) * 73856093u) ^ (hash(key.z) * 19349663u);
+		}
+	};
+
+	uint64_t edgeKey(uint32_t a, uint32_t b)
+	{
+		return (a < b) ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+	}
+}
+
+std::vector<uint32_t> simplifyMesh(
+	const std::vector<VertexData>& vertices,
+	const std::vector<uint32_t>& indices,
+	size_t targetIndexCount,
+	float& resultError)
+{
+	resultError = 0.0f;
+
+	if (indices.size() % 3 != 0)
+		throw std::runtime_error("Mesh simplification needs a triangle list!");
+
+	size_t vertexCount = vertices.size();
+
+	//************************** WELD VERTICES BY POSITION *****************************
+	//Vertices that only differ in their attributes (color seams) are the same vertex for the topology,
+	//the first one with each position stands for all of them
+	std::vector<uint32_t> canonical(vertexCount);
+	std::unordered_map<PositionKey, uint32_t, PositionHash> positionToVertex;
+	positionToVertex.reserve(vertexCount);
+
+	for (uint32_t i = 0; i < vertexCount; i++)
+	{
+		const glm::vec3& p = vertices[i].position;
+		canonical[i] = positionToVertex.emplace(PositionKey{ p.x, p.y, p.z }, i).first->second;
+	}
+
+	//************************** TRIANGLES AND ADJACENCY *****************************
+	std::vector<std::array<uint32_t, 3>> triangleCorners;		//Original vertex of every corner
+	std::vector<std::array<uint32_t, 3>> triangleVertices;		//Current welded vertex of every corner
+	std::vector<std::vector<uint32_t>> vertexTriangles(vertexCount);
+
+	triangleCorners.reserve(indices.size() / 3);
+	triangleVertices.reserve(indices.size() / 3);
+
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		uint32_t a = canonical[indices[i]];
+		uint32_t b = canonical[indices[i + 1]];
+		uint32_t c = canonical[indices[i + 2]];
+
+		//Degenerate triangles are dropped right away
+		if (a == b || b == c || a == c)
+			continue;
+
+		uint32_t triangle = (uint32_t)triangleCorners.size();
+
+		triangleCorners.push_back({ indices[i], indices[i + 1], indices[i + 2] });
+		triangleVertices.push_back({ a, b, c });
+
+		vertexTriangles[a].push_back(triangle);
+		vertexTriangles[b].push_back(triangle);
+		vertexTriangles[c].push_back(triangle);
+	}
+
+	std::vector<uint8_t> triangleAlive(triangleCorners.size(), 1);
+	size_t triangleCount = triangleCorners.size();
+
+	//************************** QUADRICS *****************************
+	std::vector<Quadric> quadrics(vertexCount);
+	std::unordered_map<uint64_t, uint32_t> edgeUses;
+	edgeUses.reserve(triangleCount * 3);
+
+	for (const auto& triangle : triangleVertices)
+		for (int k = 0; k < 3; k++)
+			edgeUses[edgeKey(triangle[k], triangle[(k + 1) % 3])]++;
+
+	for (const auto& triangle : triangleVertices)
+	{
+		const glm::vec3& p0 = vertices[triangle[0]].position;
+		const glm::vec3& p1 = vertices[triangle[1]].position;
+		const glm::vec3& p2 = vertices[triangle[2]].position;
+
+		glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+		float doubleArea = glm::length(normal);
+
+		if (doubleArea == 0.0f)
+			continue;
+
+		normal = normal / doubleArea;
+
+		Quadric planeQuadric;
+		planeQuadric.addPlane(normal, -glm::dot(normal, p0), 0.5 * doubleArea);
+
+		for (int k = 0; k < 3; k++)
+			quadrics[triangle[k]] += planeQuadric;
+
+		for (int k = 0; k < 3; k++)
+		{
+			uint32_t a = triangle[k];
+			uint32_t b = triangle[(k + 1) % 3];
+
+			if (edgeUses[edgeKey(a, b)] != 1)
+				continue;
+
+			glm::vec3 edge = vertices[b].position - vertices[a].position;
+			float edgeLength = glm::length(edge);
+
+			if (edgeLength == 0.0f)
+				continue;
+
+			glm::vec3 borderNormal = glm::normalize(glm::cross(edge, normal));
+
+			Quadric borderQuadric;
+			borderQuadric.addPlane(borderNormal, -glm::dot(borderNormal, vertices[a].position),
+				BORDER_EDGE_WEIGHT * edgeLength * edgeLength);
+
+			quadrics[a] += borderQuadric;
+			quadrics[b] += borderQuadric;
+		}
+	}
+
+	//************************** COLLAPSE CANDIDATES *****************************
+	std::vector<uint32_t> versions(vertexCount, 0);
+	std::vector<uint8_t> vertexAlive(vertexCount, 1);
+	std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> collapses;
+
+	//Only endpoints are considered as the new position, the cheaper direction of the edge is queued
+	auto pushEdge = [&](uint32_t a, uint32_t b)
+	{
+		Quadric combined = quadrics[a];
+		combined += quadrics[b];
+
+		double costAB = combined.evaluate(vertices[b].position);
+		double costBA = combined.evaluate(vertices[a].position);
+
+		if (costAB <= costBA)
+			collapses.push({ costAB, a, b, versions[a], versions[b] });
+		else
+			collapses.push({ costBA, b, a, versions[b], versions[a] });
+	};
+
+	for (const auto& edge : edgeUses)
+		pushEdge((uint32_t)(edge.first >> 32), (uint32_t)(edge.first & 0xFFFFFFFFu));
+
+	//Moving "from" onto "to" must not flip any of the triangles that survive the collapse
+	auto collapseFlipsTriangles = [&](uint32_t from, uint32_t to)
+	{
+		for (uint32_t triangle : vertexTriangles[from])
+		{
+			if (!triangleAlive[triangle])
+				continue;
+
+			const auto& corners = triangleVertices[triangle];
+
+			if (corners[0] == to || corners[1] == to || corners[2] == to)
+				continue;
+
+			glm::vec3 oldPositions[3];
+			glm::vec3 newPositions[3];
+
+			for (int k = 0; k < 3; k++)
+			{
+				oldPositions[k] = vertices[corners[k]].position;
+				newPositions[k] = (corners[k] == from) ? vertices[to].position : oldPositions[k];
+			}
+
+			glm::vec3 oldNormal = glm::cross(oldPositions[1] - oldPositions[0], oldPositions[2] - oldPositions[0]);
+			glm::vec3 newNormal = glm::cross(newPositions[1] - newPositions[0], newPositions[2] - newPositions[0]);
+
+			if (glm::dot(oldNormal, newNormal) <= 0.0f)
+				return true;
+		}
+
+		return false;
+	};
+
+	//************************** EDGE COLLAPSES *****************************
+	double maxError = 0.0;
+	std::vector<uint32_t> neighbours;
+
+	while (triangleCount * 3 > targetIndexCount && !collapses.empty())
+	{
+		Collapse collapse = collapses.top();
+		collapses.pop();
+
+		uint32_t from = collapse.from;
+		uint32_t to = collapse.to;
+
+		//Stale entry, one of the vertices changed since it was queued
+		if (!vertexAlive[from] || !vertexAlive[to] ||
+			versions[from] != collapse.fromVersion || versions[to] != collapse.toVersion)
+			continue;
+
+		//It is queued again if its neighbourhood changes
+		if (collapseFlipsTriangles(from, to))
+			continue;
+
+		double combinedWeight = quadrics[from].weight + quadrics[to].weight;
+
+		if (combinedWeight > 0.0)
+			maxError = std::max(maxError, collapse.cost / combinedWeight);
+
+		quadrics[to] += quadrics[from];
+		vertexAlive[from] = 0;
+		versions[from]++;
+		versions[to]++;
+
+		for (uint32_t triangle : vertexTriangles[from])
+		{
+			if (!triangleAlive[triangle])
+				continue;
+
+			auto& corners = triangleVertices[triangle];
+
+			if (corners[0] == to || corners[1] == to || corners[2] == to)
+			{
+				triangleAlive[triangle] = 0;
+				triangleCount--;
+				continue;
+			}
+
+			for (int k = 0; k < 3; k++)
+				if (corners[k] == from)
+					corners[k] = to;
+
+			vertexTriangles[to].push_back(triangle);
+		}
+
+		vertexTriangles[from].clear();
+		vertexTriangles[from].shrink_to_fit();
+
+		//Drops the triangles that died and queues the edges around "to" with its new quadric
+		auto& toTriangles = vertexTriangles[to];
+		toTriangles.erase(std::remove_if(toTriangles.begin(), toTriangles.end(),
+			[&](uint32_t triangle) { return !triangleAlive[triangle]; }), toTriangles.end());
+
+		neighbours.clear();
+
+		for (uint32_t triangle : toTriangles)
+			for (uint32_t corner : triangleVertices[triangle])
+				if (corner != to)
+					neighbours.push_back(corner);
+
+		std::sort(neighbours.begin(), neighbours.end());
+		neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+
+		for (uint32_t neighbour : neighbours)
+			pushEdge(to, neighbour);
+	}
+
+	//************************** RESULT *****************************
+	std::vector<uint32_t> result;
+	result.reserve(triangleCount * 3);
+
+	for (size_t triangle = 0; triangle < triangleCorners.size(); triangle++)
+	{
+		if (!triangleAlive[triangle])
+			continue;
+
+		//Corners that kept their position keep their own vertex (and attributes)
+		for (int k = 0; k < 3; k++)
+		{
+			uint32_t corner = triangleCorners[triangle][k];
+			result.push_back((canonical[corner] == triangleVertices[triangle][k]) ? corner : triangleVertices[triangle][k]);
+		}
+	}
+
+	resultError = (float)std::sqrt(maxError);
+
+	return result;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include<vulkan/vulkan.h>
+#include<vector>
+#include<string>
+#include<stdexcept>
+#include<cstdint>
+#include<glm/glm.hpp>
+#include "Utilities.h"
+
+//Simplifies an indexed triangle list down to "targetIndexCount" indices (or as close as it can get) by
+//collapsing the edges with the smallest quadric error (Garland-Heckbert). Vertices are only removed, never
+//moved or created, so the result indexes the same vertex array and can share the vertex buffer.
+//"resultError" receives the biggest distance (in object space units) between the result and the input.
+std::vector<uint32_t> simplifyMesh(
+	const std::vector<VertexData>& vertices,
+	const std::vector<uint32_t>& indices,
+	size_t targetIndexCount,
+	float& resultError);
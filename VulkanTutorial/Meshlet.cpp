@@ -0,0 +1,216 @@
+#include "Meshlet.h"
+#include<algorithm>
+#include<cmath>
+
+//Triangles are added to the meshlet next to the ones already in it, the one that brings the fewest new
+//vertices first, until it is full or there are no neighbours left
+std::vector<Meshlet> buildMeshlets(const std::vector<VertexData>& vertices, std::vector<uint32_t>& indices, size_t first, size_t count)
+{
+	std::vector<Meshlet> meshlets;
+
+	if (count % 3 != 0)
+		throw std::runtime_error("Meshlets need a triangle list!");
+
+	size_t vertexCount = vertices.size();
+	uint32_t triangleCount = (uint32_t)(count / 3);
+	const uint32_t* triangles = indices.data() + first;
+
+	//************************** VERTEX TO TRIANGLES ADJACENCY *****************************
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+	std::vector<uint32_t> adjacency(count);
+
+	for (size_t i = 0; i < count; i++)
+		adjacencyOffsets[triangles[i] + 1]++;
+
+	for (size_t i = 0; i < vertexCount; i++)
+		adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+
+	std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+
+	for (size_t i = 0; i < count; i++)
+		adjacency[fill[triangles[i]]++] = (uint32_t)(i / 3);
+
+	//************************** GREEDY CLUSTERING *****************************
+	std::vector<uint8_t> emitted(triangleCount, 0);
+	std::vector<uint32_t> vertexMeshlet(vertexCount, ~0u);		//Last meshlet that used every vertex
+	std::vector<uint32_t> candidates;
+	std::vector<uint32_t> reordered;
+	reordered.reserve(count);
+
+	for (uint32_t seed = 0; seed < triangleCount; seed++)
+	{
+		if (emitted[seed])
+			continue;
+
+		uint32_t meshletId = (uint32_t)meshlets.size();
+		uint32_t meshletVertexCount = 0;
+		uint32_t meshletTriangleCount = 0;
+		size_t meshletFirst = reordered.size();
+
+		candidates.clear();
+		candidates.push_back(seed);
+
+		while (meshletTriangleCount < MESHLET_MAX_TRIANGLES)
+		{
+			//Picks the best candidate and drops the ones that were taken by this or a previous meshlet
+			uint32_t best = ~0u;
+			uint32_t bestNewVertices = 4;
+			size_t kept = 0;
+
+			for (uint32_t candidate : candidates)
+			{
+				if (emitted[candidate])
+					continue;
+
+				candidates[kept++] = candidate;
+
+				uint32_t newVertices = 0;
+
+				for (int k = 0; k < 3; k++)
+					newVertices += (vertexMeshlet[triangles[candidate * 3 + k]] != meshletId) ? 1 : 0;
+
+				if (newVertices < bestNewVertices)
+				{
+					best = candidate;
+					bestNewVertices = newVertices;
+				}
+			}
+
+			candidates.resize(kept);
+
+			if (best == ~0u || meshletVertexCount + bestNewVertices > MESHLET_MAX_VERTICES)
+				break;
+
+			emitted[best] = 1;
+			meshletTriangleCount++;
+
+			for (int k = 0; k < 3; k++)
+			{
+				uint32_t vertex = triangles[best * 3 + k];
+				reordered.push_back(vertex);
+
+				if (vertexMeshlet[vertex] == meshletId)
+					continue;
+
+				vertexMeshlet[vertex] = meshletId;
+				meshletVertexCount++;
+
+				for (uint32_t a = adjacencyOffsets[vertex]; a < adjacencyOffsets[vertex + 1]; a++)
+					if (!emitted[adjacency[a]])
+						candidates.push_back(adjacency[a]);
+			}
+		}
+
+		Meshlet meshlet = {};
+		meshlet.firstIndex = (uint32_t)(first + meshletFirst);
+		meshlet.triangleCount = meshletTriangleCount;
+
+		//************************** BOUNDING SPHERE *****************************
+		glm::vec3 minPosition = vertices[reordered[meshletFirst]].position;
+		glm::vec3 maxPosition = minPosition;
+
+		for (size_t i = meshletFirst; i < reordered.size(); i++)
+		{
+			minPosition = glm::min(minPosition, vertices[reordered[i]].position);
+			maxPosition = glm::max(maxPosition, vertices[reordered[i]].position);
+		}
+
+		meshlet.center = (minPosition + maxPosition) * 0.5f;
+		meshlet.radius = 0.0f;
+
+		for (size_t i = meshletFirst; i < reordered.size(); i++)
+			meshlet.radius = std::max(meshlet.radius, glm::distance(meshlet.center, vertices[reordered[i]].position));
+
+		//************************** NORMAL CONE *****************************
+		//Front faces are clockwise on screen, for them cross(p2 - p0, p1 - p0) points towards the viewer
+		std::vector<glm::vec3> normals;
+		normals.reserve(meshletTriangleCount);
+
+		glm::vec3 normalSum(0.0f);
+
+		for (size_t i = meshletFirst; i < reordered.size(); i += 3)
+		{
+			const glm::vec3& p0 = vertices[reordered[i]].position;
+			const glm::vec3& p1 = vertices[reordered[i + 1]].position;
+			const glm::vec3& p2 = vertices[reordered[i + 2]].position;
+
+			glm::vec3 normal = glm::cross(p2 - p0, p1 - p0);
+			float normalLength = glm::length(normal);
+
+			if (normalLength == 0.0f)
+				continue;
+
+			normals.push_back(normal / normalLength);
+			normalSum += normals.back();
+		}
+
+		meshlet.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+		meshlet.coneCutoff = 2.0f;
+
+		float axisLength = glm::length(normalSum);
+
+		if (axisLength > 0.0f)
+		{
+			meshlet.coneAxis = normalSum / axisLength;
+
+			float minDot = 1.0f;
+
+			for (const auto& normal : normals)
+				minDot = std::min(minDot, glm::dot(normal, meshlet.coneAxis));
+
+			//Normals up to 90 degrees away from the axis can always face the viewer
+			if (minDot > 0.0f)
+				meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+		}
+
+		meshlets.push_back(meshlet);
+	}
+
+	std::copy(reordered.begin(), reordered.end(), indices.begin() + first);
+
+	return meshlets;
+}
+
+bool isMeshletVisible(const Meshlet& meshlet, const glm::mat4& model, float scale, VkExtent2D extent)
+{
+	//The vertex shader has no projection, so the world position is already in clip space with w = 1
+	glm::vec4 center = model * glm::vec4(meshlet.center, 1.0f);
+	float radius = meshlet.radius * scale;
+
+	//************************** FRUSTUM *****************************
+	if (center.x + radius < -1.0f || center.x - radius > 1.0f ||
+		center.y + radius < -1.0f || center.y - radius > 1.0f ||
+		center.z + radius < 0.0f || center.z - radius > 1.0f)
+		return false;
+
+	//************************** BACKFACE CONE *****************************
+	//The view direction is +Z everywhere
+	if (meshlet.coneCutoff <= 1.0f)
+	{
+		glm::mat3 rotation(model);
+		glm::vec3 axis = rotation * meshlet.coneAxis;
+
+		//A mirroring transform swaps the winding, so the front faces are on the other side
+		float determinant = glm::dot(glm::cross(rotation[0], rotation[1]), rotation[2]);
+
+		if (determinant < 0.0f)
+			axis = -axis;
+
+		float axisLength = glm::length(axis);
+
+		if (axisLength > 0.0f && axis.z / axisLength >= meshlet.coneCutoff)
+			return false;
+	}
+
+	//************************** SMALL CLUSTERS *****************************
+	//Nothing is rasterized if the bounds do not contain a single pixel center
+	float minX = (center.x - radius + 1.0f) * 0.5f * extent.width;
+	float maxX = (center.x + radius + 1.0f) * 0.5f * extent.width;
+	float minY = (center.y - radius + 1.0f) * 0.5f * extent.height;
+	float maxY = (center.y + radius + 1.0f) * 0.5f * extent.height;
+
+	if (std::floor(maxX - 0.5f) < std::ceil(minX - 0.5f) || std::floor(maxY - 0.5f) < std::ceil(minY - 0.5f))
+		return false;
+
+	return true;
+}
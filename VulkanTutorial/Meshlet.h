@@ -0,0 +1,34 @@
+#pragma once
+
+#include<vulkan/vulkan.h>
+#include<vector>
+#include<string>
+#include<stdexcept>
+#include<cstdint>
+#include<glm/glm.hpp>
+#include "Utilities.h"
+
+//Small cluster of triangles (at most MESHLET_MAX_VERTICES different vertices and MESHLET_MAX_TRIANGLES
+//triangles) whose indices are contiguous in the mesh's index buffer, so it can be drawn on its own
+struct Meshlet
+{
+	uint32_t firstIndex;
+	uint32_t triangleCount;
+
+	//Bounding sphere
+	glm::vec3 center;
+	float radius;
+
+	//Every front face normal of the meshlet is within the cone around "coneAxis". The whole meshlet faces
+	//away when dot(viewDirection, coneAxis) >= coneCutoff (a cutoff above 1 means it never does)
+	glm::vec3 coneAxis;
+	float coneCutoff;
+};
+
+//Reorders the triangles of indices[first, first + count) so that every meshlet is contiguous and returns
+//the meshlets, with "firstIndex" relative to the start of "indices"
+std::vector<Meshlet> buildMeshlets(const std::vector<VertexData>& vertices, std::vector<uint32_t>& indices, size_t first, size_t count);
+
+//Frustum, backface cone and small cluster test against the clip space the vertex shader outputs. "scale"
+//is the biggest scale of "model", the cone test assumes the scale is uniform
+bool isMeshletVisible(const Meshlet& meshlet, const glm::mat4& model, float scale, VkExtent2D extent);
@@ -0,0 +1,273 @@
+#include "PipelineLayoutCache.h"
+#include<algorithm>
+#include<map>
+#include "Utilities.h"
+
+namespace
+{
+	void appendHandle(std::vector<uint32_t>& key, uint64_t handle)
+	{
+		key.push_back((uint32_t)handle);
+		key.push_back((uint32_t)(handle >> 32));
+	}
+}
+
+size_t PipelineLayoutCache::KeyHash::operator()(const Key& key) const
+{
+	//FNV-1a over the words
+	uint64_t hash = 14695981039346656037ull;
+
+	for (uint32_t word : key)
+	{
+		hash ^= word;
+		hash *= 1099511628211ull;
+	}
+
+	return (size_t)hash;
+}
+
+PipelineLayoutCache::PipelineLayoutCache(VkDevice device) : device{ device }
+{
+}
+
+void PipelineLayoutCache::setExternalSetLayout(uint32_t set, VkDescriptorSetLayout layout, const std::vector<VkDescriptorSetLayoutBinding>& bindings)
+{
+	externalSetLayouts[set] = { layout, bindings };
+}
+
+VkDescriptorSetLayout PipelineLayoutCache::getExternalSetLayout(uint32_t set, const std::vector<VkDescriptorSetLayoutBinding>& bindings) const
+{
+	const ExternalSetLayout& external = externalSetLayouts.at(set);
+
+	for (const VkDescriptorSetLayoutBinding& binding : bindings)
+	{
+		auto match = std::find_if(external.bindings.begin(), external.bindings.end(),
+			[&](const VkDescriptorSetLayoutBinding& candidate) { return candidate.binding == binding.binding; });
+
+		//A runtime array (count 0) fits any size, the shader indexes it with what the application gives it
+		if (match == external.bindings.end() || match->descriptorType != binding.descriptorType ||
+			match->descriptorCount < binding.descriptorCount || (match->stageFlags & binding.stageFlags) != binding.stageFlags)
+			throw std::runtime_error("Shader descriptor does not match the layout of its set!");
+	}
+
+	return external.layout;
+}
+
+VkDescriptorSetLayout PipelineLayoutCache::getSetLayout(std::vector<VkDescriptorSetLayoutBinding> bindings)
+{
+	std::sort(bindings.begin(), bindings.end(),
+		[](const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b) { return a.binding < b.binding; });
+
+	Key key;
+	key.reserve(bindings.size() * 4);
+
+	for (const VkDescriptorSetLayoutBinding& binding : bindings)
+	{
+		if (binding.descriptorCount == 0)
+			throw std::runtime_error("Runtime descriptor arrays need a set layout given with setExternalSetLayout!");
+
+		key.push_back(binding.binding);
+		key.push_back((uint32_t)binding.descriptorType);
+		key.push_back(binding.descriptorCount);
+		key.push_back(binding.stageFlags);
+	}
+
+	lookups++;
+
+	auto found = setLayouts.find(key);
+
+	if (found != setLayouts.end())
+	{
+		hits++;
+		return found->second;
+	}
+
+	for (VkDescriptorSetLayoutBinding& binding : bindings)
+		binding.pImmutableSamplers = nullptr;
+
+	VkDescriptorSetLayoutCreateInfo layoutCreateInfo = {};
+	layoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutCreateInfo.pNext = nullptr;
+	layoutCreateInfo.flags = 0;
+	layoutCreateInfo.bindingCount = (uint32_t)bindings.size();
+	layoutCreateInfo.pBindings = bindings.data();
+
+	VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+	VkResult result = vkCreateDescriptorSetLayout(device, &layoutCreateInfo, getHostAllocator(), &layout);
+
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Failed to create a descriptor set layout!");
+
+	setLayouts.emplace(std::move(key), layout);
+
+	return layout;
+}
+
+VkPipelineLayout PipelineLayoutCache::getPipelineLayout(const std::vector<const ShaderReflection*>& stages)
+{
+	//************************** MERGE THE STAGES *****************************
+	std::map<uint32_t, std::vector<VkDescriptorSetLayoutBinding>> sets;
+
+	VkPushConstantRange pushConstants = {};
+	uint32_t pushConstantsEnd = 0;
+
+	for (const ShaderReflection* stage : stages)
+	{
+		for (const ShaderDescriptorBinding& descriptor : stage->bindings)
+		{
+			std::vector<VkDescriptorSetLayoutBinding>& bindings = sets[descriptor.set];
+
+			auto match = std::find_if(bindings.begin(), bindings.end(),
+				[&](const VkDescriptorSetLayoutBinding& binding) { return binding.binding == descriptor.binding; });
+
+			if (match == bindings.end())
+			{
+				VkDescriptorSetLayoutBinding binding = {};
+				binding.binding = descriptor.binding;
+				binding.descriptorType = descriptor.type;
+				binding.descriptorCount = descriptor.count;
+				binding.stageFlags = descriptor.stages;
+				binding.pImmutableSamplers = nullptr;
+
+				bindings.push_back(binding);
+				continue;
+			}
+
+			if (match->descriptorType != descriptor.type)
+				throw std::runtime_error("Shader stages declare the same binding with different descriptor types!");
+
+			//The biggest array any stage indexes, a runtime array stays one
+			match->descriptorCount = (match->descriptorCount == 0 || descriptor.count == 0) ? 0 : std::max(match->descriptorCount, descriptor.count);
+			match->stageFlags |= descriptor.stages;
+		}
+
+		if (stage->pushConstants.size == 0)
+			continue;
+
+		uint32_t end = stage->pushConstants.offset + stage->pushConstants.size;
+
+		pushConstants.offset = (pushConstants.stageFlags == 0) ? stage->pushConstants.offset : std::min(pushConstants.offset, stage->pushConstants.offset);
+		pushConstants.stageFlags |= stage->pushConstants.stageFlags;
+		pushConstantsEnd = std::max(pushConstantsEnd, end);
+	}
+
+	pushConstants.size = pushConstantsEnd - pushConstants.offset;
+
+	//************************** SET LAYOUTS *****************************
+	//Sets the shaders skip still need a layout, an empty one
+	uint32_t setCount = (sets.empty()) ? 0 : sets.rbegin()->first + 1;
+
+	for (const auto& external : externalSetLayouts)
+		setCount = std::max(setCount, external.first + 1);
+
+	std::vector<VkDescriptorSetLayout> layouts(setCount);
+
+	for (uint32_t i = 0; i < setCount; i++)
+	{
+		auto set = sets.find(i);
+		std::vector<VkDescriptorSetLayoutBinding> bindings = (set != sets.end()) ? set->second : std::vector<VkDescriptorSetLayoutBinding>();
+
+		layouts[i] = (externalSetLayouts.count(i) != 0) ? getExternalSetLayout(i, bindings) : getSetLayout(bindings);
+	}
+
+	//************************** PIPELINE LAYOUT *****************************
+	//The set layouts are hash-consed already, their handles stand for them
+	Key key;
+
+	for (VkDescriptorSetLayout layout : layouts)
+		appendHandle(key, (uint64_t)layout);
+
+	key.push_back(pushConstants.stageFlags);
+	key.push_back(pushConstants.offset);
+	key.push_back(pushConstants.size);
+
+	lookups++;
+
+	auto found = pipelineLayouts.find(key);
+
+	if (found != pipelineLayouts.end())
+	{
+		hits++;
+		return found->second;
+	}
+
+	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
+	pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutCreateInfo.pNext = nullptr;
+	pipelineLayoutCreateInfo.setLayoutCount = (uint32_t)layouts.size();
+	pipelineLayoutCreateInfo.pSetLayouts = layouts.data();
+	pipelineLayoutCreateInfo.pushConstantRangeCount = (pushConstants.size != 0) ? 1 : 0;
+	pipelineLayoutCreateInfo.pPushConstantRanges = (pushConstants.size != 0) ? &pushConstants : nullptr;
+
+	VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+	VkResult result = vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, getHostAllocator(), &pipelineLayout);
+
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Failed to create a pipeline layout!");
+
+	pipelineLayouts.emplace(std::move(key), pipelineLayout);
+	pipelineLayoutInfos[pipelineLayout] = { layouts, pushConstants };
+
+	return pipelineLayout;
+}
+
+VkShaderStageFlags PipelineLayoutCache::getPushConstantStages(VkPipelineLayout layout) const
+{
+	return pipelineLayoutInfos.at(layout).pushConstants.stageFlags;
+}
+
+uint32_t PipelineLayoutCache::getCompatibleSetCount(VkPipelineLayout first, VkPipelineLayout second) const
+{
+	if (first == VK_NULL_HANDLE || second == VK_NULL_HANDLE)
+		return 0;
+
+	const PipelineLayoutInfo& a = pipelineLayoutInfos.at(first);
+	const PipelineLayoutInfo& b = pipelineLayoutInfos.at(second);
+
+	//Layouts with different push constant ranges are not compatible for any set
+	if (a.pushConstants.stageFlags != b.pushConstants.stageFlags || a.pushConstants.offset != b.pushConstants.offset ||
+		a.pushConstants.size != b.pushConstants.size)
+		return 0;
+
+	uint32_t count = 0;
+
+	while (count < a.setLayouts.size() && count < b.setLayouts.size() && a.setLayouts[count] == b.setLayouts[count])
+		count++;
+
+	return count;
+}
+
+size_t PipelineLayoutCache::getSetLayoutCount() const
+{
+	return setLayouts.size();
+}
+
+size_t PipelineLayoutCache::getPipelineLayoutCount() const
+{
+	return pipelineLayouts.size();
+}
+
+uint64_t PipelineLayoutCache::getHitCount() const
+{
+	return hits;
+}
+
+uint64_t PipelineLayoutCache::getLookupCount() const
+{
+	return lookups;
+}
+
+void PipelineLayoutCache::destroy()
+{
+	for (auto& pipelineLayout : pipelineLayouts)
+		vkDestroyPipelineLayout(device, pipelineLayout.second, getHostAllocator());
+
+	//External set layouts belong to whoever gave them
+	for (auto& setLayout : setLayouts)
+		vkDestroyDescriptorSetLayout(device, setLayout.second, getHostAllocator());
+
+	pipelineLayouts.clear();
+	pipelineLayoutInfos.clear();
+	setLayouts.clear();
+	externalSetLayouts.clear();
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include<vulkan/vulkan.h>
+#include<vector>
+#include<unordered_map>
+#include<stdexcept>
+#include "ShaderReflection.h"
+
+//Descriptor set layouts and pipeline layouts built from the reflection of the shaders, hash-consed: a
+//layout with the same description as one made before is that same handle. Two pipeline layouts are
+//then compatible for a set exactly when they have the same handles up to it, so a set bound with one
+//stays bound with the other (getCompatibleSetCount).
+//
+//Every layout is owned by the cache and lives until destroy, the pipelines only borrow them
+class PipelineLayoutCache
+{
+private:
+	//Words of a layout description, compared whole on a hash match
+	typedef std::vector<uint32_t> Key;
+
+	struct KeyHash
+	{
+		size_t operator()(const Key& key) const;
+	};
+
+	struct PipelineLayoutInfo
+	{
+		std::vector<VkDescriptorSetLayout> setLayouts;
+		VkPushConstantRange pushConstants;
+	};
+
+	struct ExternalSetLayout
+	{
+		VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+		std::vector<VkDescriptorSetLayoutBinding> bindings;
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+
+	std::unordered_map<Key, VkDescriptorSetLayout, KeyHash> setLayouts;
+	std::unordered_map<Key, VkPipelineLayout, KeyHash> pipelineLayouts;
+	std::unordered_map<VkPipelineLayout, PipelineLayoutInfo> pipelineLayoutInfos;
+	std::unordered_map<uint32_t, ExternalSetLayout> externalSetLayouts;
+
+	uint64_t lookups = 0;
+	uint64_t hits = 0;
+
+	VkDescriptorSetLayout getExternalSetLayout(uint32_t set, const std::vector<VkDescriptorSetLayoutBinding>& bindings) const;
+
+public:
+	PipelineLayoutCache() = default;
+	PipelineLayoutCache(VkDevice device);
+
+	//A set whose layout is made somewhere else (the bindless set, with its binding flags and device sized
+	//arrays). The shaders using the set are checked against its bindings instead of making a layout
+	void setExternalSetLayout(uint32_t set, VkDescriptorSetLayout layout, const std::vector<VkDescriptorSetLayoutBinding>& bindings);
+
+	//The bindings are sorted by binding, immutable samplers are not part of the description
+	VkDescriptorSetLayout getSetLayout(std::vector<VkDescriptorSetLayoutBinding> bindings);
+
+	//The layout of a pipeline made of these stages: the descriptors of all of them merged by set and binding
+	//(their stage flags combined) and one push constant range covering the blocks of every stage, which
+	//vkCmdPushConstants is then called with
+	VkPipelineLayout getPipelineLayout(const std::vector<const ShaderReflection*>& stages);
+
+	VkShaderStageFlags getPushConstantStages(VkPipelineLayout layout) const;
+
+	//How many sets, from set 0, bound with one layout are still valid after binding a pipeline with the other
+	uint32_t getCompatibleSetCount(VkPipelineLayout first, VkPipelineLayout second) const;
+
+	size_t getSetLayoutCount() const;
+	size_t getPipelineLayoutCount() const;
+
+	//Lookups answered with an existing layout
+	uint64_t getHitCount() const;
+	uint64_t getLookupCount() const;
+
+	void destroy();
+};
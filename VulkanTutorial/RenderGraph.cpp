@@ -0,0 +1,514 @@
+#include "RenderGraph.h"
+#include "DebugUtils.h"
+#include<algorithm>
+
+RenderGraph::RenderGraph(MemoryBudget* memoryBudget, VkDevice device) :
+	memoryBudget{ memoryBudget }, device{ device } {
+}
+
+RenderGraphResource RenderGraph::createImage(const std::string& name, const RenderGraphImageDesc& desc)
+{
+	Resource resource = {};
+	resource.name = name;
+	resource.imported = false;
+	resource.desc = desc;
+
+	resources.push_back(resource);
+
+	return static_cast<RenderGraphResource>(resources.size() - 1);
+}
+
+RenderGraphResource RenderGraph::importImage(const std::string& name, VkImageAspectFlags aspect,
+	VkPipelineStageFlags initialStage, VkImageLayout initialLayout, VkImageLayout finalLayout)
+{
+	Resource resource = {};
+	resource.name = name;
+	resource.imported = true;
+	resource.desc.aspect = aspect;
+
+	//The stage the image is waited on (e.g. the stage the acquire semaphore waits at)
+	resource.initialState = { initialStage, 0, initialLayout };
+	resource.finalLayout = finalLayout;
+
+	resources.push_back(resource);
+
+	return static_cast<RenderGraphResource>(resources.size() - 1);
+}
+
+void RenderGraph::setImportedImages(RenderGraphResource resource, const std::vector<VkImage>& images)
+{
+	if (resource >= resources.size() || !resources[resource].imported)
+		throw std::runtime_error("Render graph resource is not an imported image!");
+
+	resources[resource].importedImages = images;
+}
+
+void RenderGraph::addPass(const std::string& name, const std::vector<RenderGraphUse>& uses, ExecuteFunction execute,
+	bool sideEffects)
+{
+	if (compiled)
+		throw std::runtime_error("Cannot add a pass to an already compiled render graph!");
+
+	for (size_t i = 0; i < uses.size(); i++)
+	{
+		if (uses[i].resource >= resources.size())
+			throw std::runtime_error("Render graph pass \"" + name + "\" uses an unknown resource!");
+
+		//A pass sees every image in a single layout
+		for (size_t j = i + 1; j < uses.size(); j++)
+			if (uses[i].resource == uses[j].resource)
+				throw std::runtime_error("Render graph pass \"" + name + "\" uses the same resource twice!");
+	}
+
+	Pass pass = {};
+	pass.name = name;
+	pass.uses = uses;
+	pass.execute = execute;
+	pass.sideEffects = sideEffects;
+
+	passes.push_back(pass);
+}
+
+void RenderGraph::compile()
+{
+	if (compiled)
+		throw std::runtime_error("Render graph already compiled!");
+
+	cullPasses();
+	computeLifetimes();
+	allocateTransientImages();
+	computeBarriers();
+
+	compiled = true;
+}
+
+void RenderGraph::execute(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+{
+	//Only the imported images change between executions
+	for (size_t i = 0; i < barriers.size(); i++)
+	{
+		const Resource& resource = resources[barrierResources[i]];
+		barriers[i].image = (resource.imported) ? resource.importedImages[imageIndex] : resource.image;
+	}
+
+	for (const Pass& pass : passes)
+	{
+		if (pass.culled)
+			continue;
+
+		//The barriers go inside the label, captures show them as part of the pass that needs them
+		beginDebugLabel(commandBuffer, pass.name.c_str());
+
+		if (pass.barrierCount > 0)
+			vkCmdPipelineBarrier(commandBuffer, pass.srcStageMask, pass.dstStageMask, 0,
+				0, nullptr, 0, nullptr, (uint32_t)pass.barrierCount, &barriers[pass.firstBarrier]);
+
+		pass.execute(commandBuffer, imageIndex);
+
+		endDebugLabel(commandBuffer);
+	}
+
+	size_t finalBarrierCount = barriers.size() - firstFinalBarrier;
+
+	if (finalBarrierCount > 0)
+		vkCmdPipelineBarrier(commandBuffer, finalSrcStageMask, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+			0, nullptr, 0, nullptr, (uint32_t)finalBarrierCount, &barriers[firstFinalBarrier]);
+}
+
+VkImageView RenderGraph::getImageView(RenderGraphResource resource) const
+{
+	if (resource >= resources.size() || resources[resource].imported)
+		throw std::runtime_error("Render graph resource is not a transient image!");
+
+	if (resources[resource].imageView == VK_NULL_HANDLE)
+		throw std::runtime_error("Render graph image \"" + resources[resource].name + "\" was never allocated!");
+
+	return resources[resource].imageView;
+}
+
+VkImage RenderGraph::getImage(RenderGraphResource resource) const
+{
+	if (resource >= resources.size() || resources[resource].imported)
+		throw std::runtime_error("Render graph resource is not a transient image!");
+
+	if (resources[resource].image == VK_NULL_HANDLE)
+		throw std::runtime_error("Render graph image \"" + resources[resource].name + "\" was never allocated!");
+
+	return resources[resource].image;
+}
+
+uint32_t RenderGraph::getCulledPassCount() const
+{
+	return (uint32_t)std::count_if(passes.begin(), passes.end(), [](const Pass& pass) { return pass.culled; });
+}
+
+uint32_t RenderGraph::getBarrierCount() const
+{
+	return (uint32_t)barriers.size();
+}
+
+VkDeviceSize RenderGraph::getTransientMemorySize() const
+{
+	VkDeviceSize size = 0;
+
+	for (const auto& block : memoryBlocks)
+		size += block.size;
+
+	return size;
+}
+
+VkDeviceSize RenderGraph::getUnaliasedMemorySize() const
+{
+	VkDeviceSize size = 0;
+
+	for (const auto& resource : resources)
+		if (resource.memoryBlock >= 0)
+			size += resource.memReqs.size;
+
+	return size;
+}
+
+void RenderGraph::destroy()
+{
+	for (auto& resource : resources)
+	{
+		if (resource.imageView != VK_NULL_HANDLE)
+			vkDestroyImageView(device, resource.imageView, getHostAllocator());
+
+		if (resource.image != VK_NULL_HANDLE)
+			vkDestroyImage(device, resource.image, getHostAllocator());
+	}
+
+	for (auto& block : memoryBlocks)
+		memoryBudget->free(block.memory);
+
+	resources.clear();
+	passes.clear();
+	memoryBlocks.clear();
+	barriers.clear();
+	barrierResources.clear();
+	compiled = false;
+}
+
+void RenderGraph::cullPasses()
+{
+	//Walking backwards from the imported images (the outputs of the graph), a pass is kept only if it
+	//uses an image that is needed afterwards or has side effects. Every image a kept pass uses becomes
+	//needed as well, since even a written attachment may be loaded
+	std::vector<bool> needed(resources.size(), false);
+
+	for (size_t i = 0; i < resources.size(); i++)
+		needed[i] = resources[i].imported;
+
+	for (auto pass = passes.rbegin(); pass != passes.rend(); pass++)
+	{
+		pass->culled = !pass->sideEffects && std::none_of(pass->uses.begin(), pass->uses.end(),
+			[&](const RenderGraphUse& use) { return needed[use.resource] && isWriteAccess(getAccessState(use.access).access); });
+
+		if (pass->culled)
+			continue;
+
+		for (const auto& use : pass->uses)
+			needed[use.resource] = true;
+	}
+}
+
+void RenderGraph::computeLifetimes()
+{
+	for (int i = 0; i < (int)passes.size(); i++)
+	{
+		if (passes[i].culled)
+			continue;
+
+		for (const auto& use : passes[i].uses)
+		{
+			Resource& resource = resources[use.resource];
+
+			if (resource.firstPass < 0)
+				resource.firstPass = i;
+
+			resource.lastPass = i;
+		}
+	}
+}
+
+void RenderGraph::allocateTransientImages()
+{
+	std::vector<RenderGraphResource> transients;
+
+	//************************** CREATE THE IMAGES *****************************
+	for (RenderGraphResource i = 0; i < resources.size(); i++)
+	{
+		Resource& resource = resources[i];
+
+		//Images only used by culled passes are never created
+		if (resource.imported || resource.firstPass < 0)
+			continue;
+
+		VkImageCreateInfo imageCreateInfo = {};
+		imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageCreateInfo.pNext = nullptr;
+		imageCreateInfo.flags = 0;
+		imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageCreateInfo.extent = { resource.desc.extent.width, resource.desc.extent.height, 1 };
+		imageCreateInfo.mipLevels = 1;
+		imageCreateInfo.arrayLayers = resource.desc.arrayLayers;
+		imageCreateInfo.format = resource.desc.format;
+		imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		imageCreateInfo.usage = resource.desc.usage;
+		imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		VkResult result = vkCreateImage(device, &imageCreateInfo, getHostAllocator(), &resource.image);
+
+		if (result != VK_SUCCESS)
+			throw std::runtime_error("Failed to create render graph image \"" + resource.name + "\"!");
+
+		setDebugName(device, VK_OBJECT_TYPE_IMAGE, (uint64_t)resource.image, resource.name.c_str());
+
+		vkGetImageMemoryRequirements(device, resource.image, &resource.memReqs);
+
+		transients.push_back(i);
+	}
+
+	//************************** ALIAS THE MEMORY *****************************
+	//Biggest images first, each one goes into the first block whose images are never alive
+	//at the same time as it (and that has a compatible memory type), otherwise a new block is made
+	std::sort(transients.begin(), transients.end(), [&](RenderGraphResource a, RenderGraphResource b)
+		{ return resources[a].memReqs.size > resources[b].memReqs.size; });
+
+	for (RenderGraphResource i : transients)
+	{
+		Resource& resource = resources[i];
+
+		auto block = std::find_if(memoryBlocks.begin(), memoryBlocks.end(), [&](const MemoryBlock& block)
+			{
+				if ((block.memoryTypeBits & resource.memReqs.memoryTypeBits) == 0)
+					return false;
+
+				return std::none_of(block.resources.begin(), block.resources.end(), [&](RenderGraphResource other)
+					{ return resource.firstPass <= resources[other].lastPass && resources[other].firstPass <= resource.lastPass; });
+			});
+
+		if (block == memoryBlocks.end())
+		{
+			memoryBlocks.push_back(MemoryBlock{});
+			block = memoryBlocks.end() - 1;
+		}
+
+		//Every image is bound at the start of its block, so only the size and alignment matter
+		block->size = std::max(block->size, resource.memReqs.size);
+		block->memoryTypeBits &= resource.memReqs.memoryTypeBits;
+		block->resources.push_back(i);
+
+		resource.memoryBlock = (int)(block - memoryBlocks.begin());
+	}
+
+	//************************** ALLOCATE AND BIND *****************************
+	for (auto& block : memoryBlocks)
+	{
+		//Every image of the block starts at offset 0, so the alignment does not matter
+		VkMemoryRequirements memReqs = {};
+		memReqs.size = block.size;
+		memReqs.memoryTypeBits = block.memoryTypeBits;
+
+		block.memory = memoryBudget->allocate(memReqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+		for (RenderGraphResource i : block.resources)
+		{
+			Resource& resource = resources[i];
+
+			vkBindImageMemory(device, resource.image, block.memory, 0);
+
+			VkImageViewCreateInfo imageViewCreateInfo = {};
+			imageViewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			imageViewCreateInfo.pNext = nullptr;
+			imageViewCreateInfo.flags = 0;
+			imageViewCreateInfo.image = resource.image;
+			imageViewCreateInfo.viewType = (resource.desc.arrayLayers > 1) ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+			imageViewCreateInfo.format = resource.desc.format;
+			imageViewCreateInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+			imageViewCreateInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+			imageViewCreateInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+			imageViewCreateInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+			imageViewCreateInfo.subresourceRange.aspectMask = resource.desc.aspect;
+			imageViewCreateInfo.subresourceRange.baseMipLevel = 0;
+			imageViewCreateInfo.subresourceRange.levelCount = 1;
+			imageViewCreateInfo.subresourceRange.baseArrayLayer = 0;
+			imageViewCreateInfo.subresourceRange.layerCount = resource.desc.arrayLayers;
+
+			VkResult result = vkCreateImageView(device, &imageViewCreateInfo, getHostAllocator(), &resource.imageView);
+
+			if (result != VK_SUCCESS)
+				throw std::runtime_error("Failed to create render graph image view \"" + resource.name + "\"!");
+		}
+	}
+}
+
+void RenderGraph::computeBarriers()
+{
+	//State each image is left in by its last use of the frame
+	std::vector<ImageState> lastStates(resources.size());
+
+	for (const auto& pass : passes)
+	{
+		if (pass.culled)
+			continue;
+
+		for (const auto& use : pass.uses)
+			lastStates[use.resource] = getAccessState(use.access);
+	}
+
+	std::vector<ImageState> states(resources.size());
+
+	for (RenderGraphResource i = 0; i < resources.size(); i++)
+	{
+		const Resource& resource = resources[i];
+
+		if (resource.imported)
+		{
+			states[i] = resource.initialState;
+			continue;
+		}
+
+		if (resource.memoryBlock < 0)
+			continue;
+
+		//The first use of a transient image has to wait for the previous user of its memory, which is
+		//the image of the block that was used last before it, or (wrapping around) the last user of the
+		//block in the previous frame. Its content is discarded, so the layout is always undefined
+		const MemoryBlock& block = memoryBlocks[resource.memoryBlock];
+
+		RenderGraphResource previous = i;
+		int previousLastPass = -1;
+		bool found = false;
+
+		for (RenderGraphResource other : block.resources)
+			if (resources[other].lastPass < resource.firstPass && resources[other].lastPass > previousLastPass)
+			{
+				previous = other;
+				previousLastPass = resources[other].lastPass;
+				found = true;
+			}
+
+		if (!found)
+			for (RenderGraphResource other : block.resources)
+				if (resources[other].lastPass > resources[previous].lastPass)
+					previous = other;
+
+		states[i] = { lastStates[previous].stage, lastStates[previous].access, VK_IMAGE_LAYOUT_UNDEFINED };
+	}
+
+	for (auto& pass : passes)
+	{
+		if (pass.culled)
+			continue;
+
+		pass.firstBarrier = barriers.size();
+
+		for (const auto& use : pass.uses)
+		{
+			ImageState& before = states[use.resource];
+			ImageState after = getAccessState(use.access);
+
+			bool layoutChange = before.layout != after.layout;
+			bool hazard = isWriteAccess(before.access) || (isWriteAccess(after.access) && before.access != 0);
+
+			//Reads after reads in the same layout need no barrier, the stages just accumulate
+			if (!layoutChange && !hazard)
+			{
+				before.stage |= after.stage;
+				before.access |= after.access;
+				continue;
+			}
+
+			pass.srcStageMask |= (before.stage != 0) ? before.stage : (VkPipelineStageFlags)VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+			pass.dstStageMask |= after.stage;
+
+			addBarrier(use.resource, before, after);
+
+			before = after;
+		}
+
+		pass.barrierCount = barriers.size() - pass.firstBarrier;
+	}
+
+	//************************** FINAL LAYOUTS *****************************
+	firstFinalBarrier = barriers.size();
+
+	for (RenderGraphResource i = 0; i < resources.size(); i++)
+	{
+		const Resource& resource = resources[i];
+
+		if (!resource.imported || resource.finalLayout == VK_IMAGE_LAYOUT_UNDEFINED || states[i].layout == resource.finalLayout)
+			continue;
+
+		finalSrcStageMask |= (states[i].stage != 0) ? states[i].stage : (VkPipelineStageFlags)VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+
+		addBarrier(i, states[i], { VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, resource.finalLayout });
+	}
+}
+
+void RenderGraph::addBarrier(RenderGraphResource resource, const ImageState& before, const ImageState& after)
+{
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.pNext = nullptr;
+
+	//Only the writes have to be made available, reads just need the execution dependency
+	barrier.srcAccessMask = before.access & (VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+		VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT);
+	barrier.dstAccessMask = after.access;
+	barrier.oldLayout = before.layout;
+	barrier.newLayout = after.layout;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = VK_NULL_HANDLE;
+	barrier.subresourceRange.aspectMask = resources[resource].desc.aspect;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+
+	barriers.push_back(barrier);
+	barrierResources.push_back(resource);
+}
+
+RenderGraph::ImageState RenderGraph::getAccessState(RenderGraphAccess access)
+{
+	switch (access)
+	{
+	case RenderGraphAccess::ColorAttachmentWrite:
+		return { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+
+	case RenderGraphAccess::DepthAttachmentWrite:
+		return { VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+
+	case RenderGraphAccess::DepthAttachmentRead:
+		return { VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+			VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL };
+
+	case RenderGraphAccess::ShaderRead:
+		return { VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+
+	case RenderGraphAccess::TransferRead:
+		return { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL };
+
+	case RenderGraphAccess::TransferWrite:
+		return { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL };
+	}
+
+	throw std::runtime_error("Unknown render graph access!");
+}
+
+bool RenderGraph::isWriteAccess(VkAccessFlags access)
+{
+	return (access & (VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+		VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT)) != 0;
+}
@@ -0,0 +1,162 @@
+#pragma once
+
+#include<vulkan/vulkan.h>
+#include<vector>
+#include<string>
+#include<functional>
+#include<stdexcept>
+#include "Utilities.h"
+#include "MemoryBudget.h"
+
+//How a pass uses an image, each one maps to a pipeline stage, an access mask and a layout
+enum class RenderGraphAccess
+{
+	ColorAttachmentWrite,
+	DepthAttachmentWrite,
+	DepthAttachmentRead,
+	ShaderRead,
+	TransferRead,
+	TransferWrite
+};
+
+//Image owned by the graph, it only lives between its first and last use within a frame
+//so its memory can be shared with other transient images that are not alive at the same time
+struct RenderGraphImageDesc
+{
+	VkFormat format;
+	VkExtent2D extent;
+	VkImageUsageFlags usage;
+	VkImageAspectFlags aspect;
+	uint32_t arrayLayers = 1;		//More than one makes a 2D array image and view (e.g. the views of a multiview pass)
+};
+
+using RenderGraphResource = uint32_t;
+
+struct RenderGraphUse
+{
+	RenderGraphResource resource;
+	RenderGraphAccess access;
+};
+
+class RenderGraph
+{
+public:
+	//Records the commands of a pass, the graph has already placed the barriers it needs
+	using ExecuteFunction = std::function<void(VkCommandBuffer commandBuffer, uint32_t imageIndex)>;
+
+	RenderGraph() = default;
+
+	RenderGraph(MemoryBudget* memoryBudget, VkDevice device);
+
+	RenderGraphResource createImage(const std::string& name, const RenderGraphImageDesc& desc);
+
+	//Images created outside of the graph (e.g. the swapchain images), one per image index. They are
+	//always considered an output of the graph and are left in "finalLayout" after the last pass
+	RenderGraphResource importImage(const std::string& name, VkImageAspectFlags aspect,
+		VkPipelineStageFlags initialStage, VkImageLayout initialLayout, VkImageLayout finalLayout);
+
+	void setImportedImages(RenderGraphResource resource, const std::vector<VkImage>& images);
+
+	//A pass with "sideEffects" is never culled, even if it writes no image (e.g. it copies one out of the graph)
+	void addPass(const std::string& name, const std::vector<RenderGraphUse>& uses, ExecuteFunction execute,
+		bool sideEffects = false);
+
+	//Culls the passes that do not contribute to an imported image, computes the barriers between
+	//the remaining ones and allocates (aliasing when possible) the memory of the transient images
+	void compile();
+
+	void execute(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+
+	VkImageView getImageView(RenderGraphResource resource) const;
+	VkImage getImage(RenderGraphResource resource) const;
+
+	uint32_t getCulledPassCount() const;
+	uint32_t getBarrierCount() const;
+
+	//Memory used by the transient images, and the memory they would have used without aliasing
+	VkDeviceSize getTransientMemorySize() const;
+	VkDeviceSize getUnaliasedMemorySize() const;
+
+	void destroy();
+
+private:
+	struct ImageState
+	{
+		VkPipelineStageFlags stage;
+		VkAccessFlags access;
+		VkImageLayout layout;
+	};
+
+	struct Resource
+	{
+		std::string name;
+		bool imported = false;
+		RenderGraphImageDesc desc = {};
+
+		//Only the transient images have a single image and view
+		VkImage image = VK_NULL_HANDLE;
+		VkImageView imageView = VK_NULL_HANDLE;
+		std::vector<VkImage> importedImages;
+
+		ImageState initialState = {};
+		VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		//Range of alive passes in which the image is used, -1 when it is never used
+		int firstPass = -1;
+		int lastPass = -1;
+
+		VkMemoryRequirements memReqs = {};
+		int memoryBlock = -1;
+	};
+
+	struct Pass
+	{
+		std::string name;
+		std::vector<RenderGraphUse> uses;
+		ExecuteFunction execute;
+		bool sideEffects = false;
+		bool culled = false;
+
+		//Barriers recorded before the pass ("barriers" range)
+		size_t firstBarrier = 0;
+		size_t barrierCount = 0;
+		VkPipelineStageFlags srcStageMask = 0;
+		VkPipelineStageFlags dstStageMask = 0;
+	};
+
+	struct MemoryBlock
+	{
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize size = 0;
+		uint32_t memoryTypeBits = ~0u;
+		std::vector<RenderGraphResource> resources;
+	};
+
+	MemoryBudget* memoryBudget = nullptr;
+	VkDevice device = VK_NULL_HANDLE;
+
+	std::vector<Resource> resources;
+	std::vector<Pass> passes;
+	std::vector<MemoryBlock> memoryBlocks;
+
+	//All the barriers of the frame, with the resource each one belongs to so the
+	//image handle of the imported resources can be patched when executing
+	std::vector<VkImageMemoryBarrier> barriers;
+	std::vector<RenderGraphResource> barrierResources;
+
+	//Barriers that leave the imported images in their final layout
+	size_t firstFinalBarrier = 0;
+	VkPipelineStageFlags finalSrcStageMask = 0;
+
+	bool compiled = false;
+
+	void cullPasses();
+	void computeLifetimes();
+	void allocateTransientImages();
+	void computeBarriers();
+
+	void addBarrier(RenderGraphResource resource, const ImageState& before, const ImageState& after);
+
+	static ImageState getAccessState(RenderGraphAccess access);
+	static bool isWriteAccess(VkAccessFlags access);
+};
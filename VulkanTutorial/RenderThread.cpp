@@ -0,0 +1,95 @@
+#include "RenderThread.h"
+#include "VulkanRenderer.h"
+
+RenderThread::~RenderThread()
+{
+	//An exception can not leave the destructor, call stop to get it
+	if (thread.joinable())
+	{
+		running = false;
+		thread.join();
+	}
+}
+
+void RenderThread::start(VulkanRenderer& renderer)
+{
+	if (thread.joinable())
+		throw std::runtime_error("Render thread is already running!");
+
+	this->renderer = &renderer;
+	error = nullptr;
+
+	//Every copy starts as the current scene, so the first ones the main thread fills already have the right sizes
+	SceneSnapshot snapshot;
+	renderer.captureSnapshot(snapshot);
+	snapshots.reset(snapshot);
+
+	drawnFrames = 0;
+	drawnSnapshot = snapshot.frame;
+	running = true;
+
+	thread = std::thread(&RenderThread::run, this);
+}
+
+void RenderThread::run()
+{
+	try
+	{
+		while (running)
+		{
+			if (snapshots.acquire())
+			{
+				renderer->applySnapshot(snapshots.getFront());
+				drawnSnapshot = snapshots.getFront().frame;
+			}
+
+			renderer->draw();
+			drawnFrames++;
+		}
+	}
+	catch (...)
+	{
+		error = std::current_exception();
+		running = false;
+	}
+}
+
+void RenderThread::stop()
+{
+	running = false;
+
+	if (thread.joinable())
+		thread.join();
+
+	if (error)
+	{
+		std::exception_ptr failure = error;
+		error = nullptr;
+		std::rethrow_exception(failure);
+	}
+}
+
+bool RenderThread::isRunning() const
+{
+	return running;
+}
+
+SceneSnapshot& RenderThread::getSnapshot()
+{
+	return snapshots.getBack();
+}
+
+void RenderThread::publishSnapshot()
+{
+	snapshots.publish();
+}
+
+uint64_t RenderThread::getDrawnFrameCount() const
+{
+	return drawnFrames;
+}
+
+uint64_t RenderThread::getDrawnSnapshotFrame() const
+{
+	return drawnSnapshot;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include<vector>
+#include<thread>
+#include<atomic>
+#include<exception>
+#include<glm/glm.hpp>
+#include "TripleBuffer.h"
+#include "SceneGraph.h"
+
+class VulkanRenderer;
+
+//The state of the scene the renderer draws, filled by the thread that runs the simulation. A snapshot is
+//never changed once it is published, the render thread only reads it.
+//
+//Only the local transforms of "changedNodes" are applied, so the scene costs nothing while it does not move.
+//The copy being filled holds the state of two snapshots ago and the render thread can skip snapshots, so a
+//node that moves is written and listed in every snapshot, until one taken after it stopped has been drawn
+//(see RenderThread::getDrawnSnapshotFrame)
+struct SceneSnapshot
+{
+	uint64_t frame = 0;								//Number of the simulation step it was taken at
+	std::vector<glm::mat4> localTransforms;			//By scene node handle
+	std::vector<SceneNode> changedNodes;			//Nodes whose local transform the simulation wrote
+	std::vector<uint32_t> instanceMaterials;		//By instance
+	std::vector<glm::mat4> viewMatrices;			//By view
+};
+
+//Draws frames on its own thread, so waiting for the GPU (the fences and the present) never holds up the
+//events and the simulation of the main thread, and they never hold up the submission. The main thread
+//publishes snapshots of the scene at its own rate, every frame draws the newest one there is.
+//
+//While it runs the renderer belongs to the render thread: the main thread only changes the scene through
+//the snapshots, and it keeps polling the window's events (GLFW only allows that on the main thread)
+class RenderThread
+{
+private:
+	VulkanRenderer* renderer = nullptr;
+	std::thread thread;
+
+	TripleBuffer<SceneSnapshot> snapshots;
+
+	std::atomic<bool> running{ false };
+	std::atomic<uint64_t> drawnFrames{ 0 };
+	std::atomic<uint64_t> drawnSnapshot{ 0 };
+	std::exception_ptr error;						//Written by the render thread before running turns false
+
+	void run();
+
+public:
+	RenderThread() = default;
+
+	RenderThread(const RenderThread&) = delete;
+	RenderThread& operator=(const RenderThread&) = delete;
+
+	~RenderThread();
+
+	//The renderer has to be initialized, the snapshots start from the scene it has
+	void start(VulkanRenderer& renderer);
+
+	//Stops drawing after the current frame (the renderer's cleanup waits for the GPU), rethrows what stopped the render thread if it failed
+	void stop();
+
+	//False once stopped or if drawing failed
+	bool isRunning() const;
+
+	//************************** MAIN THREAD *****************************
+	//The snapshot to fill before publishing it, it still holds an older state of the scene
+	SceneSnapshot& getSnapshot();
+	void publishSnapshot();
+
+	uint64_t getDrawnFrameCount() const;
+	uint64_t getDrawnSnapshotFrame() const;			//"frame" of the snapshot of the last frame drawn
+};
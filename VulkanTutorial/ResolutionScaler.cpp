@@ -0,0 +1,46 @@
+#include "ResolutionScaler.h"
+#include<stdexcept>
+
+ResolutionScaler::ResolutionScaler(double targetFrameTime, float minScale, float maxScale) :
+	targetFrameTime{ targetFrameTime }, minScale{ minScale }, maxScale{ maxScale }, scale{ maxScale }
+{
+	if (minScale <= 0.0f || minScale > maxScale || maxScale > 1.0f)
+		throw std::runtime_error("Invalid resolution scale bounds!");
+}
+
+bool ResolutionScaler::isEnabled() const
+{
+	return targetFrameTime > 0.0;
+}
+
+float ResolutionScaler::update(double frameTime, float frameScale)
+{
+	if (!isEnabled() || frameTime <= 0.0 || frameScale <= 0.0f)
+		return scale;
+
+	//************************** ESTIMATE *****************************
+	double measured = frameTime / (frameScale * frameScale);
+
+	fullScaleFrameTime = (fullScaleFrameTime == 0.0) ? measured : fullScaleFrameTime + SMOOTHING * (measured - fullScaleFrameTime);
+
+	//************************** CORRECTION *****************************
+	float wanted = (float)std::sqrt(targetFrameTime / fullScaleFrameTime);
+	wanted = std::min(std::max(wanted, minScale), maxScale);
+
+	float change = wanted - scale;
+
+	if (std::abs(change) < DEAD_BAND && wanted != minScale && wanted != maxScale)
+		return scale;
+
+	float next = scale + std::min(std::max(change, -MAX_STEP), MAX_STEP);
+	next = std::round(next * STEP_COUNT) / STEP_COUNT;
+
+	scale = std::min(std::max(next, minScale), maxScale);
+
+	return scale;
+}
+
+float ResolutionScaler::getScale() const
+{
+	return scale;
+}
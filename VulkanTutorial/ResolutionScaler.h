@@ -0,0 +1,40 @@
+#pragma once
+
+#include<algorithm>
+#include<cmath>
+
+//Picks the resolution scale of the scene (the fraction of the width and the height it is drawn at) that keeps
+//the GPU frame time at a target, from the time measured for every frame.
+//
+//The measurements come from a frame drawn a few frames ago at its own scale, so they are turned into the time
+//a frame at full scale would take (the time goes with the pixels, the square of the scale). That estimate is
+//smoothed, and the scale that would meet the target with it is where the scale moves to. Small corrections
+//are ignored and big ones are spread over a few frames, so the scale does not oscillate with the noise
+class ResolutionScaler
+{
+private:
+	static constexpr float SMOOTHING = 0.2f;		//Weight of a new measurement in the estimate
+	static constexpr float DEAD_BAND = 0.015f;	//Scale changes smaller than this are not made
+	static constexpr float MAX_STEP = 0.05f;		//Biggest scale change per frame
+	static constexpr float STEP_COUNT = 64.0f;		//The scale is a multiple of 1 / STEP_COUNT
+
+	double targetFrameTime = 0.0;
+	float minScale = 1.0f;
+	float maxScale = 1.0f;
+
+	float scale = 1.0f;
+	double fullScaleFrameTime = 0.0;		//Smoothed, 0 until the first measurement
+
+public:
+	ResolutionScaler() = default;
+
+	//"targetFrameTime" in milliseconds, 0 keeps the scale at maxScale
+	ResolutionScaler(double targetFrameTime, float minScale, float maxScale);
+
+	bool isEnabled() const;
+
+	//The GPU time of a finished frame and the scale it was drawn at, returns the scale of the next frame
+	float update(double frameTime, float frameScale);
+
+	float getScale() const;
+};
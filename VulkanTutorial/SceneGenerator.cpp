@@ -0,0 +1,98 @@
+#include "SceneGenerator.h"
+#include<random>
+#include<cmath>
+
+uint64_t GeneratedScene::getMeshBytes() const
+{
+	uint64_t bytes = 0;
+
+	for (const GeneratedMesh& mesh : meshes)
+		bytes += mesh.vertices.size() * sizeof(VertexData) + mesh.indices.size() * sizeof(uint32_t);
+
+	return bytes;
+}
+
+GeneratedMesh generateGridMesh(uint32_t triangles, uint32_t seed)
+{
+	if (triangles == 0)
+		throw std::runtime_error("A generated mesh needs at least one triangle!");
+
+	std::mt19937 random(seed);
+	std::uniform_real_distribution<float> colorDistribution(0.2f, 1.0f);
+
+	//As square as possible, two triangles per quad
+	uint32_t quads = (triangles + 1) / 2;
+	uint32_t columns = (uint32_t)std::ceil(std::sqrt((double)quads));
+	uint32_t rows = (quads + columns - 1) / columns;
+
+	GeneratedMesh mesh;
+	mesh.vertices.reserve((size_t)(columns + 1) * (rows + 1));
+	mesh.indices.reserve((size_t)triangles * 3);
+
+	for (uint32_t y = 0; y <= rows; y++)
+	{
+		for (uint32_t x = 0; x <= columns; x++)
+		{
+			float u = (float)x / columns;
+			float v = (float)y / rows;
+
+			glm::vec3 color(colorDistribution(random), colorDistribution(random), colorDistribution(random));
+
+			mesh.vertices.push_back(VertexData{ { u - 0.5f, v - 0.5f, 0.0f }, color, { u, v } });
+		}
+	}
+
+	for (uint32_t quad = 0; quad < quads; quad++)
+	{
+		uint32_t x = quad % columns;
+		uint32_t y = quad / columns;
+
+		uint32_t topLeft = y * (columns + 1) + x;
+		uint32_t bottomLeft = topLeft + columns + 1;
+
+		mesh.indices.insert(mesh.indices.end(), { topLeft, bottomLeft, topLeft + 1 });
+
+		//An odd count leaves the last quad with one triangle
+		if (mesh.indices.size() / 3 < triangles)
+			mesh.indices.insert(mesh.indices.end(), { topLeft + 1, bottomLeft, bottomLeft + 1 });
+	}
+
+	return mesh;
+}
+
+GeneratedScene generateScene(const SceneDescription& description)
+{
+	if (description.meshCount == 0)
+		throw std::runtime_error("A generated scene needs at least one mesh!");
+
+	std::mt19937 random(description.seed);
+	std::uniform_real_distribution<float> depthDistribution(0.1f, 0.9f);
+
+	GeneratedScene scene;
+
+	uint32_t meshCount = (description.instanced) ? 1 : description.meshCount;
+
+	for (uint32_t i = 0; i < meshCount; i++)
+		scene.meshes.push_back(generateGridMesh(description.trianglesPerMesh, description.seed + i));
+
+	//One cell of a square grid over [-1, 1] for every object
+	uint32_t side = (uint32_t)std::ceil(std::sqrt((double)description.meshCount));
+	float cellSize = 2.0f / side;
+
+	for (uint32_t i = 0; i < description.meshCount; i++)
+	{
+		glm::mat4 transform(1.0f);
+		transform[0][0] = cellSize * 0.9f;
+		transform[1][1] = cellSize * 0.9f;
+		transform[3] = glm::vec4(
+			-1.0f + cellSize * (i % side + 0.5f),
+			-1.0f + cellSize * (i / side + 0.5f),
+			depthDistribution(random),
+			1.0f);
+
+		scene.objectMeshes.push_back((description.instanced) ? 0 : i);
+		scene.objectTransforms.push_back(transform);
+	}
+
+	return scene;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include<vector>
+#include<cstdint>
+#include<stdexcept>
+#include<glm/glm.hpp>
+#include "Utilities.h"
+
+//Parameters of a synthetic scene, the same parameters and seed always give the same scene
+struct SceneDescription
+{
+	uint32_t meshCount = 1;				//Drawn objects
+	uint32_t trianglesPerMesh = 2;
+	bool instanced = false;				//One mesh drawn meshCount times instead of meshCount meshes
+	uint32_t seed = 1;
+};
+
+struct GeneratedMesh
+{
+	std::vector<VertexData> vertices;
+	std::vector<uint32_t> indices;
+};
+
+struct GeneratedScene
+{
+	std::vector<GeneratedMesh> meshes;
+
+	//Every object draws meshes[objectMeshes[i]] with objectTransforms[i]
+	std::vector<uint32_t> objectMeshes;
+	std::vector<glm::mat4> objectTransforms;
+
+	//Bytes of vertices and indices of all the meshes
+	uint64_t getMeshBytes() const;
+};
+
+//A grid of quads in [-0.5, 0.5] with random colors, cut to exactly "triangles" triangles
+GeneratedMesh generateGridMesh(uint32_t triangles, uint32_t seed);
+
+//The objects are tiled over clip space (there is no projection) at random depths, so they all pass
+//the culling and overlap only where the depth test has to sort them out
+GeneratedScene generateScene(const SceneDescription& description);
@@ -0,0 +1,288 @@
+#include "SceneGraph.h"
+#include<algorithm>
+
+//Below this many nodes to update it is faster to do it on the calling thread
+const size_t PARALLEL_UPDATE_THRESHOLD = 16384;
+
+//Nodes per task when the update is spread over the thread pool
+const uint32_t UPDATE_GRAIN_SIZE = 4096;
+
+void SceneGraph::reserve(size_t nodeCount)
+{
+	parents.reserve(nodeCount);
+	subtreeSizes.reserve(nodeCount);
+	localTransforms.reserve(nodeCount);
+	worldTransforms.reserve(nodeCount);
+	dirtyFlags.reserve(nodeCount);
+	indexToNode.reserve(nodeCount);
+	nodeToIndex.reserve(nodeCount);
+}
+
+SceneNode SceneGraph::addNode(SceneNode parent, const glm::mat4& localTransform)
+{
+	uint32_t parentIndex = INVALID_SCENE_NODE;
+
+	if (parent != INVALID_SCENE_NODE)
+	{
+		if (parent >= nodeToIndex.size())
+			throw std::runtime_error("Invalid parent scene node!");
+
+		parentIndex = nodeToIndex[parent];
+	}
+
+	uint32_t index = (uint32_t)parents.size();
+	SceneNode node = (SceneNode)nodeToIndex.size();
+
+	//Appending keeps the depth first order only if the parent's subtree ends right here, in which
+	//case it also ends here for all of its ancestors
+	if (!orderDirty && parentIndex != INVALID_SCENE_NODE)
+	{
+		if (parentIndex + subtreeSizes[parentIndex] == index)
+			for (uint32_t ancestor = parentIndex; ancestor != INVALID_SCENE_NODE; ancestor = parents[ancestor])
+				subtreeSizes[ancestor]++;
+		else
+			orderDirty = true;
+	}
+
+	parents.push_back(parentIndex);
+	subtreeSizes.push_back(1);
+	localTransforms.push_back(localTransform);
+	worldTransforms.push_back(localTransform);
+	dirtyFlags.push_back(1);
+	indexToNode.push_back(node);
+
+	nodeToIndex.push_back(index);
+	dirtyNodes.push_back(index);
+
+	return node;
+}
+
+void SceneGraph::setLocalTransform(SceneNode node, const glm::mat4& localTransform)
+{
+	if (node >= nodeToIndex.size())
+		throw std::runtime_error("Invalid scene node!");
+
+	uint32_t index = nodeToIndex[node];
+	localTransforms[index] = localTransform;
+
+	if (!dirtyFlags[index])
+	{
+		dirtyFlags[index] = 1;
+		dirtyNodes.push_back(index);
+	}
+}
+
+const glm::mat4& SceneGraph::getLocalTransform(SceneNode node) const
+{
+	return localTransforms[nodeToIndex.at(node)];
+}
+
+const glm::mat4& SceneGraph::getWorldTransform(SceneNode node) const
+{
+	return worldTransforms[nodeToIndex.at(node)];
+}
+
+SceneNode SceneGraph::getParent(SceneNode node) const
+{
+	uint32_t parentIndex = parents[nodeToIndex.at(node)];
+
+	return (parentIndex == INVALID_SCENE_NODE) ? INVALID_SCENE_NODE : indexToNode[parentIndex];
+}
+
+size_t SceneGraph::getNodeCount() const
+{
+	return parents.size();
+}
+
+void SceneGraph::updateTransforms(ThreadPool* threadPool)
+{
+	if (orderDirty)
+		sortNodes();
+
+	if (dirtyNodes.empty())
+		return;
+
+	//Sorted by index, a dirty node is either inside the subtree of the previous dirty root or
+	//starts a new one, so only the outermost changed subtrees are updated, once each
+	std::sort(dirtyNodes.begin(), dirtyNodes.end());
+
+	updateRanges.clear();
+	uint32_t coveredEnd = 0;
+	size_t nodesToUpdate = 0;
+
+	for (uint32_t index : dirtyNodes)
+	{
+		dirtyFlags[index] = 0;
+
+		if (index < coveredEnd)
+			continue;
+
+		coveredEnd = index + subtreeSizes[index];
+		nodesToUpdate += subtreeSizes[index];
+
+		updateRanges.push_back({ index, coveredEnd });
+	}
+
+	dirtyNodes.clear();
+
+	if (threadPool == nullptr || nodesToUpdate < PARALLEL_UPDATE_THRESHOLD)
+	{
+		for (const auto& range : updateRanges)
+			updateRange(range.begin, range.end);
+
+		return;
+	}
+
+	//Big subtrees are split into the subtrees of their children (their roots are updated here first)
+	//so that the pool gets ranges of a similar size that do not depend on each other
+	dirtyRanges.swap(updateRanges);
+	updateRanges.clear();
+
+	for (const auto& range : dirtyRanges)
+	{
+		if (range.end - range.begin > UPDATE_GRAIN_SIZE)
+			splitRange(range.begin, UPDATE_GRAIN_SIZE);
+		else
+			updateRanges.push_back(range);
+	}
+
+	size_t rangesPerTask = std::max<size_t>(updateRanges.size() / (4 * (threadPool->getThreadCount() + 1)), 1);
+
+	threadPool->parallelFor(updateRanges.size(), rangesPerTask, [this](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+				updateRange(updateRanges[i].begin, updateRanges[i].end);
+		});
+}
+
+void SceneGraph::splitRange(uint32_t node, uint32_t grainSize)
+{
+	updateRange(node, node + 1);
+
+	uint32_t end = node + subtreeSizes[node];
+	uint32_t child = node + 1;
+
+	//Consecutive small sibling subtrees are merged into a single range, all of their roots have
+	//the (already updated) node as parent
+	while (child < end)
+	{
+		if (subtreeSizes[child] > grainSize)
+		{
+			splitRange(child, grainSize);
+			child += subtreeSizes[child];
+			continue;
+		}
+
+		uint32_t rangeBegin = child;
+
+		while (child < end && subtreeSizes[child] <= grainSize && child + subtreeSizes[child] - rangeBegin <= grainSize)
+			child += subtreeSizes[child];
+
+		updateRanges.push_back({ rangeBegin, child });
+	}
+}
+
+void SceneGraph::updateRange(uint32_t begin, uint32_t end)
+{
+	//Parents come first, so they are always up to date when their children are reached
+	for (uint32_t i = begin; i < end; i++)
+	{
+		uint32_t parent = parents[i];
+
+		worldTransforms[i] = (parent == INVALID_SCENE_NODE) ?
+			localTransforms[i] : worldTransforms[parent] * localTransforms[i];
+	}
+}
+
+void SceneGraph::sortNodes()
+{
+	size_t nodeCount = parents.size();
+
+	//************************** CHILDREN LISTS (COUNTING SORT) *****************************
+	std::vector<uint32_t> childOffsets(nodeCount + 1, 0);
+
+	for (size_t i = 0; i < nodeCount; i++)
+		if (parents[i] != INVALID_SCENE_NODE)
+			childOffsets[parents[i] + 1]++;
+
+	for (size_t i = 0; i < nodeCount; i++)
+		childOffsets[i + 1] += childOffsets[i];
+
+	std::vector<uint32_t> children(childOffsets[nodeCount]);
+	std::vector<uint32_t> fill(childOffsets.begin(), childOffsets.end() - 1);
+
+	for (uint32_t i = 0; i < nodeCount; i++)
+		if (parents[i] != INVALID_SCENE_NODE)
+			children[fill[parents[i]]++] = i;
+
+	//************************** DEPTH FIRST ORDER *****************************
+	std::vector<uint32_t> newToOld;
+	newToOld.reserve(nodeCount);
+
+	std::vector<uint32_t> stack;
+
+	for (uint32_t root = 0; root < nodeCount; root++)
+	{
+		if (parents[root] != INVALID_SCENE_NODE)
+			continue;
+
+		stack.push_back(root);
+
+		while (!stack.empty())
+		{
+			uint32_t node = stack.back();
+			stack.pop_back();
+
+			newToOld.push_back(node);
+
+			//Pushed in reverse so the children keep their insertion order
+			for (uint32_t c = childOffsets[node + 1]; c > childOffsets[node]; c--)
+				stack.push_back(children[c - 1]);
+		}
+	}
+
+	std::vector<uint32_t> oldToNew(nodeCount);
+
+	for (uint32_t i = 0; i < nodeCount; i++)
+		oldToNew[newToOld[i]] = i;
+
+	//************************** PERMUTE THE ARRAYS *****************************
+	std::vector<uint32_t> newParents(nodeCount);
+	std::vector<glm::mat4> newLocalTransforms(nodeCount);
+	std::vector<glm::mat4> newWorldTransforms(nodeCount);
+	std::vector<uint8_t> newDirtyFlags(nodeCount);
+	std::vector<SceneNode> newIndexToNode(nodeCount);
+
+	for (uint32_t i = 0; i < nodeCount; i++)
+	{
+		uint32_t old = newToOld[i];
+
+		newParents[i] = (parents[old] == INVALID_SCENE_NODE) ? INVALID_SCENE_NODE : oldToNew[parents[old]];
+		newLocalTransforms[i] = localTransforms[old];
+		newWorldTransforms[i] = worldTransforms[old];
+		newDirtyFlags[i] = dirtyFlags[old];
+		newIndexToNode[i] = indexToNode[old];
+	}
+
+	parents.swap(newParents);
+	localTransforms.swap(newLocalTransforms);
+	worldTransforms.swap(newWorldTransforms);
+	dirtyFlags.swap(newDirtyFlags);
+	indexToNode.swap(newIndexToNode);
+
+	for (auto& index : nodeToIndex)
+		index = oldToNew[index];
+
+	for (auto& index : dirtyNodes)
+		index = oldToNew[index];
+
+	//Children come after their parents, so walking backwards every subtree is complete when
+	//it is added to its parent
+	std::fill(subtreeSizes.begin(), subtreeSizes.end(), 1);
+
+	for (size_t i = nodeCount; i-- > 0;)
+		if (parents[i] != INVALID_SCENE_NODE)
+			subtreeSizes[parents[i]] += subtreeSizes[i];
+
+	orderDirty = false;
+}
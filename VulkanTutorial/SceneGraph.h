@@ -0,0 +1,71 @@
+#pragma once
+
+#include<vector>
+#include<cstdint>
+#include<stdexcept>
+#include<glm/glm.hpp>
+#include "ThreadPool.h"
+
+//Stable handle of a node, it does not change when the nodes are reordered
+using SceneNode = uint32_t;
+
+const SceneNode INVALID_SCENE_NODE = ~0u;
+
+//Transform hierarchy stored as parallel arrays (SoA) in depth first order: a parent always comes
+//before its children and every subtree is a contiguous range [node, node + subtreeSize). Changing a
+//node only recomputes the world transforms of its own subtree
+class SceneGraph
+{
+private:
+	//**************************** PER NODE ARRAYS (BY INDEX) ****************************
+	std::vector<uint32_t> parents;				//Index of the parent, INVALID_SCENE_NODE for roots
+	std::vector<uint32_t> subtreeSizes;			//The node plus all of its descendants
+	std::vector<glm::mat4> localTransforms;		//Relative to the parent
+	std::vector<glm::mat4> worldTransforms;
+	std::vector<uint8_t> dirtyFlags;
+	std::vector<SceneNode> indexToNode;
+
+	//Index of every node handle
+	std::vector<uint32_t> nodeToIndex;
+
+	//Nodes whose local transform changed since the last update
+	std::vector<uint32_t> dirtyNodes;
+
+	//New nodes are appended, the depth first order is restored on the next update
+	bool orderDirty = false;
+
+	//Contiguous ranges whose first node's parent is already up to date
+	struct UpdateRange
+	{
+		uint32_t begin;
+		uint32_t end;
+	};
+
+	std::vector<UpdateRange> updateRanges;
+	std::vector<UpdateRange> dirtyRanges;		//Kept to reuse its memory, only used while splitting
+
+	void sortNodes();
+	void splitRange(uint32_t node, uint32_t grainSize);
+	void updateRange(uint32_t begin, uint32_t end);
+
+public:
+	SceneGraph() = default;
+
+	void reserve(size_t nodeCount);
+
+	SceneNode addNode(SceneNode parent = INVALID_SCENE_NODE, const glm::mat4& localTransform = glm::mat4(1.0f));
+
+	void setLocalTransform(SceneNode node, const glm::mat4& localTransform);
+
+	const glm::mat4& getLocalTransform(SceneNode node) const;
+
+	//Up to date after the last call to updateTransforms
+	const glm::mat4& getWorldTransform(SceneNode node) const;
+
+	SceneNode getParent(SceneNode node) const;
+
+	size_t getNodeCount() const;
+
+	//Recomputes the world transforms of the changed subtrees, spread over the pool when there is enough work
+	void updateTransforms(ThreadPool* threadPool = nullptr);
+};
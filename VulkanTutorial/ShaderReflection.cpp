@@ -0,0 +1,557 @@
+#include "ShaderReflection.h"
+#include<unordered_map>
+#include<algorithm>
+#include<cstring>
+
+namespace
+{
+	const uint32_t SPIRV_MAGIC = 0x07230203;
+	const uint32_t SPIRV_HEADER_WORDS = 5;
+
+	//The opcodes, decorations and storage classes the reflection needs (SPIR-V specification, section 3)
+	enum Op : uint32_t
+	{
+		OpName = 5,
+		OpEntryPoint = 15,
+		OpTypeBool = 20,
+		OpTypeInt = 21,
+		OpTypeFloat = 22,
+		OpTypeVector = 23,
+		OpTypeMatrix = 24,
+		OpTypeImage = 25,
+		OpTypeSampler = 26,
+		OpTypeSampledImage = 27,
+		OpTypeArray = 28,
+		OpTypeRuntimeArray = 29,
+		OpTypeStruct = 30,
+		OpTypePointer = 32,
+		OpConstant = 43,
+		OpSpecConstantTrue = 48,
+		OpSpecConstantFalse = 49,
+		OpSpecConstant = 50,
+		OpFunction = 54,
+		OpVariable = 59,
+		OpDecorate = 71,
+		OpMemberDecorate = 72
+	};
+
+	enum Decoration : uint32_t
+	{
+		DecorationSpecId = 1,
+		DecorationBlock = 2,
+		DecorationBufferBlock = 3,
+		DecorationArrayStride = 6,
+		DecorationMatrixStride = 7,
+		DecorationBuiltIn = 11,
+		DecorationLocation = 30,
+		DecorationBinding = 33,
+		DecorationDescriptorSet = 34,
+		DecorationOffset = 35
+	};
+
+	enum StorageClass : uint32_t
+	{
+		StorageClassUniformConstant = 0,
+		StorageClassInput = 1,
+		StorageClassUniform = 2,
+		StorageClassPushConstant = 9,
+		StorageClassStorageBuffer = 12
+	};
+
+	const uint32_t DIM_BUFFER = 5;
+	const uint32_t DIM_SUBPASS_DATA = 6;
+
+	const uint32_t NONE = ~0u;
+
+	struct Decorations
+	{
+		uint32_t location = NONE;
+		uint32_t binding = NONE;
+		uint32_t set = NONE;
+		uint32_t specId = NONE;
+		uint32_t arrayStride = 0;
+		bool builtIn = false;
+		bool block = false;
+		bool bufferBlock = false;
+	};
+
+	struct MemberDecorations
+	{
+		uint32_t offset = 0;
+		uint32_t matrixStride = 0;
+		bool builtIn = false;
+	};
+
+	//The operands after the result id
+	struct Type
+	{
+		uint32_t opcode = 0;
+		std::vector<uint32_t> operands;
+	};
+
+	struct Variable
+	{
+		uint32_t id;
+		uint32_t pointerType;
+		uint32_t storageClass;
+	};
+
+	struct SpecConstant
+	{
+		uint32_t id;
+		uint32_t type;
+		uint32_t value;
+	};
+
+	class Module
+	{
+	public:
+		std::unordered_map<uint32_t, std::string> names;
+		std::unordered_map<uint32_t, Decorations> decorations;
+		std::unordered_map<uint32_t, std::vector<MemberDecorations>> memberDecorations;
+		std::unordered_map<uint32_t, Type> types;
+		std::unordered_map<uint32_t, uint32_t> constants;
+		std::vector<Variable> variables;
+		std::vector<SpecConstant> specConstants;
+
+		uint32_t executionModel = NONE;
+		std::string entryPoint;
+
+		const Type& getType(uint32_t id) const
+		{
+			auto type = types.find(id);
+
+			if (type == types.end())
+				throw std::runtime_error("SPIR-V uses an undeclared type!");
+
+			return type->second;
+		}
+
+		const Decorations& getDecorations(uint32_t id) const
+		{
+			static const Decorations none;
+
+			auto found = decorations.find(id);
+			return (found != decorations.end()) ? found->second : none;
+		}
+
+		const MemberDecorations& getMemberDecorations(uint32_t id, uint32_t member) const
+		{
+			static const MemberDecorations none;
+
+			auto found = memberDecorations.find(id);
+			return (found != memberDecorations.end() && member < found->second.size()) ? found->second[member] : none;
+		}
+
+		std::string getName(uint32_t id) const
+		{
+			auto found = names.find(id);
+			return (found != names.end()) ? found->second : std::string();
+		}
+
+		//Bytes the type takes in a block, with the offsets and strides the compiler laid it out with
+		uint32_t getSize(uint32_t id, uint32_t matrixStride = 0) const
+		{
+			const Type& type = getType(id);
+
+			switch (type.opcode)
+			{
+			case OpTypeBool:
+				return 4;
+			case OpTypeInt:
+			case OpTypeFloat:
+				return type.operands[0] / 8;
+			case OpTypeVector:
+				return type.operands[1] * getSize(type.operands[0]);
+			case OpTypeMatrix:
+				return type.operands[1] * ((matrixStride != 0) ? matrixStride : getSize(type.operands[0]));
+			case OpTypeArray:
+			{
+				uint32_t stride = getDecorations(id).arrayStride;
+				return getArrayLength(type) * ((stride != 0) ? stride : getSize(type.operands[0]));
+			}
+			case OpTypeRuntimeArray:
+				return 0;
+			case OpTypeStruct:
+			{
+				uint32_t size = 0;
+
+				for (uint32_t i = 0; i < type.operands.size(); i++)
+				{
+					const MemberDecorations& member = getMemberDecorations(id, i);
+					size = std::max(size, member.offset + getSize(type.operands[i], member.matrixStride));
+				}
+
+				return size;
+			}
+			default:
+				throw std::runtime_error("SPIR-V block member has a type without a size!");
+			}
+		}
+
+		uint32_t getArrayLength(const Type& array) const
+		{
+			auto length = constants.find(array.operands[1]);
+
+			if (length == constants.end())
+				throw std::runtime_error("SPIR-V array length is not a constant!");
+
+			return length->second;
+		}
+	};
+
+	std::string readString(const uint32_t* words, uint32_t wordCount)
+	{
+		const char* string = reinterpret_cast<const char*>(words);
+		return std::string(string, strnlen(string, wordCount * sizeof(uint32_t)));
+	}
+
+	Module parseModule(const std::vector<char>& code)
+	{
+		if (code.size() % sizeof(uint32_t) != 0 || code.size() < SPIRV_HEADER_WORDS * sizeof(uint32_t))
+			throw std::runtime_error("Shader code is not SPIR-V!");
+
+		//The code comes from a file read as bytes, it is copied to have aligned words
+		std::vector<uint32_t> words(code.size() / sizeof(uint32_t));
+		memcpy(words.data(), code.data(), code.size());
+
+		if (words[0] != SPIRV_MAGIC)
+			throw std::runtime_error("Shader code is not SPIR-V!");
+
+		Module module;
+
+		size_t position = SPIRV_HEADER_WORDS;
+
+		while (position < words.size())
+		{
+			uint32_t opcode = words[position] & 0xFFFF;
+			uint32_t wordCount = words[position] >> 16;
+
+			if (wordCount == 0 || position + wordCount > words.size())
+				throw std::runtime_error("SPIR-V instruction runs past the end of the code!");
+
+			const uint32_t* operands = &words[position + 1];
+			uint32_t operandCount = wordCount - 1;
+
+			//Everything the reflection reads is declared before the first function
+			if (opcode == OpFunction)
+				break;
+
+			switch (opcode)
+			{
+			case OpName:
+				if (operandCount >= 2)
+					module.names[operands[0]] = readString(operands + 1, operandCount - 1);
+				break;
+
+			case OpEntryPoint:
+				//Only the first entry point is reflected, the renderer compiles one per module
+				if (module.executionModel == NONE && operandCount >= 3)
+				{
+					module.executionModel = operands[0];
+					module.entryPoint = readString(operands + 2, operandCount - 2);
+				}
+				break;
+
+			case OpDecorate:
+			{
+				if (operandCount < 2)
+					break;
+
+				Decorations& decorations = module.decorations[operands[0]];
+				uint32_t literal = (operandCount >= 3) ? operands[2] : 0;
+
+				switch (operands[1])
+				{
+				case DecorationSpecId:			decorations.specId = literal; break;
+				case DecorationBlock:			decorations.block = true; break;
+				case DecorationBufferBlock:		decorations.bufferBlock = true; break;
+				case DecorationArrayStride:		decorations.arrayStride = literal; break;
+				case DecorationBuiltIn:			decorations.builtIn = true; break;
+				case DecorationLocation:		decorations.location = literal; break;
+				case DecorationBinding:			decorations.binding = literal; break;
+				case DecorationDescriptorSet:	decorations.set = literal; break;
+				}
+				break;
+			}
+
+			case OpMemberDecorate:
+			{
+				if (operandCount < 3)
+					break;
+
+				std::vector<MemberDecorations>& members = module.memberDecorations[operands[0]];
+
+				if (members.size() <= operands[1])
+					members.resize(operands[1] + 1);
+
+				uint32_t literal = (operandCount >= 4) ? operands[3] : 0;
+
+				switch (operands[2])
+				{
+				case DecorationOffset:			members[operands[1]].offset = literal; break;
+				case DecorationMatrixStride:	members[operands[1]].matrixStride = literal; break;
+				case DecorationBuiltIn:			members[operands[1]].builtIn = true; break;
+				}
+				break;
+			}
+
+			case OpTypeBool:
+			case OpTypeInt:
+			case OpTypeFloat:
+			case OpTypeVector:
+			case OpTypeMatrix:
+			case OpTypeImage:
+			case OpTypeSampler:
+			case OpTypeSampledImage:
+			case OpTypeArray:
+			case OpTypeRuntimeArray:
+			case OpTypeStruct:
+			case OpTypePointer:
+				if (operandCount >= 1)
+					module.types[operands[0]] = { opcode, std::vector<uint32_t>(operands + 1, operands + operandCount) };
+				break;
+
+			case OpConstant:
+				if (operandCount >= 3)
+					module.constants[operands[1]] = operands[2];
+				break;
+
+			case OpSpecConstantTrue:
+			case OpSpecConstantFalse:
+				if (operandCount >= 2)
+					module.specConstants.push_back({ operands[1], operands[0], (opcode == OpSpecConstantTrue) ? 1u : 0u });
+				break;
+
+			case OpSpecConstant:
+				if (operandCount >= 3)
+				{
+					module.specConstants.push_back({ operands[1], operands[0], operands[2] });
+					module.constants[operands[1]] = operands[2];
+				}
+				break;
+
+			case OpVariable:
+				if (operandCount >= 3)
+					module.variables.push_back({ operands[1], operands[0], operands[2] });
+				break;
+			}
+
+			position += wordCount;
+		}
+
+		if (module.executionModel == NONE)
+			throw std::runtime_error("SPIR-V module has no entry point!");
+
+		return module;
+	}
+
+	VkShaderStageFlagBits getStage(uint32_t executionModel)
+	{
+		switch (executionModel)
+		{
+		case 0: return VK_SHADER_STAGE_VERTEX_BIT;
+		case 1: return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+		case 2: return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+		case 3: return VK_SHADER_STAGE_GEOMETRY_BIT;
+		case 4: return VK_SHADER_STAGE_FRAGMENT_BIT;
+		case 5: return VK_SHADER_STAGE_COMPUTE_BIT;
+		default:
+			throw std::runtime_error("SPIR-V entry point has an unsupported execution model!");
+		}
+	}
+
+	//The format with the components of a scalar or vector input type, VK_FORMAT_UNDEFINED for anything else
+	VkFormat getInputFormat(const Module& module, uint32_t typeId)
+	{
+		const Type& type = module.getType(typeId);
+
+		uint32_t componentCount = 1;
+		const Type* component = &type;
+
+		if (type.opcode == OpTypeVector)
+		{
+			componentCount = type.operands[1];
+			component = &module.getType(type.operands[0]);
+		}
+
+		if ((component->opcode != OpTypeInt && component->opcode != OpTypeFloat) || componentCount < 1 || componentCount > 4)
+			return VK_FORMAT_UNDEFINED;
+
+		static const VkFormat FLOAT32[] = { VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT };
+		static const VkFormat FLOAT64[] = { VK_FORMAT_R64_SFLOAT, VK_FORMAT_R64G64_SFLOAT, VK_FORMAT_R64G64B64_SFLOAT, VK_FORMAT_R64G64B64A64_SFLOAT };
+		static const VkFormat SINT32[] = { VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT };
+		static const VkFormat UINT32[] = { VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT };
+
+		uint32_t width = component->operands[0];
+
+		if (component->opcode == OpTypeFloat)
+			return (width == 64) ? FLOAT64[componentCount - 1] : (width == 32) ? FLOAT32[componentCount - 1] : VK_FORMAT_UNDEFINED;
+
+		if (width != 32)
+			return VK_FORMAT_UNDEFINED;
+
+		bool isSigned = component->operands[1] != 0;
+		return (isSigned) ? SINT32[componentCount - 1] : UINT32[componentCount - 1];
+	}
+
+	//The descriptor type of a resource variable, arrays are unwrapped into "count" first
+	VkDescriptorType getDescriptorType(const Module& module, uint32_t typeId, uint32_t storageClass, uint32_t& count)
+	{
+		const Type* type = &module.getType(typeId);
+		count = 1;
+
+		if (type->opcode == OpTypeArray)
+		{
+			count = module.getArrayLength(*type);
+			typeId = type->operands[0];
+			type = &module.getType(typeId);
+		}
+		else if (type->opcode == OpTypeRuntimeArray)
+		{
+			count = 0;
+			typeId = type->operands[0];
+			type = &module.getType(typeId);
+		}
+
+		switch (type->opcode)
+		{
+		case OpTypeSampler:
+			return VK_DESCRIPTOR_TYPE_SAMPLER;
+
+		case OpTypeSampledImage:
+		{
+			const Type& image = module.getType(type->operands[0]);
+			return (image.operands[1] == DIM_BUFFER) ? VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		}
+
+		case OpTypeImage:
+		{
+			//Operands: sampled type, dim, depth, arrayed, multisampled, sampled (1 with a sampler, 2 storage)
+			uint32_t dim = type->operands[1];
+			uint32_t sampled = type->operands[5];
+
+			if (dim == DIM_SUBPASS_DATA)
+				return VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+
+			if (dim == DIM_BUFFER)
+				return (sampled == 2) ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+
+			return (sampled == 2) ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+		}
+
+		case OpTypeStruct:
+			//SPIR-V before 1.3 declares storage buffers as Uniform blocks decorated BufferBlock
+			if (storageClass == StorageClassStorageBuffer || module.getDecorations(typeId).bufferBlock)
+				return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+
+			return VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+
+		default:
+			throw std::runtime_error("SPIR-V resource variable has an unsupported type!");
+		}
+	}
+}
+
+ShaderReflection reflectShader(const std::vector<char>& code)
+{
+	Module module = parseModule(code);
+
+	ShaderReflection reflection;
+	reflection.stage = getStage(module.executionModel);
+	reflection.entryPoint = module.entryPoint;
+
+	for (const Variable& variable : module.variables)
+	{
+		const Type& pointer = module.getType(variable.pointerType);
+
+		if (pointer.opcode != OpTypePointer)
+			throw std::runtime_error("SPIR-V variable is not a pointer!");
+
+		uint32_t typeId = pointer.operands[1];
+		const Decorations& decorations = module.getDecorations(variable.id);
+
+		switch (variable.storageClass)
+		{
+		case StorageClassInput:
+		{
+			//Built-ins and blocks (which only have locations on their members) are not fed by the application
+			if (decorations.builtIn || decorations.location == NONE)
+				break;
+
+			ShaderInput input;
+			input.location = decorations.location;
+			input.format = getInputFormat(module, typeId);
+			input.name = module.getName(variable.id);
+
+			reflection.inputs.push_back(input);
+			break;
+		}
+
+		case StorageClassUniformConstant:
+		case StorageClassUniform:
+		case StorageClassStorageBuffer:
+		{
+			ShaderDescriptorBinding binding;
+			binding.set = (decorations.set != NONE) ? decorations.set : 0;
+			binding.binding = (decorations.binding != NONE) ? decorations.binding : 0;
+			binding.type = getDescriptorType(module, typeId, variable.storageClass, binding.count);
+			binding.stages = reflection.stage;
+			binding.name = module.getName(variable.id);
+
+			reflection.bindings.push_back(binding);
+			break;
+		}
+
+		case StorageClassPushConstant:
+		{
+			const Type& block = module.getType(typeId);
+
+			if (block.opcode != OpTypeStruct)
+				throw std::runtime_error("SPIR-V push constant block is not a struct!");
+
+			//The range covers the members the block declares, from the first to the end of the last
+			uint32_t begin = NONE;
+
+			for (uint32_t i = 0; i < block.operands.size(); i++)
+				begin = std::min(begin, module.getMemberDecorations(typeId, i).offset);
+
+			reflection.pushConstants.stageFlags = reflection.stage;
+			reflection.pushConstants.offset = (begin != NONE) ? begin : 0;
+			reflection.pushConstants.size = module.getSize(typeId) - reflection.pushConstants.offset;
+			break;
+		}
+		}
+	}
+
+	for (const SpecConstant& specConstant : module.specConstants)
+	{
+		const Decorations& decorations = module.getDecorations(specConstant.id);
+
+		//Spec constant operations and constants without an id can not be set at pipeline creation
+		if (decorations.specId == NONE)
+			continue;
+
+		ShaderSpecializationConstant constant;
+		constant.id = decorations.specId;
+		constant.size = module.getSize(specConstant.type);
+		constant.defaultValue = specConstant.value;
+		constant.name = module.getName(specConstant.id);
+
+		reflection.specializationConstants.push_back(constant);
+	}
+
+	std::sort(reflection.inputs.begin(), reflection.inputs.end(),
+		[](const ShaderInput& a, const ShaderInput& b) { return a.location < b.location; });
+
+	std::sort(reflection.bindings.begin(), reflection.bindings.end(),
+		[](const ShaderDescriptorBinding& a, const ShaderDescriptorBinding& b)
+		{
+			return (a.set != b.set) ? a.set < b.set : a.binding < b.binding;
+		});
+
+	std::sort(reflection.specializationConstants.begin(), reflection.specializationConstants.end(),
+		[](const ShaderSpecializationConstant& a, const ShaderSpecializationConstant& b) { return a.id < b.id; });
+
+	return reflection;
+}
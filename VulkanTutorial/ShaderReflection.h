@@ -0,0 +1,49 @@
+#pragma once
+
+#include<vulkan/vulkan.h>
+#include<vector>
+#include<string>
+#include<stdexcept>
+
+//A vertex input (or the input of any other stage) read through a location, built-ins are left out
+struct ShaderInput
+{
+	uint32_t location = 0;
+	VkFormat format = VK_FORMAT_UNDEFINED;		//What the shader reads, the vertex buffer can hold anything that converts to it
+	std::string name;
+};
+
+struct ShaderDescriptorBinding
+{
+	uint32_t set = 0;
+	uint32_t binding = 0;
+	VkDescriptorType type = VK_DESCRIPTOR_TYPE_MAX_ENUM;
+	uint32_t count = 1;							//0 for runtime arrays (unsized, descriptor indexing)
+	VkShaderStageFlags stages = 0;
+	std::string name;
+};
+
+struct ShaderSpecializationConstant
+{
+	uint32_t id = 0;							//constant_id in GLSL, constantID of VkSpecializationMapEntry
+	uint32_t size = 0;							//Bytes the specialization data holds for it (booleans are a VkBool32)
+	uint32_t defaultValue = 0;					//Lower 32 bits of the value compiled in
+	std::string name;
+};
+
+//What a SPIR-V module takes from the outside, read straight from its declarations: the first entry point
+//and its stage, the inputs, the descriptors, the push constant block and the specialization constants.
+//Everything a pipeline layout or a vertex input state has to agree with
+struct ShaderReflection
+{
+	VkShaderStageFlagBits stage = VK_SHADER_STAGE_VERTEX_BIT;
+	std::string entryPoint;
+
+	std::vector<ShaderInput> inputs;						//Sorted by location
+	std::vector<ShaderDescriptorBinding> bindings;			//Sorted by set and binding
+	VkPushConstantRange pushConstants = {};					//Size 0 without a push constant block
+	std::vector<ShaderSpecializationConstant> specializationConstants;		//Sorted by id
+};
+
+//Throws if the code is not SPIR-V or uses a stage the renderer can not create
+ShaderReflection reflectShader(const std::vector<char>& code);
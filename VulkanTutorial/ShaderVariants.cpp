@@ -0,0 +1,203 @@
+#include "ShaderVariants.h"
+#include "DebugUtils.h"
+#include "AllocationCounter.h"
+#include "Utilities.h"
+
+namespace
+{
+	//The copies would point to structures that are gone
+	template<typename State>
+	State copyState(const State* state)
+	{
+		if (state == nullptr)
+			return State{};
+
+		if (state->pNext != nullptr)
+			throw std::runtime_error("Shader variants can not copy pipeline state with extension structures!");
+
+		return *state;
+	}
+
+	template<typename Element>
+	std::vector<Element> copyArray(const Element* elements, uint32_t count)
+	{
+		return (elements != nullptr) ? std::vector<Element>(elements, elements + count) : std::vector<Element>();
+	}
+}
+
+ShaderVariants::ShaderVariants(VkDevice device, VkPipelineCache pipelineCache, const VkGraphicsPipelineCreateInfo& createInfo,
+	const std::vector<const ShaderReflection*>& reflections, const std::string& name) :
+	device{ device }, pipelineCache{ pipelineCache }, name{ name }
+{
+	if (reflections.size() != createInfo.stageCount)
+		throw std::runtime_error("Shader variants need the reflection of every stage!");
+
+	if (createInfo.pTessellationState != nullptr)
+		throw std::runtime_error("Shader variants do not support tessellation!");
+
+	//************************** STAGES *****************************
+	for (uint32_t i = 0; i < createInfo.stageCount; i++)
+	{
+		const VkPipelineShaderStageCreateInfo& stageCreateInfo = createInfo.pStages[i];
+
+		Stage stage;
+		stage.stage = stageCreateInfo.stage;
+		stage.module = stageCreateInfo.module;
+		stage.entryPoint = stageCreateInfo.pName;
+
+		//One 4 byte value per feature constant, in the order the stage declares them
+		for (const ShaderSpecializationConstant& constant : reflections[i]->specializationConstants)
+		{
+			if (constant.id >= MAX_SHADER_FEATURE_BITS)
+				continue;
+
+			if (constant.size != sizeof(VkBool32))
+				throw std::runtime_error("Shader feature constant is not a boolean!");
+
+			VkSpecializationMapEntry entry = {};
+			entry.constantID = constant.id;
+			entry.offset = (uint32_t)(stage.featureEntries.size() * sizeof(VkBool32));
+			entry.size = sizeof(VkBool32);
+
+			stage.featureEntries.push_back(entry);
+		}
+
+		stages.push_back(stage);
+	}
+
+	//************************** FIXED FUNCTION STATE *****************************
+	vertexInputState = copyState(createInfo.pVertexInputState);
+	vertexBindings = copyArray(vertexInputState.pVertexBindingDescriptions, vertexInputState.vertexBindingDescriptionCount);
+	vertexAttributes = copyArray(vertexInputState.pVertexAttributeDescriptions, vertexInputState.vertexAttributeDescriptionCount);
+
+	inputAssemblyState = copyState(createInfo.pInputAssemblyState);
+
+	viewportState = copyState(createInfo.pViewportState);
+	viewports = copyArray(viewportState.pViewports, viewportState.viewportCount);
+	scissors = copyArray(viewportState.pScissors, viewportState.scissorCount);
+
+	rasterizationState = copyState(createInfo.pRasterizationState);
+	multisampleState = copyState(createInfo.pMultisampleState);
+	depthStencilState = copyState(createInfo.pDepthStencilState);
+
+	colorBlendState = copyState(createInfo.pColorBlendState);
+	blendAttachments = copyArray(colorBlendState.pAttachments, colorBlendState.attachmentCount);
+
+	if (createInfo.pDynamicState != nullptr)
+		dynamicStates = copyArray(createInfo.pDynamicState->pDynamicStates, createInfo.pDynamicState->dynamicStateCount);
+
+	layout = createInfo.layout;
+	renderPass = createInfo.renderPass;
+	subpass = createInfo.subpass;
+}
+
+VkPipeline ShaderVariants::createVariant(uint32_t features)
+{
+	//************************** SPECIALIZATION *****************************
+	std::vector<VkPipelineShaderStageCreateInfo> stageCreateInfos(stages.size());
+	std::vector<VkSpecializationInfo> specializationInfos(stages.size());
+	std::vector<std::vector<VkBool32>> featureValues(stages.size());
+
+	for (size_t i = 0; i < stages.size(); i++)
+	{
+		for (const VkSpecializationMapEntry& entry : stages[i].featureEntries)
+			featureValues[i].push_back(((features >> entry.constantID) & 1) ? VK_TRUE : VK_FALSE);
+
+		specializationInfos[i].mapEntryCount = (uint32_t)stages[i].featureEntries.size();
+		specializationInfos[i].pMapEntries = stages[i].featureEntries.data();
+		specializationInfos[i].dataSize = featureValues[i].size() * sizeof(VkBool32);
+		specializationInfos[i].pData = featureValues[i].data();
+
+		stageCreateInfos[i].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		stageCreateInfos[i].pNext = nullptr;
+		stageCreateInfos[i].flags = 0;
+		stageCreateInfos[i].stage = stages[i].stage;
+		stageCreateInfos[i].module = stages[i].module;
+		stageCreateInfos[i].pName = stages[i].entryPoint.c_str();
+		stageCreateInfos[i].pSpecializationInfo = (featureValues[i].empty()) ? nullptr : &specializationInfos[i];
+	}
+
+	//************************** STATE *****************************
+	VkPipelineVertexInputStateCreateInfo vertexInputCreateInfo = vertexInputState;
+	vertexInputCreateInfo.pVertexBindingDescriptions = vertexBindings.data();
+	vertexInputCreateInfo.pVertexAttributeDescriptions = vertexAttributes.data();
+
+	VkPipelineViewportStateCreateInfo viewportCreateInfo = viewportState;
+	viewportCreateInfo.pViewports = (viewports.empty()) ? nullptr : viewports.data();
+	viewportCreateInfo.pScissors = (scissors.empty()) ? nullptr : scissors.data();
+
+	VkPipelineColorBlendStateCreateInfo blendCreateInfo = colorBlendState;
+	blendCreateInfo.pAttachments = (blendAttachments.empty()) ? nullptr : blendAttachments.data();
+
+	VkPipelineDynamicStateCreateInfo dynamicCreateInfo = {};
+	dynamicCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicCreateInfo.dynamicStateCount = (uint32_t)dynamicStates.size();
+	dynamicCreateInfo.pDynamicStates = dynamicStates.data();
+
+	VkGraphicsPipelineCreateInfo pipelineCreateInfo = {};
+	pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipelineCreateInfo.pNext = nullptr;
+	pipelineCreateInfo.flags = 0;
+	pipelineCreateInfo.stageCount = (uint32_t)stageCreateInfos.size();
+	pipelineCreateInfo.pStages = stageCreateInfos.data();
+	pipelineCreateInfo.pVertexInputState = &vertexInputCreateInfo;
+	pipelineCreateInfo.pInputAssemblyState = &inputAssemblyState;
+	pipelineCreateInfo.pViewportState = &viewportCreateInfo;
+	pipelineCreateInfo.pRasterizationState = &rasterizationState;
+	pipelineCreateInfo.pMultisampleState = &multisampleState;
+	pipelineCreateInfo.pDepthStencilState = &depthStencilState;
+	pipelineCreateInfo.pColorBlendState = &blendCreateInfo;
+	pipelineCreateInfo.pDynamicState = (dynamicStates.empty()) ? nullptr : &dynamicCreateInfo;
+	pipelineCreateInfo.layout = layout;
+	pipelineCreateInfo.renderPass = renderPass;
+	pipelineCreateInfo.subpass = subpass;
+	pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
+	pipelineCreateInfo.basePipelineIndex = -1;
+
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	VkResult result = vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, getHostAllocator(), &pipeline);
+
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Failed to create a shader variant pipeline!");
+
+	std::string debugName = name + " (features " + std::to_string(features) + ")";
+	setDebugName(device, VK_OBJECT_TYPE_PIPELINE, (uint64_t)pipeline, debugName.c_str());
+
+	return pipeline;
+}
+
+VkPipeline ShaderVariants::getPipeline(uint32_t features)
+{
+	if (features >= (1u << MAX_SHADER_FEATURE_BITS))
+		throw std::runtime_error("Shader features do not fit in the feature bits!");
+
+	auto found = pipelines.find(features);
+
+	if (found != pipelines.end())
+		return found->second;
+
+	//Once per feature combination, the frame loop is allowed to allocate here
+	AllowAllocations allowAllocations;
+
+	VkPipeline pipeline = createVariant(features);
+	pipelines.emplace(features, pipeline);
+
+	return pipeline;
+}
+
+size_t ShaderVariants::getVariantCount() const
+{
+	return pipelines.size();
+}
+
+void ShaderVariants::destroy()
+{
+	for (auto& pipeline : pipelines)
+		vkDestroyPipeline(device, pipeline.second, getHostAllocator());
+
+	for (Stage& stage : stages)
+		vkDestroyShaderModule(device, stage.module, getHostAllocator());
+
+	pipelines.clear();
+	stages.clear();
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include<vulkan/vulkan.h>
+#include<vector>
+#include<string>
+#include<unordered_map>
+#include<stdexcept>
+#include "ShaderReflection.h"
+
+//Feature bits of the scene shaders. Feature bit i is the boolean specialization constant with constant_id i,
+//so every variant is compiled without the code of the features it does not have, from the same SPIR-V.
+//Constants with higher ids are not features and keep the value they were compiled with
+const uint32_t SHADER_FEATURE_BASE_COLOR_TEXTURE = 1 << 0;		//Multiplies the base color by its texture
+const uint32_t MAX_SHADER_FEATURE_BITS = 8;						//Same as the pipeline field of the draw keys
+
+//The pipelines of one set of shaders and fixed function state, one per combination of feature bits.
+//A variant is created the first time it is asked for, through the pipeline cache, and kept until destroy.
+//
+//The state of the create info is copied, so it does not have to outlive the constructor. The shader modules
+//of its stages are owned from then on, variants can be created at any time
+class ShaderVariants
+{
+private:
+	struct Stage
+	{
+		VkShaderStageFlagBits stage;
+		VkShaderModule module;
+		std::string entryPoint;
+		std::vector<VkSpecializationMapEntry> featureEntries;		//The feature constants the stage declares
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+	std::string name;
+
+	std::vector<Stage> stages;
+
+	//Fixed function state, the pointers between the structures are set again for every variant
+	std::vector<VkVertexInputBindingDescription> vertexBindings;
+	std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+	VkPipelineVertexInputStateCreateInfo vertexInputState = {};
+	VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = {};
+	std::vector<VkViewport> viewports;
+	std::vector<VkRect2D> scissors;
+	VkPipelineViewportStateCreateInfo viewportState = {};
+	VkPipelineRasterizationStateCreateInfo rasterizationState = {};
+	VkPipelineMultisampleStateCreateInfo multisampleState = {};
+	VkPipelineDepthStencilStateCreateInfo depthStencilState = {};
+	std::vector<VkPipelineColorBlendAttachmentState> blendAttachments;
+	VkPipelineColorBlendStateCreateInfo colorBlendState = {};
+	std::vector<VkDynamicState> dynamicStates;
+	VkPipelineLayout layout = VK_NULL_HANDLE;
+	VkRenderPass renderPass = VK_NULL_HANDLE;
+	uint32_t subpass = 0;
+
+	std::unordered_map<uint32_t, VkPipeline> pipelines;
+
+	VkPipeline createVariant(uint32_t features);
+
+public:
+	ShaderVariants() = default;
+
+	//"reflections" go with the stages of the create info, in the same order
+	ShaderVariants(VkDevice device, VkPipelineCache pipelineCache, const VkGraphicsPipelineCreateInfo& createInfo,
+		const std::vector<const ShaderReflection*>& reflections, const std::string& name);
+
+	//Creates the variant the first time, not thread safe
+	VkPipeline getPipeline(uint32_t features);
+
+	size_t getVariantCount() const;
+
+	void destroy();
+};
@@ -1,3 +1,3 @@
-C:/VulkanSDK/1.3.261.1/Bin/glslangValidator.exe -V shader.vert
-C:/VulkanSDK/1.3.261.1/Bin/glslangValidator.exe -V shader.frag
+C:/VulkanSDK/1.3.261.1/Bin/glslangValidator.exe -V --target-env vulkan1.2 shader.vert
+C:/VulkanSDK/1.3.261.1/Bin/glslangValidator.exe -V --target-env vulkan1.2 shader.frag
 pause
\ No newline at end of file
@@ -1,7 +1,43 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
 layout(location = 0) out vec4 outColour; 
 layout(location = 0) in vec3 vertexColor;
+layout(location = 1) in vec2 vertexUV;
+
+//World transform and material of the mesh being drawn (MeshPushConstants)
+layout(push_constant) uniform PushModel {
+	mat4 model;
+	uint materialBuffer;
+	uint material;
+	uint viewBuffer;
+} pushModel;
+
+//MaterialData
+struct Material {
+	vec4 baseColor;
+	uint baseColorTexture;
+};
+
+//Shader features (SHADER_FEATURE_* bits), set for every pipeline variant so the code of the
+//features a variant does not have is compiled out
+layout(constant_id = 0) const bool BASE_COLOR_TEXTURE = true;
+
+//Bindless arrays (BindlessDescriptors), indexed by the IDs pushed with every draw
+layout(set = 0, binding = 0) readonly buffer MaterialTable {
+	Material materials[];
+} buffers[];
+
+layout(set = 0, binding = 1) uniform sampler2D textures[];
 
 void main() {
-	outColour = vec4(vertexColor, 1.0);
+	Material material = buffers[pushModel.materialBuffer].materials[pushModel.material];
+
+	vec4 baseColor = material.baseColor;
+
+	//Only the materials that have a texture are drawn with this feature
+	if (BASE_COLOR_TEXTURE)
+		baseColor *= texture(textures[nonuniformEXT(material.baseColorTexture)], vertexUV);
+
+	outColour = vec4(vertexColor, 1.0) * baseColor;
 }
\ No newline at end of file
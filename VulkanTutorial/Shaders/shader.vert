@@ -1,11 +1,35 @@
 #version 450 		// Use GLSL 4.5
+#extension GL_EXT_multiview : require
+#extension GL_EXT_nonuniform_qualifier : require
 
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 color;
+layout(location = 2) in vec2 uv;
 
 layout(location = 0) out vec3 vertexColor;
+layout(location = 1) out vec2 vertexUV;
+
+//World transform and material of the mesh being drawn (MeshPushConstants)
+layout(push_constant) uniform PushModel {
+	mat4 model;
+	uint materialBuffer;
+	uint material;
+	uint viewBuffer;
+} pushModel;
+
+//Bindless buffers (BindlessDescriptors), the view matrices are one of them
+layout(set = 0, binding = 0) readonly buffer ViewTable {
+	mat4 viewMatrices[];
+} buffers[];
+
+//The depth pre-pass and the color pass test against each other's depth, both have to compute the exact same position
+invariant gl_Position;
 
 void main() {
-	gl_Position = vec4(position, 1.0);
+	//Every view of a multiview pass runs the shader with its own gl_ViewIndex (always 0 with one view)
+	mat4 view = buffers[pushModel.viewBuffer].viewMatrices[gl_ViewIndex];
+
+	gl_Position = view * pushModel.model * vec4(position, 1.0);
 	vertexColor = color;
+	vertexUV = uv;
 }
\ No newline at end of file
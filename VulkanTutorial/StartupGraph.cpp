@@ -0,0 +1,183 @@
+#include "StartupGraph.h"
+#include<chrono>
+#include<mutex>
+#include<condition_variable>
+#include<exception>
+#include<iomanip>
+#include<algorithm>
+
+StartupTask StartupGraph::addTask(const std::string& name, std::function<void()> function,
+	std::initializer_list<StartupTask> dependencies, bool mainThread)
+{
+	StartupTask task = (StartupTask)tasks.size();
+
+	for (StartupTask dependency : dependencies)
+	{
+		if (dependency >= task)
+			throw std::runtime_error("Startup task \"" + name + "\" depends on a task added after it!");
+
+		tasks[dependency].dependents.push_back(task);
+	}
+
+	tasks.emplace_back();
+	tasks[task].name = name;
+	tasks[task].function = std::move(function);
+	tasks[task].pendingDependencies = (uint32_t)dependencies.size();
+	tasks[task].mainThread = mainThread;
+
+	return task;
+}
+
+void StartupGraph::run(ThreadPool& pool)
+{
+	auto startTime = std::chrono::steady_clock::now();
+
+	auto millisecondsSinceStart = [startTime]()
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+	};
+
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::vector<StartupTask> mainThreadTasks;
+	size_t finishedTasks = 0;
+	std::exception_ptr error;
+
+	std::function<void(StartupTask)> schedule;
+
+	//Runs the task (unless something already failed) and schedules the dependents it was the last
+	//dependency of. Skipped tasks still go through here so everything finishes
+	auto execute = [&](StartupTask index)
+	{
+		Task& task = tasks[index];
+		bool failed = false;
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			failed = (error != nullptr);
+		}
+
+		if (!failed)
+		{
+			task.start = millisecondsSinceStart();
+			task.thread = std::this_thread::get_id();
+
+			try
+			{
+				task.function();
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+
+				if (error == nullptr)
+					error = std::current_exception();
+			}
+
+			task.end = millisecondsSinceStart();
+		}
+
+		std::vector<StartupTask> ready;
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			for (StartupTask dependent : task.dependents)
+				if (--tasks[dependent].pendingDependencies == 0)
+					ready.push_back(dependent);
+
+			//Once the last task is counted run can return, nothing of it is touched after this
+			finishedTasks++;
+			changed.notify_all();
+		}
+
+		for (StartupTask dependent : ready)
+			schedule(dependent);
+	};
+
+	schedule = [&](StartupTask index)
+	{
+		if (tasks[index].mainThread)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			mainThreadTasks.push_back(index);
+			changed.notify_all();
+		}
+		else
+		{
+			pool.submit([&execute, index]() { execute(index); });
+		}
+	};
+
+	//Counted before anything runs, the pool could change them as soon as the first task is submitted
+	std::vector<StartupTask> roots;
+
+	for (StartupTask i = 0; i < tasks.size(); i++)
+		if (tasks[i].pendingDependencies == 0)
+			roots.push_back(i);
+
+	for (StartupTask root : roots)
+		schedule(root);
+
+	//The calling thread runs the main thread tasks and waits for the rest
+	std::unique_lock<std::mutex> lock(mutex);
+
+	while (finishedTasks < tasks.size())
+	{
+		changed.wait(lock, [&]() { return !mainThreadTasks.empty() || finishedTasks == tasks.size(); });
+
+		while (!mainThreadTasks.empty())
+		{
+			StartupTask index = mainThreadTasks.back();
+			mainThreadTasks.pop_back();
+
+			lock.unlock();
+			execute(index);
+			lock.lock();
+		}
+	}
+
+	totalTime = millisecondsSinceStart();
+
+	if (error != nullptr)
+		std::rethrow_exception(error);
+}
+
+double StartupGraph::getTotalTime() const
+{
+	return totalTime;
+}
+
+void StartupGraph::printTimeline(std::ostream& stream, double firstFrameTime) const
+{
+	//Threads are numbered by the order they first show up in
+	std::vector<std::thread::id> threads;
+
+	size_t nameWidth = 0;
+
+	for (const Task& task : tasks)
+		nameWidth = std::max(nameWidth, task.name.size());
+
+	stream << "Startup timeline (ms):\n" << std::fixed << std::setprecision(2);
+
+	for (const Task& task : tasks)
+	{
+		stream << "  " << std::left << std::setw((int)nameWidth) << task.name << std::right;
+
+		if (task.start < 0.0)
+		{
+			stream << "  skipped\n";
+			continue;
+		}
+
+		auto thread = std::find(threads.begin(), threads.end(), task.thread);
+
+		if (thread == threads.end())
+			thread = threads.insert(threads.end(), task.thread);
+
+		stream << "  " << std::setw(9) << task.start << " - " << std::setw(9) << task.end
+			<< "  (" << std::setw(8) << task.end - task.start << ")  thread " << (thread - threads.begin()) << "\n";
+	}
+
+	stream << "  Startup: " << totalTime << " ms, first frame: " << firstFrameTime << " ms\n" << std::defaultfloat;
+}
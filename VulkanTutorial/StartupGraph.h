@@ -0,0 +1,53 @@
+#pragma once
+
+#include<vector>
+#include<string>
+#include<functional>
+#include<initializer_list>
+#include<thread>
+#include<ostream>
+#include<stdexcept>
+#include "ThreadPool.h"
+
+using StartupTask = uint32_t;
+
+//The steps of the renderer's startup and what each of them needs. A task starts on the pool as soon
+//as its dependencies are done, so independent steps (loading shaders, uploading meshes, compiling
+//pipelines...) overlap. Every task is timed for the startup timeline
+class StartupGraph
+{
+private:
+	struct Task
+	{
+		std::string name;
+		std::function<void()> function;
+		std::vector<StartupTask> dependents;
+		uint32_t pendingDependencies = 0;
+		bool mainThread = false;
+
+		//Milliseconds since the start of run, both -1 if the task was skipped after an error
+		double start = -1.0;
+		double end = -1.0;
+		std::thread::id thread;
+	};
+
+	std::vector<Task> tasks;
+	double totalTime = 0.0;
+
+public:
+	//Dependencies have to be added first, so the graph can not have cycles. Main thread tasks are run by
+	//the thread that calls run (GLFW only allows some of its functions there)
+	StartupTask addTask(const std::string& name, std::function<void()> function,
+		std::initializer_list<StartupTask> dependencies = {}, bool mainThread = false);
+
+	//Runs every task and returns once all of them are done. After the first exception no other task
+	//starts, and that exception is thrown again once the running ones finish
+	void run(ThreadPool& pool);
+
+	//Milliseconds the last run took
+	double getTotalTime() const;
+
+	//Start, end and thread of every task, followed by the time to the first frame (measured from the
+	//start of run as well)
+	void printTimeline(std::ostream& stream, double firstFrameTime) const;
+};
@@ -0,0 +1,360 @@
+#include<iostream>
+#include<fstream>
+#include<filesystem>
+#include<random>
+#include<functional>
+#include<cstring>
+#include<algorithm>
+#include<cstdlib>
+#include"AsyncFileReader.h"
+
+//Checks the reader against a file it writes to the temp directory, with io_uring (where the kernel has it) and
+//with the fallback threads: reads of every priority, a high priority read queued behind a burst of low priority
+//ones, cancel() and stop() with reads still queued, rejected reads and readFile(). Failures are reported on stderr, the exit code is
+//EXIT_FAILURE if there was any. Needs no GPU, run with ctest
+
+namespace
+{
+	const size_t FILE_SIZE = 16 << 20;
+	const size_t SMALL_READ_SIZE = 8 << 10;
+	const size_t LARGE_READ_SIZE = 64 << 10;
+
+	bool throwsError(const std::function<void()>& function)
+	{
+		try
+		{
+			function();
+		}
+		catch (const std::exception&)
+		{
+			return true;
+		}
+
+		return false;
+	}
+
+	class ReaderTest
+	{
+	private:
+		const std::string& path;
+		const std::vector<char>& contents;
+		const char* backend = "";
+		bool readsQueueUp = false;
+		uint32_t failures = 0;
+
+		void fail(const std::string& what)
+		{
+			std::cerr << "FAILED (" << backend << "): " << what << "\n";
+			failures++;
+		}
+
+		bool matches(const std::vector<char>& destination, size_t offset, size_t size)
+		{
+			return memcmp(destination.data() + offset, contents.data() + offset, size) == 0;
+		}
+
+		//Whether reads queue up depends on how fast they are read. Once the priority check saw them queue up, a
+		//check that never found a queued read is a failure
+		void notChecked(const std::string& what)
+		{
+			if (readsQueueUp)
+				fail(what + " never found a queued read");
+			else
+				std::cerr << "Note (" << backend << "): the reads were too fast to queue up, " << what << " was not checked\n";
+		}
+
+		//The whole file in small reads, the reads that did not happen leave zeros
+		void queueReads(AsyncFileReader& reader, FileHandle file, std::vector<char>& destination, ReadBatch& batch)
+		{
+			for (size_t offset = 0; offset < FILE_SIZE; offset += SMALL_READ_SIZE)
+				reader.read(file, offset, SMALL_READ_SIZE, destination.data() + offset, ReadPriority::Low, batch);
+		}
+
+		size_t countFinished(const std::vector<char>& destination)
+		{
+			size_t finished = 0;
+
+			for (size_t offset = 0; offset < FILE_SIZE; offset += SMALL_READ_SIZE)
+				if (matches(destination, offset, SMALL_READ_SIZE))
+					finished++;
+
+			return finished;
+		}
+
+		//Every offset of the file once, with the priorities mixed
+		void checkReads(AsyncFileReader& reader, FileHandle file)
+		{
+			std::vector<char> destination(FILE_SIZE, 0);
+			ReadBatch batch;
+
+			for (size_t offset = 0; offset < FILE_SIZE; offset += LARGE_READ_SIZE)
+				reader.read(file, offset, LARGE_READ_SIZE, destination.data() + offset, (ReadPriority)(offset / LARGE_READ_SIZE % READ_PRIORITY_COUNT), batch);
+
+			batch.wait();
+
+			if (batch.hasFailed() || destination != contents)
+				fail("reads of mixed priorities");
+
+			//Reused once done
+			batch.reset();
+
+			char bytes[16] = {};
+			reader.read(file, FILE_SIZE - sizeof(bytes), sizeof(bytes), bytes, ReadPriority::Normal, batch);
+			batch.wait();
+
+			if (batch.hasFailed() || memcmp(bytes, contents.data() + FILE_SIZE - sizeof(bytes), sizeof(bytes)) != 0)
+				fail("read of a reused batch");
+		}
+
+		//A high priority read queued after a burst of low priority ones only waits for those already started (at
+		//most the reader's queue depth), the others start after it. They all read into the same bytes (a race on
+		//purpose, ThreadSanitizer reports it), so what is left there is usually from one of those, in queue order
+		//it would be the high priority read's own. Only usually: a read can be preempted after it started, so it
+		//takes most of the attempts to fail. How many reads are still queued when it comes depends on how fast
+		//they are read, attempts with too few don't count
+		void checkPriority(AsyncFileReader& reader, FileHandle file)
+		{
+			const size_t lowReadCount = 256;
+			const size_t maxStarted = 32;			//AsyncFileReader::QUEUE_DEPTH
+			const uint32_t attempts = 32;
+			const uint32_t checkCount = 8;
+
+			std::vector<char> destination(SMALL_READ_SIZE, 0);
+			uint32_t checks = 0;
+			uint32_t highLast = 0;
+
+			for (uint32_t attempt = 0; attempt < attempts && checks < checkCount; attempt++)
+			{
+				//One batch per read, to see how many of them are left. The high priority read is the start of the file
+				std::vector<ReadBatch> lowBatches(lowReadCount);
+
+				for (size_t i = 0; i < lowReadCount; i++)
+					reader.read(file, (i + 1) * SMALL_READ_SIZE, SMALL_READ_SIZE, destination.data(), ReadPriority::Low, lowBatches[i]);
+
+				ReadBatch highBatch;
+				reader.read(file, 0, SMALL_READ_SIZE, destination.data(), ReadPriority::High, highBatch);
+
+				size_t pending = std::count_if(lowBatches.begin(), lowBatches.end(), [](ReadBatch& batch) { return !batch.isDone(); });
+
+				highBatch.wait();
+
+				for (ReadBatch& batch : lowBatches)
+					batch.wait();
+
+				bool failed = highBatch.hasFailed() ||
+					std::any_of(lowBatches.begin(), lowBatches.end(), [](ReadBatch& batch) { return batch.hasFailed(); });
+
+				if (failed)
+				{
+					fail("reads of different priorities");
+					return;
+				}
+
+				if (pending <= 2 * maxStarted)
+					continue;
+
+				checks++;
+
+				if (matches(destination, 0, SMALL_READ_SIZE))
+					highLast++;
+			}
+
+			readsQueueUp = (checks > 0);
+
+			if (checks == 0)
+				notChecked("the priority order");
+			else if (highLast * 2 > checks)
+				fail("high priority read finished after the low priority reads queued before it " + std::to_string(highLast) + " times in " + std::to_string(checks));
+		}
+
+		//The reads that had not started are failed and their destinations are left alone, the others still finish,
+		//other batches are not touched. Tried until a read was still queued at the cancel
+		void checkCancel(AsyncFileReader& reader, FileHandle file)
+		{
+			const size_t readCount = FILE_SIZE / SMALL_READ_SIZE;
+			const uint32_t attempts = 8;
+
+			std::vector<char> destination(FILE_SIZE);
+
+			for (uint32_t attempt = 0; attempt < attempts; attempt++)
+			{
+				std::fill(destination.begin(), destination.end(), 0);
+				ReadBatch cancelledBatch;
+
+				queueReads(reader, file, destination, cancelledBatch);
+
+				char bytes[16] = {};
+				ReadBatch otherBatch;
+
+				reader.read(file, 100, sizeof(bytes), bytes, ReadPriority::Normal, otherBatch);
+
+				size_t cancelled = reader.cancel(cancelledBatch);
+
+				//Waits for the reads in flight, the destination has to outlive them
+				cancelledBatch.wait();
+				otherBatch.wait();
+
+				if (cancelledBatch.hasFailed() != (cancelled > 0))
+					fail("batch failed by cancel() that cancelled " + std::to_string(cancelled) + " reads");
+
+				size_t finished = countFinished(destination);
+
+				if (finished != readCount - cancelled)
+					fail("cancel() returned " + std::to_string(cancelled) + " but " + std::to_string(readCount - finished) + " reads did not happen");
+
+				if (otherBatch.hasFailed() || memcmp(bytes, contents.data() + 100, sizeof(bytes)) != 0)
+					fail("read of another batch during a cancel");
+
+				//Nothing left to cancel
+				if (reader.cancel(cancelledBatch) != 0)
+					fail("second cancel() of a done batch");
+
+				if (cancelled > 0)
+					return;
+			}
+
+			notChecked("cancel() of queued reads");
+		}
+
+		void checkErrors(AsyncFileReader& reader, FileHandle file)
+		{
+			char bytes[16] = {};
+			ReadBatch batch;
+
+			if (!throwsError([&]() { reader.read(file, FILE_SIZE - 2, 4, bytes, ReadPriority::High, batch); }))
+				fail("read past the end of the file accepted");
+
+			if (!throwsError([&]() { reader.read(file + 1, 0, 4, bytes, ReadPriority::High, batch); }))
+				fail("invalid file handle accepted");
+
+			if (!batch.isDone() || batch.hasFailed())
+				fail("rejected read counted in its batch");
+
+			if (!throwsError([&]() { reader.readFile(path + ".missing"); }))
+				fail("missing file opened");
+
+			if (reader.readFile(path, ReadPriority::High) != contents)
+				fail("readFile()");
+		}
+
+		//The queued reads are failed (stop() does not wait for them) and their destinations are left alone, the
+		//batch still completes. Tried until a read was still queued at the stop, the reader is started again after each
+		void checkStop(AsyncFileReader& reader, bool allowIoUring)
+		{
+			const size_t readCount = FILE_SIZE / SMALL_READ_SIZE;
+			const uint32_t attempts = 8;
+
+			std::vector<char> destination(FILE_SIZE);
+
+			for (uint32_t attempt = 0; attempt < attempts; attempt++)
+			{
+				std::fill(destination.begin(), destination.end(), 0);
+				ReadBatch batch;
+
+				FileHandle file = reader.openFile(path);
+				queueReads(reader, file, destination, batch);
+
+				reader.stop();
+
+				if (!batch.isDone())
+					fail("batch not done after stop()");
+
+				size_t finished = countFinished(destination);
+
+				if (batch.hasFailed() != (finished < readCount))
+					fail("batch with " + std::to_string(readCount - finished) + " reads stopped before they started " + (batch.hasFailed() ? "" : "not ") + "failed");
+
+				if (reader.isRunning())
+					fail("running after stop()");
+
+				char bytes[16] = {};
+
+				if (!throwsError([&]() { reader.read(file, 0, sizeof(bytes), bytes, ReadPriority::High, batch); }))
+					fail("read after stop() accepted");
+
+				//The files were closed, they are opened again
+				reader.start(allowIoUring);
+
+				if (finished < readCount)
+					return;
+			}
+
+			notChecked("stop() with queued reads");
+		}
+
+	public:
+		ReaderTest(const std::string& path, const std::vector<char>& contents) :
+			path{ path }, contents{ contents } {
+		}
+
+		uint32_t run(bool allowIoUring)
+		{
+			AsyncFileReader reader;
+			reader.start(allowIoUring);
+
+			backend = reader.isUsingIoUring() ? "io_uring" : "threads";
+
+			if (allowIoUring && !reader.isUsingIoUring())
+				std::cerr << "io_uring is not available, the fallback threads were checked again\n";
+
+			FileHandle file = reader.openFile(path);
+
+			if (reader.getFileSize(file) != FILE_SIZE)
+				fail("file size");
+
+			checkReads(reader, file);
+			checkPriority(reader, file);
+			checkCancel(reader, file);
+			checkErrors(reader, file);
+			checkStop(reader, allowIoUring);
+
+			//Still reads after it was started again
+			file = reader.openFile(path);
+			checkReads(reader, file);
+
+			reader.stop();
+
+			return failures;
+		}
+	};
+}
+
+int main()
+{
+	std::string path = (std::filesystem::temp_directory_path() / "AsyncFileReaderTest.bin").string();
+
+	try
+	{
+		std::vector<char> contents(FILE_SIZE);
+		std::mt19937 random(4321);
+
+		for (char& byte : contents)
+			byte = (char)random();
+
+		{
+			std::ofstream file(path, std::ios::binary);
+			file.write(contents.data(), contents.size());
+
+			if (!file)
+				throw std::runtime_error("Failed to write " + path + "!");
+		}
+
+		uint32_t failures = ReaderTest(path, contents).run(true);
+		failures += ReaderTest(path, contents).run(false);
+
+		std::filesystem::remove(path);
+
+		std::cerr << "AsyncFileReader test: " << ((failures == 0) ? "passed" : std::to_string(failures) + " failures") << "\n";
+
+		return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "ERROR: " << e.what() << "\n";
+
+		std::error_code error;
+		std::filesystem::remove(path, error);
+
+		return EXIT_FAILURE;
+	}
+}
@@ -0,0 +1,354 @@
+#include<iostream>
+#include<functional>
+#include<unordered_map>
+#include<unordered_set>
+#include<cstdint>
+#include<cstdlib>
+#include"DescriptorAllocator.h"
+
+//Checks the descriptor allocator on the CPU, against a fake device: this program defines the pool and set
+//entry points the allocator calls (instead of linking the Vulkan loader), with pools that run out after
+//their maxSets. Covers the cache (hits, what tells two contents apart, the texel buffer views), what
+//the set writes point to, pool growth and reuse across frames. Failures are reported on stderr, the
+//exit code is EXIT_FAILURE if there was any. Needs no GPU, run with ctest
+
+namespace
+{
+	//************************** FAKE DEVICE *****************************
+	struct FakePool
+	{
+		uint32_t maxSets;
+		uint32_t allocatedSets;
+	};
+
+	struct FakeDevice
+	{
+		std::unordered_map<uint64_t, FakePool> pools;
+		uint64_t nextHandle = 1;
+		uint32_t createdPools = 0;
+		uint32_t destroyedPools = 0;
+
+		//The last vkUpdateDescriptorSets, copied (the allocator reuses its write array)
+		std::vector<VkWriteDescriptorSet> writes;
+		uint32_t updateCount = 0;
+	};
+
+	FakeDevice fakeDevice;
+
+	template<typename Handle>
+	Handle makeHandle()
+	{
+		return (Handle)(uintptr_t)fakeDevice.nextHandle++;
+	}
+
+	template<typename Handle>
+	uint64_t getHandleValue(Handle handle)
+	{
+		return (uint64_t)(uintptr_t)handle;
+	}
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateDescriptorPool(VkDevice, const VkDescriptorPoolCreateInfo* pCreateInfo,
+	const VkAllocationCallbacks*, VkDescriptorPool* pDescriptorPool)
+{
+	*pDescriptorPool = makeHandle<VkDescriptorPool>();
+	fakeDevice.pools[getHandleValue(*pDescriptorPool)] = { pCreateInfo->maxSets, 0 };
+	fakeDevice.createdPools++;
+
+	return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyDescriptorPool(VkDevice, VkDescriptorPool descriptorPool, const VkAllocationCallbacks*)
+{
+	fakeDevice.pools.erase(getHandleValue(descriptorPool));
+	fakeDevice.destroyedPools++;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkResetDescriptorPool(VkDevice, VkDescriptorPool descriptorPool, VkDescriptorPoolResetFlags)
+{
+	fakeDevice.pools.at(getHandleValue(descriptorPool)).allocatedSets = 0;
+
+	return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkAllocateDescriptorSets(VkDevice, const VkDescriptorSetAllocateInfo* pAllocateInfo,
+	VkDescriptorSet* pDescriptorSets)
+{
+	FakePool& pool = fakeDevice.pools.at(getHandleValue(pAllocateInfo->descriptorPool));
+
+	if (pool.allocatedSets + pAllocateInfo->descriptorSetCount > pool.maxSets)
+		return VK_ERROR_OUT_OF_POOL_MEMORY;
+
+	for (uint32_t i = 0; i < pAllocateInfo->descriptorSetCount; i++)
+		pDescriptorSets[i] = makeHandle<VkDescriptorSet>();
+
+	pool.allocatedSets += pAllocateInfo->descriptorSetCount;
+
+	return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkUpdateDescriptorSets(VkDevice, uint32_t descriptorWriteCount, const VkWriteDescriptorSet* pDescriptorWrites,
+	uint32_t, const VkCopyDescriptorSet*)
+{
+	fakeDevice.writes.assign(pDescriptorWrites, pDescriptorWrites + descriptorWriteCount);
+	fakeDevice.updateCount++;
+}
+
+namespace
+{
+	//************************** CHECKS *****************************
+	uint32_t failures = 0;
+
+	void fail(const std::string& what)
+	{
+		std::cerr << "FAILED: " << what << "\n";
+		failures++;
+	}
+
+	bool throwsError(const std::function<void()>& function)
+	{
+		try
+		{
+			function();
+		}
+		catch (const std::exception&)
+		{
+			return true;
+		}
+
+		return false;
+	}
+
+	DescriptorWrite makeBufferWrite(uint32_t binding, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
+	{
+		DescriptorWrite write;
+		write.binding = binding;
+		write.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		write.buffer = { buffer, offset, range };
+
+		return write;
+	}
+
+	DescriptorWrite makeImageWrite(uint32_t binding, VkSampler sampler, VkImageView imageView)
+	{
+		DescriptorWrite write;
+		write.binding = binding;
+		write.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		write.image = { sampler, imageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+
+		return write;
+	}
+
+	DescriptorWrite makeTexelWrite(uint32_t binding, VkBufferView view)
+	{
+		DescriptorWrite write;
+		write.binding = binding;
+		write.type = VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+		write.texelBufferView = view;
+
+		return write;
+	}
+
+	//Same layout and content is the same set, written once. Only the part of a DescriptorWrite that describes
+	//its type tells contents apart
+	void checkCache(VkDevice device)
+	{
+		DescriptorAllocator allocator(device);
+
+		VkDescriptorSetLayout layout = makeHandle<VkDescriptorSetLayout>();
+		VkDescriptorSetLayout otherLayout = makeHandle<VkDescriptorSetLayout>();
+		VkBuffer buffer = makeHandle<VkBuffer>();
+		VkSampler sampler = makeHandle<VkSampler>();
+		VkImageView imageView = makeHandle<VkImageView>();
+
+		//Two views of the same buffer range, with the buffer info filled in the same way
+		VkBufferView texelView = makeHandle<VkBufferView>();
+		VkBufferView otherTexelView = makeHandle<VkBufferView>();
+
+		std::vector<DescriptorWrite> bufferContent = { makeBufferWrite(0, buffer, 0, 256) };
+		std::vector<DescriptorWrite> imageContent = { makeImageWrite(0, sampler, imageView) };
+
+		std::vector<DescriptorWrite> texelContent = { makeTexelWrite(0, texelView) };
+		std::vector<DescriptorWrite> otherTexelContent = { makeTexelWrite(0, otherTexelView) };
+		texelContent[0].buffer = otherTexelContent[0].buffer = { buffer, 0, 256 };
+
+		uint32_t updatesBefore = fakeDevice.updateCount;
+		VkDescriptorSet bufferSet = allocator.getCachedSet(layout, bufferContent);
+
+		if (allocator.getCachedSet(layout, bufferContent) != bufferSet)
+			fail("same content did not give the same cached set");
+
+		if (fakeDevice.updateCount != updatesBefore + 1)
+			fail("cached set written " + std::to_string(fakeDevice.updateCount - updatesBefore) + " times");
+
+		std::vector<DescriptorWrite> otherRange = { makeBufferWrite(0, buffer, 0, 128) };
+
+		if (allocator.getCachedSet(layout, otherRange) == bufferSet)
+			fail("buffer ranges not told apart");
+
+		if (allocator.getCachedSet(otherLayout, bufferContent) == bufferSet)
+			fail("layouts not told apart");
+
+		VkDescriptorSet texelSet = allocator.getCachedSet(layout, texelContent);
+
+		if (allocator.getCachedSet(layout, otherTexelContent) == texelSet)
+			fail("texel buffer views of the same buffer range not told apart");
+
+		if (allocator.getCachedSet(layout, texelContent) != texelSet)
+			fail("same texel buffer view did not give the same cached set");
+
+		//The buffer info does not describe an image descriptor
+		VkDescriptorSet imageSet = allocator.getCachedSet(layout, imageContent);
+		imageContent[0].buffer = { buffer, 64, 64 };
+
+		if (allocator.getCachedSet(layout, imageContent) != imageSet)
+			fail("unused buffer info of an image descriptor told apart");
+
+		if (allocator.getCachedSetCount() != 6 || allocator.getCacheHitCount() != 3 || allocator.getCacheLookupCount() != 9)
+			fail("cache counted " + std::to_string(allocator.getCachedSetCount()) + " sets, " + std::to_string(allocator.getCacheHitCount()) +
+				" hits in " + std::to_string(allocator.getCacheLookupCount()) + " lookups");
+
+		//Cleared, the sets are allocated and written again from the same pools
+		uint32_t poolCount = allocator.getPoolCount();
+		allocator.clearCache();
+
+		updatesBefore = fakeDevice.updateCount;
+		allocator.getCachedSet(layout, bufferContent);
+
+		if (allocator.getCachedSetCount() != 1 || fakeDevice.updateCount != updatesBefore + 1 || allocator.getPoolCount() != poolCount)
+			fail("cache not cleared");
+
+		allocator.destroy();
+	}
+
+	//Each descriptor is written through the pointer its type reads, the others stay null
+	void checkWrites(VkDevice device)
+	{
+		DescriptorAllocator allocator(device);
+
+		VkDescriptorSetLayout layout = makeHandle<VkDescriptorSetLayout>();
+		VkBufferView texelView = makeHandle<VkBufferView>();
+
+		std::vector<DescriptorWrite> content = {
+			makeBufferWrite(0, makeHandle<VkBuffer>(), 16, 32),
+			makeImageWrite(1, makeHandle<VkSampler>(), makeHandle<VkImageView>()),
+			makeTexelWrite(2, texelView)
+		};
+
+		content[2].type = VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER;
+
+		VkDescriptorSet set = allocator.allocate(layout, content);
+		const std::vector<VkWriteDescriptorSet>& writes = fakeDevice.writes;
+
+		if (writes.size() != 3)
+		{
+			fail("set written with " + std::to_string(writes.size()) + " of 3 descriptors");
+			return;
+		}
+
+		for (const VkWriteDescriptorSet& write : writes)
+			if (write.dstSet != set || write.descriptorCount != 1)
+				fail("descriptor written to binding " + std::to_string(write.dstBinding) + " of another set");
+
+		if (writes[0].pBufferInfo != &content[0].buffer || writes[0].pImageInfo != nullptr || writes[0].pTexelBufferView != nullptr)
+			fail("buffer descriptor not written from its buffer info");
+
+		if (writes[1].pImageInfo != &content[1].image || writes[1].pBufferInfo != nullptr || writes[1].pTexelBufferView != nullptr)
+			fail("image descriptor not written from its image info");
+
+		if (writes[2].pTexelBufferView == nullptr || *writes[2].pTexelBufferView != texelView ||
+			writes[2].pBufferInfo != nullptr || writes[2].pImageInfo != nullptr)
+			fail("texel buffer descriptor not written from its buffer view");
+
+		//Nothing in a DescriptorWrite describes an inline uniform block
+		DescriptorWrite inlineBlock;
+		inlineBlock.type = VK_DESCRIPTOR_TYPE_INLINE_UNIFORM_BLOCK;
+
+		if (!throwsError([&]() { allocator.getCachedSet(layout, { inlineBlock }); }))
+			fail("inline uniform block accepted");
+
+		allocator.destroy();
+	}
+
+	//A full pool is followed by one with twice the sets. Once the frames come around, their pools are reset and
+	//taken again, no pool is created after the first frames
+	void checkPools(VkDevice device)
+	{
+		DescriptorAllocator allocator(device);
+		VkDescriptorSetLayout layout = makeHandle<VkDescriptorSetLayout>();
+
+		uint32_t createdBefore = fakeDevice.createdPools;
+		std::unordered_set<uint64_t> sets;
+
+		allocator.nextFrame(0);
+
+		for (uint32_t i = 0; i < 64; i++)
+			sets.insert(getHandleValue(allocator.allocate(layout)));
+
+		if (allocator.getPoolCount() != 1)
+			fail(std::to_string(allocator.getPoolCount()) + " pools for the sets of the first pool");
+
+		for (uint32_t i = 0; i < 128; i++)
+			sets.insert(getHandleValue(allocator.allocate(layout)));
+
+		if (allocator.getPoolCount() != 2)
+			fail(std::to_string(allocator.getPoolCount()) + " pools for the sets of a pool and of one twice as big");
+
+		if (sets.size() != 192 || allocator.getFrameAllocationCount() != 192)
+			fail("frame sets not all different");
+
+		//Every frame in flight allocates as much, a few times around
+		for (uint32_t round = 0; round < 4; round++)
+		{
+			for (uint32_t frame = 0; frame < MAX_FRAME_COUNT; frame++)
+			{
+				allocator.nextFrame(frame);
+
+				for (uint32_t i = 0; i < 192; i++)
+					allocator.allocate(layout);
+			}
+		}
+
+		uint32_t poolCount = allocator.getPoolCount();
+
+		for (uint32_t frame = 0; frame < MAX_FRAME_COUNT; frame++)
+		{
+			allocator.nextFrame(frame);
+
+			for (uint32_t i = 0; i < 192; i++)
+				allocator.allocate(layout);
+		}
+
+		if (allocator.getPoolCount() != poolCount)
+			fail("pools created once every frame had its own");
+
+		if (fakeDevice.createdPools - createdBefore != allocator.getPoolCount())
+			fail("pool count does not match the pools created");
+
+		allocator.destroy();
+
+		if (fakeDevice.createdPools != fakeDevice.destroyedPools)
+			fail(std::to_string(fakeDevice.createdPools - fakeDevice.destroyedPools) + " pools left after destroy()");
+	}
+}
+
+int main()
+{
+	VkDevice device = makeHandle<VkDevice>();
+
+	try
+	{
+		checkCache(device);
+		checkWrites(device);
+		checkPools(device);
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "ERROR: " << e.what() << "\n";
+		return EXIT_FAILURE;
+	}
+
+	std::cerr << "DescriptorAllocator test: " << ((failures == 0) ? "passed" : std::to_string(failures) + " failures") << "\n";
+
+	return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,887 @@
+#include "TextureManager.h"
+#include "AllocationCounter.h"
+#include "DebugUtils.h"
+#include<fstream>
+#include<algorithm>
+#include<cstring>
+#include<limits>
+
+namespace
+{
+	//KTX2 file layout: header, index and level index (one entry per mip, the biggest first)
+	struct Ktx2Header
+	{
+		uint8_t identifier[12];
+		uint32_t vkFormat;
+		uint32_t typeSize;
+		uint32_t pixelWidth;
+		uint32_t pixelHeight;
+		uint32_t pixelDepth;
+		uint32_t layerCount;
+		uint32_t faceCount;
+		uint32_t levelCount;
+		uint32_t supercompressionScheme;
+
+		uint32_t dfdByteOffset;
+		uint32_t dfdByteLength;
+		uint32_t kvdByteOffset;
+		uint32_t kvdByteLength;
+		uint64_t sgdByteOffset;
+		uint64_t sgdByteLength;
+	};
+
+	struct Ktx2Level
+	{
+		uint64_t byteOffset;
+		uint64_t byteLength;
+		uint64_t uncompressedByteLength;
+	};
+
+	const uint8_t KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+	//Texel block size of the formats the manager can load
+	bool getFormatBlock(VkFormat format, uint32_t& blockSize, uint32_t& blockBytes)
+	{
+		switch (format)
+		{
+		case VK_FORMAT_R8G8B8A8_UNORM:
+		case VK_FORMAT_R8G8B8A8_SRGB:
+		case VK_FORMAT_B8G8R8A8_UNORM:
+		case VK_FORMAT_B8G8R8A8_SRGB:
+			blockSize = 1;
+			blockBytes = 4;
+			return true;
+
+		case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+		case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+		case VK_FORMAT_BC4_UNORM_BLOCK:
+		case VK_FORMAT_BC4_SNORM_BLOCK:
+			blockSize = 4;
+			blockBytes = 8;
+			return true;
+
+		case VK_FORMAT_BC2_UNORM_BLOCK:
+		case VK_FORMAT_BC2_SRGB_BLOCK:
+		case VK_FORMAT_BC3_UNORM_BLOCK:
+		case VK_FORMAT_BC3_SRGB_BLOCK:
+		case VK_FORMAT_BC5_UNORM_BLOCK:
+		case VK_FORMAT_BC5_SNORM_BLOCK:
+		case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+		case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+		case VK_FORMAT_BC7_UNORM_BLOCK:
+		case VK_FORMAT_BC7_SRGB_BLOCK:
+			blockSize = 4;
+			blockBytes = 16;
+			return true;
+
+		default:
+			return false;
+		}
+	}
+
+	//Copy offsets in buffers have to be a multiple of the block size (and of 4)
+	VkDeviceSize alignLevel(VkDeviceSize size)
+	{
+		return (size + 15) & ~(VkDeviceSize)15;
+	}
+
+	VkImageMemoryBarrier imageBarrier(VkImage image, uint32_t baseMip, uint32_t mipCount,
+		VkImageLayout oldLayout, VkImageLayout newLayout, VkAccessFlags srcAccess, VkAccessFlags dstAccess)
+	{
+		VkImageMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.pNext = nullptr;
+		barrier.srcAccessMask = srcAccess;
+		barrier.dstAccessMask = dstAccess;
+		barrier.oldLayout = oldLayout;
+		barrier.newLayout = newLayout;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = image;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.baseMipLevel = baseMip;
+		barrier.subresourceRange.levelCount = mipCount;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = 1;
+
+		return barrier;
+	}
+}
+
+TextureManager::TextureManager(VkPhysicalDevice physicalDevice, VkDevice device, VkQueue queue, uint32_t queueFamily,
+	BindlessDescriptors* bindlessDescriptors, MemoryBudget* memoryBudget, AsyncFileReader* fileReader, VkDeviceSize residencyBudget) :
+	physicalDevice{ physicalDevice }, device{ device }, queue{ queue }, bindlessDescriptors{ bindlessDescriptors },
+	memoryBudget{ memoryBudget }, fileReader{ fileReader }, residencyBudget{ residencyBudget }
+{
+	deviceHeap = memoryBudget->getHeapIndex(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	VkSamplerCreateInfo samplerCreateInfo = {};
+	samplerCreateInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerCreateInfo.pNext = nullptr;
+	samplerCreateInfo.magFilter = VK_FILTER_LINEAR;
+	samplerCreateInfo.minFilter = VK_FILTER_LINEAR;
+	samplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+	samplerCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	samplerCreateInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	samplerCreateInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	samplerCreateInfo.mipLodBias = 0.0f;
+	samplerCreateInfo.anisotropyEnable = VK_FALSE;
+	samplerCreateInfo.compareEnable = VK_FALSE;
+	samplerCreateInfo.minLod = 0.0f;
+	samplerCreateInfo.maxLod = VK_LOD_CLAMP_NONE;
+	samplerCreateInfo.unnormalizedCoordinates = VK_FALSE;
+
+	if (vkCreateSampler(device, &samplerCreateInfo, getHostAllocator(), &sampler) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create the texture sampler!");
+
+	VkCommandPoolCreateInfo commandPoolCreateInfo = {};
+	commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	commandPoolCreateInfo.pNext = nullptr;
+	commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	commandPoolCreateInfo.queueFamilyIndex = queueFamily;
+
+	if (vkCreateCommandPool(device, &commandPoolCreateInfo, getHostAllocator(), &uploadCommandPool) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create the texture upload command pool!");
+
+	stagingBuffers.resize(MAX_FRAME_COUNT);
+	stagingMemories.resize(MAX_FRAME_COUNT);
+	stagingMappings.resize(MAX_FRAME_COUNT);
+
+	for (int i = 0; i < MAX_FRAME_COUNT; i++)
+	{
+		memoryBudget->createBuffer(TEXTURE_STAGING_SIZE, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 0, stagingBuffers[i], stagingMemories[i]);
+
+		vkMapMemory(device, stagingMemories[i], 0, TEXTURE_STAGING_SIZE, 0, &stagingMappings[i]);
+	}
+}
+
+TextureHandle TextureManager::loadKtx2(const std::string& path)
+{
+	//************************** HEADER *****************************
+	std::ifstream file(path, std::ios::binary);
+
+	if (!file.is_open())
+		throw std::runtime_error("Failed to open the texture \"" + path + "\"!");
+
+	Ktx2Header header = {};
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+	if (!file || memcmp(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0)
+		throw std::runtime_error("\"" + path + "\" is not a KTX2 file!");
+
+	if (header.supercompressionScheme != 0)
+		throw std::runtime_error("Supercompressed KTX2 files are not supported: \"" + path + "\"");
+
+	if (header.pixelHeight == 0 || header.pixelDepth > 1 || header.layerCount > 1 || header.faceCount != 1)
+		throw std::runtime_error("Only 2D KTX2 textures are supported: \"" + path + "\"");
+
+	Texture texture = {};
+	texture.path = path;
+	texture.format = static_cast<VkFormat>(header.vkFormat);
+
+	uint32_t blockSize = 0;
+	uint32_t blockBytes = 0;
+
+	if (!getFormatBlock(texture.format, blockSize, blockBytes))
+		throw std::runtime_error("Unsupported texture format in \"" + path + "\"");
+
+	VkFormatProperties formatProperties = {};
+	vkGetPhysicalDeviceFormatProperties(physicalDevice, texture.format, &formatProperties);
+
+	if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT))
+		throw std::runtime_error("The device can not sample the format of \"" + path + "\"");
+
+	//A level count of 0 asks the loader to generate the mips
+	uint32_t fileLevelCount = std::max(header.levelCount, 1u);
+	std::vector<Ktx2Level> fileLevels(fileLevelCount);
+	file.read(reinterpret_cast<char*>(fileLevels.data()), sizeof(Ktx2Level) * fileLevelCount);
+
+	if (!file)
+		throw std::runtime_error("Truncated KTX2 file \"" + path + "\"");
+
+	//************************** MIPS *****************************
+	uint32_t fullMipCount = 1;
+
+	while ((std::max(header.pixelWidth, header.pixelHeight) >> fullMipCount) > 0)
+		fullMipCount++;
+
+	//Compressed formats can not be blitted, they keep the mips of the file
+	const VkFormatFeatureFlags blitFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+		VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+
+	bool generateMips = fileLevelCount < fullMipCount && blockSize == 1 &&
+		(formatProperties.optimalTilingFeatures & blitFeatures) == blitFeatures;
+
+	uint32_t mipCount = (generateMips) ? fullMipCount : fileLevelCount;
+	texture.levels.resize(mipCount);
+
+	for (uint32_t i = 0; i < mipCount; i++)
+	{
+		texture.levels[i].extent.width = std::max(header.pixelWidth >> i, 1u);
+		texture.levels[i].extent.height = std::max(header.pixelHeight >> i, 1u);
+		texture.levels[i].fileOffset = (i < fileLevelCount) ? fileLevels[i].byteOffset : 0;
+		texture.levels[i].byteLength = (i < fileLevelCount) ? fileLevels[i].byteLength : 0;
+	}
+
+	//Generated mips (and levels too big for the staging buffers) can not be brought back from the file
+	texture.streamable = !generateMips && mipCount > 1;
+
+	for (const auto& level : texture.levels)
+		if (alignLevel(level.byteLength) > TEXTURE_STAGING_SIZE)
+			texture.streamable = false;
+
+	//Streamed textures start with as many mips as fit in the budget, the rest always get every mip
+	texture.residentMip = 0;
+
+	if (texture.streamable)
+	{
+		texture.residentMip = mipCount - 1;
+
+		VkDeviceSize budget = getAvailableBudget();
+
+		while (texture.residentMip > 0 &&
+			residentBytes + getResidentSize(texture, texture.residentMip - 1) <= budget)
+			texture.residentMip--;
+	}
+
+	//************************** UPLOAD *****************************
+	uint32_t uploadEnd = (generateMips) ? 1 : mipCount;
+	VkDeviceSize uploadSize = 0;
+
+	for (uint32_t i = texture.residentMip; i < uploadEnd; i++)
+		uploadSize += alignLevel(texture.levels[i].byteLength);
+
+	VkBuffer uploadBuffer;
+	VkDeviceMemory uploadMemory;
+	memoryBudget->createBuffer(uploadSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 0, uploadBuffer, uploadMemory);
+
+	//The file is read straight into the mapped staging memory
+	void* uploadData = nullptr;
+	vkMapMemory(device, uploadMemory, 0, uploadSize, 0, &uploadData);
+
+	texture.file = fileReader->openFile(path);
+
+	ReadBatch reads;
+	std::vector<VkDeviceSize> offsets;
+	try
+	{
+		readLevels(texture, texture.residentMip, uploadEnd, static_cast<uint8_t*>(uploadData), ReadPriority::High, reads, offsets);
+	}
+	catch (...)
+	{
+		fileReader->closeFile(texture.file);
+		throw;
+	}
+
+	reads.wait();
+
+	//Only streamed textures read the file again
+	if (!texture.streamable || reads.hasFailed())
+	{
+		fileReader->closeFile(texture.file);
+		texture.file = ~0u;
+	}
+
+	vkUnmapMemory(device, uploadMemory);
+
+	if (reads.hasFailed())
+		throw std::runtime_error("Failed to read the mips of \"" + path + "\"!");
+
+	createImage(texture, texture.residentMip, texture.image, texture.imageView, texture.memory, texture.memorySize);
+
+	uint32_t imageMipCount = mipCount - texture.residentMip;
+
+	VkCommandBufferAllocateInfo commandBufferAllocInfo = {};
+	commandBufferAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	commandBufferAllocInfo.pNext = nullptr;
+	commandBufferAllocInfo.commandPool = uploadCommandPool;
+	commandBufferAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	commandBufferAllocInfo.commandBufferCount = 1;
+
+	VkCommandBuffer commandBuffer;
+
+	if (vkAllocateCommandBuffers(device, &commandBufferAllocInfo, &commandBuffer) != VK_SUCCESS)
+		throw std::runtime_error("Failed to allocate the texture upload command buffer!");
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.pNext = nullptr;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+	VkImageMemoryBarrier barrier = imageBarrier(texture.image, 0, imageMipCount,
+		VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, VK_ACCESS_TRANSFER_WRITE_BIT);
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+		0, nullptr, 0, nullptr, 1, &barrier);
+
+	std::vector<VkBufferImageCopy> copies;
+
+	for (uint32_t i = texture.residentMip; i < uploadEnd; i++)
+	{
+		VkBufferImageCopy copy = {};
+		copy.bufferOffset = offsets[i - texture.residentMip];
+		copy.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, i - texture.residentMip, 0, 1 };
+		copy.imageExtent = { texture.levels[i].extent.width, texture.levels[i].extent.height, 1 };
+
+		copies.push_back(copy);
+	}
+
+	vkCmdCopyBufferToImage(commandBuffer, uploadBuffer, texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		(uint32_t)copies.size(), copies.data());
+
+	if (generateMips)
+	{
+		//Every mip is blitted from the previous one, which then is ready to be sampled
+		for (uint32_t i = 1; i < mipCount; i++)
+		{
+			barrier = imageBarrier(texture.image, i - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+				0, nullptr, 0, nullptr, 1, &barrier);
+
+			VkImageBlit blit = {};
+			blit.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, i - 1, 0, 1 };
+			blit.srcOffsets[1] = { (int32_t)texture.levels[i - 1].extent.width, (int32_t)texture.levels[i - 1].extent.height, 1 };
+			blit.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1 };
+			blit.dstOffsets[1] = { (int32_t)texture.levels[i].extent.width, (int32_t)texture.levels[i].extent.height, 1 };
+
+			vkCmdBlitImage(commandBuffer, texture.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+			barrier = imageBarrier(texture.image, i - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+				0, nullptr, 0, nullptr, 1, &barrier);
+		}
+
+		barrier = imageBarrier(texture.image, mipCount - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+	}
+	else
+	{
+		barrier = imageBarrier(texture.image, 0, imageMipCount, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+	}
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+		0, nullptr, 0, nullptr, 1, &barrier);
+
+	vkEndCommandBuffer(commandBuffer);
+
+	VkFenceCreateInfo fenceCreateInfo = {};
+	fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fenceCreateInfo.pNext = nullptr;
+	fenceCreateInfo.flags = 0;
+
+	VkFence uploadFence;
+
+	if (vkCreateFence(device, &fenceCreateInfo, getHostAllocator(), &uploadFence) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create the texture upload fence!");
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = nullptr;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+
+	if (vkQueueSubmit(queue, 1, &submitInfo, uploadFence) != VK_SUCCESS)
+		throw std::runtime_error("Failed to submit the texture upload!");
+
+	vkWaitForFences(device, 1, &uploadFence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+
+	vkDestroyFence(device, uploadFence, getHostAllocator());
+	vkFreeCommandBuffers(device, uploadCommandPool, 1, &commandBuffer);
+	vkDestroyBuffer(device, uploadBuffer, getHostAllocator());
+	memoryBudget->free(uploadMemory);
+
+	TextureHandle handle = (TextureHandle)textures.size();
+
+	texture.descriptorIndex = bindlessDescriptors->addSampledImage(texture.imageView, sampler);
+	texture.lastUsedFrame = memoryBudget->getFrameNumber();
+
+	if (texture.streamable)
+		texture.memoryResource = memoryBudget->registerResource(texture.memory, [this, handle]() { evict(handle); });
+
+	residentBytes += texture.memorySize;
+	version++;
+
+	textures.push_back(texture);
+
+	return handle;
+}
+
+void TextureManager::setRequiredMip(TextureHandle texture, uint32_t mip)
+{
+	textures.at(texture).requiredMip = mip;
+}
+
+void TextureManager::touch(TextureHandle texture)
+{
+	Texture& touched = textures.at(texture);
+	touched.lastUsedFrame = memoryBudget->getFrameNumber();
+
+	if (touched.memoryResource != ~0u)
+		memoryBudget->touch(touched.memoryResource);
+}
+
+uint32_t TextureManager::getResidentMip(TextureHandle texture) const
+{
+	return textures.at(texture).residentMip;
+}
+
+uint32_t TextureManager::getDescriptorIndex(TextureHandle texture) const
+{
+	return textures.at(texture).descriptorIndex;
+}
+
+uint64_t TextureManager::getVersion() const
+{
+	return version;
+}
+
+VkDeviceSize TextureManager::getResidentBytes() const
+{
+	return residentBytes;
+}
+
+void TextureManager::update(VkCommandBuffer commandBuffer, uint32_t currentFrame, FrameArena& frameArena)
+{
+	for (auto& retired : retiredImages[currentFrame])
+	{
+		vkDestroyImageView(device, retired.imageView, getHostAllocator());
+		vkDestroyImage(device, retired.image, getHostAllocator());
+		memoryBudget->free(retired.memory);
+	}
+
+	retiredImages[currentFrame].clear();
+
+	//************************** TARGET RESIDENCY *****************************
+	//Every texture wants its required mip (evicted ones only once they are used again), while that does
+	//not fit the biggest resident mip is dropped
+	FrameVector<uint32_t> targetMips(textures.size(), ArenaAllocator<uint32_t>(frameArena));
+	VkDeviceSize targetBytes = 0;
+	VkDeviceSize budget = getAvailableBudget();
+
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		const Texture& texture = textures[i];
+
+		targetMips[i] = (texture.streamable && !isEvictedAndUnused(texture)) ?
+			std::min(texture.requiredMip, (uint32_t)texture.levels.size() - 1) : texture.residentMip;
+
+		targetBytes += getResidentSize(texture, targetMips[i]);
+	}
+
+	while (targetBytes > budget)
+	{
+		size_t biggest = textures.size();
+
+		for (size_t i = 0; i < textures.size(); i++)
+			if (textures[i].streamable && targetMips[i] + 1 < textures[i].levels.size() &&
+				(biggest == textures.size() ||
+					textures[i].levels[targetMips[i]].byteLength > textures[biggest].levels[targetMips[biggest]].byteLength))
+				biggest = i;
+
+		if (biggest == textures.size())
+			break;
+
+		targetBytes -= textures[biggest].levels[targetMips[biggest]].byteLength;
+		targetMips[biggest]++;
+	}
+
+	//************************** RESIDENCY CHANGES *****************************
+	//Evictions first, they only copy on the GPU and free memory for the mips streamed in
+	for (size_t i = 0; i < textures.size(); i++)
+		if (targetMips[i] > textures[i].residentMip)
+			changeResidency(textures[i], targetMips[i], commandBuffer, currentFrame, 0);
+
+	//************************** STREAMING *****************************
+	//The staging buffer of this frame has the reads it started the last time it ran until they are all done
+	//and copied, only then it starts new ones. Reads for textures evicted since would be thrown away
+	std::vector<StreamIn>& frameStreamIns = streamIns[currentFrame];
+
+	if (!frameStreamIns.empty())
+	{
+		bool readsDone = true;
+
+		for (StreamIn& streamIn : frameStreamIns)
+		{
+			if (textures[streamIn.texture].residentMip != streamIn.fromMip)
+				fileReader->cancel(*streamIn.reads);
+
+			readsDone = readsDone && streamIn.reads->isDone();
+		}
+
+		if (readsDone)
+			finishStreamIns(commandBuffer, currentFrame);
+
+		return;
+	}
+
+	//Mips are streamed in from the coarsest while they fit in this frame's staging buffer, the rest wait
+	VkDeviceSize stagingUsed = 0;
+
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		Texture& texture = textures[i];
+
+		//The evictions may have evicted this one, and a texture streams in one batch of mips at a time
+		if (isEvictedAndUnused(texture) || texture.streamingIn)
+			continue;
+
+		uint32_t newResidentMip = texture.residentMip;
+		VkDeviceSize stagingNeeded = stagingUsed;
+
+		while (newResidentMip > targetMips[i] &&
+			stagingNeeded + alignLevel(texture.levels[newResidentMip - 1].byteLength) <= TEXTURE_STAGING_SIZE)
+		{
+			newResidentMip--;
+			stagingNeeded += alignLevel(texture.levels[newResidentMip].byteLength);
+		}
+
+		if (newResidentMip < texture.residentMip)
+			startStreamIn((TextureHandle)i, newResidentMip, currentFrame, stagingUsed);
+	}
+}
+
+void TextureManager::startStreamIn(TextureHandle handle, uint32_t newResidentMip, uint32_t frame, VkDeviceSize& stagingUsed)
+{
+	Texture& texture = textures[handle];
+
+	//Queuing the reads allocates, which the frame loop is allowed to do here
+	AllowAllocations allowAllocations;
+
+	StreamIn streamIn;
+	streamIn.texture = handle;
+	streamIn.fromMip = texture.residentMip;
+	streamIn.toMip = newResidentMip;
+	streamIn.stagingOffset = stagingUsed;
+	streamIn.reads.reset(new ReadBatch);
+
+	//A texture with nothing resident is not drawn until they are done
+	ReadPriority priority = (texture.image == VK_NULL_HANDLE) ? ReadPriority::High : ReadPriority::Normal;
+
+	std::vector<VkDeviceSize> offsets;
+	readLevels(texture, newResidentMip, texture.residentMip, static_cast<uint8_t*>(stagingMappings[frame]) + stagingUsed,
+		priority, *streamIn.reads, offsets);
+
+	for (uint32_t i = newResidentMip; i < texture.residentMip; i++)
+		stagingUsed += alignLevel(texture.levels[i].byteLength);
+
+	texture.streamingIn = true;
+	streamIns[frame].push_back(std::move(streamIn));
+}
+
+void TextureManager::finishStreamIns(VkCommandBuffer commandBuffer, uint32_t frame)
+{
+	for (StreamIn& streamIn : streamIns[frame])
+	{
+		Texture& texture = textures[streamIn.texture];
+		texture.streamingIn = false;
+
+		//Mips were evicted while the file was read, what was read does not go with what is resident any more
+		if (texture.residentMip != streamIn.fromMip)
+			continue;
+
+		if (streamIn.reads->hasFailed())
+			throw std::runtime_error("Failed to read the mips of \"" + texture.path + "\"!");
+
+		changeResidency(texture, streamIn.toMip, commandBuffer, frame, streamIn.stagingOffset);
+	}
+
+	streamIns[frame].clear();
+}
+
+void TextureManager::changeResidency(Texture& texture, uint32_t newResidentMip, VkCommandBuffer commandBuffer, uint32_t frame, VkDeviceSize stagingOffset)
+{
+	uint32_t oldResidentMip = texture.residentMip;
+	uint32_t mipCount = (uint32_t)texture.levels.size();
+	bool hasImage = texture.image != VK_NULL_HANDLE;
+
+	//Reading the file and creating the image allocate, which the frame loop is allowed to do here
+	AllowAllocations allowAllocations;
+
+	//The allocation of the new image must not evict the texture it copies from
+	if (texture.memoryResource != ~0u)
+		memoryBudget->touch(texture.memoryResource);
+
+	VkImage image;
+	VkImageView imageView;
+	VkDeviceMemory memory;
+	VkDeviceSize memorySize;
+
+	createImage(texture, newResidentMip, image, imageView, memory, memorySize);
+
+	//The old image may still be sampled by the previous frame, the barrier waits for it
+	VkImageMemoryBarrier barriers[2] = {
+		imageBarrier(image, 0, mipCount - newResidentMip, VK_IMAGE_LAYOUT_UNDEFINED,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, VK_ACCESS_TRANSFER_WRITE_BIT),
+		imageBarrier(texture.image, 0, mipCount - oldResidentMip, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, 0, VK_ACCESS_TRANSFER_READ_BIT)
+	};
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+		0, nullptr, 0, nullptr, (hasImage) ? 2 : 1, barriers);
+
+	//Mips both images have are copied on the GPU
+	std::vector<VkImageCopy> imageCopies;
+
+	for (uint32_t i = std::max(newResidentMip, oldResidentMip); i < mipCount; i++)
+	{
+		VkImageCopy copy = {};
+		copy.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, i - oldResidentMip, 0, 1 };
+		copy.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, i - newResidentMip, 0, 1 };
+		copy.extent = { texture.levels[i].extent.width, texture.levels[i].extent.height, 1 };
+
+		imageCopies.push_back(copy);
+	}
+
+	//An evicted texture has nothing to copy
+	if (!imageCopies.empty())
+		vkCmdCopyImage(commandBuffer, texture.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, (uint32_t)imageCopies.size(), imageCopies.data());
+
+	//The new finer mips come from the file, through the staging buffer
+	if (newResidentMip < oldResidentMip)
+	{
+		std::vector<VkBufferImageCopy> bufferCopies;
+		VkDeviceSize offset = stagingOffset;
+
+		for (uint32_t i = newResidentMip; i < oldResidentMip; i++)
+		{
+			VkBufferImageCopy copy = {};
+			copy.bufferOffset = offset;
+			copy.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, i - newResidentMip, 0, 1 };
+			copy.imageExtent = { texture.levels[i].extent.width, texture.levels[i].extent.height, 1 };
+
+			bufferCopies.push_back(copy);
+			offset += alignLevel(texture.levels[i].byteLength);
+		}
+
+		vkCmdCopyBufferToImage(commandBuffer, stagingBuffers[frame], image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			(uint32_t)bufferCopies.size(), bufferCopies.data());
+	}
+
+	VkImageMemoryBarrier readBarrier = imageBarrier(image, 0, mipCount - newResidentMip, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+		0, nullptr, 0, nullptr, 1, &readBarrier);
+
+	//The old image (and its descriptor) are kept until no frame in flight can use them
+	if (hasImage)
+	{
+		retiredImages[frame].push_back({ texture.image, texture.imageView, texture.memory });
+		bindlessDescriptors->removeSampledImage(texture.descriptorIndex);
+	}
+
+	residentBytes = residentBytes - texture.memorySize + memorySize;
+
+	texture.image = image;
+	texture.imageView = imageView;
+	texture.memory = memory;
+	texture.memorySize = memorySize;
+	texture.residentMip = newResidentMip;
+	texture.descriptorIndex = bindlessDescriptors->addSampledImage(imageView, sampler);
+
+	if (texture.memoryResource != ~0u)
+		memoryBudget->setResourceMemory(texture.memoryResource, memory);
+	else
+	{
+		TextureHandle handle = (TextureHandle)(&texture - textures.data());
+		texture.memoryResource = memoryBudget->registerResource(memory, [this, handle]() { evict(handle); });
+	}
+
+	version++;
+}
+
+void TextureManager::evict(TextureHandle handle)
+{
+	//Only called by the memory budget, for textures the frames in flight do not use
+	Texture& texture = textures.at(handle);
+
+	vkDestroyImageView(device, texture.imageView, getHostAllocator());
+	vkDestroyImage(device, texture.image, getHostAllocator());
+	memoryBudget->free(texture.memory);
+	memoryBudget->unregisterResource(texture.memoryResource);
+
+	bindlessDescriptors->removeSampledImage(texture.descriptorIndex);
+	residentBytes -= texture.memorySize;
+
+	texture.image = VK_NULL_HANDLE;
+	texture.imageView = VK_NULL_HANDLE;
+	texture.memory = VK_NULL_HANDLE;
+	texture.memorySize = 0;
+	texture.residentMip = (uint32_t)texture.levels.size();
+	texture.descriptorIndex = ~0u;
+	texture.memoryResource = ~0u;
+
+	version++;
+}
+
+void TextureManager::createImage(Texture& texture, uint32_t baseMip, VkImage& image, VkImageView& imageView, VkDeviceMemory& memory, VkDeviceSize& memorySize)
+{
+	uint32_t mipCount = (uint32_t)texture.levels.size() - baseMip;
+
+	VkImageCreateInfo imageCreateInfo = {};
+	imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageCreateInfo.pNext = nullptr;
+	imageCreateInfo.flags = 0;
+	imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageCreateInfo.format = texture.format;
+	imageCreateInfo.extent = { texture.levels[baseMip].extent.width, texture.levels[baseMip].extent.height, 1 };
+	imageCreateInfo.mipLevels = mipCount;
+	imageCreateInfo.arrayLayers = 1;
+	imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	if (vkCreateImage(device, &imageCreateInfo, getHostAllocator(), &image) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create a texture image!");
+
+	setDebugName(device, VK_OBJECT_TYPE_IMAGE, (uint64_t)image, texture.path.c_str());
+
+	VkMemoryRequirements memReqs = {};
+	vkGetImageMemoryRequirements(device, image, &memReqs);
+
+	//Falls back to any memory the image can use when the device local heap is full
+	memory = memoryBudget->allocate(memReqs, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	vkBindImageMemory(device, image, memory, 0);
+	memorySize = memReqs.size;
+
+	VkImageViewCreateInfo viewCreateInfo = {};
+	viewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewCreateInfo.pNext = nullptr;
+	viewCreateInfo.flags = 0;
+	viewCreateInfo.image = image;
+	viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewCreateInfo.format = texture.format;
+	viewCreateInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+	viewCreateInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+	viewCreateInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+	viewCreateInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+	viewCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	viewCreateInfo.subresourceRange.baseMipLevel = 0;
+	viewCreateInfo.subresourceRange.levelCount = mipCount;
+	viewCreateInfo.subresourceRange.baseArrayLayer = 0;
+	viewCreateInfo.subresourceRange.layerCount = 1;
+
+	if (vkCreateImageView(device, &viewCreateInfo, getHostAllocator(), &imageView) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create a texture image view!");
+}
+
+void TextureManager::readLevels(const Texture& texture, uint32_t firstMip, uint32_t endMip, uint8_t* destination, ReadPriority priority,
+	ReadBatch& batch, std::vector<VkDeviceSize>& offsets)
+{
+	uint64_t fileSize = fileReader->getFileSize(texture.file);
+
+	//Checked before any read is queued, throwing halfway would leave the queued ones writing to the destination
+	for (uint32_t i = firstMip; i < endMip; i++)
+		if (texture.levels[i].fileOffset > fileSize || texture.levels[i].byteLength > fileSize - texture.levels[i].fileOffset)
+			throw std::runtime_error("Truncated KTX2 file \"" + texture.path + "\"");
+
+	VkDeviceSize offset = 0;
+
+	for (uint32_t i = firstMip; i < endMip; i++)
+	{
+		const MipLevel& level = texture.levels[i];
+
+		fileReader->read(texture.file, level.fileOffset, (size_t)level.byteLength, destination + offset, priority, batch);
+
+		offsets.push_back(offset);
+		offset += alignLevel(level.byteLength);
+	}
+}
+
+VkDeviceSize TextureManager::getAvailableBudget() const
+{
+	return std::min(residencyBudget, residentBytes + memoryBudget->getAvailable(deviceHeap));
+}
+
+bool TextureManager::isEvictedAndUnused(const Texture& texture) const
+{
+	return texture.image == VK_NULL_HANDLE && texture.lastUsedFrame != memoryBudget->getFrameNumber();
+}
+
+VkDeviceSize TextureManager::getResidentSize(const Texture& texture, uint32_t residentMip) const
+{
+	VkDeviceSize size = 0;
+
+	for (size_t i = residentMip; i < texture.levels.size(); i++)
+		size += texture.levels[i].byteLength;
+
+	return size;
+}
+
+void TextureManager::destroy()
+{
+	if (device == VK_NULL_HANDLE)
+		return;
+
+	//Reads still going write to the staging buffers
+	for (auto& frameStreamIns : streamIns)
+	{
+		for (StreamIn& streamIn : frameStreamIns)
+		{
+			fileReader->cancel(*streamIn.reads);
+			streamIn.reads->wait();
+		}
+
+		frameStreamIns.clear();
+	}
+
+	for (auto& texture : textures)
+	{
+		if (texture.file != ~0u)
+			fileReader->closeFile(texture.file);
+
+		if (texture.image == VK_NULL_HANDLE)
+			continue;
+
+		vkDestroyImageView(device, texture.imageView, getHostAllocator());
+		vkDestroyImage(device, texture.image, getHostAllocator());
+		memoryBudget->free(texture.memory);
+
+		if (texture.memoryResource != ~0u)
+			memoryBudget->unregisterResource(texture.memoryResource);
+	}
+
+	for (auto& frameImages : retiredImages)
+	{
+		for (auto& retired : frameImages)
+		{
+			vkDestroyImageView(device, retired.imageView, getHostAllocator());
+			vkDestroyImage(device, retired.image, getHostAllocator());
+			memoryBudget->free(retired.memory);
+		}
+
+		frameImages.clear();
+	}
+
+	for (size_t i = 0; i < stagingBuffers.size(); i++)
+	{
+		vkDestroyBuffer(device, stagingBuffers[i], getHostAllocator());
+		memoryBudget->free(stagingMemories[i]);
+	}
+
+	vkDestroyCommandPool(device, uploadCommandPool, getHostAllocator());
+	vkDestroySampler(device, sampler, getHostAllocator());
+
+	textures.clear();
+	stagingBuffers.clear();
+	stagingMemories.clear();
+	stagingMappings.clear();
+	residentBytes = 0;
+	device = VK_NULL_HANDLE;
+}
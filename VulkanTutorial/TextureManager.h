@@ -0,0 +1,148 @@
+#pragma once
+
+#include<vulkan/vulkan.h>
+#include<vector>
+#include<string>
+#include<memory>
+#include<stdexcept>
+#include "Utilities.h"
+#include "BindlessDescriptors.h"
+#include "MemoryBudget.h"
+#include "FrameArena.h"
+#include "AsyncFileReader.h"
+
+using TextureHandle = uint32_t;
+
+const TextureHandle INVALID_TEXTURE = ~0u;
+
+//Loads KTX2 textures (BCn or 8 bit RGBA, without supercompression) into device local images sampled through
+//the bindless descriptors. Mips missing from uncompressed files are generated with blits.
+//
+//Textures whose mips are all in the file are streamed: only the mips from "residentMip" down are kept in
+//memory, and the resident set of every texture follows the mip the caller says it needs within the memory
+//budget. Changing the resident mips recreates the image (the mips kept are copied on the GPU, the new ones
+//come from the file through a per frame staging buffer) and gives the texture a new descriptor index.
+//The file is read asynchronously: a frame starts the reads into its staging buffer and records the copies
+//the next time it comes around, if they are done by then, so the frame loop never waits for the disk.
+//
+//Streamed textures can also be evicted whole by the memory budget when they were not used by the frames
+//in flight and memory runs out. They come back (coarsest mips first) the next time they are used.
+class TextureManager
+{
+private:
+	struct MipLevel
+	{
+		uint64_t fileOffset;
+		uint64_t byteLength;
+		VkExtent2D extent;
+	};
+
+	struct Texture
+	{
+		std::string path;
+		FileHandle file = ~0u;		//Kept open while the texture is streamed
+		VkFormat format;
+		std::vector<MipLevel> levels;
+		bool streamable;
+
+		uint32_t residentMip;
+		uint32_t requiredMip = 0;
+		bool streamingIn = false;		//Finer mips are being read into a staging buffer
+
+		VkImage image = VK_NULL_HANDLE;
+		VkImageView imageView = VK_NULL_HANDLE;
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize memorySize = 0;
+
+		uint32_t descriptorIndex;
+
+		uint64_t lastUsedFrame = 0;
+		MemoryResource memoryResource = ~0u;		//Only streamed textures can be evicted
+	};
+
+	//Destroyed once the frames in flight that could sample them are finished
+	struct RetiredImage
+	{
+		VkImage image;
+		VkImageView imageView;
+		VkDeviceMemory memory;
+	};
+
+	//Mips read into the staging buffer of a frame, for the next time the frame comes around
+	struct StreamIn
+	{
+		TextureHandle texture;
+		uint32_t fromMip;				//Resident mip when the reads started, they are thrown away if it changed since
+		uint32_t toMip;
+		VkDeviceSize stagingOffset;
+		std::unique_ptr<ReadBatch> reads;
+	};
+
+	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+	VkDevice device = VK_NULL_HANDLE;
+	VkQueue queue = VK_NULL_HANDLE;
+	BindlessDescriptors* bindlessDescriptors = nullptr;
+	MemoryBudget* memoryBudget = nullptr;
+	AsyncFileReader* fileReader = nullptr;
+
+	//Textures never use more than this, nor more than what is left in the budget of the device local heap
+	VkDeviceSize residencyBudget = 0;
+	uint32_t deviceHeap = 0;
+	VkDeviceSize residentBytes = 0;
+	uint64_t version = 0;
+
+	VkSampler sampler = VK_NULL_HANDLE;
+	VkCommandPool uploadCommandPool = VK_NULL_HANDLE;
+
+	std::vector<Texture> textures;
+	std::vector<RetiredImage> retiredImages[MAX_FRAME_COUNT];
+
+	//Stream in staging memory, one persistently mapped buffer per frame in flight
+	std::vector<VkBuffer> stagingBuffers;
+	std::vector<VkDeviceMemory> stagingMemories;
+	std::vector<void*> stagingMappings;
+	std::vector<StreamIn> streamIns[MAX_FRAME_COUNT];
+
+	void createImage(Texture& texture, uint32_t baseMip, VkImage& image, VkImageView& imageView, VkDeviceMemory& memory, VkDeviceSize& memorySize);
+	void readLevels(const Texture& texture, uint32_t firstMip, uint32_t endMip, uint8_t* destination, ReadPriority priority,
+		ReadBatch& batch, std::vector<VkDeviceSize>& offsets);
+
+	//The finer mips have to be in the frame's staging buffer from "stagingOffset", as startStreamIn reads them
+	void changeResidency(Texture& texture, uint32_t newResidentMip, VkCommandBuffer commandBuffer, uint32_t frame, VkDeviceSize stagingOffset);
+	void startStreamIn(TextureHandle texture, uint32_t newResidentMip, uint32_t frame, VkDeviceSize& stagingUsed);
+	void finishStreamIns(VkCommandBuffer commandBuffer, uint32_t frame);
+	VkDeviceSize getResidentSize(const Texture& texture, uint32_t residentMip) const;
+	VkDeviceSize getAvailableBudget() const;
+	bool isEvictedAndUnused(const Texture& texture) const;
+	void evict(TextureHandle texture);
+
+public:
+	TextureManager() = default;
+
+	TextureManager(VkPhysicalDevice physicalDevice, VkDevice device, VkQueue queue, uint32_t queueFamily,
+		BindlessDescriptors* bindlessDescriptors, MemoryBudget* memoryBudget, AsyncFileReader* fileReader, VkDeviceSize residencyBudget);
+
+	//Loads every mip that fits in the budget and waits for the reads and the upload to finish
+	TextureHandle loadKtx2(const std::string& path);
+
+	//Finest mip the texture needs on screen, the budget may keep it coarser
+	void setRequiredMip(TextureHandle texture, uint32_t mip);
+
+	//Marks the texture as used by the frame being recorded: it can not be evicted and it is brought back if it was
+	void touch(TextureHandle texture);
+
+	//The mip count when the texture was evicted (and its descriptor index ~0u)
+	uint32_t getResidentMip(TextureHandle texture) const;
+	uint32_t getDescriptorIndex(TextureHandle texture) const;
+
+	//Changes whenever a descriptor index changes
+	uint64_t getVersion() const;
+
+	VkDeviceSize getResidentBytes() const;
+
+	//Records the residency changes of this frame into its command buffer, before anything samples the
+	//textures. Called after waiting for the frame's fence, the scratch memory comes from the frame's arena
+	void update(VkCommandBuffer commandBuffer, uint32_t currentFrame, FrameArena& frameArena);
+
+	void destroy();
+};
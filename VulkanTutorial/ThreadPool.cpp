@@ -0,0 +1,227 @@
+#include "ThreadPool.h"
+#include<algorithm>
+
+ThreadPool::ThreadPool(unsigned threadCount)
+{
+	if (threadCount == 0)
+	{
+		unsigned hardwareThreads = std::thread::hardware_concurrency();
+		threadCount = (hardwareThreads > 1) ? hardwareThreads - 1 : 1;
+	}
+
+	//A helper still running may hold on to its state while the next parallelFor starts, so there can be
+	//one state per thread in use at the same time (more only when parallelFors are nested)
+	freeStates.reserve(threadCount + 1);
+
+	for (unsigned i = 0; i < threadCount + 1; i++)
+		freeStates.emplace_back(new ParallelForState);
+
+	tasks.resize(16);
+
+	workers.reserve(threadCount);
+
+	for (unsigned i = 0; i < threadCount; i++)
+		workers.emplace_back(&ThreadPool::workerLoop, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(tasksMutex);
+		stopping = true;
+	}
+
+	tasksAvailable.notify_all();
+
+	for (auto& worker : workers)
+		worker.join();
+}
+
+unsigned ThreadPool::getThreadCount() const
+{
+	return (unsigned)workers.size();
+}
+
+void ThreadPool::pushTask(std::function<void()>&& task)
+{
+	if (taskCount == tasks.size())
+	{
+		//The pending tasks are moved to the start of a bigger ring
+		std::vector<std::function<void()>> grown(std::max<size_t>(tasks.size() * 2, 16));
+
+		for (size_t i = 0; i < taskCount; i++)
+			grown[i] = std::move(tasks[(firstTask + i) % tasks.size()]);
+
+		tasks.swap(grown);
+		firstTask = 0;
+	}
+
+	tasks[(firstTask + taskCount) % tasks.size()] = std::move(task);
+	taskCount++;
+}
+
+std::function<void()> ThreadPool::popTask()
+{
+	std::function<void()> task = std::move(tasks[firstTask]);
+	tasks[firstTask] = nullptr;
+
+	firstTask = (firstTask + 1) % tasks.size();
+	taskCount--;
+
+	return task;
+}
+
+void ThreadPool::workerLoop()
+{
+	while (true)
+	{
+		std::function<void()> task;
+
+		{
+			std::unique_lock<std::mutex> lock(tasksMutex);
+			tasksAvailable.wait(lock, [this]() { return stopping || taskCount != 0; });
+
+			//Pending tasks are still finished before stopping, someone may be waiting on them
+			if (taskCount == 0)
+				return;
+
+			task = popTask();
+		}
+
+		task();
+	}
+}
+
+void ThreadPool::runChunks(ParallelForState* state)
+{
+	size_t chunk;
+
+	while ((chunk = state->nextChunk.fetch_add(1)) < state->chunkCount)
+	{
+		size_t begin = chunk * state->grainSize;
+		(*state->function)(begin, std::min(begin + state->grainSize, state->count));
+
+		if (state->finishedChunks.fetch_add(1) + 1 == state->chunkCount)
+		{
+			std::lock_guard<std::mutex> lock(state->doneMutex);
+			state->done.notify_all();
+		}
+	}
+}
+
+void ThreadPool::ParallelForHelper::operator()() const
+{
+	pool->runChunks(state);
+	pool->releaseState(state);
+}
+
+void ThreadPool::releaseState(ParallelForState* state)
+{
+	if (state->references.fetch_sub(1) != 1)
+		return;
+
+	std::lock_guard<std::mutex> lock(tasksMutex);
+
+	for (auto& freeState : freeStates)
+	{
+		if (!freeState)
+		{
+			freeState.reset(state);
+			return;
+		}
+	}
+
+	freeStates.emplace_back(state);
+}
+
+size_t ThreadPool::cancelHelpers(ParallelForState* state)
+{
+	std::lock_guard<std::mutex> lock(tasksMutex);
+
+	size_t kept = 0;
+
+	for (size_t i = 0; i < taskCount; i++)
+	{
+		std::function<void()>& task = tasks[(firstTask + i) % tasks.size()];
+		const ParallelForHelper* helper = task.target<ParallelForHelper>();
+
+		if (helper != nullptr && helper->state == state)
+			continue;
+
+		if (kept != i)
+			tasks[(firstTask + kept) % tasks.size()] = std::move(task);
+
+		kept++;
+	}
+
+	size_t cancelled = taskCount - kept;
+
+	for (size_t i = kept; i < taskCount; i++)
+		tasks[(firstTask + i) % tasks.size()] = nullptr;
+
+	taskCount = kept;
+
+	return cancelled;
+}
+
+void ThreadPool::parallelFor(size_t count, size_t grainSize, const std::function<void(size_t begin, size_t end)>& function)
+{
+	if (count == 0)
+		return;
+
+	grainSize = std::max<size_t>(grainSize, 1);
+	size_t chunkCount = (count + grainSize - 1) / grainSize;
+
+	if (chunkCount == 1 || workers.empty())
+	{
+		function(0, count);
+		return;
+	}
+
+	//Chunks are grabbed from a shared counter by the helpers and by this thread. A helper that starts
+	//after every chunk was taken returns without touching "function", which may be gone by then, and
+	//the state is reused only after every helper has let go of it. Helpers still waiting in the queue
+	//when this thread runs out of chunks are removed, they would have nothing to do
+	size_t helperCount = std::min(chunkCount - 1, workers.size());
+	ParallelForState* state = nullptr;
+
+	{
+		std::lock_guard<std::mutex> lock(tasksMutex);
+
+		for (auto& freeState : freeStates)
+		{
+			if (freeState)
+			{
+				state = freeState.release();
+				break;
+			}
+		}
+
+		if (state == nullptr)
+			state = new ParallelForState;
+
+		state->function = &function;
+		state->count = count;
+		state->grainSize = grainSize;
+		state->chunkCount = chunkCount;
+		state->nextChunk = 0;
+		state->finishedChunks = 0;
+		state->references = helperCount + 1;
+
+		for (size_t i = 0; i < helperCount; i++)
+			pushTask(ParallelForHelper{ this, state });
+	}
+
+	tasksAvailable.notify_all();
+
+	runChunks(state);
+
+	state->references -= cancelHelpers(state);
+
+	{
+		std::unique_lock<std::mutex> lock(state->doneMutex);
+		state->done.wait(lock, [state, chunkCount]() { return state->finishedChunks.load() == chunkCount; });
+	}
+
+	releaseState(state);
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include<vector>
+#include<thread>
+#include<mutex>
+#include<condition_variable>
+#include<functional>
+#include<future>
+#include<memory>
+#include<atomic>
+
+class ThreadPool
+{
+private:
+	std::vector<std::thread> workers;
+
+	//Ring buffer of pending tasks, it only grows so the steady state does not allocate
+	std::vector<std::function<void()>> tasks;
+	size_t firstTask = 0;
+	size_t taskCount = 0;
+
+	std::mutex tasksMutex;
+	std::condition_variable tasksAvailable;
+	bool stopping = false;
+
+	//State of a parallelFor shared by the calling thread and its helpers. It goes back to the free list
+	//when the last of them is done with it instead of being deleted
+	struct ParallelForState
+	{
+		const std::function<void(size_t begin, size_t end)>* function = nullptr;
+		size_t count = 0;
+		size_t grainSize = 0;
+		size_t chunkCount = 0;
+
+		std::atomic<size_t> nextChunk{ 0 };
+		std::atomic<size_t> finishedChunks{ 0 };
+		std::atomic<size_t> references{ 0 };
+		std::mutex doneMutex;
+		std::condition_variable done;
+	};
+
+	std::vector<std::unique_ptr<ParallelForState>> freeStates;		//Guarded by tasksMutex
+
+	//Task of a parallelFor helper, two pointers fit in std::function without allocating
+	struct ParallelForHelper
+	{
+		ThreadPool* pool;
+		ParallelForState* state;
+
+		void operator()() const;
+	};
+
+	void workerLoop();
+
+	//Both need tasksMutex locked
+	void pushTask(std::function<void()>&& task);
+	std::function<void()> popTask();
+
+	void runChunks(ParallelForState* state);
+	void releaseState(ParallelForState* state);
+
+	//Removes the helpers of "state" that did not start yet, returns how many
+	size_t cancelHelpers(ParallelForState* state);
+
+public:
+	//By default one worker per hardware thread, leaving one for the thread that owns the pool
+	explicit ThreadPool(unsigned threadCount = 0);
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	~ThreadPool();
+
+	unsigned getThreadCount() const;
+
+	template<typename Function>
+	auto submit(Function&& function) -> std::future<decltype(function())>
+	{
+		using ReturnType = decltype(function());
+
+		//std::function has to be copyable, so the packaged task lives in a shared pointer
+		auto task = std::make_shared<std::packaged_task<ReturnType()>>(std::forward<Function>(function));
+		std::future<ReturnType> future = task->get_future();
+
+		{
+			std::lock_guard<std::mutex> lock(tasksMutex);
+			pushTask([task]() { (*task)(); });
+		}
+
+		tasksAvailable.notify_one();
+
+		return future;
+	}
+
+	//Calls "function(begin, end)" over [0, count) in chunks of "grainSize". The calling thread works on
+	//the chunks too, so it is safe to call from inside a task of the same pool. Once the pool has seen as
+	//many parallelFors at the same time as it will ever see (one per thread unless they are nested), it
+	//does not allocate
+	void parallelFor(size_t count, size_t grainSize, const std::function<void(size_t begin, size_t end)>& function);
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include<atomic>
+#include<cstdint>
+
+//Three copies of a value handed from one writer thread to one reader thread without locks. The writer
+//fills the back copy and publishes it, the reader takes the newest published copy when it wants one.
+//Neither of them ever waits for the other: the writer can publish any number of times between two reads
+//(the reader only sees the last one) and the reader can read the same copy any number of times.
+//
+//The third copy sits between them, an atomic index swaps it with the back copy on publish and with the
+//front copy on acquire. Its fresh bit says whether it was published after the reader last took it
+template<typename T>
+class TripleBuffer
+{
+private:
+	static constexpr uint32_t INDEX_MASK = 3;
+	static constexpr uint32_t FRESH_BIT = 4;
+
+	T values[3];
+
+	uint32_t back = 0;							//Only used by the writer
+	std::atomic<uint32_t> middle{ 1 };
+	uint32_t front = 2;							//Only used by the reader
+
+public:
+	TripleBuffer() = default;
+
+	TripleBuffer(const TripleBuffer&) = delete;
+	TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+	//Sets all three copies, while neither thread is using the buffer
+	void reset(const T& value)
+	{
+		values[0] = value;
+		values[1] = value;
+		values[2] = value;
+
+		back = 0;
+		middle.store(1, std::memory_order_relaxed);
+		front = 2;
+	}
+
+	//************************** WRITER *****************************
+	//What it holds is the copy published two times ago (or the reset value), not the last one
+	T& getBack()
+	{
+		return values[back];
+	}
+
+	void publish()
+	{
+		//Release so the reader sees what was written to the copy, acquire so the copy the writer gets
+		//back is not still being read
+		back = middle.exchange(back | FRESH_BIT, std::memory_order_acq_rel) & INDEX_MASK;
+	}
+
+	//************************** READER *****************************
+	//Takes the newest published copy, false (and the front copy stays) if nothing was published since the last time
+	bool acquire()
+	{
+		if ((middle.load(std::memory_order_relaxed) & FRESH_BIT) == 0)
+			return false;
+
+		front = middle.exchange(front, std::memory_order_acq_rel) & INDEX_MASK;
+
+		return true;
+	}
+
+	const T& getFront() const
+	{
+		return values[front];
+	}
+};
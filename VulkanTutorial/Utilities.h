@@ -1,6 +1,9 @@
 #pragma once
 #include <fstream>
+#include<algorithm>
 #include<glm/glm.hpp>
+#include "HostAllocator.h"
+#include "VertexLayout.h"
 
 #ifdef NDEBUG
 const bool enableValidationLayers = false;
@@ -17,6 +20,47 @@ const std::vector<const char*> validationLayers = {
 
 const int MAX_FRAME_COUNT = 2;
 
+//Driver host allocations go through HostAllocator (counted by scope, pooled for commands and objects)
+const bool enableHostAllocator = true;
+
+//Debug builds check that draw() makes no heap allocations after the first frames. Only on Windows, where
+//the driver and the validation layers have their own operator new instead of sharing ours
+#if !defined(NDEBUG) && defined(_WIN32)
+const bool enableAllocationCheck = true;
+#else
+const bool enableAllocationCheck = false;
+#endif
+const uint64_t ALLOCATION_CHECK_WARMUP_FRAMES = 16;
+
+//Renders the depth of the scene first (no fragment shader) and then shades only the
+//fragments whose depth is EQUAL to the stored one, so every pixel is shaded once
+const bool enableDepthPrePass = true;
+
+//Mesh levels of detail, every level has about half the triangles of the previous one
+const int MAX_LOD_COUNT = 8;
+const float LOD_MAX_PIXEL_ERROR = 1.0f;
+
+//Splits every LOD into meshlets and draws only the ones that may be visible (the limits fit mesh shaders)
+const bool enableMeshletCulling = true;
+const uint32_t MESHLET_MAX_VERTICES = 64;
+const uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+//Sizes of the bindless descriptor arrays (clamped to the device limits) and of the material table
+const uint32_t MAX_BINDLESS_BUFFERS = 16384;
+const uint32_t MAX_BINDLESS_IMAGES = 16384;
+const uint32_t MAX_MATERIALS = 1024;
+
+//Views a frame can draw in one multiview pass, the smallest maxMultiviewViewCount a device can have
+//(the six faces of a cube map)
+const uint32_t MAX_VIEWS = 6;
+
+//Device memory the streamed texture mips can use, and the staging memory each frame can stream in with
+const VkDeviceSize TEXTURE_MEMORY_BUDGET = 512ull * 1024 * 1024;
+const VkDeviceSize TEXTURE_STAGING_SIZE = 32ull * 1024 * 1024;
+
+//Compiled pipelines are kept between runs in this file, next to the working directory
+const char* const PIPELINE_CACHE_FILE = "pipeline_cache.bin";
+
 //Indices (Locations) of queue families
 struct QueueFamilyIndices
 {
@@ -32,6 +76,32 @@ struct QueueFamilyIndices
 struct VertexData {
 	glm::vec3 position;
 	glm::vec3 color;
+	glm::vec2 uv;
+};
+
+//Locations 0, 1 and 2 of the vertex shader
+template<> struct VertexAttributes<VertexData>
+{
+	static constexpr std::array<VertexAttribute, 3> value = {
+		VERTEX_ATTRIBUTE(VertexData, position),
+		VERTEX_ATTRIBUTE(VertexData, color),
+		VERTEX_ATTRIBUTE(VertexData, uv)
+	};
+};
+
+//Same layout as the material struct of the shaders (std430)
+struct MaterialData {
+	glm::vec4 baseColor;
+	uint32_t baseColorTexture;		//Bindless index of the texture, ~0u if it has none
+	uint32_t padding[3] = {};
+};
+
+//Pushed before every draw, the material is found through the bindless buffer array
+struct MeshPushConstants {
+	glm::mat4 model;
+	uint32_t materialBuffer;		//Bindless index of the material table
+	uint32_t material;				//Index in the material table
+	uint32_t viewBuffer;			//Bindless index of the view matrices, indexed by gl_ViewIndex
 };
 
 struct Device
@@ -62,6 +132,14 @@ struct SwapChainImage {
 
 
 
+//Biggest scale along any of the axes of the transform
+static float getMaxScale(const glm::mat4& transform)
+{
+	return std::max(glm::length(glm::vec3(transform[0].x, transform[0].y, transform[0].z)),
+		std::max(glm::length(glm::vec3(transform[1].x, transform[1].y, transform[1].z)),
+			glm::length(glm::vec3(transform[2].x, transform[2].y, transform[2].z))));
+}
+
 static std::vector<char> readFile(const std::string& filename)
 {
 	std::ifstream file(filename, std::ios::binary | std::ios::ate);
@@ -0,0 +1,124 @@
+#pragma once
+
+#include<vulkan/vulkan.h>
+#include<glm/glm.hpp>
+#include<array>
+#include<cstddef>
+#include<cstdint>
+
+//************************** PACKED ATTRIBUTE TYPES *****************************
+//Smaller than their float counterparts, the vertex fetch unpacks them for free
+struct PackedNormal				//VK_FORMAT_A2B10G10R10_SNORM_PACK32
+{
+	uint32_t value;
+};
+
+struct HalfVec2					//VK_FORMAT_R16G16_SFLOAT
+{
+	uint16_t x;
+	uint16_t y;
+};
+
+struct UNormColor				//VK_FORMAT_R8G8B8A8_UNORM
+{
+	uint8_t r, g, b, a;
+};
+
+//************************** FORMATS *****************************
+//Format of every type a vertex attribute can have. A member of any other type does not compile
+template<typename T>
+struct VertexFormat;
+
+template<> struct VertexFormat<float>			{ static constexpr VkFormat value = VK_FORMAT_R32_SFLOAT; };
+template<> struct VertexFormat<glm::vec2>		{ static constexpr VkFormat value = VK_FORMAT_R32G32_SFLOAT; };
+template<> struct VertexFormat<glm::vec3>		{ static constexpr VkFormat value = VK_FORMAT_R32G32B32_SFLOAT; };
+template<> struct VertexFormat<glm::vec4>		{ static constexpr VkFormat value = VK_FORMAT_R32G32B32A32_SFLOAT; };
+template<> struct VertexFormat<uint32_t>		{ static constexpr VkFormat value = VK_FORMAT_R32_UINT; };
+template<> struct VertexFormat<PackedNormal>	{ static constexpr VkFormat value = VK_FORMAT_A2B10G10R10_SNORM_PACK32; };
+template<> struct VertexFormat<HalfVec2>		{ static constexpr VkFormat value = VK_FORMAT_R16G16_SFLOAT; };
+template<> struct VertexFormat<UNormColor>		{ static constexpr VkFormat value = VK_FORMAT_R8G8B8A8_UNORM; };
+
+//************************** LAYOUTS *****************************
+struct VertexAttribute
+{
+	uint32_t offset;
+	uint32_t size;
+	VkFormat format;
+};
+
+//Offset, size and format of a member, all taken from the struct itself
+#define VERTEX_ATTRIBUTE(Vertex, member) \
+	VertexAttribute{ (uint32_t)offsetof(Vertex, member), (uint32_t)sizeof(Vertex::member), VertexFormat<decltype(Vertex::member)>::value }
+
+//Specialized next to every vertex struct with its members in shader location order:
+//
+//	template<> struct VertexAttributes<MyVertex>
+//	{
+//		static constexpr std::array<VertexAttribute, 2> value = {
+//			VERTEX_ATTRIBUTE(MyVertex, position),
+//			VERTEX_ATTRIBUTE(MyVertex, normal)
+//		};
+//	};
+template<typename Vertex>
+struct VertexAttributes;
+
+//The attributes have to follow each other without overlapping and cover every byte of the vertex, so a
+//member added to the struct but not to its attributes is a compile error
+template<typename Vertex>
+constexpr bool isVertexLayoutComplete()
+{
+	const auto& attributes = VertexAttributes<Vertex>::value;
+
+	uint32_t end = 0;
+	uint32_t size = 0;
+
+	for (size_t i = 0; i < attributes.size(); i++)
+	{
+		if (attributes[i].offset < end)
+			return false;
+
+		end = attributes[i].offset + attributes[i].size;
+		size += attributes[i].size;
+	}
+
+	return end <= sizeof(Vertex) && size == sizeof(Vertex);
+}
+
+//Binding and attribute descriptions of a vertex struct, and the pipeline state that uses them. Everything
+//is a constant, pipelines point to it instead of filling descriptions at runtime
+template<typename Vertex, uint32_t Binding = 0, VkVertexInputRate InputRate = VK_VERTEX_INPUT_RATE_VERTEX>
+struct VertexInputState
+{
+	static_assert(isVertexLayoutComplete<Vertex>(), "The vertex attributes do not match the members of the vertex struct!");
+
+	static constexpr size_t attributeCount = VertexAttributes<Vertex>::value.size();
+
+	static constexpr VkVertexInputBindingDescription binding = { Binding, (uint32_t)sizeof(Vertex), InputRate };
+
+	static constexpr std::array<VkVertexInputAttributeDescription, attributeCount> makeAttributeDescriptions()
+	{
+		std::array<VkVertexInputAttributeDescription, attributeCount> descriptions = {};
+
+		for (size_t i = 0; i < attributeCount; i++)
+		{
+			descriptions[i].location = (uint32_t)i;
+			descriptions[i].binding = Binding;
+			descriptions[i].format = VertexAttributes<Vertex>::value[i].format;
+			descriptions[i].offset = VertexAttributes<Vertex>::value[i].offset;
+		}
+
+		return descriptions;
+	}
+
+	static constexpr std::array<VkVertexInputAttributeDescription, attributeCount> attributes = makeAttributeDescriptions();
+
+	static constexpr VkPipelineVertexInputStateCreateInfo createInfo = {
+		VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+		nullptr,
+		0,
+		1,
+		&binding,
+		(uint32_t)attributeCount,
+		attributes.data()
+	};
+};
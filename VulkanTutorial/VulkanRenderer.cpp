@@ -1,39 +1,60 @@
 #include "VulkanRenderer.h"
+#include<cstring>
 
-int VulkanRenderer::init(GLFWwindow* window)
+int VulkanRenderer::init(GLFWwindow* window, const RendererSettings& settings)
 {
     this->window = window;
+	this->settings = settings;
+
+	startupStart = std::chrono::steady_clock::now();
+
+	//The default material, createMaterialBuffers copies the table into the material buffers
+	materials = { MaterialData{ glm::vec4(1.0f), INVALID_TEXTURE } };
+	materialTextures = { INVALID_TEXTURE };
+	viewMatrices.assign(settings.viewCount, glm::mat4(1.0f));
+
+	//Before the startup tasks, some of them read files
+	fileReader.start();
+
+	//Each step lists the ones whose results it reads. Only the swapchain has to stay on this thread
+	//(it asks GLFW for the framebuffer size), the rest runs on the pool as soon as it can
+	StartupGraph& graph = startupGraph;
+
+	StartupTask shadersTask = graph.addTask("Load shaders", [this]() { loadShaders(); });
+	StartupTask instanceTask = graph.addTask("Instance", [this]() { createVkInstance(); });
+	StartupTask debugCallbackTask = graph.addTask("Debug callback", [this]() { createDebugCallback(); }, { instanceTask });
+	StartupTask surfaceTask = graph.addTask("Surface", [this]() { createSurface(); }, { instanceTask });
+	StartupTask physicalDeviceTask = graph.addTask("Physical device", [this]() { getPhysicalDevice(); }, { surfaceTask, debugCallbackTask });
+	StartupTask logicalDeviceTask = graph.addTask("Logical device", [this]() { createLogicalDevice(); }, { physicalDeviceTask });
+	StartupTask swapChainTask = graph.addTask("Swapchain", [this]() { createSwapChain(); }, { logicalDeviceTask }, !settings.headless);
+	StartupTask bindlessTask = graph.addTask("Bindless descriptors", [this]() { createBindlessDescriptors(); }, { logicalDeviceTask });
+	graph.addTask("Descriptor allocator", [this]() { createDescriptorAllocator(); }, { logicalDeviceTask });
+
+	//The memory budget is not thread safe, the tasks that allocate from it run one after the other:
+	//scene, material buffers, view buffers, texture manager, render graph and frame readback
+	StartupTask budgetTask = graph.addTask("Memory budget", [this]() { createMemoryBudget(); }, { logicalDeviceTask });
+	StartupTask sceneTask = graph.addTask("Scene and mesh upload", [this]() { createScene(); }, { budgetTask });
+	StartupTask materialsTask = graph.addTask("Material buffers", [this]() { createMaterialBuffers(); }, { bindlessTask, sceneTask });
+	StartupTask viewsTask = graph.addTask("View buffers", [this]() { createViewBuffers(); }, { materialsTask });
+	StartupTask textureManagerTask = graph.addTask("Texture manager", [this]() { createTextureManager(); }, { viewsTask });
+	StartupTask renderGraphTask = graph.addTask("Render graph", [this]() { createRenderGraph(); }, { swapChainTask, textureManagerTask });
+	graph.addTask("Frame readback", [this]() { createFrameReadback(); }, { renderGraphTask });
+	StartupTask renderPassTask = graph.addTask("Render pass", [this]() { createRenderPass(); }, { renderGraphTask });
+	StartupTask pipelineCacheTask = graph.addTask("Pipeline cache", [this]() { createPipelineCache(); }, { logicalDeviceTask });
+	graph.addTask("Pipelines", [this]() { createGraphicsPipeline(); }, { renderPassTask, bindlessTask, shadersTask, pipelineCacheTask });
+	graph.addTask("Framebuffers", [this]() { createFramebuffers(); }, { renderPassTask });
+	StartupTask commandPoolTask = graph.addTask("Command pool", [this]() { createCommandPool(); }, { logicalDeviceTask });
+	StartupTask commandBuffersTask = graph.addTask("Command buffers", [this]() { createCommandBuffers(); }, { commandPoolTask });
+	graph.addTask("Query pools", [this]() { createQueryPool(); }, { commandBuffersTask });
+	graph.addTask("Synchronization", [this]() { createSyncronization(); }, { logicalDeviceTask });
 
 	try
 	{
-		createVkInstance();
-		createDebugCallback();
-		createSurface();
-		getPhysicalDevice();
-		createLogicalDevice();
-
-		auto vertices = std::vector<VertexData>{
-			VertexData{{0.0f,-0.1f,0.0f}, {1.0f, 0.0f, 0.0f}},
-			VertexData{{0.1f, 0.1f,0.0f}, {0.0f, 1.0f, 0.0f}},
-			VertexData{{-0.1f,0.1f,0.0f}, {0.0f, 0.0f, 1.0f}}
-		};
-
-		meshes = { 
-			Mesh(mainDevice.physicalDevice, mainDevice.logicalDevice, vertices)
-		};
-
-		createSwapChain();
-		createRenderPass();
-		createGraphicsPipeline();
-		createFramebuffers();
-		createCommandPool();
-		createCommandBuffers();
-		recordCommands();
-		createSyncronization();
+		graph.run(threadPool);
 	}
 	catch (const std::runtime_error& e)
 	{
-		std::cout << "ERROR:" << e.what() << "\n";
+		std::cerr << "ERROR:" << e.what() << "\n";
 		return EXIT_FAILURE;
 	}
     
@@ -45,6 +66,21 @@ void VulkanRenderer::draw()
 	vkWaitForFences(mainDevice.logicalDevice, 1, &drawFences[currentFrame], VK_FALSE, std::numeric_limits<uint64_t>::max());
 	vkResetFences(mainDevice.logicalDevice, 1, &drawFences[currentFrame]);
 
+	//The copy this frame made the last time is done, the writer can have it
+	if (frameReadback.isRunning())
+		frameReadback.completeFrame(currentFrame);
+
+	//Nothing the GPU still reads lives in the arena, only what this frame recorded the last time
+	frameArenas[currentFrame].reset();
+
+	uint64_t frameStartAllocations = getAllocationCount();
+
+	//Resources last used MAX_FRAME_COUNT frames ago can be evicted from now on
+	memoryBudget.beginFrame();
+
+	//Driver host allocations made from here on count as this frame's
+	getHostAllocatorInstance().beginFrame();
+
 	uint32_t imageIndex = 0;
 	VkResult result;
 
@@ -56,6 +92,56 @@ void VulkanRenderer::draw()
 		VK_NULL_HANDLE,
 		&imageIndex);
 
+	//The statistics of this frame's previous submission are read before its command buffer
+	//resets the query again, without waiting for them if they are not available yet
+	if (pipelineStatisticsSupported && statisticsQueryIssued[currentFrame])
+	{
+		uint64_t invocations = 0;
+
+		if (vkGetQueryPoolResults(mainDevice.logicalDevice, statisticsQueryPool, currentFrame, 1,
+			sizeof(invocations), &invocations, sizeof(invocations), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+			fragmentShaderInvocations = invocations;
+	}
+
+	if (timestampsSupported && timestampQueryIssued[currentFrame])
+	{
+		uint64_t timestamps[2] = {};
+
+		if (vkGetQueryPoolResults(mainDevice.logicalDevice, timestampQueryPool, currentFrame * 2, 2,
+			sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+		{
+			gpuFrameTime = (timestamps[1] - timestamps[0]) * deviceCapabilities.properties.limits.timestampPeriod / 1000000.0;
+
+			//The scale this frame is drawn at follows the time of the one that used its command buffer last
+			if (resolutionScaler.isEnabled())
+				sceneExtent = getScaledExtent(resolutionScaler.update(gpuFrameTime, frameResolutionScales[currentFrame]));
+		}
+	}
+
+	frameResolutionScales[currentFrame] = resolutionScaler.getScale();
+
+	bindlessDescriptors.nextFrame(currentFrame);
+	descriptorAllocator.nextFrame(currentFrame);
+
+	//Only the subtrees that changed since the last frame are updated
+	sceneGraph.updateTransforms(&threadPool);
+
+	selectMeshLods();
+	cullMeshlets();
+	buildDrawList();
+
+	//The fence guarantees this frame's command buffer is no longer in use, so it is recorded again
+	//with the current transforms
+	auto recordStart = std::chrono::steady_clock::now();
+
+	recordCommands(imageIndex);
+
+	cpuRecordTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - recordStart).count();
+
+	//After recording, the texture residency changes may have given textures new descriptor indices
+	uploadMaterials();
+	uploadViews();
+
 	VkPipelineStageFlags waitStages[] = {
 		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
 	};
@@ -64,7 +150,7 @@ void VulkanRenderer::draw()
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 	submitInfo.pNext = nullptr;
 	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffers[imageIndex];
+	submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
 	submitInfo.waitSemaphoreCount = 1;
 	submitInfo.pWaitSemaphores = &readyToDraw[currentFrame];
 	submitInfo.pWaitDstStageMask = waitStages;
@@ -76,6 +162,12 @@ void VulkanRenderer::draw()
 	if (result != VK_SUCCESS)
 		throw std::runtime_error("Failed to submit command buffer");
 
+	if (pipelineStatisticsSupported)
+		statisticsQueryIssued[currentFrame] = true;
+
+	if (timestampsSupported)
+		timestampQueryIssued[currentFrame] = true;
+
 	VkPresentInfoKHR presentInfo = {};
 	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 	presentInfo.pNext = nullptr;
@@ -91,6 +183,20 @@ void VulkanRenderer::draw()
 	if (result != VK_SUCCESS)
 		throw std::runtime_error("Failed to present the image to the screen");
 
+	if (!firstFramePresented)
+	{
+		firstFramePresented = true;
+
+		if (settings.printStartupTimeline)
+			startupGraph.printTimeline(std::cerr,
+				std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startupStart).count());
+	}
+
+	//Per frame memory comes from the arenas, anything else is churn that slipped in
+	if (enableAllocationCheck && memoryBudget.getFrameNumber() > ALLOCATION_CHECK_WARMUP_FRAMES &&
+		getAllocationCount() != frameStartAllocations)
+		throw std::runtime_error("Heap allocation in the frame loop!");
+
 	currentFrame = (currentFrame < (MAX_FRAME_COUNT-1)) ? ++currentFrame : 0;
 
 }
@@ -99,37 +205,75 @@ void VulkanRenderer::cleanup() noexcept
 {
 	vkDeviceWaitIdle(mainDevice.logicalDevice);
 
+	frameReadback.stop();
 
 	for(auto& mesh : meshes)
 		mesh.destroyVertexBuffer();
 
 	for (size_t i = 0; i < MAX_FRAME_COUNT; i++)
 	{
-		vkDestroySemaphore(mainDevice.logicalDevice, readyToPresent[i], nullptr);
-		vkDestroySemaphore(mainDevice.logicalDevice, readyToDraw[i], nullptr);
-		vkDestroyFence(mainDevice.logicalDevice, drawFences[i], nullptr);
+		vkDestroySemaphore(mainDevice.logicalDevice, readyToPresent[i], getHostAllocator());
+		vkDestroySemaphore(mainDevice.logicalDevice, readyToDraw[i], getHostAllocator());
+		vkDestroyFence(mainDevice.logicalDevice, drawFences[i], getHostAllocator());
 	}
 	
-	vkDestroyCommandPool(mainDevice.logicalDevice, graphicsCommandPool, nullptr);
+	if (statisticsQueryPool != VK_NULL_HANDLE)
+		vkDestroyQueryPool(mainDevice.logicalDevice, statisticsQueryPool, getHostAllocator());
+
+	if (timestampQueryPool != VK_NULL_HANDLE)
+		vkDestroyQueryPool(mainDevice.logicalDevice, timestampQueryPool, getHostAllocator());
+
+	vkDestroyCommandPool(mainDevice.logicalDevice, graphicsCommandPool, getHostAllocator());
 
 	for (auto& framebuffer : swapChainFramebuffers)
-		vkDestroyFramebuffer(mainDevice.logicalDevice, framebuffer, nullptr);
+		vkDestroyFramebuffer(mainDevice.logicalDevice, framebuffer, getHostAllocator());
+
+	sceneVariants.destroy();
+
+	if (depthPrePassPipeline != VK_NULL_HANDLE)
+		vkDestroyPipeline(mainDevice.logicalDevice, depthPrePassPipeline, getHostAllocator());
+
+	pipelineLayoutCache.destroy();
+
+	savePipelineCache();
+	vkDestroyPipelineCache(mainDevice.logicalDevice, pipelineCache, getHostAllocator());
+
+	for (size_t i = 0; i < materialBuffers.size(); i++)
+	{
+		vkDestroyBuffer(mainDevice.logicalDevice, materialBuffers[i], getHostAllocator());
+		memoryBudget.free(materialMemories[i]);
+	}
+
+	for (size_t i = 0; i < viewBuffers.size(); i++)
+	{
+		vkDestroyBuffer(mainDevice.logicalDevice, viewBuffers[i], getHostAllocator());
+		memoryBudget.free(viewMemories[i]);
+	}
+
+	//The reads of the textures are finished or cancelled before the reader stops
+	textureManager.destroy();
+	fileReader.stop();
+	descriptorAllocator.destroy();
+	bindlessDescriptors.destroy();
+
+	vkDestroyRenderPass(mainDevice.logicalDevice, renderPass, getHostAllocator());
 
-	vkDestroyPipeline(mainDevice.logicalDevice, graphicsPipeline, nullptr);
-	vkDestroyPipelineLayout(mainDevice.logicalDevice, pipelineLayout, nullptr);
-	vkDestroyRenderPass(mainDevice.logicalDevice, renderPass, nullptr);
+	renderGraph.destroy();
 
 	for (auto& image : swapChainImages)
-		vkDestroyImageView(mainDevice.logicalDevice, image.imageView, nullptr);
+		vkDestroyImageView(mainDevice.logicalDevice, image.imageView, getHostAllocator());
 
-	vkDestroySwapchainKHR(mainDevice.logicalDevice, swapchain, nullptr);
-	vkDestroyDevice(mainDevice.logicalDevice, nullptr);
-	vkDestroySurfaceKHR(instance, surface, nullptr);
+	vkDestroySwapchainKHR(mainDevice.logicalDevice, swapchain, getHostAllocator());
+	vkDestroyDevice(mainDevice.logicalDevice, getHostAllocator());
+	vkDestroySurfaceKHR(instance, surface, getHostAllocator());
 
-	if (enableValidationLayers)
-		DestroyDebugReportCallbackEXT(instance, callback, nullptr);
+	if (debugMessenger != VK_NULL_HANDLE)
+		DestroyDebugUtilsMessengerEXT(instance, debugMessenger, getHostAllocator());
 
-	vkDestroyInstance(instance, nullptr);
+	//After the messenger is gone nothing pushes to the log anymore
+	debugLog.stop();
+
+	vkDestroyInstance(instance, getHostAllocator());
 }
 
 VulkanRenderer::~VulkanRenderer()
@@ -137,6 +281,239 @@ VulkanRenderer::~VulkanRenderer()
 	cleanup();
 }
 
+const DeviceCapabilities& VulkanRenderer::getDeviceCapabilities() const
+{
+	return deviceCapabilities;
+}
+
+uint64_t VulkanRenderer::getFragmentShaderInvocations() const
+{
+	return fragmentShaderInvocations;
+}
+
+SceneGraph& VulkanRenderer::getSceneGraph()
+{
+	return sceneGraph;
+}
+
+SceneNode VulkanRenderer::getSceneRoot() const
+{
+	return sceneRoot;
+}
+
+SceneNode VulkanRenderer::getInstanceNode(size_t instance) const
+{
+	return instanceNodes.at(instance);
+}
+
+void VulkanRenderer::captureSnapshot(SceneSnapshot& snapshot) const
+{
+	snapshot.localTransforms.resize(sceneGraph.getNodeCount());
+
+	for (SceneNode node = 0; node < (SceneNode)sceneGraph.getNodeCount(); node++)
+		snapshot.localTransforms[node] = sceneGraph.getLocalTransform(node);
+
+	snapshot.changedNodes.clear();
+	snapshot.instanceMaterials = instanceMaterials;
+	snapshot.viewMatrices = viewMatrices;
+}
+
+void VulkanRenderer::applySnapshot(const SceneSnapshot& snapshot)
+{
+	if (snapshot.localTransforms.size() != sceneGraph.getNodeCount() || snapshot.instanceMaterials.size() != instanceMaterials.size() ||
+		snapshot.viewMatrices.size() != viewMatrices.size())
+		throw std::runtime_error("Scene snapshot does not match the scene!");
+
+	//Setting a transform dirties its whole subtree, so the unchanged ones are left alone
+	for (SceneNode node : snapshot.changedNodes)
+	{
+		if (node >= snapshot.localTransforms.size())
+			throw std::runtime_error("Invalid scene node!");
+
+		if (snapshot.localTransforms[node] != sceneGraph.getLocalTransform(node))
+			sceneGraph.setLocalTransform(node, snapshot.localTransforms[node]);
+	}
+
+	for (size_t i = 0; i < instanceMaterials.size(); i++)
+	{
+		if (snapshot.instanceMaterials[i] >= materials.size())
+			throw std::runtime_error("Invalid material!");
+
+		instanceMaterials[i] = snapshot.instanceMaterials[i];
+	}
+
+	std::copy(snapshot.viewMatrices.begin(), snapshot.viewMatrices.end(), viewMatrices.begin());
+}
+
+uint32_t VulkanRenderer::getViewCount() const
+{
+	return (uint32_t)viewMatrices.size();
+}
+
+void VulkanRenderer::setViewMatrix(uint32_t view, const glm::mat4& viewMatrix)
+{
+	viewMatrices.at(view) = viewMatrix;
+}
+
+uint32_t VulkanRenderer::addMesh(const std::vector<VertexData>& vertices, const std::vector<uint32_t>& indices)
+{
+	uint32_t mesh = (uint32_t)meshes.size();
+
+	//Without indices every three vertices are a triangle
+	if (indices.empty())
+		meshes.push_back(Mesh(&memoryBudget, mainDevice.logicalDevice, vertices));
+	else
+		meshes.push_back(Mesh(&memoryBudget, mainDevice.logicalDevice, vertices, indices));
+
+	nameMesh(mesh);
+
+	return mesh;
+}
+
+uint32_t VulkanRenderer::addMesh(const std::vector<char>& encodedMesh)
+{
+	uint32_t mesh = (uint32_t)meshes.size();
+
+	meshes.push_back(Mesh(&memoryBudget, mainDevice.logicalDevice, encodedMesh));
+	nameMesh(mesh);
+
+	return mesh;
+}
+
+uint32_t VulkanRenderer::loadMesh(const std::string& path)
+{
+	return addMesh(fileReader.readFile(path));
+}
+
+void VulkanRenderer::nameMesh(uint32_t mesh)
+{
+	//The names show up in the validation messages and in GPU captures
+	std::string name = "Mesh " + std::to_string(mesh);
+
+	setDebugName(mainDevice.logicalDevice, VK_OBJECT_TYPE_BUFFER, (uint64_t)meshes[mesh].getVertexBuffer(), (name + " vertices").c_str());
+	setDebugName(mainDevice.logicalDevice, VK_OBJECT_TYPE_BUFFER, (uint64_t)meshes[mesh].getIndexBuffer(), (name + " indices").c_str());
+}
+
+void VulkanRenderer::createFrameReadback()
+{
+	if (settings.readbackOutput.empty())
+		return;
+
+	frameReadback.start(mainDevice.logicalDevice, &memoryBudget, swapChainExtent, swapChainFormat,
+		settings.readbackOutput, settings.readbackFormat);
+}
+
+void VulkanRenderer::createScene()
+{
+	//Every instance hangs from a common root, moving the root moves the whole scene
+	sceneRoot = sceneGraph.addNode();
+
+	if (settings.defaultScene)
+	{
+		auto vertices = std::vector<VertexData>{
+			VertexData{{0.0f,-0.1f,0.0f}, {1.0f, 0.0f, 0.0f}, {0.5f, 0.0f}},
+			VertexData{{0.1f, 0.1f,0.0f}, {0.0f, 1.0f, 0.0f}, {1.0f, 1.0f}},
+			VertexData{{-0.1f,0.1f,0.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 1.0f}}
+		};
+
+		addMeshInstance(addMesh(vertices, {}));
+	}
+}
+
+uint32_t VulkanRenderer::addMeshInstance(uint32_t mesh)
+{
+	if (mesh >= meshes.size())
+		throw std::runtime_error("Invalid mesh!");
+
+	instanceMeshes.push_back(mesh);
+	instanceNodes.push_back(sceneGraph.addNode(sceneRoot));
+	instanceMaterials.push_back(0);
+
+	return (uint32_t)(instanceMeshes.size() - 1);
+}
+
+size_t VulkanRenderer::getInstanceCount() const
+{
+	return instanceMeshes.size();
+}
+
+uint32_t VulkanRenderer::createMaterial(const glm::vec4& baseColor)
+{
+	if (materials.size() == MAX_MATERIALS)
+		throw std::runtime_error("Too many materials!");
+
+	materials.push_back({ baseColor, INVALID_TEXTURE });
+	materialTextures.push_back(INVALID_TEXTURE);
+	materialUploadsPending = MAX_FRAME_COUNT;
+
+	return (uint32_t)(materials.size() - 1);
+}
+
+void VulkanRenderer::setMaterialColor(uint32_t material, const glm::vec4& baseColor)
+{
+	materials.at(material).baseColor = baseColor;
+	materialUploadsPending = MAX_FRAME_COUNT;
+}
+
+void VulkanRenderer::setInstanceMaterial(size_t instance, uint32_t material)
+{
+	if (material >= materials.size())
+		throw std::runtime_error("Invalid material!");
+
+	instanceMaterials.at(instance) = material;
+}
+
+TextureHandle VulkanRenderer::loadTexture(const std::string& path)
+{
+	return textureManager.loadKtx2(path);
+}
+
+void VulkanRenderer::setMaterialTexture(uint32_t material, TextureHandle texture)
+{
+	materialTextures.at(material) = texture;
+	materialUploadsPending = MAX_FRAME_COUNT;
+}
+
+TextureManager& VulkanRenderer::getTextureManager()
+{
+	return textureManager;
+}
+
+uint64_t VulkanRenderer::getDrawnTriangleCount() const
+{
+	return drawnTriangleCount;
+}
+
+uint32_t VulkanRenderer::getUnsortedBindCount() const
+{
+	return unsortedBindCount;
+}
+
+uint32_t VulkanRenderer::getSortedBindCount() const
+{
+	return sortedBindCount;
+}
+
+size_t VulkanRenderer::getShaderVariantCount() const
+{
+	return sceneVariants.getVariantCount();
+}
+
+double VulkanRenderer::getCpuRecordTime() const
+{
+	return cpuRecordTime;
+}
+
+double VulkanRenderer::getGpuFrameTime() const
+{
+	return gpuFrameTime;
+}
+
+float VulkanRenderer::getResolutionScale() const
+{
+	return resolutionScaler.getScale();
+}
+
 void VulkanRenderer::createVkInstance()
 {
 	//Checking Validation Layers
@@ -151,7 +528,7 @@ void VulkanRenderer::createVkInstance()
 	appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
 	appInfo.pEngineName = "No Engine";
 	appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-	appInfo.apiVersion = VK_API_VERSION_1_0;
+	appInfo.apiVersion = VK_API_VERSION_1_2;		//Descriptor indexing is core in 1.2
 
 	//Creation Information to create the vulkan instance
 	VkInstanceCreateInfo createInfo = {};
@@ -163,19 +540,32 @@ void VulkanRenderer::createVkInstance()
 	//List of instance extensions
 	std::vector<const char*> instanceExtensions;
 
-	uint32_t glfwReqExtensionCount = 0;
+	if (settings.headless)
+	{
+		//A surface that is not shown anywhere, the swapchain works as usual
+		instanceExtensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+		instanceExtensions.push_back(VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME);
+	}
+	else
+	{
+		uint32_t glfwReqExtensionCount = 0;
 
-	const char** glfwReqExtensions = 
-		glfwGetRequiredInstanceExtensions(&glfwReqExtensionCount);
+		const char** glfwReqExtensions =
+			glfwGetRequiredInstanceExtensions(&glfwReqExtensionCount);
 
-	//Adding the required GLFW extensions to the extension list
-	instanceExtensions.insert(
-		instanceExtensions.end(), 
-		glfwReqExtensions, 
-		glfwReqExtensions + glfwReqExtensionCount);
+		//Adding the required GLFW extensions to the extension list
+		instanceExtensions.insert(
+			instanceExtensions.end(),
+			glfwReqExtensions,
+			glfwReqExtensions + glfwReqExtensionCount);
+	}
 
-	if (enableValidationLayers) {
-		instanceExtensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
+	//Labels and names are useful in captures of release builds too, so the extension is enabled
+	//whenever the instance has it (validation needs it for its messenger)
+	debugUtilsEnabled = enableValidationLayers || checkInstanceExtensionSupport({ VK_EXT_DEBUG_UTILS_EXTENSION_NAME });
+
+	if (debugUtilsEnabled) {
+		instanceExtensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
 	}
 
 	createInfo.enabledExtensionCount = static_cast<uint32_t>(instanceExtensions.size());
@@ -191,11 +581,14 @@ void VulkanRenderer::createVkInstance()
 
 	if (supported)
 	{
-		VkResult result = vkCreateInstance(&createInfo, nullptr, &instance);
+		VkResult result = vkCreateInstance(&createInfo, getHostAllocator(), &instance);
 
 		if (result != VK_SUCCESS)
 			throw std::runtime_error("Failed to create a Vulkan Instance!");
 
+		if (debugUtilsEnabled)
+			loadDebugUtils(instance);
+
 		return;
 	}
 	
@@ -207,17 +600,22 @@ void VulkanRenderer::createDebugCallback()
 	// Only create callback if validation enabled
 	if (!enableValidationLayers) return;
 
-	VkDebugReportCallbackCreateInfoEXT callbackCreateInfo = {};
-	callbackCreateInfo.sType = VK_STRUCTURE_TYPE_DEBUG_REPORT_CALLBACK_CREATE_INFO_EXT;
-	callbackCreateInfo.flags = VK_DEBUG_REPORT_ERROR_BIT_EXT | 
-		VK_DEBUG_REPORT_WARNING_BIT_EXT | 
-		VK_DEBUG_REPORT_INFORMATION_BIT_EXT | 
-		VK_DEBUG_REPORT_PERFORMANCE_WARNING_BIT_EXT |
-		VK_DEBUG_REPORT_DEBUG_BIT_EXT;	// Which validation reports should initiate callback
-	callbackCreateInfo.pfnCallback = debugCallback;												// Pointer to callback function itself
-
-	// Create debug callback with custom create function
-	VkResult result = CreateDebugReportCallbackEXT(instance, &callbackCreateInfo, nullptr, &callback);
+	// The log has to be running before the first message arrives
+	debugLog.start();
+
+	VkDebugUtilsMessengerCreateInfoEXT messengerCreateInfo = {};
+	messengerCreateInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
+	messengerCreateInfo.pNext = nullptr;
+	messengerCreateInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT |
+		VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT;		// Info and verbose would flood the log
+	messengerCreateInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
+		VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
+		VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+	messengerCreateInfo.pfnUserCallback = debugCallback;										// Pointer to callback function itself
+	messengerCreateInfo.pUserData = &debugLog;
+
+	// Create debug messenger with custom create function
+	VkResult result = CreateDebugUtilsMessengerEXT(instance, &messengerCreateInfo, getHostAllocator(), &debugMessenger);
 	if (result != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to create Debug Callback!");
@@ -227,7 +625,7 @@ void VulkanRenderer::createDebugCallback()
 void VulkanRenderer::createLogicalDevice()
 {
 	//Queue Family and Queue Priority(0.0f to 1.0f)
-	auto queueFamilies = getQueueFamilies(mainDevice.physicalDevice);
+	const QueueFamilyIndices& queueFamilies = deviceCapabilities.queueFamilyIndices;
 	float priotity = 1.0f;
 
 	//The graphics could be the same as the presentation queue, however if 
@@ -236,6 +634,7 @@ void VulkanRenderer::createLogicalDevice()
 	std::set<int> queueSet{ queueFamilies.graphicsFamily, queueFamilies.presentationFamily };
 
 	std::vector<VkDeviceQueueCreateInfo> queueCreateInfos(queueSet.size());
+	auto family = queueSet.begin();
 
 	//Create one VkDeviceQueueCreateInfo per unique family in "queueFamilies"
 	for (VkDeviceQueueCreateInfo& item : queueCreateInfos)
@@ -243,26 +642,59 @@ void VulkanRenderer::createLogicalDevice()
 		//Device Queue Creation Info
 		item = {};
 		item.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-		item.queueFamilyIndex = queueFamilies.graphicsFamily;
+		item.queueFamilyIndex = *family++;
 		item.queueCount = 1;
 		item.pQueuePriorities = &priotity;
 	}
 
 	//Physical Device Features
-	VkPhysicalDeviceFeatures deviceFeatures;
-	vkGetPhysicalDeviceFeatures(mainDevice.physicalDevice, &deviceFeatures);
+	VkPhysicalDeviceFeatures deviceFeatures = deviceCapabilities.features;
+
+	//Needed to count the fragment shader invocations (overdraw) of every frame
+	pipelineStatisticsSupported = deviceFeatures.pipelineStatisticsQuery == VK_TRUE;
+
+	//Timestamps need no feature, only a queue that writes them
+	timestampsSupported = deviceCapabilities.queueFamilies[deviceCapabilities.queueFamilyIndices.graphicsFamily].timestampValidBits > 0;
+
+	//Descriptor indexing for the bindless descriptors (checkDeviceSuitable made sure it is supported)
+	VkPhysicalDeviceVulkan12Features vulkan12Features = {};
+	vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	vulkan12Features.pNext = nullptr;
+	vulkan12Features.descriptorIndexing = VK_TRUE;
+	vulkan12Features.runtimeDescriptorArray = VK_TRUE;
+	vulkan12Features.descriptorBindingPartiallyBound = VK_TRUE;
+	vulkan12Features.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+	vulkan12Features.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+	vulkan12Features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+	vulkan12Features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+	vulkan12Features.shaderStorageBufferArrayNonUniformIndexing = VK_TRUE;
+
+	//The vertex shader reads gl_ViewIndex, so multiview is needed even when there is one view
+	VkPhysicalDeviceVulkan11Features vulkan11Features = {};
+	vulkan11Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
+	vulkan11Features.pNext = &vulkan12Features;
+	vulkan11Features.multiview = VK_TRUE;
 	
 	//Logical Device Creation Info
 	VkDeviceCreateInfo deviceCreateInfo = {};
 	deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+	deviceCreateInfo.pNext = &vulkan11Features;
 	deviceCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
 	deviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();
-	deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-	deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions.data();
+	//Optional extensions go after the required ones
+	std::vector<const char*> extensions = deviceExtensions;
+
+	memoryBudgetExtensionEnabled = deviceCapabilities.hasExtension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+	if (memoryBudgetExtensionEnabled)
+		extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+	deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+	deviceCreateInfo.ppEnabledExtensionNames = extensions.data();
 	deviceCreateInfo.pEnabledFeatures = &deviceFeatures;
 
 	//Create Logical Device
-	VkResult result = vkCreateDevice(mainDevice.physicalDevice, &deviceCreateInfo, nullptr, &mainDevice.logicalDevice);
+	VkResult result = vkCreateDevice(mainDevice.physicalDevice, &deviceCreateInfo, getHostAllocator(), &mainDevice.logicalDevice);
 
 	//Logical Device Creation Validation
 	if (result != VK_SUCCESS)
@@ -275,10 +707,31 @@ void VulkanRenderer::createLogicalDevice()
 	vkGetDeviceQueue(mainDevice.logicalDevice,queueFamilies.presentationFamily,0,&presentationQueue);
 }
 
+void VulkanRenderer::createMemoryBudget()
+{
+	memoryBudget = MemoryBudget(deviceCapabilities, mainDevice.logicalDevice, memoryBudgetExtensionEnabled);
+}
+
 void VulkanRenderer::createSurface()
 {
-	//Create Surface
-	VkResult result = glfwCreateWindowSurface(instance, window, nullptr,&surface);
+	VkResult result = VK_ERROR_EXTENSION_NOT_PRESENT;
+
+	if (settings.headless)
+	{
+		VkHeadlessSurfaceCreateInfoEXT surfaceCreateInfo = {};
+		surfaceCreateInfo.sType = VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT;
+		surfaceCreateInfo.pNext = nullptr;
+
+		auto createHeadlessSurface = (PFN_vkCreateHeadlessSurfaceEXT)vkGetInstanceProcAddr(instance, "vkCreateHeadlessSurfaceEXT");
+
+		if (createHeadlessSurface != nullptr)
+			result = createHeadlessSurface(instance, &surfaceCreateInfo, getHostAllocator(), &surface);
+	}
+	else
+	{
+		//Create Surface
+		result = glfwCreateWindowSurface(instance, window, getHostAllocator(), &surface);
+	}
 
 	if (result != VK_SUCCESS)
 		throw std::runtime_error("Failed to create a Surface!");
@@ -316,7 +769,30 @@ void VulkanRenderer::createSwapChain()
 	swapChainCreateInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 	swapChainCreateInfo.clipped = VK_TRUE;
 
-	auto queueIndices = getQueueFamilies(mainDevice.physicalDevice);
+	//The readback copies the images, so no pixel can be left out because the window is covered
+	if (!settings.readbackOutput.empty())
+	{
+		if (!(scPtr->supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT))
+			throw std::runtime_error("The swapchain images can not be copied for the frame readback!");
+
+		swapChainCreateInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		swapChainCreateInfo.clipped = VK_FALSE;
+	}
+
+	if (settings.viewCount == 0 || settings.viewCount > MAX_VIEWS)
+		throw std::runtime_error("Invalid view count!");
+
+	//With several views or resolution scaling the scene is drawn to an image of its own, which is copied
+	//(or scaled up) into the swapchain images
+	if (isSceneOffscreen())
+	{
+		if (!(scPtr->supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT))
+			throw std::runtime_error("The scene can not be copied to the swapchain images!");
+
+		swapChainCreateInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	}
+
+	const QueueFamilyIndices& queueIndices = deviceCapabilities.queueFamilyIndices;
 
 	if (queueIndices.graphicsFamily != queueIndices.presentationFamily)
 	{
@@ -333,7 +809,7 @@ void VulkanRenderer::createSwapChain()
 		swapChainCreateInfo.pQueueFamilyIndices = nullptr;
 	}
 
-	VkResult result = vkCreateSwapchainKHR(mainDevice.logicalDevice, &swapChainCreateInfo, nullptr, &swapchain);
+	VkResult result = vkCreateSwapchainKHR(mainDevice.logicalDevice, &swapChainCreateInfo, getHostAllocator(), &swapchain);
 
 	if (result != VK_SUCCESS)
 		throw std::runtime_error("Failed to create a SwapChain!");
@@ -341,6 +817,24 @@ void VulkanRenderer::createSwapChain()
 	swapChainExtent = extent;
 	swapChainFormat = format.format;
 
+	//The views are tiles of the swapchain image, as close to a square grid as they can be
+	viewColumns = 1;
+
+	while (viewColumns * viewColumns < settings.viewCount)
+		viewColumns++;
+
+	uint32_t viewRows = (settings.viewCount + viewColumns - 1) / viewColumns;
+
+	renderExtent = { extent.width / viewColumns, extent.height / viewRows };
+
+	//The scene images keep the full size, a smaller scale only draws to a part of them
+	resolutionScaler = ResolutionScaler(settings.targetGpuFrameTime, settings.minResolutionScale, settings.maxResolutionScale);
+
+	for (float& scale : frameResolutionScales)
+		scale = resolutionScaler.getScale();
+
+	sceneExtent = getScaledExtent(resolutionScaler.getScale());
+
 	uint32_t swapChainImageCount = 0;
 	vkGetSwapchainImagesKHR(mainDevice.logicalDevice, swapchain, &swapChainImageCount, nullptr);
 
@@ -356,6 +850,95 @@ void VulkanRenderer::createSwapChain()
 	}
 }
 
+void VulkanRenderer::createRenderGraph()
+{
+	renderGraph = RenderGraph(&memoryBudget, mainDevice.logicalDevice);
+
+	//The swapchain image is waited on by the submission at the color output stage, and has to be
+	//handed to the presentation engine in its present layout
+	backBufferResource = renderGraph.importImage(
+		"BackBuffer",
+		VK_IMAGE_ASPECT_COLOR_BIT,
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+		VK_IMAGE_LAYOUT_UNDEFINED,
+		VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+
+	std::vector<VkImage> images(swapChainImages.size());
+
+	for (size_t i = 0; i < swapChainImages.size(); i++)
+		images[i] = swapChainImages[i].image;
+
+	renderGraph.setImportedImages(backBufferResource, images);
+
+	//Picks the first depth format the device can use as an optimal tiled depth attachment
+	depthBufferFormat = chooseSupportedFormat(
+		{ VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT },
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+
+	RenderGraphImageDesc depthDesc = {};
+	depthDesc.format = depthBufferFormat;
+	depthDesc.extent = renderExtent;
+	depthDesc.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	depthDesc.aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+	depthDesc.arrayLayers = settings.viewCount;
+
+	depthBufferResource = renderGraph.createImage("DepthBuffer", depthDesc);
+
+	//One view draws straight to the swapchain image. More draw to the layers of an image in a single
+	//multiview pass, which are copied to their tiles of the swapchain image afterwards. With resolution
+	//scaling the scene is drawn to an image of its own too, even with one view
+	RenderGraphResource colorTarget = backBufferResource;
+
+	if (isSceneOffscreen())
+	{
+		//Scaling up needs a blit, with linear filtering
+		VkFormatProperties formatProperties = {};
+		vkGetPhysicalDeviceFormatProperties(mainDevice.physicalDevice, swapChainFormat, &formatProperties);
+
+		VkFormatFeatureFlags blitFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+
+		if (resolutionScaler.isEnabled() && (formatProperties.optimalTilingFeatures & blitFeatures) != blitFeatures)
+			throw std::runtime_error("The swapchain format can not be scaled up for the resolution scaling!");
+
+		RenderGraphImageDesc colorDesc = {};
+		colorDesc.format = swapChainFormat;
+		colorDesc.extent = renderExtent;
+		colorDesc.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		colorDesc.aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+		colorDesc.arrayLayers = settings.viewCount;
+
+		sceneColorResource = renderGraph.createImage("SceneColor", colorDesc);
+		colorTarget = sceneColorResource;
+	}
+
+	renderGraph.addPass("Scene",
+		{
+			{ colorTarget, RenderGraphAccess::ColorAttachmentWrite },
+			{ depthBufferResource, RenderGraphAccess::DepthAttachmentWrite }
+		},
+		[this](VkCommandBuffer commandBuffer, uint32_t imageIndex) { recordScenePass(commandBuffer, imageIndex); });
+
+	if (isSceneOffscreen())
+		renderGraph.addPass("Compose",
+			{
+				{ sceneColorResource, RenderGraphAccess::TransferRead },
+				{ backBufferResource, RenderGraphAccess::TransferWrite }
+			},
+			[this](VkCommandBuffer commandBuffer, uint32_t imageIndex) { recordComposePass(commandBuffer, imageIndex); });
+
+	//Writes nothing the graph knows about, so it has to be kept on purpose
+	if (!settings.readbackOutput.empty())
+		renderGraph.addPass("Readback",
+			{
+				{ backBufferResource, RenderGraphAccess::TransferRead }
+			},
+			[this](VkCommandBuffer commandBuffer, uint32_t imageIndex) { frameReadback.recordCopy(commandBuffer, swapChainImages[imageIndex].image, currentFrame); },
+			true);
+
+	renderGraph.compile();
+}
+
 void VulkanRenderer::createRenderPass()
 {
 	//************************** COLOR ATTACHMENT *****************************
@@ -369,99 +952,211 @@ void VulkanRenderer::createRenderPass()
 	//Describes what to do with the attachment after rendering 
 	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 
-	//TODO (When implementing Depth Stencil)
+	//The color attachment has no stencil
 	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 
 	//Framebuffer data will be stored as an image, but images can be stored in different laouts
 	//for them to be optimal for certain operations
 
-	//Describes the layout of the image before entering the render pass
-	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-
-	//Describes the layout of the image after the render pass 
-	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	//The render graph transitions the attachments before and after the render pass (e.g. to
+	//VK_IMAGE_LAYOUT_PRESENT_SRC_KHR), so they enter and leave it in the layout it uses them in
+	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
 	VkAttachmentReference colorAttachmentReference = {};
 	colorAttachmentReference.attachment = 0;
 	colorAttachmentReference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
+	//************************** DEPTH ATTACHMENT *****************************
+	VkAttachmentDescription depthAttachment = {};
+	depthAttachment.format = depthBufferFormat;
+	depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+
+	//The depth is only needed while rendering, it is never read after the render pass
+	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	//Used by the subpass that writes the depth
+	VkAttachmentReference depthWriteReference = {};
+	depthWriteReference.attachment = 1;
+	depthWriteReference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	//Used by the color subpass after a depth pre-pass, which only tests against the depth
+	VkAttachmentReference depthReadReference = {};
+	depthReadReference.attachment = 1;
+	depthReadReference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
 	//****************************** CREATE SUBPASS DESCRIPTION ************************************
+	std::vector<VkSubpassDescription> subpasses;
+
+	//With the depth pre-pass enabled, the first subpass only fills the depth attachment
+	if (enableDepthPrePass)
+	{
+		VkSubpassDescription depthSubpass = {};
+		depthSubpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		depthSubpass.colorAttachmentCount = 0;
+		depthSubpass.pDepthStencilAttachment = &depthWriteReference;
+
+		subpasses.push_back(depthSubpass);
+	}
+
 	VkSubpassDescription subpass = {};
 	subpass.colorAttachmentCount = 1;
 	subpass.pColorAttachments = &colorAttachmentReference;
+	subpass.pDepthStencilAttachment = (enableDepthPrePass) ? &depthReadReference : &depthWriteReference;
 
 	//Describes the pipeline type to be bound to the subpass
 	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
 
-	//Determines when to do image layout transitions
-	//The first will transition from VK_IMAGE_LAYOUT_UNDEFINED to VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
-	//The second will transition from VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL to VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
-	VkSubpassDependency subpassDependencies[2];
-
-	subpassDependencies[0].dependencyFlags = 0;
-	subpassDependencies[1].dependencyFlags = 0;
-
-	//Describes the previous subpass, from which image layout is going to be transformed 
-	//VK_SUBPASS_EXTERNAL = outside the render pass 
-	subpassDependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
-
-	//Defines after what stage of the src subpass do the image layout transition 
-	//VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT = once its finished
-	subpassDependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-
-	//Defines after what operation within the "srcStageMask" to do the image layout transition
-	//VK_ACCESS_MEMORY_READ_BIT = once the memory is read
-	subpassDependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+	subpasses.push_back(subpass);
 
-	//Defines before what stage of the dst subpass to do the image layout transition
-	//VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT = before the fragment shader outputs the color
-	subpassDependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	uint32_t colorSubpass = static_cast<uint32_t>(subpasses.size() - 1);
 
-	//Defines before what operation within the "dstStageMask" to do the image layout transition
-	//VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT = before reading or writing to the attachment
-	subpassDependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	//The dependencies with the commands outside of the render pass are barriers placed by the
+	//render graph, only the dependencies between subpasses are described here
+	std::vector<VkSubpassDependency> subpassDependencies;
 
-	//Describes the next subpass to which image layout is going to be transformed to
-	//0 = the first subpass in the render pass
-	subpassDependencies[0].dstSubpass = 0;
-
-	//Just the same but in reverse order :)
-	subpassDependencies[1].srcSubpass = 0;
-	subpassDependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	subpassDependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	//The color subpass tests against the depth written by the pre-pass, and only the
+	//same pixel is read, so the dependency can be by region
+	if (enableDepthPrePass)
+	{
+		VkSubpassDependency depthToColor = {};
+		depthToColor.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+		depthToColor.srcSubpass = 0;
+		depthToColor.srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		depthToColor.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		depthToColor.dstSubpass = colorSubpass;
+		depthToColor.dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		depthToColor.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+
+		subpassDependencies.push_back(depthToColor);
+	}
 
-	subpassDependencies[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-	subpassDependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-	subpassDependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+	//************************** MULTIVIEW *****************************
+	//Every subpass draws all the views, each draw is broadcast to the layers of the attachments and the
+	//vertex shader picks the view matrix with gl_ViewIndex. The views are assumed to be close to each other
+	//(stereo pairs, thumbnails of the same scene), the correlation mask lets the driver share work between them
+	uint32_t viewMask = (1u << settings.viewCount) - 1;
+	std::vector<uint32_t> viewMasks(subpasses.size(), viewMask);
+
+	VkRenderPassMultiviewCreateInfo multiviewCreateInfo = {};
+	multiviewCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO;
+	multiviewCreateInfo.pNext = nullptr;
+	multiviewCreateInfo.subpassCount = static_cast<uint32_t>(viewMasks.size());
+	multiviewCreateInfo.pViewMasks = viewMasks.data();
+	multiviewCreateInfo.dependencyCount = 0;
+	multiviewCreateInfo.pViewOffsets = nullptr;
+	multiviewCreateInfo.correlationMaskCount = 1;
+	multiviewCreateInfo.pCorrelationMasks = &viewMask;
+
+	//Each view's color only tests against the depth of the same view
+	if (settings.viewCount > 1)
+		for (VkSubpassDependency& dependency : subpassDependencies)
+			dependency.dependencyFlags |= VK_DEPENDENCY_VIEW_LOCAL_BIT;
 
 	//************************** RENDER PASS CREATE INFO ***************************************
+	std::array<VkAttachmentDescription, 2> attachments = { colorAttachment, depthAttachment };
+
 	VkRenderPassCreateInfo renderPassCreateInfo = {};
 	renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-	renderPassCreateInfo.pNext = nullptr;
+	renderPassCreateInfo.pNext = (settings.viewCount > 1) ? &multiviewCreateInfo : nullptr;
 	renderPassCreateInfo.flags = 0;
-	renderPassCreateInfo.attachmentCount = (uint32_t)1;
-	renderPassCreateInfo.pAttachments = &colorAttachment;
-	renderPassCreateInfo.subpassCount = (uint32_t)1;
-	renderPassCreateInfo.pSubpasses = &subpass;
-	renderPassCreateInfo.dependencyCount = (uint32_t)2;
-	renderPassCreateInfo.pDependencies = subpassDependencies;
+	renderPassCreateInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+	renderPassCreateInfo.pAttachments = attachments.data();
+	renderPassCreateInfo.subpassCount = static_cast<uint32_t>(subpasses.size());
+	renderPassCreateInfo.pSubpasses = subpasses.data();
+	renderPassCreateInfo.dependencyCount = static_cast<uint32_t>(subpassDependencies.size());
+	renderPassCreateInfo.pDependencies = (subpassDependencies.empty()) ? nullptr : subpassDependencies.data();
 
 	VkResult result = vkCreateRenderPass(
-		mainDevice.logicalDevice, &renderPassCreateInfo, nullptr, &renderPass);
+		mainDevice.logicalDevice, &renderPassCreateInfo, getHostAllocator(), &renderPass);
 
 	if (result != VK_SUCCESS)
 		throw std::runtime_error("Failed to create render pass!");
 }
 
+void VulkanRenderer::loadShaders()
+{
+	//Both files are read at the same time
+	FileHandle vertexFile = fileReader.openFile("Shaders/vert.spv");
+	FileHandle fragmentFile = fileReader.openFile("Shaders/frag.spv");
+
+	vertexShaderCode.resize((size_t)fileReader.getFileSize(vertexFile));
+	fragmentShaderCode.resize((size_t)fileReader.getFileSize(fragmentFile));
+
+	ReadBatch reads;
+	fileReader.read(vertexFile, 0, vertexShaderCode.size(), vertexShaderCode.data(), ReadPriority::High, reads);
+	fileReader.read(fragmentFile, 0, fragmentShaderCode.size(), fragmentShaderCode.data(), ReadPriority::High, reads);
+	reads.wait();
+
+	fileReader.closeFile(vertexFile);
+	fileReader.closeFile(fragmentFile);
+
+	if (reads.hasFailed())
+		throw std::runtime_error("Failed to read the shaders!");
+
+	vertexShaderReflection = reflectShader(vertexShaderCode);
+	fragmentShaderReflection = reflectShader(fragmentShaderCode);
+
+	//Every location the vertex shader reads has to come from the vertex struct
+	const auto& attributes = VertexInputState<VertexData>::attributes;
+
+	for (const ShaderInput& input : vertexShaderReflection.inputs)
+		if (std::none_of(attributes.begin(), attributes.end(),
+			[&](const VkVertexInputAttributeDescription& attribute) { return attribute.location == input.location; }))
+			throw std::runtime_error("Vertex shader reads an input the vertex struct does not have!");
+}
+
+void VulkanRenderer::createPipelineCache()
+{
+	std::vector<char> cacheData;
+	std::ifstream file(PIPELINE_CACHE_FILE, std::ios::binary | std::ios::ate);
+
+	if (file.is_open())
+	{
+		cacheData.resize((size_t)file.tellg());
+		file.seekg(0);
+		file.read(cacheData.data(), cacheData.size());
+	}
+
+	//Data of another device or driver is dropped here, some drivers do not check it themselves
+	//Header: size, version, vendor ID, device ID, pipeline cache UUID
+	const size_t headerSize = 4 * sizeof(uint32_t) + VK_UUID_SIZE;
+	uint32_t header[4] = {};
+
+	if (cacheData.size() >= headerSize)
+		memcpy(header, cacheData.data(), sizeof(header));
+
+	const VkPhysicalDeviceProperties& properties = deviceCapabilities.properties;
+
+	if (cacheData.size() < headerSize || header[0] < headerSize || header[1] != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+		header[2] != properties.vendorID || header[3] != properties.deviceID ||
+		memcmp(cacheData.data() + sizeof(header), properties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+		cacheData.clear();
+
+	VkPipelineCacheCreateInfo cacheCreateInfo = {};
+	cacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	cacheCreateInfo.pNext = nullptr;
+	cacheCreateInfo.flags = 0;
+	cacheCreateInfo.initialDataSize = cacheData.size();
+	cacheCreateInfo.pInitialData = (cacheData.empty()) ? nullptr : cacheData.data();
+
+	VkResult result = vkCreatePipelineCache(mainDevice.logicalDevice, &cacheCreateInfo, getHostAllocator(), &pipelineCache);
+
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Failed to create the pipeline cache!");
+}
+
 void VulkanRenderer::createGraphicsPipeline()
 {
-	auto vertexCode = readFile("Shaders/vert.spv");
-	auto fragmentCode = readFile("Shaders/frag.spv");
-
 	//*************************BUILD SHADER MODULE TO LINK TO THE GRAPHICS PIPELINE***********************
-	VkShaderModule vertexModule = createShaderModule(vertexCode);
-	VkShaderModule fragmentModule = createShaderModule(fragmentCode);
+	VkShaderModule vertexModule = createShaderModule(vertexShaderCode);
+	VkShaderModule fragmentModule = createShaderModule(fragmentShaderCode);
 
 
 	//*****************************CREATE VERTEX SHADER STAGE CREATE INFO*************************
@@ -488,35 +1183,8 @@ void VulkanRenderer::createGraphicsPipeline()
 
 
 	//*************************CREATE VERTEX INPUT CREATE INFO*************************************
-	VkPipelineVertexInputStateCreateInfo vertexInputCreateInfo = {};
-	vertexInputCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vertexInputCreateInfo.pNext = nullptr;
-	vertexInputCreateInfo.flags = 0;
-
-	VkVertexInputBindingDescription bindingDescription;
-	bindingDescription.binding = 0;
-	bindingDescription.stride = sizeof(VertexData);
-	bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-	// List of vertex binding descriptions(data spacing, stride etc...)
-	vertexInputCreateInfo.pVertexBindingDescriptions = &bindingDescription;
-	vertexInputCreateInfo.vertexBindingDescriptionCount = (uint32_t)1;
-
-	std::array<VkVertexInputAttributeDescription, 2> attributeDescription;
-	attributeDescription[0].binding = 0;
-	attributeDescription[0].location = 0;
-	attributeDescription[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-	attributeDescription[0].offset = offsetof(VertexData, position);
-
-	attributeDescription[1].binding = 0;
-	attributeDescription[1].location = 1;
-	attributeDescription[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-	attributeDescription[1].offset = offsetof(VertexData, color);
-
-
-	//List of vertex attribute descriptions(data format, and where to bind to)
-	vertexInputCreateInfo.pVertexAttributeDescriptions = attributeDescription.data();
-	vertexInputCreateInfo.vertexAttributeDescriptionCount = (uint32_t)attributeDescription.size();
+	//Derived from VertexData when compiling, see VertexAttributes<VertexData>
+	const VkPipelineVertexInputStateCreateInfo& vertexInputCreateInfo = VertexInputState<VertexData>::createInfo;
 
 
 	//**************************CREATE INPUT ASSEMBLY CREATE INFO***********************************
@@ -532,14 +1200,24 @@ void VulkanRenderer::createGraphicsPipeline()
 	VkViewport viewport = {};
 	viewport.x = 0.0f;
 	viewport.y = 0.0f;
-	viewport.width = (float)swapChainExtent.width;
-	viewport.height = (float)swapChainExtent.height;
+	viewport.width = (float)renderExtent.width;
+	viewport.height = (float)renderExtent.height;
 	viewport.minDepth = 0;
 	viewport.maxDepth = 1;
 	
 	VkRect2D scissor = {};
 	scissor.offset = { 0,0 };
-	scissor.extent = swapChainExtent;
+	scissor.extent = renderExtent;
+
+	//The viewport and the scissor follow the resolution scale, they are set when recording
+	VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+	VkPipelineDynamicStateCreateInfo dynamicStateCreateInfo = {};
+	dynamicStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicStateCreateInfo.pNext = nullptr;
+	dynamicStateCreateInfo.flags = 0;
+	dynamicStateCreateInfo.dynamicStateCount = (uint32_t)(sizeof(dynamicStates) / sizeof(dynamicStates[0]));
+	dynamicStateCreateInfo.pDynamicStates = dynamicStates;
 
 	VkPipelineViewportStateCreateInfo viewportCreateInfo = {};
 	viewportCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
@@ -591,7 +1269,7 @@ void VulkanRenderer::createGraphicsPipeline()
 	colorState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
 		VK_COLOR_COMPONENT_B_BIT |VK_COLOR_COMPONENT_A_BIT;
 
-	colorState.blendEnable = VK_TRUE;
+	colorState.blendEnable = (settings.blending) ? VK_TRUE : VK_FALSE;
 
 	//Blending formula (srcAlphaBlendFactor * color1) colorBlendOp (dstColorBlendFactor * color2)
 	//It will be the (VK_BLEND_FACTOR_SRC_ALPHA * color1) + (VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA * color2)
@@ -611,23 +1289,32 @@ void VulkanRenderer::createGraphicsPipeline()
 	blendCreateInfo.pAttachments = &colorState;
 
 
+	//***************************DEPTH STENCIL CREATE INFO*********************************************
+	VkPipelineDepthStencilStateCreateInfo depthStencilCreateInfo = {};
+	depthStencilCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depthStencilCreateInfo.pNext = nullptr;
+	depthStencilCreateInfo.depthTestEnable = VK_TRUE;
+
+	//After a depth pre-pass the depth is already resolved, so only the closest fragment
+	//of every pixel passes the EQUAL test and gets shaded and blended
+	depthStencilCreateInfo.depthWriteEnable = (enableDepthPrePass) ? VK_FALSE : VK_TRUE;
+	depthStencilCreateInfo.depthCompareOp = (enableDepthPrePass) ? VK_COMPARE_OP_EQUAL : VK_COMPARE_OP_LESS;
+	depthStencilCreateInfo.depthBoundsTestEnable = VK_FALSE;
+	depthStencilCreateInfo.stencilTestEnable = VK_FALSE;
+
+
 	//*******************************PIPELINE LAYOUT*****************************************
-	//For descriptor sets and push constants (what in OpenGL are Uniforms)
-	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
-	pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutCreateInfo.setLayoutCount = 0;
-	pipelineLayoutCreateInfo.pSetLayouts = nullptr;
-	pipelineLayoutCreateInfo.pushConstantRangeCount = 0;
-	pipelineLayoutCreateInfo.pPushConstantRanges = nullptr;
-
-	VkResult result = vkCreatePipelineLayout(
-		mainDevice.logicalDevice, 
-		&pipelineLayoutCreateInfo, 
-		nullptr, 
-		&pipelineLayout);
+	//For descriptor sets and push constants (what in OpenGL are Uniforms), made from what the shaders declare.
+	//Set 0 is the bindless set, its layout has device sized arrays the shaders can not know about
+	pipelineLayoutCache = PipelineLayoutCache(mainDevice.logicalDevice);
+	pipelineLayoutCache.setExternalSetLayout(0, bindlessDescriptors.getLayout(), bindlessDescriptors.getBindings());
 
-	if (result != VK_SUCCESS)
-		throw std::runtime_error("Failed to create pipeline loayout!");
+	pipelineLayout = pipelineLayoutCache.getPipelineLayout({ &vertexShaderReflection, &fragmentShaderReflection });
+
+	//The model matrix and the material of each mesh are pushed before its draw, the shaders can not read past them
+	for (const ShaderReflection* reflection : { &vertexShaderReflection, &fragmentShaderReflection })
+		if (reflection->pushConstants.offset + reflection->pushConstants.size > sizeof(MeshPushConstants))
+			throw std::runtime_error("Shader push constant block is bigger than MeshPushConstants!");
 
 
 	//************************CREATE GRAPHICS PIPELINE CREATE INFO*********************************
@@ -640,26 +1327,53 @@ void VulkanRenderer::createGraphicsPipeline()
 	gPipelineCreateInfo.pInputAssemblyState = &inputAssemblyCreateInfo;
 	gPipelineCreateInfo.pMultisampleState = &multisampleCreateInfo;
 	gPipelineCreateInfo.pViewportState = &viewportCreateInfo;
-	gPipelineCreateInfo.pDynamicState = nullptr;
+	gPipelineCreateInfo.pDynamicState = &dynamicStateCreateInfo;
 	gPipelineCreateInfo.pColorBlendState = &blendCreateInfo;
-	gPipelineCreateInfo.pDepthStencilState = nullptr;
+	gPipelineCreateInfo.pDepthStencilState = &depthStencilCreateInfo;
 	gPipelineCreateInfo.stageCount = 2;
 	gPipelineCreateInfo.pStages = shaders;
 	gPipelineCreateInfo.layout = pipelineLayout;
 	gPipelineCreateInfo.renderPass = renderPass;
-	gPipelineCreateInfo.subpass = 0;
+	gPipelineCreateInfo.subpass = (enableDepthPrePass) ? 1 : 0;
 	gPipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
 	gPipelineCreateInfo.basePipelineIndex = -1;
 
-	result = vkCreateGraphicsPipelines(
-		mainDevice.logicalDevice, VK_NULL_HANDLE, 1, &gPipelineCreateInfo, nullptr, &graphicsPipeline);
+	//One pipeline per combination of shader features, created when the draw list first needs it. The
+	//variants own the shader modules from here on
+	sceneVariants = ShaderVariants(mainDevice.logicalDevice, pipelineCache, gPipelineCreateInfo,
+		{ &vertexShaderReflection, &fragmentShaderReflection }, "Scene pipeline");
 
-	if (result != VK_SUCCESS)
-		throw std::runtime_error("Failed to create the graphics pipeline!");
+	//************************CREATE DEPTH PRE-PASS PIPELINE*********************************
+	if (enableDepthPrePass)
+	{
+		//Same geometry state, but only the vertex shader and no color attachments
+		VkPipelineColorBlendStateCreateInfo depthOnlyBlendCreateInfo = blendCreateInfo;
+		depthOnlyBlendCreateInfo.attachmentCount = 0;
+		depthOnlyBlendCreateInfo.pAttachments = nullptr;
 
-	//***************************DESTROY SHADER MODULES********************************************
-	vkDestroyShaderModule(mainDevice.logicalDevice, fragmentModule, nullptr);
-	vkDestroyShaderModule(mainDevice.logicalDevice, vertexModule, nullptr);
+		VkPipelineDepthStencilStateCreateInfo depthOnlyStencilCreateInfo = depthStencilCreateInfo;
+		depthOnlyStencilCreateInfo.depthWriteEnable = VK_TRUE;
+		depthOnlyStencilCreateInfo.depthCompareOp = VK_COMPARE_OP_LESS;
+
+		VkGraphicsPipelineCreateInfo depthPipelineCreateInfo = gPipelineCreateInfo;
+		depthPipelineCreateInfo.stageCount = 1;
+		depthPipelineCreateInfo.pStages = &vertexStateCreateInfo;
+		depthPipelineCreateInfo.pColorBlendState = &depthOnlyBlendCreateInfo;
+		depthPipelineCreateInfo.pDepthStencilState = &depthOnlyStencilCreateInfo;
+		depthPipelineCreateInfo.subpass = 0;
+
+		VkResult result = vkCreateGraphicsPipelines(
+			mainDevice.logicalDevice, pipelineCache, 1, &depthPipelineCreateInfo, getHostAllocator(), &depthPrePassPipeline);
+
+		if (result != VK_SUCCESS)
+			throw std::runtime_error("Failed to create the depth pre-pass pipeline!");
+
+		setDebugName(mainDevice.logicalDevice, VK_OBJECT_TYPE_PIPELINE, (uint64_t)depthPrePassPipeline, "Depth pre-pass pipeline");
+	}
+
+	//***************************RELEASE SHADER CODE********************************************
+	std::vector<char>().swap(vertexShaderCode);
+	std::vector<char>().swap(fragmentShaderCode);
 }
 
 void VulkanRenderer::createFramebuffers()
@@ -670,22 +1384,27 @@ void VulkanRenderer::createFramebuffers()
 	{
 		VkFramebufferCreateInfo frameBufferCreateInfo = {};
 		
-		VkImageView attachments[] = { swapChainImages[i].imageView };
+		//Has to match the attachment order of the render pass. With several views they are array views
+		//of all the layers, the framebuffer itself has one layer
+		std::array<VkImageView, 2> attachments = {
+			(isSceneOffscreen()) ? renderGraph.getImageView(sceneColorResource) : swapChainImages[i].imageView,
+			renderGraph.getImageView(depthBufferResource)
+		};
 
 		frameBufferCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
 		frameBufferCreateInfo.pNext = nullptr;
 		frameBufferCreateInfo.flags = 0;
 		frameBufferCreateInfo.renderPass = renderPass;
-		frameBufferCreateInfo.attachmentCount = 1;
-		frameBufferCreateInfo.pAttachments = attachments;
-		frameBufferCreateInfo.width = swapChainExtent.width;
-		frameBufferCreateInfo.height = swapChainExtent.height;
+		frameBufferCreateInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+		frameBufferCreateInfo.pAttachments = attachments.data();
+		frameBufferCreateInfo.width = renderExtent.width;
+		frameBufferCreateInfo.height = renderExtent.height;
 		frameBufferCreateInfo.layers = (uint32_t)1;
 
 		VkResult result = vkCreateFramebuffer(
 			mainDevice.logicalDevice, 
 			&frameBufferCreateInfo, 
-			nullptr, 
+			getHostAllocator(), 
 			&swapChainFramebuffers[i]);
 
 		if (result != VK_SUCCESS)
@@ -699,13 +1418,13 @@ void VulkanRenderer::createCommandPool()
 
 	commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 	commandPoolCreateInfo.pNext = nullptr;
-	commandPoolCreateInfo.flags = 0;
+	//Command buffers are recorded again every frame
+	commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
-	commandPoolCreateInfo.queueFamilyIndex = 
-		getQueueFamilies(mainDevice.physicalDevice).graphicsFamily;
+	commandPoolCreateInfo.queueFamilyIndex = deviceCapabilities.queueFamilyIndices.graphicsFamily;
 
 	VkResult result = vkCreateCommandPool(
-		mainDevice.logicalDevice, &commandPoolCreateInfo, nullptr, &graphicsCommandPool);
+		mainDevice.logicalDevice, &commandPoolCreateInfo, getHostAllocator(), &graphicsCommandPool);
 
 	if (result != VK_SUCCESS)
 		throw std::runtime_error("Failed to create the graphics command pool!");
@@ -714,7 +1433,8 @@ void VulkanRenderer::createCommandPool()
 
 void VulkanRenderer::createCommandBuffers()
 {
-	commandBuffers.resize(swapChainFramebuffers.size());
+	//One per frame in flight, recorded for whichever image was acquired
+	commandBuffers.resize(MAX_FRAME_COUNT);
 
 	VkCommandBufferAllocateInfo commandBufferAllocInfo = {};
 
@@ -722,13 +1442,17 @@ void VulkanRenderer::createCommandBuffers()
 	commandBufferAllocInfo.pNext = nullptr;
 	commandBufferAllocInfo.commandPool = graphicsCommandPool;
 	commandBufferAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	commandBufferAllocInfo.commandBufferCount = static_cast<uint32_t>(swapChainFramebuffers.size()); 
+	commandBufferAllocInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size()); 
 
 	VkResult result  = vkAllocateCommandBuffers(
 		mainDevice.logicalDevice, &commandBufferAllocInfo, commandBuffers.data());
 
 	if (result != VK_SUCCESS)
 		throw std::runtime_error("Failed to allocate command buffers on the command pool!");
+
+	for (size_t i = 0; i < commandBuffers.size(); i++)
+		setDebugName(mainDevice.logicalDevice, VK_OBJECT_TYPE_COMMAND_BUFFER, (uint64_t)commandBuffers[i],
+			("Frame " + std::to_string(i) + " commands").c_str());
 }
 
 void VulkanRenderer::createSyncronization()
@@ -747,70 +1471,538 @@ void VulkanRenderer::createSyncronization()
 	fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
 	for(int i =0; i<MAX_FRAME_COUNT; i++)
-		if(vkCreateSemaphore(mainDevice.logicalDevice, &semaphoreCreateInfo, nullptr, &readyToDraw[i]) != VK_SUCCESS ||
-			vkCreateSemaphore(mainDevice.logicalDevice, &semaphoreCreateInfo, nullptr, &readyToPresent[i]) != VK_SUCCESS ||
-			vkCreateFence(mainDevice.logicalDevice, &fenceCreateInfo, nullptr, &drawFences[i]) != VK_SUCCESS)
+		if(vkCreateSemaphore(mainDevice.logicalDevice, &semaphoreCreateInfo, getHostAllocator(), &readyToDraw[i]) != VK_SUCCESS ||
+			vkCreateSemaphore(mainDevice.logicalDevice, &semaphoreCreateInfo, getHostAllocator(), &readyToPresent[i]) != VK_SUCCESS ||
+			vkCreateFence(mainDevice.logicalDevice, &fenceCreateInfo, getHostAllocator(), &drawFences[i]) != VK_SUCCESS)
 			throw std::runtime_error("Failed to create the syncronization mechanism!");
 }
 
-void VulkanRenderer::recordCommands()
+void VulkanRenderer::createBindlessDescriptors()
 {
-	VkClearValue clearValues[] = { 
-		VkClearValue{0.6f, 0.65f, 0.4, 1.0f}
-	};
+	bindlessDescriptors = BindlessDescriptors(deviceCapabilities, mainDevice.logicalDevice);
+}
+
+void VulkanRenderer::createDescriptorAllocator()
+{
+	descriptorAllocator = DescriptorAllocator(mainDevice.logicalDevice);
+}
+
+void VulkanRenderer::createMaterialBuffers()
+{
+	materialBuffers.resize(MAX_FRAME_COUNT);
+	materialMemories.resize(MAX_FRAME_COUNT);
+	materialMappings.resize(MAX_FRAME_COUNT);
+	materialBufferIndices.resize(MAX_FRAME_COUNT);
+
+	VkDeviceSize size = sizeof(MaterialData) * MAX_MATERIALS;
+
+	for (int i = 0; i < MAX_FRAME_COUNT; i++)
+	{
+		memoryBudget.createBuffer(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 0, materialBuffers[i], materialMemories[i]);
+
+		//Stays mapped, the table is rewritten whenever a material changes
+		vkMapMemory(mainDevice.logicalDevice, materialMemories[i], 0, size, 0, &materialMappings[i]);
+		memcpy(materialMappings[i], materials.data(), sizeof(MaterialData) * materials.size());
+
+		materialBufferIndices[i] = bindlessDescriptors.addStorageBuffer(materialBuffers[i]);
+
+		setDebugName(mainDevice.logicalDevice, VK_OBJECT_TYPE_BUFFER, (uint64_t)materialBuffers[i],
+			("Materials " + std::to_string(i)).c_str());
+	}
+}
+
+void VulkanRenderer::createViewBuffers()
+{
+	viewBuffers.resize(MAX_FRAME_COUNT);
+	viewMemories.resize(MAX_FRAME_COUNT);
+	viewMappings.resize(MAX_FRAME_COUNT);
+	viewBufferIndices.resize(MAX_FRAME_COUNT);
+
+	VkDeviceSize size = sizeof(glm::mat4) * MAX_VIEWS;
+
+	for (int i = 0; i < MAX_FRAME_COUNT; i++)
+	{
+		memoryBudget.createBuffer(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 0, viewBuffers[i], viewMemories[i]);
+
+		vkMapMemory(mainDevice.logicalDevice, viewMemories[i], 0, size, 0, &viewMappings[i]);
+		memcpy(viewMappings[i], viewMatrices.data(), sizeof(glm::mat4) * viewMatrices.size());
+
+		viewBufferIndices[i] = bindlessDescriptors.addStorageBuffer(viewBuffers[i]);
+
+		setDebugName(mainDevice.logicalDevice, VK_OBJECT_TYPE_BUFFER, (uint64_t)viewBuffers[i],
+			("Views " + std::to_string(i)).c_str());
+	}
+}
+
+void VulkanRenderer::createTextureManager()
+{
+	textureManager = TextureManager(mainDevice.physicalDevice, mainDevice.logicalDevice, graphicsQueue,
+		deviceCapabilities.queueFamilyIndices.graphicsFamily, &bindlessDescriptors, &memoryBudget, &fileReader, TEXTURE_MEMORY_BUDGET);
+}
+
+void VulkanRenderer::createQueryPool()
+{
+	if (timestampsSupported)
+	{
+		VkQueryPoolCreateInfo timestampPoolCreateInfo = {};
+		timestampPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		timestampPoolCreateInfo.pNext = nullptr;
+		timestampPoolCreateInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		timestampPoolCreateInfo.queryCount = static_cast<uint32_t>(commandBuffers.size() * 2);
+
+		VkResult result = vkCreateQueryPool(
+			mainDevice.logicalDevice, &timestampPoolCreateInfo, getHostAllocator(), &timestampQueryPool);
+
+		if (result != VK_SUCCESS)
+			throw std::runtime_error("Failed to create the timestamp query pool!");
+
+		timestampQueryIssued.assign(commandBuffers.size(), false);
+	}
+
+	if (!pipelineStatisticsSupported)
+		return;
+
+	VkQueryPoolCreateInfo queryPoolCreateInfo = {};
+	queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryPoolCreateInfo.pNext = nullptr;
+	queryPoolCreateInfo.flags = 0;
+	queryPoolCreateInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+	queryPoolCreateInfo.queryCount = static_cast<uint32_t>(commandBuffers.size());
+
+	//Counts how many times the fragment shader ran, which is the overdraw the depth pre-pass removes
+	queryPoolCreateInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+	VkResult result = vkCreateQueryPool(
+		mainDevice.logicalDevice, &queryPoolCreateInfo, getHostAllocator(), &statisticsQueryPool);
+
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Failed to create the pipeline statistics query pool!");
+
+	statisticsQueryIssued.assign(commandBuffers.size(), false);
+}
+
+void VulkanRenderer::uploadMaterials()
+{
+	//Streaming moves textures to new descriptor indices, the tables have to follow them
+	if (textureManager.getVersion() != materialTextureVersion)
+	{
+		materialTextureVersion = textureManager.getVersion();
+		materialUploadsPending = MAX_FRAME_COUNT;
+	}
+
+	//Every copy of the table gets the changes the next time its frame comes around
+	if (materialUploadsPending == 0)
+		return;
+
+	for (size_t i = 0; i < materials.size(); i++)
+		materials[i].baseColorTexture = (materialTextures[i] == INVALID_TEXTURE) ?
+			~0u : textureManager.getDescriptorIndex(materialTextures[i]);
+
+	memcpy(materialMappings[currentFrame], materials.data(), sizeof(MaterialData) * materials.size());
+	materialUploadsPending--;
+}
+
+void VulkanRenderer::uploadViews()
+{
+	memcpy(viewMappings[currentFrame], viewMatrices.data(), sizeof(glm::mat4) * viewMatrices.size());
+}
+
+void VulkanRenderer::selectMeshLods()
+{
+	size_t viewCount = viewMatrices.size();
+
+	instanceLods.resize(instanceMeshes.size());
+	instanceViewModels.resize(instanceMeshes.size() * viewCount);
+
+	for (size_t i = 0; i < instanceMeshes.size(); i++)
+	{
+		const glm::mat4& model = sceneGraph.getWorldTransform(instanceNodes[i]);
+
+		//The vertex shader outputs the position in the view as clip space (there is no projection), so one
+		//unit covers half the height of the view times the biggest scale of the transform. One LOD is drawn
+		//to all the views, the one the closest view needs
+		float maxScale = 0.0f;
+
+		for (size_t v = 0; v < viewCount; v++)
+		{
+			instanceViewModels[i * viewCount + v] = viewMatrices[v] * model;
+			maxScale = std::max(maxScale, getMaxScale(instanceViewModels[i * viewCount + v]));
+		}
+
+		float pixelsPerUnit = maxScale * sceneExtent.height * 0.5f;
+
+		instanceLods[i] = meshes[instanceMeshes[i]].selectLod(pixelsPerUnit);
+	}
+}
+
+void VulkanRenderer::cullMeshlets()
+{
+	meshDrawRanges.clear();
+	instanceDrawOffsets.assign(1, 0);
+	drawnTriangleCount = 0;
+
+	for (size_t i = 0; i < instanceMeshes.size(); i++)
+	{
+		const Mesh& mesh = meshes[instanceMeshes[i]];
+		const MeshLod& lod = mesh.getLod(instanceLods[i]);
+
+		if (lod.meshletCount == 0)
+		{
+			meshDrawRanges.push_back({ lod.firstIndex, lod.indexCount });
+			drawnTriangleCount += lod.indexCount / 3;
+		}
+		else
+		{
+			const glm::mat4* viewModels = &instanceViewModels[i * viewMatrices.size()];
+			const auto& meshlets = mesh.getMeshlets();
+
+			//The views share the draws, a meshlet is drawn if any of them can see it
+			float scales[MAX_VIEWS];
+
+			for (size_t v = 0; v < viewMatrices.size(); v++)
+				scales[v] = getMaxScale(viewModels[v]);
+
+			for (uint32_t m = lod.firstMeshlet; m < lod.firstMeshlet + lod.meshletCount; m++)
+			{
+				const Meshlet& meshlet = meshlets[m];
+				bool visible = false;
+
+				for (size_t v = 0; v < viewMatrices.size() && !visible; v++)
+					visible = isMeshletVisible(meshlet, viewModels[v], scales[v], sceneExtent);
+
+				if (!visible)
+					continue;
+
+				drawnTriangleCount += meshlet.triangleCount;
+
+				//Visible meshlets next to each other in the index buffer are drawn together
+				if (meshDrawRanges.size() > instanceDrawOffsets.back() &&
+					meshDrawRanges.back().firstIndex + meshDrawRanges.back().indexCount == meshlet.firstIndex)
+					meshDrawRanges.back().indexCount += meshlet.triangleCount * 3;
+				else
+					meshDrawRanges.push_back({ meshlet.firstIndex, meshlet.triangleCount * 3 });
+			}
+		}
+
+		instanceDrawOffsets.push_back((uint32_t)meshDrawRanges.size());
+	}
+}
+
+void VulkanRenderer::buildDrawList()
+{
+	drawList.clear();
+
+	//Feature combinations the draws use, their variants are created before recording
+	bool usedFeatures[1 << MAX_SHADER_FEATURE_BITS] = {};
+
+	for (size_t i = 0; i < instanceMeshes.size(); i++)
+	{
+		if (instanceDrawOffsets[i] == instanceDrawOffsets[i + 1])
+			continue;
+
+		//There is no projection, the z of the clip space position is already the depth (in the first view,
+		//the draws are sorted once for all of them). Blended draws are all in the translucent pass, which
+		//orders them back to front before grouping them by state
+		const glm::mat4& model = instanceViewModels[i * viewMatrices.size()];
+		float depth = model[3].z / model[3].w;
+		uint32_t pass = (settings.blending) ? DRAW_PASS_TRANSLUCENT : DRAW_PASS_OPAQUE;
+
+		//Materials without a texture get the variant that does not sample one
+		uint32_t features = 0;
+
+		if (materialTextures[instanceMaterials[i]] != INVALID_TEXTURE)
+			features |= SHADER_FEATURE_BASE_COLOR_TEXTURE;
+
+		usedFeatures[features] = true;
+
+		drawList.add(makeDrawKey(pass, features, instanceMaterials[i], instanceMeshes[i], depth), (uint32_t)i);
+	}
+
+	for (uint32_t features = 0; features < (1 << MAX_SHADER_FEATURE_BITS); features++)
+		if (usedFeatures[features])
+			sceneVariants.getPipeline(features);
+
+	unsortedBindCount = drawList.countBinds();
 
+	drawList.sort(&threadPool);
+
+	sortedBindCount = drawList.countBinds();
+}
+
+void VulkanRenderer::recordCommands(uint32_t imageIndex)
+{
 	VkCommandBufferBeginInfo beginInfo = {};
 	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 	beginInfo.pNext = nullptr;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	VkCommandBuffer commandBuffer = commandBuffers[currentFrame];
+
+	VkResult result = vkBeginCommandBuffer(commandBuffer, &beginInfo);
+	
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Failed to start recording command buffers!");
+
+	//Everything the frame does happens between the two timestamps
+	if (timestampsSupported)
+	{
+		vkCmdResetQueryPool(commandBuffer, timestampQueryPool, currentFrame * 2, 2);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampQueryPool, currentFrame * 2);
+	}
+
+	//The textures drawn this frame can not be evicted (and the evicted ones come back)
+	for (size_t j = 0; j < instanceMeshes.size(); j++)
+	{
+		TextureHandle texture = materialTextures[instanceMaterials[j]];
+
+		if (instanceDrawOffsets[j] != instanceDrawOffsets[j + 1] && texture != INVALID_TEXTURE)
+			textureManager.touch(texture);
+	}
+
+	//Mips streamed in or out are copied before anything samples the textures
+	beginDebugLabel(commandBuffer, "Texture streaming");
+	textureManager.update(commandBuffer, currentFrame, frameArenas[currentFrame]);
+	endDebugLabel(commandBuffer);
+
+	//Records every pass of the graph with the barriers between them
+	renderGraph.execute(commandBuffer, imageIndex);
+
+	if (timestampsSupported)
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampQueryPool, currentFrame * 2 + 1);
+
+	result = vkEndCommandBuffer(commandBuffer);
+
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Failed to end recording command buffers!");
+}
+
+void VulkanRenderer::recordScenePass(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+{
+	VkClearValue clearValues[2] = {};
+	clearValues[0].color = { 0.6f, 0.65f, 0.4f, 1.0f };
+	clearValues[1].depthStencil.depth = 1.0f;
 
 	VkRenderPassBeginInfo renderPassBeginInfo = {};
 	renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
 	renderPassBeginInfo.pNext = nullptr;
 	renderPassBeginInfo.renderPass = renderPass;
 	renderPassBeginInfo.renderArea.offset = { 0,0 };
-	renderPassBeginInfo.renderArea.extent = swapChainExtent;
+	renderPassBeginInfo.renderArea.extent = sceneExtent;
 	renderPassBeginInfo.pClearValues = clearValues;
-	renderPassBeginInfo.clearValueCount = (uint32_t)1;
+	renderPassBeginInfo.clearValueCount = (uint32_t)2;
+	renderPassBeginInfo.framebuffer = swapChainFramebuffers[imageIndex];
 
-	for (size_t i = 0; i < commandBuffers.size(); i++)
+	//Every resource the draws use is in the bindless set, it is only bound again for a pipeline whose
+	//layout is not compatible with the one it was bound with
+	VkPipelineLayout boundLayout = VK_NULL_HANDLE;
+
+	auto bindPipeline = [&](VkPipeline pipeline, VkPipelineLayout layout)
 	{
-		VkResult result = vkBeginCommandBuffer(commandBuffers[i], &beginInfo);
-		
-		if (result != VK_SUCCESS)
-			throw std::runtime_error("Failed to start recording command buffers!");
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+
+		if (pipelineLayoutCache.getCompatibleSetCount(boundLayout, layout) == 0)
+		{
+			VkDescriptorSet bindlessSet = bindlessDescriptors.getSet();
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 1, &bindlessSet, 0, nullptr);
+
+			boundLayout = layout;
+		}
+	};
 
-		std::vector<VkBuffer> vertexBuffers(meshes.size());
-		std::vector<VkDeviceSize> offsets(meshes.size(),0);
+	VkShaderStageFlags pushConstantStages = pipelineLayoutCache.getPushConstantStages(pipelineLayout);
 
-		int vertexCount = 0;
+	//The instances in draw list order with the buffers of their mesh (bound again only when the mesh
+	//changes), the world transform of their node and the index ranges of their LOD that survived the culling.
+	//The color pass binds the shader variant of the draws too, the depth pre-pass has one pipeline for all
+	auto drawMeshes = [&](bool bindVariants)
+	{
+		VkDeviceSize offset = 0;
+		uint32_t boundMesh = ~0u;
+		uint32_t boundFeatures = ~0u;
 
-		for (int j = 0; j < meshes.size(); j++)
+		for (const DrawItem& item : drawList.getItems())
 		{
-			vertexBuffers[j] = meshes[j].getVertexBuffer();
-			vertexCount += meshes[j].getVerticesCount();
+			uint32_t j = item.instance;
+			uint32_t features = getDrawKeyPipeline(item.key);
+
+			if (bindVariants && features != boundFeatures)
+			{
+				boundFeatures = features;
+				bindPipeline(sceneVariants.getPipeline(features), pipelineLayout);
+			}
+
+			MeshPushConstants pushConstants = {};
+			pushConstants.model = sceneGraph.getWorldTransform(instanceNodes[j]);
+			pushConstants.materialBuffer = materialBufferIndices[currentFrame];
+			pushConstants.material = instanceMaterials[j];
+			pushConstants.viewBuffer = viewBufferIndices[currentFrame];
+
+			vkCmdPushConstants(commandBuffer, pipelineLayout, pushConstantStages, 0, sizeof(MeshPushConstants), &pushConstants);
+
+			if (instanceMeshes[j] != boundMesh)
+			{
+				boundMesh = instanceMeshes[j];
+
+				VkBuffer vertexBuffer = meshes[boundMesh].getVertexBuffer();
+
+				vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, &offset);
+				vkCmdBindIndexBuffer(commandBuffer, meshes[boundMesh].getIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
+			}
+
+			for (uint32_t r = instanceDrawOffsets[j]; r < instanceDrawOffsets[j + 1]; r++)
+				vkCmdDrawIndexed(commandBuffer, meshDrawRanges[r].indexCount, 1, meshDrawRanges[r].firstIndex, 0, 0);
 		}
-					
-		renderPassBeginInfo.framebuffer = swapChainFramebuffers[i];
+	};
+
+	//RECORDING COMMANDS
+	if (pipelineStatisticsSupported)
+	{
+		//Queries have to be reset outside of a render pass before being used again
+		vkCmdResetQueryPool(commandBuffer, statisticsQueryPool, currentFrame, 1);
+		vkCmdBeginQuery(commandBuffer, statisticsQueryPool, currentFrame, 0);
+	}
 
-		//RECORDING COMMANDS
-		vkCmdBeginRenderPass(commandBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+	vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-			vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
-			
-			vkCmdBindVertexBuffers(commandBuffers[i], 0, vertexBuffers.size(), vertexBuffers.data(), offsets.data());
+		//The part of the scene images drawn at this frame's resolution scale, every pipeline keeps it
+		VkViewport viewport = { 0.0f, 0.0f, (float)sceneExtent.width, (float)sceneExtent.height, 0.0f, 1.0f };
+		VkRect2D scissor = { { 0, 0 }, sceneExtent };
 
-			vkCmdDraw(commandBuffers[i], vertexCount, 1, 0, 0);
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-		vkCmdEndRenderPass(commandBuffers[i]);
+		if (enableDepthPrePass)
+		{
+			//Subpass 0: depth only
+			bindPipeline(depthPrePassPipeline, pipelineLayout);
 
+			drawMeshes(false);
 
-		result = vkEndCommandBuffer(commandBuffers[i]);
+			vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
+		}
 
-		if (result != VK_SUCCESS)
-			throw std::runtime_error("Failed to end recording command buffers!");
+		drawMeshes(true);
+
+	vkCmdEndRenderPass(commandBuffer);
+
+	if (pipelineStatisticsSupported)
+		vkCmdEndQuery(commandBuffer, statisticsQueryPool, currentFrame);
+}
+
+void VulkanRenderer::recordComposePass(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+{
+	VkImage swapChainImage = swapChainImages[imageIndex].image;
+
+	//The tiles may not cover the whole image (a row that is not full, or a size that does not divide evenly)
+	VkClearColorValue clearColor = { 0.6f, 0.65f, 0.4f, 1.0f };
+
+	VkImageSubresourceRange range = {};
+	range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	range.baseMipLevel = 0;
+	range.levelCount = 1;
+	range.baseArrayLayer = 0;
+	range.layerCount = 1;
+
+	vkCmdClearColorImage(commandBuffer, swapChainImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clearColor, 1, &range);
+
+	//The copies write over the cleared pixels
+	VkMemoryBarrier clearBarrier = {};
+	clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	clearBarrier.pNext = nullptr;
+	clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	clearBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+		1, &clearBarrier, 0, nullptr, 0, nullptr);
+
+	VkImage sceneImage = renderGraph.getImage(sceneColorResource);
+
+	//At full scale the layers are copied as they are (same format and size), otherwise the part of them
+	//that was drawn is scaled up to the whole tile
+	if (sceneExtent.width == renderExtent.width && sceneExtent.height == renderExtent.height)
+	{
+		VkImageCopy copies[MAX_VIEWS] = {};
+
+		for (uint32_t view = 0; view < settings.viewCount; view++)
+		{
+			VkImageCopy& copy = copies[view];
+			copy.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			copy.srcSubresource.mipLevel = 0;
+			copy.srcSubresource.baseArrayLayer = view;
+			copy.srcSubresource.layerCount = 1;
+			copy.srcOffset = { 0, 0, 0 };
+			copy.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			copy.dstSubresource.mipLevel = 0;
+			copy.dstSubresource.baseArrayLayer = 0;
+			copy.dstSubresource.layerCount = 1;
+			copy.dstOffset = { (int32_t)((view % viewColumns) * renderExtent.width), (int32_t)((view / viewColumns) * renderExtent.height), 0 };
+			copy.extent = { renderExtent.width, renderExtent.height, 1 };
+		}
+
+		vkCmdCopyImage(commandBuffer, sceneImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			swapChainImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, settings.viewCount, copies);
+	}
+	else
+	{
+		VkImageBlit blits[MAX_VIEWS] = {};
+
+		for (uint32_t view = 0; view < settings.viewCount; view++)
+		{
+			int32_t tileX = (int32_t)((view % viewColumns) * renderExtent.width);
+			int32_t tileY = (int32_t)((view / viewColumns) * renderExtent.height);
+
+			VkImageBlit& blit = blits[view];
+			blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			blit.srcSubresource.mipLevel = 0;
+			blit.srcSubresource.baseArrayLayer = view;
+			blit.srcSubresource.layerCount = 1;
+			blit.srcOffsets[0] = { 0, 0, 0 };
+			blit.srcOffsets[1] = { (int32_t)sceneExtent.width, (int32_t)sceneExtent.height, 1 };
+			blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			blit.dstSubresource.mipLevel = 0;
+			blit.dstSubresource.baseArrayLayer = 0;
+			blit.dstSubresource.layerCount = 1;
+			blit.dstOffsets[0] = { tileX, tileY, 0 };
+			blit.dstOffsets[1] = { tileX + (int32_t)renderExtent.width, tileY + (int32_t)renderExtent.height, 1 };
+		}
+
+		vkCmdBlitImage(commandBuffer, sceneImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			swapChainImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, settings.viewCount, blits, VK_FILTER_LINEAR);
 	}
 }
 
+VkExtent2D VulkanRenderer::getScaledExtent(float scale) const
+{
+	return {
+		std::max(1u, (uint32_t)(renderExtent.width * scale + 0.5f)),
+		std::max(1u, (uint32_t)(renderExtent.height * scale + 0.5f))
+	};
+}
+
+bool VulkanRenderer::isSceneOffscreen() const
+{
+	return settings.viewCount > 1 || settings.targetGpuFrameTime > 0.0;
+}
+
+void VulkanRenderer::savePipelineCache()
+{
+	size_t dataSize = 0;
+
+	if (vkGetPipelineCacheData(mainDevice.logicalDevice, pipelineCache, &dataSize, nullptr) != VK_SUCCESS || dataSize == 0)
+		return;
+
+	std::vector<char> cacheData(dataSize);
+
+	if (vkGetPipelineCacheData(mainDevice.logicalDevice, pipelineCache, &dataSize, cacheData.data()) != VK_SUCCESS)
+		return;
+
+	//Not being able to keep the cache only makes the next start slower
+	std::ofstream file(PIPELINE_CACHE_FILE, std::ios::binary | std::ios::trunc);
+	file.write(cacheData.data(), dataSize);
+}
+
 bool VulkanRenderer::checkInstanceExtensionSupport(const std::vector<const char*>& extensions)
 {
 	uint32_t extensionCount = 0;
@@ -833,50 +2025,37 @@ bool VulkanRenderer::checkInstanceExtensionSupport(const std::vector<const char*
 	return true;
 }
 
-bool VulkanRenderer::checkDeviceSuitable(VkPhysicalDevice device)
+bool VulkanRenderer::checkDeviceSuitable(const DeviceCapabilities& capabilities)
 {
-	VkPhysicalDeviceProperties deviceProperties;
-	vkGetPhysicalDeviceProperties(device, &deviceProperties);
-
-	VkPhysicalDeviceFeatures deviceFeatures;
-	vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
-
 	//In order to a Device being suitable we need:
 	
 	//1 support the required device extensions:
-	bool supportDeviceExt = checkDeviceExtensions(device);
+	bool supportDeviceExt = std::all_of(deviceExtensions.begin(), deviceExtensions.end(),
+		[&capabilities](const char* ext) { return capabilities.hasExtension(ext); });
 
 	//2:Suport the swapchain
-	SwapChainDetails scDetails = getSwapchainDetails(device);
+	SwapChainDetails scDetails = getSwapchainDetails(capabilities.physicalDevice);
 
 	//3: Support the required queue families
-	QueueFamilyIndices queueFamilies = getQueueFamilies(device);
+	QueueFamilyIndices queueFamilies = capabilities.queueFamilyIndices;
+
+	//4: Support Vulkan 1.2 and the descriptor indexing features of the bindless descriptors
+	const VkPhysicalDeviceVulkan12Features& vulkan12Features = capabilities.vulkan12Features;
+
+	bool supportBindless = capabilities.properties.apiVersion >= VK_API_VERSION_1_2 &&
+		vulkan12Features.descriptorIndexing &&
+		vulkan12Features.runtimeDescriptorArray &&
+		vulkan12Features.descriptorBindingPartiallyBound &&
+		vulkan12Features.descriptorBindingUpdateUnusedWhilePending &&
+		vulkan12Features.descriptorBindingStorageBufferUpdateAfterBind &&
+		vulkan12Features.descriptorBindingSampledImageUpdateAfterBind &&
+		vulkan12Features.shaderSampledImageArrayNonUniformIndexing &&
+		vulkan12Features.shaderStorageBufferArrayNonUniformIndexing;
+
+	//5: Support multiview (every Vulkan 1.1 device should)
+	bool supportMultiview = capabilities.vulkan11Features.multiview == VK_TRUE;
 	
-	return queueFamilies.isValid() && supportDeviceExt && scDetails.isValid();
-}
-
-bool VulkanRenderer::checkDeviceExtensions(VkPhysicalDevice device)
-{
-	uint32_t extensionCount = 0;
-	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
-
-	if (extensionCount == 0)
-		return false;
-
-	std::vector<VkExtensionProperties> supportedExt(extensionCount);
-	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, supportedExt.data());
-
-	for (const auto& ext : deviceExtensions)
-	{
-		auto it = std::find_if(supportedExt.begin(), supportedExt.end(),
-			[&ext](VkExtensionProperties prop) {return strcmp(prop.extensionName, ext) == 0; });
-
-		if (it == supportedExt.end())
-			return false;
-	}
-
-	return true;
-
+	return queueFamilies.isValid() && supportDeviceExt && scDetails.isValid() && supportBindless && supportMultiview;
 }
 
 bool VulkanRenderer::checkValidationLayerSupport()
@@ -910,58 +2089,45 @@ void VulkanRenderer::getPhysicalDevice()
 	std::vector<VkPhysicalDevice> physicalDevices(deviceCount);
 	vkEnumeratePhysicalDevices(instance, &deviceCount, physicalDevices.data());
 
-	auto it = std::find_if(physicalDevices.begin(), physicalDevices.end(),
-		[&](auto device) {return checkDeviceSuitable(device); });
-
-	if (it == physicalDevices.end())
-		throw std::runtime_error("No Graphics queue family avaliable");
-
-	mainDevice.physicalDevice = *it;
-}
+	//Every device is queried once, the one picked keeps its snapshot
+	std::vector<DeviceCapabilities> candidates;
 
-QueueFamilyIndices VulkanRenderer::getQueueFamilies(VkPhysicalDevice device)
-{
-	QueueFamilyIndices queueIndices = {};
-	VkBool32 presentationSupport = false;
+	for (auto device : physicalDevices)
+	{
+		DeviceCapabilities capabilities = queryDeviceCapabilities(device, surface);
 
-	bool foundGraphicsQueue, foundPresentationQueue = foundGraphicsQueue = false;
+		if (checkDeviceSuitable(capabilities))
+			candidates.push_back(std::move(capabilities));
+	}
 
-	uint32_t queueCount = 0;
-	vkGetPhysicalDeviceQueueFamilyProperties(device, &queueCount, nullptr);
+	if (candidates.empty())
+		throw std::runtime_error("No Graphics queue family avaliable");
 
-	std::vector<VkQueueFamilyProperties> queues(queueCount);
-	vkGetPhysicalDeviceQueueFamilyProperties(device, &queueCount, queues.data());
+	auto best = std::max_element(candidates.begin(), candidates.end(),
+		[](const DeviceCapabilities& a, const DeviceCapabilities& b) { return scoreDevice(a) < scoreDevice(b); });
 
+	//The override is the index of the device (in the enumeration order) or a part of its name
+	const char* deviceOverride = std::getenv(DEVICE_OVERRIDE_VARIABLE);
 
-	for (auto it = queues.begin(); it < queues.end(); it++)
+	if (deviceOverride != nullptr && deviceOverride[0] != '\0')
 	{
-		if (foundGraphicsQueue && foundPresentationQueue)
-			break;
-
-		int index = it - queues.begin();
+		std::string name = deviceOverride;
 
-		vkGetPhysicalDeviceSurfaceSupportKHR(
-			device,
-			index, 
-			surface,
-			&presentationSupport);
-
-		if (it->queueCount > 0 && it->queueFlags & VK_QUEUE_GRAPHICS_BIT)
+		auto overridden = std::find_if(candidates.begin(), candidates.end(), [&](const DeviceCapabilities& capabilities)
 		{
-			queueIndices.graphicsFamily = index;
-			foundGraphicsQueue = true;
-		}
+			auto index = std::find(physicalDevices.begin(), physicalDevices.end(), capabilities.physicalDevice) - physicalDevices.begin();
 
-		if (presentationSupport)
-		{
-			queueIndices.presentationFamily = index;
-			foundPresentationQueue = true;
-		}
-			
-	}
+			return std::to_string(index) == name || std::string(capabilities.properties.deviceName).find(name) != std::string::npos;
+		});
 
-	return queueIndices;
+		if (overridden != candidates.end())
+			best = overridden;
+		else
+			std::cerr << "WARNING: " << DEVICE_OVERRIDE_VARIABLE << "=" << name << " matches no suitable device\n";
+	}
 
+	deviceCapabilities = *best;
+	mainDevice.physicalDevice = deviceCapabilities.physicalDevice;
 }
 
 SwapChainDetails VulkanRenderer::getSwapchainDetails(VkPhysicalDevice device)
@@ -1034,11 +2200,14 @@ VkExtent2D VulkanRenderer::chooseSwapChainExtent(const VkSurfaceCapabilitiesKHR&
 		return surfaceCapabilities.currentExtent;
 
 	VkExtent2D windowExtent = {};
-	int width, height;
+	int width = (int)settings.width;
+	int height = (int)settings.height;
 
-	glfwGetFramebufferSize(window, &width, &height);
+	//A headless surface has no size of its own, the settings give it one
+	if (!settings.headless)
+		glfwGetFramebufferSize(window, &width, &height);
 		
-	windowExtent.height = std::max(
+	windowExtent.width = std::max(
 		std::min((int)surfaceCapabilities.maxImageExtent.width, width),
 		(int)surfaceCapabilities.minImageExtent.width);
 
@@ -1049,6 +2218,24 @@ VkExtent2D VulkanRenderer::chooseSwapChainExtent(const VkSurfaceCapabilitiesKHR&
 	return windowExtent;	
 }
 
+VkFormat VulkanRenderer::chooseSupportedFormat(const std::vector<VkFormat>& formats, VkImageTiling tiling, VkFormatFeatureFlags featureFlags)
+{
+	//Returns the first format (in order of preference) that supports the features with the given tiling
+	for (VkFormat format : formats)
+	{
+		VkFormatProperties properties;
+		vkGetPhysicalDeviceFormatProperties(mainDevice.physicalDevice, format, &properties);
+
+		VkFormatFeatureFlags supported = (tiling == VK_IMAGE_TILING_LINEAR) ?
+			properties.linearTilingFeatures : properties.optimalTilingFeatures;
+
+		if ((supported & featureFlags) == featureFlags)
+			return format;
+	}
+
+	throw std::runtime_error("Failed to find a supported format!");
+}
+
 VkImageView VulkanRenderer::createImageView(VkImage image, VkFormat format, VkImageAspectFlags flags)
 {
 	VkImageView imageView = {};
@@ -1079,7 +2266,7 @@ VkImageView VulkanRenderer::createImageView(VkImage image, VkFormat format, VkIm
 	imageViewCreateInfo.subresourceRange.baseArrayLayer = 0;
 	imageViewCreateInfo.subresourceRange.layerCount = 1;
 
-	VkResult result = vkCreateImageView(mainDevice.logicalDevice, &imageViewCreateInfo, nullptr, &imageView);
+	VkResult result = vkCreateImageView(mainDevice.logicalDevice, &imageViewCreateInfo, getHostAllocator(), &imageView);
 
 	if (result != VK_SUCCESS)
 		throw std::runtime_error("Failed to create a ImageView!");
@@ -1098,10 +2285,10 @@ VkShaderModule VulkanRenderer::createShaderModule(const std::vector<char>& code)
 	shaderModuleCreateInfo.flags = 0;
 	shaderModuleCreateInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
 
-	VkResult result = vkCreateShaderModule(mainDevice.logicalDevice, &shaderModuleCreateInfo, nullptr, &shaderModule);
+	VkResult result = vkCreateShaderModule(mainDevice.logicalDevice, &shaderModuleCreateInfo, getHostAllocator(), &shaderModule);
 
 	if (result != VK_SUCCESS)
-		std::runtime_error("Failed to create a shader module!");
+		throw std::runtime_error("Failed to create a shader module!");
 
 	return shaderModule;
 }
@@ -8,30 +8,171 @@
 #include<algorithm>
 #include<string>
 #include<set>
+#include<cstdlib>
+#include<chrono>
 #include"Utilities.h"
 #include"VulkanValidation.h"
 #include<array>
 #include"Mesh.h"
+#include"RenderGraph.h"
+#include"SceneGraph.h"
+#include"ThreadPool.h"
+#include"BindlessDescriptors.h"
+#include"TextureManager.h"
+#include"MemoryBudget.h"
+#include"DeviceCapabilities.h"
+#include"FrameArena.h"
+#include"AllocationCounter.h"
+#include"StartupGraph.h"
+#include"FrameReadback.h"
+#include"DrawList.h"
+#include"PipelineLayoutCache.h"
+#include"ShaderVariants.h"
+#include"RenderThread.h"
+#include"ResolutionScaler.h"
+#include"DescriptorAllocator.h"
+#include"AsyncFileReader.h"
+
+//Options fixed for the lifetime of the renderer
+struct RendererSettings
+{
+	//Renders to a VK_EXT_headless_surface instead of a window (which can be nullptr then), for machines
+	//without a display such as benchmark runners with lavapipe
+	bool headless = false;
+	uint32_t width = 800;			//Of the headless swapchain, a window has its own size
+	uint32_t height = 800;
+
+	bool blending = true;			//Alpha blending in the scene pipeline
+	bool defaultScene = true;		//The triangle, turned off when the scene is made with addMesh
+
+	bool printStartupTimeline = true;	//To std::cerr once the first frame is presented
+
+	//Every frame is copied back and streamed to this file ("-" for stdout), empty turns the readback off
+	std::string readbackOutput;
+	ReadbackFormat readbackFormat = ReadbackFormat::Raw;
+
+	//Views drawn by every frame (up to MAX_VIEWS). More than one draws them all in a single multiview pass,
+	//into the layers of one image whose tiles the window then shows side by side
+	uint32_t viewCount = 1;
+
+	//Resolution scaling: the scene is drawn at the scale (of its width and height, between the bounds) that keeps
+	//the GPU frame time measured with the timestamps at the target, then scaled up to the swapchain image.
+	//A target of 0 turns it off
+	double targetGpuFrameTime = 0.0;		//Milliseconds
+	float minResolutionScale = 0.5f;
+	float maxResolutionScale = 1.0f;
+};
 
 class VulkanRenderer
 {
 public:
 	VulkanRenderer() = default;
-	int init(GLFWwindow* window);
+	int init(GLFWwindow* window, const RendererSettings& settings = RendererSettings());
 	void draw();
 	void cleanup() noexcept;
 	~VulkanRenderer();
 
+	//Snapshot of the properties, features and queue families of the device in use
+	const DeviceCapabilities& getDeviceCapabilities() const;
+
+	//Fragment shader invocations of the last frame whose statistics are available (0 if unsupported)
+	uint64_t getFragmentShaderInvocations() const;
+
+	//A mesh is uploaded once and drawn by each of its instances, every instance has its own node (a child
+	//of the scene root) and material. Instances of a mesh added one after the other bind its buffers once
+	uint32_t addMesh(const std::vector<VertexData>& vertices, const std::vector<uint32_t>& indices);
+	uint32_t addMesh(const std::vector<char>& encodedMesh);		//A mesh file (see Mesh::encode)
+	uint32_t loadMesh(const std::string& path);					//Reads the mesh file with the file reader
+	uint32_t addMeshInstance(uint32_t mesh);
+	size_t getInstanceCount() const;
+
+	//Instances are drawn with the world transform of their node, changes are picked up on the next draw
+	SceneGraph& getSceneGraph();
+	SceneNode getSceneRoot() const;
+	SceneNode getInstanceNode(size_t instance) const;
+
+	//The scene as a snapshot, and the other way around for snapshots filled on another thread (see RenderThread).
+	//Applying one only marks the nodes whose transform changed, and does not allocate
+	void captureSnapshot(SceneSnapshot& snapshot) const;
+	void applySnapshot(const SceneSnapshot& snapshot);
+
+	//Transform from the scene to the clip space of each view (identity by default). Like the model transforms
+	//they are expected to be affine, the culling and the LOD selection do not handle a perspective divide
+	uint32_t getViewCount() const;
+	void setViewMatrix(uint32_t view, const glm::mat4& viewMatrix);
+
+	//Materials live in a table read by the shaders through the bindless descriptors, changing them or
+	//assigning them to instances never rebinds anything. Material 0 is the default (white) one
+	uint32_t createMaterial(const glm::vec4& baseColor);
+	void setMaterialColor(uint32_t material, const glm::vec4& baseColor);
+	void setInstanceMaterial(size_t instance, uint32_t material);
+
+	//Textures are multiplied with the base color of the materials that use them
+	TextureHandle loadTexture(const std::string& path);
+	void setMaterialTexture(uint32_t material, TextureHandle texture);
+	TextureManager& getTextureManager();
+
+	//Triangles drawn by the last recorded frame, after the LOD selection and the meshlet culling
+	uint64_t getDrawnTriangleCount() const;
+
+	//Binds (pipeline or mesh buffers) the last frame's draws would have needed in instance order, and the
+	//ones they needed sorted by their keys
+	uint32_t getUnsortedBindCount() const;
+	uint32_t getSortedBindCount() const;
+
+	//Scene pipelines compiled so far, one per combination of shader features the draws have needed
+	size_t getShaderVariantCount() const;
+
+	//Milliseconds spent recording the last frame, and on the GPU by the last frame whose timestamps are
+	//available (0 when the queue has no timestamps)
+	double getCpuRecordTime() const;
+	double getGpuFrameTime() const;
+
+	//Scale the next frame is drawn at (1 without resolution scaling)
+	float getResolutionScale() const;
+
 private:
 	int currentFrame = 0;
+
+	//Scratch memory of each frame in flight, reset once its fence has signaled
+	FrameArena frameArenas[MAX_FRAME_COUNT];
 	
 	std::vector<Mesh> meshes;
 
+	RendererSettings settings;
+
+	//Scene (instance i draws meshes[instanceMeshes[i]] with the world transform of instanceNodes[i])
+	ThreadPool threadPool;
+	SceneGraph sceneGraph;
+	SceneNode sceneRoot = INVALID_SCENE_NODE;
+	std::vector<uint32_t> instanceMeshes;
+	std::vector<SceneNode> instanceNodes;
+
+	//LOD of every instance for the frame being recorded
+	std::vector<uint32_t> instanceLods;
+	uint64_t drawnTriangleCount = 0;
+
+	//Index ranges left after culling, the ones of instance i are [instanceDrawOffsets[i], instanceDrawOffsets[i + 1])
+	struct IndexRange
+	{
+		uint32_t firstIndex;
+		uint32_t indexCount;
+	};
+
+	std::vector<IndexRange> meshDrawRanges;
+	std::vector<uint32_t> instanceDrawOffsets;
+
+	//Instances with something left to draw, in the order they are recorded
+	DrawList drawList;
+	uint32_t unsortedBindCount = 0;
+	uint32_t sortedBindCount = 0;
+
 	GLFWwindow* window;
 
 	//Vulkan Components
 	VkInstance instance;
 	Device mainDevice;
+	DeviceCapabilities deviceCapabilities;
 	VkQueue graphicsQueue;
 	VkQueue presentationQueue;
 	VkSurfaceKHR surface;
@@ -39,15 +180,73 @@ private:
 	VkExtent2D swapChainExtent;
 	VkFormat swapChainFormat;
 
-	VkDebugReportCallbackEXT callback;
+	//Size of the scene pass, one tile of the swapchain image per view
+	VkExtent2D renderExtent;
+	uint32_t viewColumns = 1;
+
+	//Resolution scaling (the part of renderExtent the scene is drawn to, and the scale each frame in flight used)
+	ResolutionScaler resolutionScaler;
+	VkExtent2D sceneExtent;
+	float frameResolutionScales[MAX_FRAME_COUNT] = {};
+
+	//Validation messages are printed by the log's thread, labels and names need VK_EXT_debug_utils
+	bool debugUtilsEnabled = false;
+	VkDebugUtilsMessengerEXT debugMessenger = VK_NULL_HANDLE;
+	DebugLog debugLog;
+
+	//Memory (heap usage and budgets, VK_EXT_memory_budget is enabled when the device has it)
+	bool memoryBudgetExtensionEnabled = false;
+	MemoryBudget memoryBudget;
+
+	//Swapchain images copied out at the end of the frame (a pass of the render graph) when enabled
+	FrameReadback frameReadback;
 
 	std::vector<SwapChainImage> swapChainImages;
 	std::vector<VkFramebuffer> swapChainFramebuffers;
 	std::vector<VkCommandBuffer> commandBuffers;
 
+	//Render Graph (the depth buffer is one of its transient images)
+	RenderGraph renderGraph;
+	RenderGraphResource backBufferResource;
+	RenderGraphResource depthBufferResource;
+	RenderGraphResource sceneColorResource;		//When the scene is drawn offscreen (isSceneOffscreen), a layer per view
+	VkFormat depthBufferFormat;
+
+	//Bindless Descriptors (set 0 of every pipeline, bound once per command buffer)
+	BindlessDescriptors bindlessDescriptors;
+	DescriptorAllocator descriptorAllocator;		//Sets outside the bindless one: per frame, or cached by content
+
+	//Files (the shaders are read through it, and the textures stream their mips with it)
+	AsyncFileReader fileReader;
+
+	//Textures (their residency changes are recorded at the start of every frame)
+	TextureManager textureManager;
+
+	//Materials (one copy of the table per frame in flight, so it can change while the other frame is drawn)
+	std::vector<MaterialData> materials;
+	std::vector<TextureHandle> materialTextures;
+	uint64_t materialTextureVersion = 0;
+	std::vector<uint32_t> instanceMaterials;
+	std::vector<VkBuffer> materialBuffers;
+	std::vector<VkDeviceMemory> materialMemories;
+	std::vector<void*> materialMappings;
+	std::vector<uint32_t> materialBufferIndices;
+	int materialUploadsPending = 0;
+
+	//Views (the matrices are small, they are copied to the frame's buffer every frame)
+	std::vector<glm::mat4> viewMatrices;
+	std::vector<VkBuffer> viewBuffers;
+	std::vector<VkDeviceMemory> viewMemories;
+	std::vector<void*> viewMappings;
+	std::vector<uint32_t> viewBufferIndices;
+	std::vector<glm::mat4> instanceViewModels;		//View matrix times world transform, by instance and view
+
 	//Pipeline
-	VkPipeline graphicsPipeline;
-	VkPipelineLayout pipelineLayout;
+	VkPipeline depthPrePassPipeline = VK_NULL_HANDLE;
+	VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+	ShaderVariants sceneVariants;					//Indexed by the SHADER_FEATURE_* bits
+	VkPipelineLayout pipelineLayout;				//Owned by the cache
+	PipelineLayoutCache pipelineLayoutCache;
 	VkRenderPass renderPass;
 
 	//Pools
@@ -58,38 +257,86 @@ private:
 	std::vector<VkSemaphore> readyToPresent;
 	std::vector<VkFence> drawFences;
 
+	//Queries (one pipeline statistics query per frame in flight, as the command buffers are)
+	bool pipelineStatisticsSupported = false;
+	VkQueryPool statisticsQueryPool = VK_NULL_HANDLE;
+	std::vector<bool> statisticsQueryIssued;
+	uint64_t fragmentShaderInvocations = 0;
+
+	//Two timestamps per frame in flight, around everything its command buffer does
+	bool timestampsSupported = false;
+	VkQueryPool timestampQueryPool = VK_NULL_HANDLE;
+	std::vector<bool> timestampQueryIssued;
+	double gpuFrameTime = 0.0;
+	double cpuRecordTime = 0.0;
+
+	//Startup steps run as a graph on the thread pool, timed from the start of init to the first present
+	StartupGraph startupGraph;
+	std::chrono::steady_clock::time_point startupStart;
+	bool firstFramePresented = false;
+
+	//Read by their own startup task while the device is created, released once the pipelines exist
+	std::vector<char> vertexShaderCode;
+	std::vector<char> fragmentShaderCode;
+	ShaderReflection vertexShaderReflection;
+	ShaderReflection fragmentShaderReflection;
+
 	//Vulkan Functions
 	//***********************CREATE FUNCTIONS*********************************
 	void createVkInstance();
 	void createDebugCallback();
 	void createLogicalDevice();
+	void createMemoryBudget();
 	void createSurface();
 	void createSwapChain();
+	void createRenderGraph();
 	void createRenderPass();
+	void createPipelineCache();
 	void createGraphicsPipeline();
 	void createFramebuffers();
 	void createCommandPool();
 	void createCommandBuffers();
 	void createSyncronization();
+	void createQueryPool();
+	void createBindlessDescriptors();
+	void createDescriptorAllocator();
+	void createMaterialBuffers();
+	void createViewBuffers();
+	void createTextureManager();
+	void createScene();
+	void nameMesh(uint32_t mesh);
+	void createFrameReadback();
+	void loadShaders();
 
 	//**********************RECORD FUNCTIONS***********************************
-	void recordCommands();
+	void uploadMaterials();
+	void uploadViews();
+	void selectMeshLods();
+	void cullMeshlets();
+	void buildDrawList();
+	void recordCommands(uint32_t imageIndex);
+	void recordScenePass(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+	void recordComposePass(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+
+	//***********************SAVE FUNCTIONS************************************
+	void savePipelineCache();
 
 	//***********************CHECKER FUNCTIONS*********************************
 	bool checkInstanceExtensionSupport(const std::vector<const char*>& extensions);
-	bool checkDeviceSuitable(VkPhysicalDevice device);
-	bool checkDeviceExtensions(VkPhysicalDevice device);
+	bool checkDeviceSuitable(const DeviceCapabilities& capabilities);
 	bool checkValidationLayerSupport();
 
 	//************************GET FUNCTIONS*************************************
 	void getPhysicalDevice();
-	QueueFamilyIndices getQueueFamilies(VkPhysicalDevice device);
 	SwapChainDetails getSwapchainDetails(VkPhysicalDevice device);
+	VkExtent2D getScaledExtent(float scale) const;		//Of renderExtent
+	bool isSceneOffscreen() const;						//With several views or resolution scaling
 
 	//************************CHOOSE FUNCTIONS**********************************
 	VkSurfaceFormatKHR chooseFormat(const std::vector<VkSurfaceFormatKHR>& surfaceFormats);
 	VkPresentModeKHR choosePresentationMode(const std::vector<VkPresentModeKHR>& surfacePresentationModes);
 	VkExtent2D chooseSwapChainExtent(const VkSurfaceCapabilitiesKHR& surfaceCapabilities);
+	VkFormat chooseSupportedFormat(const std::vector<VkFormat>& formats, VkImageTiling tiling, VkFormatFeatureFlags featureFlags);
 
 	//**************************CREATE SUPPORT FUNCTIONS****************************
 	VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags flags);
@@ -3,45 +3,32 @@
 #include <vector>
 #include <vulkan/vk_platform.h>
 #include <vulkan/vulkan_core.h>
+#include "DebugUtils.h"
 
 // Callback function for validation debugging (will be called when validation information record)
+// It runs inside the driver, so the message is only queued, the DebugLog in userData prints it later
 static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
-	VkDebugReportFlagsEXT flags,				// Type of error
-	VkDebugReportObjectTypeEXT objType,			// Type of object causing error
-	uint64_t obj,								// ID of object
-	size_t location,
-	int32_t code,
-	const char* layerPrefix,
-	const char* message,						// Validation Information
+	VkDebugUtilsMessageSeverityFlagBitsEXT severity,			// Error, warning, info or verbose
+	VkDebugUtilsMessageTypeFlagsEXT type,						// General, validation or performance
+	const VkDebugUtilsMessengerCallbackDataEXT* callbackData,	// Validation Information
 	void* userData)
 {
-	// If validation ERROR, then output error and return failure
-	if (flags & VK_DEBUG_REPORT_ERROR_BIT_EXT)
-	{
-		printf("VALIDATION ERROR: %s\n", message);
-		return VK_TRUE;
-	}
-
-	// If validation WARNING, then output warning and return okay
-	if (flags & VK_DEBUG_REPORT_WARNING_BIT_EXT)
-	{
-		printf("VALIDATION WARNING: %s\n", message);
-		return VK_FALSE;
-	}
+	static_cast<DebugLog*>(userData)->push(severity, type, callbackData);
 
+	// The call that caused the message is not aborted, returning VK_TRUE is reserved for the layers
 	return VK_FALSE;
 }
 
-static VkResult CreateDebugReportCallbackEXT(VkInstance instance, const VkDebugReportCallbackCreateInfoEXT* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkDebugReportCallbackEXT* pCallback)
+static VkResult CreateDebugUtilsMessengerEXT(VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkDebugUtilsMessengerEXT* pMessenger)
 {
 	// vkGetInstanceProcAddr returns a function pointer to the requested function in the requested instance
-	// resulting function is cast as a function pointer with the header of "vkCreateDebugReportCallbackEXT"
-	auto func = (PFN_vkCreateDebugReportCallbackEXT)vkGetInstanceProcAddr(instance, "vkCreateDebugReportCallbackEXT");
+	// resulting function is cast as a function pointer with the header of "vkCreateDebugUtilsMessengerEXT"
+	auto func = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT");
 
 	// If function was found, executre if with given data and return result, otherwise, return error
 	if (func != nullptr)
 	{
-		return func(instance, pCreateInfo, pAllocator, pCallback);
+		return func(instance, pCreateInfo, pAllocator, pMessenger);
 	}
 	else
 	{
@@ -49,14 +36,14 @@ static VkResult CreateDebugReportCallbackEXT(VkInstance instance, const VkDebugR
 	}
 }
 
-static void DestroyDebugReportCallbackEXT(VkInstance instance, VkDebugReportCallbackEXT callback, const VkAllocationCallbacks* pAllocator)
+static void DestroyDebugUtilsMessengerEXT(VkInstance instance, VkDebugUtilsMessengerEXT messenger, const VkAllocationCallbacks* pAllocator)
 {
-	// get function pointer to requested function, then cast to function pointer for vkDestroyDebugReportCallbackEXT
-	auto func = (PFN_vkDestroyDebugReportCallbackEXT)vkGetInstanceProcAddr(instance, "vkDestroyDebugReportCallbackEXT");
+	// get function pointer to requested function, then cast to function pointer for vkDestroyDebugUtilsMessengerEXT
+	auto func = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT");
 
 	// If function found, execute
 	if (func != nullptr)
 	{
-		func(instance, callback, pAllocator);
+		func(instance, messenger, pAllocator);
 	}
 }
\ No newline at end of file
@@ -1,9 +1,14 @@
 #include<iostream>
+#include<glm/gtc/matrix_transform.hpp>
 #include"VulkanRenderer.h"
+#include"RenderThread.h"
 
 const uint32_t WIDTH = 800;
 const uint32_t HEIGHT = 800;
 
+const double SIMULATION_STEP = 1.0 / 120.0;		//Seconds
+const float ROTATION_SPEED = 1.5f;				//Radians per second
+
 GLFWwindow* window;
 
 void initWIndow(const char* name, unsigned int width = 800, unsigned int height = 600);
@@ -19,13 +24,45 @@ int main()
     if (vkRenderer.init(window) == EXIT_FAILURE)
         return EXIT_FAILURE;
     
-    //Render Loop
-    while (!glfwWindowShouldClose(window))
+    //Frames are drawn on the render thread, this one only handles the events and the simulation
+    RenderThread renderThread;
+    renderThread.start(vkRenderer);
+
+    SceneNode sceneRoot = vkRenderer.getSceneRoot();
+    float sceneAngle = 0.0f;
+    uint64_t simulationFrame = 0;
+
+    //Simulation Loop (fixed steps, waiting for the events in between)
+    double nextStep = glfwGetTime();
+
+    while (!glfwWindowShouldClose(window) && renderThread.isRunning())
     {
-        glfwPollEvents();
-        vkRenderer.draw();
+        glfwWaitEventsTimeout(std::max(0.0, nextStep - glfwGetTime()));
+
+        if (glfwGetTime() < nextStep)
+            continue;
+
+        nextStep += SIMULATION_STEP;
+
+        //The arrow keys turn the whole scene
+        if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS)
+            sceneAngle += ROTATION_SPEED * (float)SIMULATION_STEP;
+        if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS)
+            sceneAngle -= ROTATION_SPEED * (float)SIMULATION_STEP;
+
+        //The snapshot holds an older step, what the simulation changes is written (and listed) again every step
+        SceneSnapshot& snapshot = renderThread.getSnapshot();
+        snapshot.frame = ++simulationFrame;
+        snapshot.localTransforms[sceneRoot] = glm::rotate(glm::mat4(1.0f), sceneAngle, glm::vec3(0.0f, 0.0f, 1.0f));
+        snapshot.changedNodes.clear();
+        snapshot.changedNodes.push_back(sceneRoot);
+
+        renderThread.publishSnapshot();
     }
 
+    //Rethrows if drawing failed, the renderer is cleaned up after the thread is gone
+    renderThread.stop();
+
     glfwDestroyWindow(window);
     glfwTerminate();
 